@@ -0,0 +1,406 @@
+/*
+ * Benchmark.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+/**
+ * Benchmark of the FMM against the direct calculation (FmmTree::solveDirect)
+ *
+ * For each combination of the options below one tree is built and solved, and
+ * one line (CSV) or one object (JSON) is written to the standard output with
+ *  - the wall time of building the tree and of each phase of FmmTree::apply
+ *    (P2M, M2M, M2L, P2L, L2L, L2P, M2P and P2P), see class FmmStats
+ *  - the floating point operations of the solve (counted from the
+ *    interactions of the tree, FmmStats::getTotalFlops) and the rate in Gflop/s
+ *  - the throughput of the solve (particles per second)
+ *  - the maximum and the root mean square error of the FMM potentials
+ *    relative to the largest direct potential.  For more than 'samples'
+ *    targets the direct potentials are only computed for 'samples' targets
+ *    (evenly spaced in the input order, FmmTree::solveDirect(u, targetIndexes));
+ *    a potential that is not finite gives the error nan
+ *
+ * Options (lists are separated by commas):
+ *   --n 1000,10000        numbers of particles (sources = targets)
+ *   --p 8,12              truncation indexes p of the series (0: from --error, see FmmTuning)
+ *   --error 1e-6          target error for p = 0
+ *   --leaf 0,32           particles per leaf box (0: chosen by FmmTuning)
+ *   --dist uniform,clustered,grid
+ *                         uniform:   uniform random points in the unit square
+ *                         clustered: gaussian clusters of random size and width
+ *                         tight:     one gaussian cluster of width 1e-6 (deep adaptive trees)
+ *                         grid:      four points per cell of a uniform grid (like Example1)
+ *   --tree uniform,adaptive
+ *                         uniform:   FmmTree(level, x, y, potential) with the level
+ *                                    that gives the leaf size closest to --leaf
+ *                         adaptive:  FmmTree(x, y, potential, maxParticlesPerBox)
+ *                                    with maxParticlesPerBox = 2.5 * leaf (see FmmTuning.cc)
+ *   --samples 1000        targets checked against the direct calculation (0: all)
+ *   --threads 1           threads of the passes (FmmTree::setNumThreads)
+ *   --scheduler levels    levels or tasks (FmmTree::setScheduler)
+ *   --m2l matrix          matrix or factored (FmmTree::setM2LEngine)
+ *   --precision double    double or mixed (FmmTree::setPrecision)
+ *   --kernel laplace      laplace (FmmTree::apply) or yukawa (KernelFmm<YukawaKernel>)
+ *   --lambda 1            screening parameter of the yukawa kernel
+ *   --gpu -1              CUDA device of the P2P and M2L (-1: none, FmmTree::enableGpu)
+ *   --format csv          csv or json
+ *   --seed 1              seed of the random points and charges
+ *   --max-error 0         exit status 1 if a max_error is above it or nan (0: no check)
+ *
+ * Example (from the top directory of the repository, the build options of the
+ * Makefile apply, e.g. make OPENMP=0 benchmark):
+ *   make benchmark
+ *   bin/benchmark --n 1000,10000,100000 --p 8,12,16 --dist uniform,clustered > results.csv
+ */
+
+#include <vector>
+#include <complex>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+
+#include "Point.h"
+#include "Potential.h"
+#include "FmmTree.h"
+#include "FmmTuning.h"
+#include "FmmStats.h"
+#include "KernelFmm.h"
+#include "YukawaKernel.h"
+
+struct BenchmarkOptions
+{
+  std::vector<int> n;
+  std::vector<int> p;
+  std::vector<int> leaf;
+  std::vector<std::string> dist;
+  std::vector<std::string> tree;
+  double error;
+  int samples;
+  int threads;
+  std::string scheduler;
+  std::string m2l;
+  std::string precision;
+  std::string kernel;
+  double lambda;
+  int gpu;
+  std::string format;
+  unsigned int seed;
+  double maxError;
+};
+
+struct BenchmarkResult
+{
+  std::string dist;
+  std::string tree;
+  int n;
+  int p;
+  int leaf;
+  int levels;
+  int leaves;
+  FmmStats stats;                  // times of the phases and operations of the solve
+  double solveTime;
+  double directTime;
+  int samples;
+  double maxError;
+  double rmsError;
+};
+
+static std::vector<std::string> split(const std::string &list)
+{
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+static std::vector<int> splitInt(const std::string &list)
+{
+  std::vector<std::string> items = split(list);
+  std::vector<int> values;
+  for (unsigned int i=0; i<items.size(); ++i)
+    values.push_back((int)std::atof(items[i].c_str()));     // atof: allows 1e6
+  return values;
+}
+
+// points of the distribution 'dist' in the unit square [0,1)^2
+static std::vector<Point> makePoints(const std::string &dist, int n, std::mt19937 &random)
+{
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<Point> points(n);
+  if (dist == "clustered")
+  {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    int numClusters = std::max(1, (int)std::sqrt((double)n) / 10);
+    std::vector<std::complex<double> > centers(numClusters);
+    std::vector<double> widths(numClusters);
+    for (int k=0; k<numClusters; ++k)
+    {
+      centers[k] = std::complex<double>(0.1 + 0.8*uniform(random), 0.1 + 0.8*uniform(random));
+      widths[k] = std::pow(10.0, -1.0 - 2.0*uniform(random));   // between 1e-3 and 1e-1
+    }
+    for (int i=0; i<n; ++i)
+    {
+      int k = std::min(numClusters-1, (int)(uniform(random)*numClusters));
+      double px, py;
+      do
+      {
+        px = centers[k].real() + widths[k]*normal(random);
+        py = centers[k].imag() + widths[k]*normal(random);
+      } while (px < 0.0 || px >= 1.0 || py < 0.0 || py >= 1.0);
+      points[i] = Point(std::complex<double>(px, py));
+    }
+  }
+  else if (dist == "tight")
+  {
+    std::normal_distribution<double> normal(0.5, 1.0e-6);
+    for (int i=0; i<n; ++i)
+      points[i] = Point(std::complex<double>(normal(random), normal(random)));
+  }
+  else if (dist == "grid")
+  {
+    // four points per cell at the quarter and three quarter lengths of the
+    // cells (see Example1), with the smallest grid that has n points
+    int cells = std::max(1, (int)std::ceil(std::sqrt(n / 4.0)));
+    double h = 1.0 / cells;
+    for (int i=0; i<n; ++i)
+    {
+      int cell = i / 4;
+      int corner = i % 4;
+      double px = (cell % cells + 0.25 + 0.5*(corner % 2)) * h;
+      double py = (cell / cells + 0.25 + 0.5*(corner / 2)) * h;
+      points[i] = Point(std::complex<double>(px, py));
+    }
+  }
+  else
+  {
+    for (int i=0; i<n; ++i)
+      points[i] = Point(std::complex<double>(uniform(random), uniform(random)));
+  }
+  return points;
+}
+
+static BenchmarkResult run(const BenchmarkOptions &options, const std::string &dist,
+                           const std::string &treeType, int n, int p, int leaf)
+{
+  typedef std::chrono::steady_clock Clock;
+
+  std::mt19937 random(options.seed);
+  std::vector<Point> x = makePoints(dist, n, random);
+  std::uniform_real_distribution<double> charge(-1.0, 1.0);
+  std::vector<double> u(n);
+  for (int i=0; i<n; ++i)
+    u[i] = charge(random);
+
+  FmmTuning tuning;
+  if (p <= 0)
+    p = FmmTuning::getP(options.error);
+  if (leaf <= 0)
+  {
+    tuning.calibrate(p);
+    leaf = std::max(1, (int)(tuning.getLeafSize(p) + 0.5));
+  }
+  Potential potential(p);
+
+  FmmTree *tree;
+  if (treeType == "adaptive")
+    tree = new FmmTree(x, x, potential, std::max(1, (int)(2.5*leaf + 0.5)));
+  else
+  {
+    // number of levels L with n / 4^(L-1) closest to leaf
+    int levels = 1 + std::max(0, (int)std::floor(std::log(n / (double)leaf) / std::log(4.0) + 0.5));
+    tree = new FmmTree(std::min(levels, 16), x, x, potential);
+  }
+  tree->setNumThreads(options.threads);
+  tree->setScheduler(options.scheduler == "tasks" ? FmmTree::TASKS : FmmTree::LEVELS);
+  tree->setM2LEngine(options.m2l == "factored" ? FmmTree::FACTORED_M2L : FmmTree::MATRIX_M2L);
+  tree->setPrecision(options.precision == "mixed" ? FmmTree::MIXED_PRECISION : FmmTree::DOUBLE_PRECISION);
+  if (options.gpu >= 0 && !tree->enableGpu(options.gpu))
+    std::cerr << "no CUDA device " << options.gpu << ", using the CPU\n";
+
+  // the other kernels run their passes on the same tree (see KernelFmm)
+  YukawaKernel yukawa(options.lambda, p);
+  KernelFmm<YukawaKernel> yukawaFmm(*tree, yukawa);
+  bool isYukawa = (options.kernel == "yukawa");
+
+  Clock::time_point start = Clock::now();
+  std::vector<double> v = isYukawa ? yukawaFmm.solve(u) : tree->solve(u);
+  double solveTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<int> targetIndexes;
+  int samples = (options.samples <= 0 || options.samples > n) ? n : options.samples;
+  for (int k=0; k<samples; ++k)
+    targetIndexes.push_back((int)((long long)k * n / samples));
+  start = Clock::now();
+  std::vector<double> direct = isYukawa ? yukawaFmm.solveDirect(u, targetIndexes)
+                                        : tree->solveDirect(u, targetIndexes);
+  double directTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+  double maxDirect = 0.0;
+  double maxError = 0.0;
+  double sumError2 = 0.0;
+  for (int k=0; k<samples; ++k)
+  {
+    double e = std::abs(v[targetIndexes[k]] - direct[k]);
+    maxDirect = std::max(maxDirect, std::abs(direct[k]));
+    if (!(e <= maxError))                // also keeps a nan
+      maxError = e;
+    sumError2 += e*e;
+  }
+  if (maxDirect == 0.0)
+    maxDirect = 1.0;
+
+  BenchmarkResult result;
+  result.dist = dist;
+  result.tree = treeType;
+  result.n = n;
+  result.p = p;
+  result.leaf = leaf;
+  result.levels = tree->getNumOfLevels();
+  result.leaves = tree->getNumOfLeaves();
+  result.stats = isYukawa ? yukawaFmm.getStats() : tree->getStats();
+  result.solveTime = solveTime;
+  result.directTime = directTime;
+  result.samples = samples;
+  result.maxError = maxError / maxDirect;
+  result.rmsError = std::sqrt(sumError2 / samples) / maxDirect;
+  delete tree;
+  return result;
+}
+
+// column name of a phase: build_s, p2m_s, ...
+static std::string getPhaseColumn(int phase)
+{
+  std::string name = FmmStats::getPhaseName(phase);
+  for (unsigned int k=0; k<name.size(); ++k)
+    name[k] = std::tolower(name[k]);
+  return name + "_s";
+}
+
+static void writeCsvHeader(std::ostream &out)
+{
+  out << "dist,tree,n,p,leaf,levels,leaves";
+  for (int k=0; k<FmmStats::NUM_PHASES; ++k)
+    out << "," << getPhaseColumn(k);
+  out << ",solve_s,particles_per_s,flops,gflops_per_s,direct_s,direct_samples,max_error,rms_error\n";
+}
+
+static void writeCsv(std::ostream &out, BenchmarkResult &r)
+{
+  out << r.dist << "," << r.tree << "," << r.n << "," << r.p << "," << r.leaf << ","
+      << r.levels << "," << r.leaves;
+  for (int k=0; k<FmmStats::NUM_PHASES; ++k)
+    out << "," << r.stats.time[k];
+  out << "," << r.solveTime << "," << r.n / r.solveTime << "," << r.stats.getTotalFlops() << ","
+      << r.stats.getTotalFlops() / r.solveTime * 1.0e-9 << "," << r.directTime << ","
+      << r.samples << "," << r.maxError << "," << r.rmsError << "\n";
+}
+
+static void writeJson(std::ostream &out, BenchmarkResult &r, bool first)
+{
+  out << (first ? "  " : ",\n  ")
+      << "{\"dist\": \"" << r.dist << "\", \"tree\": \"" << r.tree << "\", \"n\": " << r.n
+      << ", \"p\": " << r.p << ", \"leaf\": " << r.leaf << ", \"levels\": " << r.levels
+      << ", \"leaves\": " << r.leaves;
+  for (int k=0; k<FmmStats::NUM_PHASES; ++k)
+    out << ", \"" << getPhaseColumn(k) << "\": " << r.stats.time[k];
+  out << ", \"solve_s\": " << r.solveTime << ", \"particles_per_s\": " << r.n / r.solveTime
+      << ", \"flops\": " << r.stats.getTotalFlops()
+      << ", \"gflops_per_s\": " << r.stats.getTotalFlops() / r.solveTime * 1.0e-9
+      << ", \"direct_s\": " << r.directTime << ", \"direct_samples\": " << r.samples
+      << ", \"max_error\": " << r.maxError << ", \"rms_error\": " << r.rmsError << "}";
+}
+
+int main(int argc, char **argv)
+{
+  BenchmarkOptions options;
+  options.n = splitInt("1000,10000,100000");
+  options.p = splitInt("8,12,16");
+  options.leaf = splitInt("0");
+  options.dist = split("uniform,clustered,grid");
+  options.tree = split("uniform,adaptive");
+  options.error = 1.0e-6;
+  options.samples = 1000;
+  options.threads = 1;
+  options.scheduler = "levels";
+  options.m2l = "matrix";
+  options.precision = "double";
+  options.kernel = "laplace";
+  options.lambda = 1.0;
+  options.gpu = -1;
+  options.format = "csv";
+  options.seed = 1;
+  options.maxError = 0.0;
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    std::string name = argv[i];
+    std::string value = argv[i+1];
+    if (name == "--n")            options.n = splitInt(value);
+    else if (name == "--p")       options.p = splitInt(value);
+    else if (name == "--error")   options.error = std::atof(value.c_str());
+    else if (name == "--leaf")    options.leaf = splitInt(value);
+    else if (name == "--dist")    options.dist = split(value);
+    else if (name == "--tree")    options.tree = split(value);
+    else if (name == "--samples") options.samples = std::atoi(value.c_str());
+    else if (name == "--threads") options.threads = std::atoi(value.c_str());
+    else if (name == "--scheduler") options.scheduler = value;
+    else if (name == "--m2l")     options.m2l = value;
+    else if (name == "--precision") options.precision = value;
+    else if (name == "--kernel")  options.kernel = value;
+    else if (name == "--lambda")  options.lambda = std::atof(value.c_str());
+    else if (name == "--gpu")     options.gpu = std::atoi(value.c_str());
+    else if (name == "--format")  options.format = value;
+    else if (name == "--seed")    options.seed = std::atoi(value.c_str());
+    else if (name == "--max-error") options.maxError = std::atof(value.c_str());
+    else
+    {
+      std::cerr << "unknown option " << name << " (see bench/Benchmark.cc)\n";
+      return 1;
+    }
+  }
+
+  std::ostream &out = std::cout;
+
+  bool json = (options.format == "json");
+  if (json)
+    out << "[\n";
+  else
+    writeCsvHeader(out);
+  bool first = true;
+  bool failed = false;
+  for (unsigned int d=0; d<options.dist.size(); ++d)
+    for (unsigned int t=0; t<options.tree.size(); ++t)
+      for (unsigned int k=0; k<options.n.size(); ++k)
+        for (unsigned int j=0; j<options.p.size(); ++j)
+          for (unsigned int m=0; m<options.leaf.size(); ++m)
+          {
+            BenchmarkResult result = run(options, options.dist[d], options.tree[t],
+                                         options.n[k], options.p[j], options.leaf[m]);
+            if (json)
+              writeJson(out, result, first);
+            else
+              writeCsv(out, result);
+            out.flush();
+            first = false;
+            if (options.maxError > 0.0 && !(result.maxError <= options.maxError))
+            {
+              std::cerr << "max_error " << result.maxError << " above " << options.maxError
+                        << " (" << result.dist << ", " << result.tree << ", n = " << result.n
+                        << ", p = " << result.p << ")\n";
+              failed = true;
+            }
+          }
+  if (json)
+    out << "\n]\n";
+
+  return failed ? 1 : 0;
+}
@@ -11,6 +11,8 @@
 #include <complex>
 #include <vector>
 #include <iostream>
+#include <cstddef>
+#include <cmath>
 
 #include "Point.h"
 //#include "FmmTree.h"
@@ -23,19 +25,28 @@ class Box
     int DEFAULT_INDEX=0;
 
     int level;                             // refinement level of box
-    int index;                             // cell index of box (or cell)
+    long long index;                       // cell index of box (or cell), 64 bits for deep trees
     int p;                                 // p is the index at which the series are truncated
 
 //    unsigned int nParticlesPerCell = 4;    // points in each cell at lowest refinement level (l = L)
 //    int totalParticles;                     // total particles in domain (unit square)
 
 
-    bool empty;                            // is box empty
+    bool empty;                            // is box empty (no source and no target points)
 
+    std::complex<double> center;           // center of box (computed when the level or index is set)
 
-    std::vector<std::complex<double> > c;
-    std::vector<std::complex<double> > dtilde;
-    std::vector<std::complex<double> > d;
+
+    // coefficients (p terms) of the S-expansion c, of the R-expansion dtilde from
+    // the interaction list and of the R-expansion d of the box.  The box does
+    // not own them: they are views into the coefficient arena of the level of
+    // the box, which is owned by FmmTree (see FmmTree::allocateCoefficients),
+    // and are NULL until setCoefficients is called.  getC, getD and getDtilde
+    // return the storage itself, so the passes of FmmTree can add to the
+    // coefficients in place (see Potential::applyTranslation)
+    std::complex<double> *c;
+    std::complex<double> *dtilde;
+    std::complex<double> *d;
 
 
     // The number of source points (and target points) in a box will depend
@@ -43,65 +54,104 @@ class Box
     // per box.  As we work up through the levels to level l = 0, the number
     // of particles will increase by a multiple of 4 when going from one level
     // up to the next (four children for each parent)
-
-    std::vector<Point> x;  // source points
-    std::vector<Point> y;  // target points
+    //
+    // The points themselves are stored (sorted in Morton order) in the
+    // Particles arrays of FmmTree.  A box only keeps the range of positions
+    // [xBegin, xEnd) of its source points and [yBegin, yEnd) of its target points
+
+    int xBegin;            // first source point of box
+    int xEnd;              // one past the last source point of box
+    int yBegin;            // first target point of box
+    int yEnd;              // one past the last target point of box
+
+    // The boxes of a level are stored in FmmTree::tree_structure[level] in the
+    // (Morton) order of their index.  Only the boxes with source or target
+    // points are stored (and for an adaptive tree only the boxes that were
+    // created by subdividing a box with too many particles), so the position
+    // and the index of a box are in general different (see FmmTree::findBox).
+
+    int  parent;           // position of the parent at level-1 (-1 for the box at level 0)
+    int  firstChild;       // position of the first child at level+1 (-1 if box is a leaf)
+    int  numChildren;      // number of children (the children are next to each other)
+    bool leaf;             // box is not subdivided (its particles are handled by the box)
+
+    // The interaction lists of the boxes are stored by FmmTree
+    // (see FmmTree::buildInteractionLists and class InteractionList)
 
     // Creates a new instance of Node
     Box();
-    Box(int level, int index, int p);
+    Box(int level, long long index, int p);
 
     int       getLevel() { return level; };
     void      printLevel() { std::cout << "Box level is " << level << '\n'; };
-    void      setLevel(int i) { this->level = i; };
-    int       getIndex() { return index; };
+    void      setLevel(int i) { this->level = i; updateCenter(); };
+    long long getIndex() { return index; };
     void      printIndex() { std::cout << "Box index is " << index << '\n'; };
-    void      setIndex(int i) { this->index = i; };
-    Point     getCenter();
-    double    getSize() { return std::pow(2.0, -level); };
-
-    void      setP(int p) { this->p = p; };
+    void      setIndex(long long i) { this->index = i; updateCenter(); };
+    Point     getCenter() { return Point(center); };
+    double    getSize() { return std::ldexp(1.0, -level); };
+
+    void      setP(int p);
+    void      setCoefficients(std::complex<double> *c, std::complex<double> *dtilde,
+                              std::complex<double> *d)
+                { this->c = c; this->dtilde = dtilde; this->d = d; };
+    bool      hasCoefficients() { return c != NULL; };
     bool      isEmpty() { return empty; };
 
-    std::vector<std::complex<double> > getC() {return c; };
+    std::complex<double>*              getC() {return c; };
     void                               addToC(std::vector<std::complex<double> > &increment);
+    void                               addToC(const std::complex<double> *increment);
     std::string                        cToString();
     void                               printC();
 
-    std::vector<std::complex<double> > getD() {return d; };
+    std::complex<double>*              getD() {return d; };
     void                               addToD(const std::vector<std::complex<double> > &increment);
+    void                               addToD(const std::complex<double> *increment);
     std::string                        dToString();
     void                               printD();
 
-    std::vector<std::complex<double> > getDtilde() {return dtilde; };
+    std::complex<double>*              getDtilde() {return dtilde; };
     void                               addToDtilde(const std::vector<std::complex<double> > &increment);
+    void                               addToDtilde(const std::complex<double> *increment);
     std::string                        dtildeToString();
     void                               printDtilde();
 
 
-    void               addX(Point &p);
-    int                getSizeX() { return this->x.size(); };
-    std::vector<Point> getX() { return this->x; };
-    void               printSizeX() { std::cout << "Box sizeX is " << x.size() << "\n"; };
+    void               setRangeX(int begin, int end) { this->xBegin = begin; this->xEnd = end; updateEmpty(); };
+    int                getBeginX() { return this->xBegin; };
+    int                getEndX() { return this->xEnd; };
+    int                getSizeX() { return this->xEnd - this->xBegin; };
+    void               printSizeX() { std::cout << "Box sizeX is " << getSizeX() << "\n"; };
+
+    void               setRangeY(int begin, int end) { this->yBegin = begin; this->yEnd = end; updateEmpty(); };
+    int                getBeginY() { return this->yBegin; };
+    int                getEndY() { return this->yEnd; };
+    int                getSizeY() { return this->yEnd - this->yBegin; };
+    void               printSizeY() { std::cout << "Box sizeY is " << getSizeY() << "\n"; };
 
-    void               addY(Point &p);
-    int                getSizeY() { return this->y.size(); };
-    std::vector<Point> getY() { return this->y; };
-    void               printSizeY() { std::cout << "Box sizeY is " << y.size() << "\n"; };
+    int                getParent() { return this->parent; };
+    void               setParent(int i) { this->parent = i; };
+    int                getFirstChild() { return this->firstChild; };
+    int                getNumChildren() { return this->numChildren; };
+    void               setChildren(int first, int num) { this->firstChild = first; this->numChildren = num; };
+    bool               isLeaf() { return this->leaf; };
+    void               setLeaf(bool leaf) { this->leaf = leaf; };
 
     std::string        toString();
-    int                getParentIndex();
-    void               getNeighborsIndex(std::vector<int> &neighbor_indexes);
-    void               getParentsNeighborsIndex (std::vector<int> &parents_neighbor_indexes);
+    long long          getParentIndex();
+    void               getNeighborsIndex(std::vector<long long> &neighbor_indexes);
+    void               getParentsNeighborsIndex (std::vector<long long> &parents_neighbor_indexes);
 
-    void               getNeighborsE4Index (std::vector<int> &neighborE4_indexes);
+    void               getNeighborsE4Index (std::vector<long long> &neighborE4_indexes);
 
-    void               getChildrenIndex(std::vector<int> &children_indexes);
+    void               getChildrenIndex(std::vector<long long> &children_indexes);
 
 
   private:
 
-    void               getChildrenIndexOfBox(int levelOfBox, int indexOfBox, std::vector<int> &children_indexes_of_box);
+    void               getChildrenIndexOfBox(int levelOfBox, long long indexOfBox, std::vector<long long> &children_indexes_of_box);
+    void               updateEmpty() { this->empty = (xEnd == xBegin && yEnd == yBegin); };
+    void               updateCenter();
 
 };
 
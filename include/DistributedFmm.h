@@ -0,0 +1,149 @@
+/*
+ * DistributedFmm.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef DISTRIBUTEDFMM_H_
+#define DISTRIBUTEDFMM_H_
+
+#ifdef FMM2D_USE_MPI
+
+#include <complex>
+#include <vector>
+#include <utility>
+
+#include <mpi.h>
+
+#include "FmmTree.h"
+#include "Potential.h"
+#include "TranslationOperators.h"
+
+// Explanation of DistributedFmm:
+//
+// the FMM of a uniform tree on several MPI processes (ranks), compiled with
+// FMM2D_USE_MPI.  The cells of the partition level are split into contiguous
+// ranges of their Morton index, one range for each rank, and each rank owns the
+// source and target points of its cells and builds an FmmTree of them.  The
+// levels up to the partition level form a coarse tree that every rank computes
+// (from the S-expansions of all cells of the partition level), and below it
+// each rank gets the S-expansions of the boxes of the other ranks in the
+// interaction lists of its boxes and the source points of the neighbors of
+// its leaf boxes (ghost data).  See DistributedFmm.cc.
+class DistributedFmm
+{
+  public:
+    MPI_Comm comm;
+    int      rank;
+    int      numRanks;
+
+    // the partition level is refined by rebalance until no cell costs more than
+    // CELL_FRACTION of the average cost of a rank, at most to MAX_PARTITION_LEVEL
+    // (the coarse tree of every rank has all cells of the partition level)
+    static const int    MAX_PARTITION_LEVEL = 7;
+    static const double CELL_FRACTION;
+
+    int      numOfLevels;                  // levels of the uniform tree
+    int      partitionLevel;               // level of the cells split among the ranks
+    int      costLevel;                    // level of the cells of the keys and the costs
+    Potential potential;
+    int      numThreads;
+
+    // the cells cellStart[r], ..., cellStart[r+1]-1 of the partition level
+    // belong to rank r
+    std::vector<long long> cellStart;
+
+    FmmTree *tree;                         // tree of the points of this rank (owned points)
+
+    // routing of the points of the input of this rank (the u and v of apply) to
+    // the ranks that own them: the input point sendOrder[k] is the k-th point
+    // sent, sendCount[r] of them to rank r, and recvCount[r] owned points come
+    // from rank r (in this order).  Each owned point keeps its origin (rank,
+    // index in the input of that rank) so that the points can be moved again
+    std::vector<int> sourceSendOrder, sourceSendCount, sourceRecvCount;
+    std::vector<int> targetSendOrder, targetSendCount, targetRecvCount;
+    std::vector<long long> sourceKey;      // cell of the cost level of each input source
+    std::vector<long long> targetKey;      // cell of the cost level of each input target
+    std::vector<double> ownedSourceX, ownedSourceY, ownedTargetX, ownedTargetY;
+    std::vector<int>    ownedSourceOrigin, ownedSourceIndex, ownedTargetOrigin, ownedTargetIndex;
+
+    // ghost S-expansions (M2L below the partition level): the boxes of other
+    // ranks in the interaction lists of the boxes of this rank.  ghostC holds
+    // p coefficients for each of them (in the order of the Exchanges), and each
+    // entry of ghostM2L is (row of the box in the tree, ghost box, S|R offset
+    // index) with the level in ghostM2LLevel
+    std::vector<std::complex<double> > ghostC;
+    std::vector<int> ghostM2LRow, ghostM2LLevel, ghostM2LBox, ghostM2LOffset;
+
+    // ghost sources (P2P): the source points of the leaf boxes of other ranks
+    // that are neighbors of the leaf boxes of this rank, ghost leaf g has the
+    // points ghostStart[g], ..., ghostStart[g+1]-1, and each entry of ghostP2P is
+    // (position of the leaf box of this rank, ghost leaf)
+    std::vector<double> ghostX, ghostY, ghostCharge;
+    std::vector<int> ghostStart;
+    std::vector<int> ghostP2PLeaf, ghostP2PBox;
+
+    // Exchange of the ghost data with one other rank (point to point messages):
+    // the boxes (S-expansions) and the source ranges (charges) this rank sends
+    // to it, and the parts of ghostC and ghostCharge it receives from it
+    struct Exchange
+    {
+      int rank;
+      std::vector<std::pair<int,int> > sendBoxes;    // (level, position) in the tree
+      std::vector<std::pair<int,int> > sendRanges;   // [first, second) of the sorted sources
+      int sendCharges;                               // number of charges of sendRanges
+      int firstGhostBox, numGhostBoxes;              // part of ghostC (in boxes)
+      int firstGhostCharge, numGhostCharges;         // part of ghostCharge
+      std::vector<std::complex<double> > sendC;      // send buffers
+      std::vector<double> sendQ;
+    };
+    std::vector<Exchange> exchanges;
+
+    // coarse tree: c and d of all cells of the levels 0, ..., partitionLevel
+    std::vector<std::vector<std::complex<double> > > coarseC;
+    std::vector<std::vector<std::complex<double> > > coarseD;
+    std::vector<std::vector<char> > coarseNeeded;    // cell is an ancestor of a cell of this rank
+
+    std::vector<double> ownedCharge;       // charges and potentials of the owned points
+    std::vector<double> ownedPotential;
+
+    DistributedFmm(int level, const double *sourceX, const double *sourceY, int numSources,
+                   const double *targetX, const double *targetY, int numTargets,
+                   Potential &potential, MPI_Comm comm);
+    ~DistributedFmm();
+    DistributedFmm(const DistributedFmm &fmm) = delete;
+    DistributedFmm& operator=(const DistributedFmm &fmm) = delete;
+
+    void   apply(const double *u, double *v);   // charges and potentials of the input of this rank
+    bool   rebalance();                         // new partition from the costs of the boxes
+    void   setNumThreads(int n);
+
+    int    getOwner(long long cell);            // rank of a cell of the partition level
+    int    getNumOwnedSources() { return this->ownedSourceX.size(); };
+    int    getNumOwnedTargets() { return this->ownedTargetX.size(); };
+    double getImbalance();                      // largest cost of a rank / average cost
+    FmmTree& getTree() { return *this->tree; };
+
+  private:
+    std::vector<double> cellCost;          // cost of each cell of the cost level (all ranks)
+
+    int    getMinPartitionLevel();
+    long long getCostCell(int level, long long index);
+    std::vector<double> getCellWeight(int level);
+    void   partition(const std::vector<double> &weight);
+    void   distribute();
+    void   route(std::vector<long long> &key, std::vector<int> &sendOrder,
+                 std::vector<int> &sendCount, std::vector<int> &recvCount);
+    void   migrate(std::vector<double> &x, std::vector<double> &y,
+                   std::vector<int> &origin, std::vector<int> &index);
+    void   buildGhosts();
+    void   computeCosts();
+    void   coarsePasses();
+};
+
+#endif /* FMM2D_USE_MPI */
+
+
+
+
+#endif /* DISTRIBUTEDFMM_H_ */
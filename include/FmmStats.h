@@ -0,0 +1,106 @@
+/*
+ * FmmStats.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef FMMSTATS_H_
+#define FMMSTATS_H_
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#ifndef FMM2D_NO_STATS
+#include <chrono>
+#endif
+
+class FmmStats
+{
+  public:
+    // phases of the FMM (see FmmTree::apply)
+    static const int BUILD = 0;            // constructor (or update): sorting, boxes, lists, matrices
+    static const int P2M = 1;              // S-expansions of the leaf boxes
+    static const int M2M = 2;              // S|S translations (upward pass)
+    static const int M2L = 3;              // S|R translations (interaction lists, vList)
+    static const int P2L = 4;              // R-expansions of the points of the xList
+    static const int L2L = 5;              // R|R translations (downward pass 2)
+    static const int L2P = 6;              // evaluation of the R-expansions at the targets
+    static const int M2P = 7;              // evaluation of the S-expansions of the wList
+    static const int P2P = 8;              // direct calculation (near field, uList)
+    static const int NUM_PHASES = 9;
+
+    double    time[NUM_PHASES];            // wall time (seconds)
+    long long count[NUM_PHASES];           // interactions (see FmmStats.cc)
+    long long flops[NUM_PHASES];           // floating point operations
+    long long cycles[NUM_PHASES];          // hardware counters (-1 if not measured)
+    long long instructions[NUM_PHASES];
+
+    std::vector<int>       boxesPerLevel;  // boxes of each level
+    std::vector<int>       leavesPerLevel; // leaf boxes of each level
+    std::vector<long long> m2lPerLevel;    // S|R translations of each level
+    long long              uListEntries;
+    long long              vListEntries;
+    long long              wListEntries;
+    long long              xListEntries;
+    size_t                 bytes;          // memory of the tree (particles, boxes, coefficients, lists, matrices)
+
+    FmmStats();
+
+    void        reset();
+    void        resetPasses();             // the times and hardware counters of the passes
+    double      getTotalTime();            // all phases except BUILD
+    long long   getTotalFlops();
+    static std::string getPhaseName(int phase);
+    static double      getFlopsPerInteraction(int phase, int p);
+    std::string toString();
+};
+
+// optional hardware counters (cycles and instructions of the calling thread)
+// read with perf_event_open on Linux when compiled with FMM2D_USE_PERF_EVENT
+class HardwareCounters
+{
+  public:
+    int cyclesFd;
+    int instructionsFd;
+
+    HardwareCounters() : cyclesFd(-1), instructionsFd(-1) {};
+    ~HardwareCounters() { close(); };
+    HardwareCounters(const HardwareCounters &counters) = delete;
+    HardwareCounters& operator=(const HardwareCounters &counters) = delete;
+
+    bool open();                           // false if the counters are not available
+    void close();
+    bool isOpen() { return this->cyclesFd >= 0; };
+    void read(long long &cycles, long long &instructions);
+};
+
+// Explanation of PhaseTimer:
+//
+// adds the wall time (and the hardware counters, if they are open) between its
+// construction and its destruction to the phase of stats, for example
+//   { PhaseTimer timer(stats, FmmStats::M2L, counters);  ...loop...  }
+// When compiled with FMM2D_NO_STATS it does nothing (and costs nothing).
+class PhaseTimer
+{
+  public:
+#ifdef FMM2D_NO_STATS
+    PhaseTimer(FmmStats &, int, HardwareCounters &) {};
+#else
+    PhaseTimer(FmmStats &stats, int phase, HardwareCounters &counters);
+    ~PhaseTimer();
+
+  private:
+    FmmStats &stats;
+    int phase;
+    HardwareCounters &counters;
+    long long startCycles;
+    long long startInstructions;
+    std::chrono::steady_clock::time_point start;
+#endif
+};
+
+
+
+
+#endif /* FMMSTATS_H_ */
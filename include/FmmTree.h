@@ -10,41 +10,179 @@
 
 #include <complex>
 #include <vector>
+#include <utility>
+#include <ostream>
 
 #include "Box.h"
 #include "Potential.h"
+#include "Particles.h"
+#include "TranslationOperators.h"
+#include "NearField.h"
+#include "InteractionList.h"
+#include "FmmStats.h"
+#include "TaskGraph.h"
+#include "GpuBackend.h"
 
 
 class FmmTree
 {
   public:
-    int MAX_NUM_LEVEL=8;
+    int MAX_NUM_LEVEL=32;
     int DEFAULT_NUM_LEVEL=3;
 
+    // verbosity levels of the diagnostic messages (see setVerbosity)
+    static const int SILENT = 0;           // no output (default)
+    static const int INFO = 1;             // size of the tree, passes and statistics of each solve
+    static const int DEBUG = 2;            // also the tree structure and the coefficients of each source point
+
+    // schedulers of the passes of apply (see setScheduler)
+    static const int LEVELS = 0;           // level by level, one parallel loop for each phase and level
+    static const int TASKS = 1;            // a task for each box and phase, no barriers (see runTasks)
+
+    // engines of the S|R translations of apply (see setM2LEngine)
+    static const int MATRIX_M2L = 0;       // p x p complex matrix of each offset
+    static const int FACTORED_M2L = 1;     // scaled coefficients and the Pascal matrix
+
+    // precision of the near field and the translations of apply (see setPrecision)
+    static const int DOUBLE_PRECISION = 0; // all in double
+    static const int MIXED_PRECISION = 1;  // P2P and M2L in float, sums in double
+
     int dimension = 2;
 
     int numOfLevels;
     int currLevel;
 
-    std::vector<Point> x;
-    std::vector<Point> y;
+    // the source points x and the target points y are only kept sorted in
+    // Morton order (the input order is in Particles::index)
+    Particles sources;                     // source points x sorted in Morton order
+    Particles targets;                     // target points y sorted in Morton order
 
     Potential potential;
+    TranslationOperators operators;        // S|S, S|R and R|R matrices of the tree
+    NearField nearField;                   // near field kernel (direct calculation, P2P)
 
     std::vector<std::vector<Box> > tree_structure;              // an array of structs
 
+    // coefficient arena of each level (see allocateCoefficients): the
+    // coefficients c, dtilde and d of all boxes of level l are stored in
+    // coefficients[l] (one allocation per level) and the boxes point into it
+    std::vector<std::vector<std::complex<double> > > coefficients;
+
     long numOpsIndirect;
     long numOpsDirect;
 
+    int numThreads;                        // threads used by the passes (see setNumThreads)
+    int scheduler;                         // LEVELS or TASKS
+    int m2lEngine;                         // MATRIX_M2L or FACTORED_M2L
+    int precision;                         // DOUBLE_PRECISION or MIXED_PRECISION
+
+    int verbosity;                         // SILENT, INFO or DEBUG
+    std::ostream *logStream;               // the diagnostic messages are written to *logStream
+
+    // counts and operations of the phases of the FMM (computed once for the
+    // tree) and the wall times of the constructor and of the last apply
+    FmmStats stats;
+    HardwareCounters counters;             // optional, see enableHardwareCounters
+    GpuBackend gpu;                        // optional, see enableGpu
+
+    // near field (P2P) and far field (L2P, M2P) parts of the potential at
+    // the sorted targets (one array each, reused by every apply)
+    std::vector<double> nearPart;
+    std::vector<double> farPart;
+    std::vector<std::complex<double> > phiPart;   // complex potential and field (see applyField)
+    std::vector<std::complex<double> > dphiPart;
+
+    // applyBatch: numRhs series for each box (coefficients c, dtilde and d of
+    // level l in batchCoefficients[l], see getBatchSeries), the sorted charges
+    // (numRhs for each source) and the potentials at the sorted targets
+    int numRhs;
+    std::vector<std::vector<std::complex<double> > > batchCoefficients;
+    std::vector<double> batchCharge;
+    std::vector<double> batchPart;
+
+    bool adaptive;                         // the tree was built with the adaptive constructor
+    int  maxParticlesPerBox;               // adaptive tree: boxes with more points are subdivided
+    std::vector<std::pair<int,int> > leaves;  // (level, position) of the leaf boxes
+
+    // interaction lists of the boxes (compressed sparse rows, built once by
+    // buildInteractionLists).  Box pos of level l is the row levelStart[l] + pos
+    std::vector<int> levelStart;
+    InteractionList vList;                 // (position, S|R offset index) of the E_4 boxes
+    InteractionList uList;                 // source range [xBegin, xEnd) of the near boxes
+    InteractionList wList;                 // (level, position) of the W boxes (adaptive tree)
+    InteractionList xList;                 // source range [xBegin, xEnd) of the X boxes (adaptive tree)
+
+    // scheduler TASKS: the task graph (built by the first apply, see
+    // buildTaskGraph), the box (level, position) of each task and the time of
+    // each thread in the phases (TASK_TIME_STRIDE values for each thread)
+    TaskGraph taskGraph;
+    std::vector<std::pair<int,int> > taskBox;
+    std::vector<double> taskTime;
+
+    // MIXED_PRECISION (built by the first apply after the tree or the points
+    // changed, see prepareMixed): the coordinates of the sorted points relative
+    // to the center of the bounding box of the points of their leaf box and the
+    // charges in float, the shift (target frame minus source frame) and the
+    // self interaction tolerance of each uList entry (three floats) and float
+    // copies of the S-expansions c of each level (stored [box][term])
+    bool mixedReady;
+    std::vector<float> sourceXFloat, sourceYFloat, chargeFloat;
+    std::vector<float> targetXFloat, targetYFloat;
+    std::vector<float> uListShift;
+    std::vector<std::vector<std::complex<float> > > coefficientsFloat;
+
     FmmTree();                                // Constructor
     FmmTree(int level, std::vector<Point> &source, std::vector<Point> &target, Potential &potential);
+    FmmTree(std::vector<Point> &source, std::vector<Point> &target, Potential &potential,
+            int maxParticlesPerBox);          // adaptive tree
+    // the same from arrays of coordinates (for example of a ParticleFile)
+    FmmTree(int level, const double *sourceX, const double *sourceY, int numSources,
+            const double *targetX, const double *targetY, int numTargets, Potential &potential);
+    FmmTree(const double *sourceX, const double *sourceY, int numSources,
+            const double *targetX, const double *targetY, int numTargets, Potential &potential,
+            int maxParticlesPerBox);
+
+    // the boxes point into the coefficient arenas of the tree,
+    // so a tree can not be copied
+    FmmTree(const FmmTree &tree) = delete;
+    FmmTree& operator=(const FmmTree &tree) = delete;
 
     void initStruct();
+    void initAdaptiveStruct();
+    void buildBoxes(int maxLevel, int maxParticles);
+    void allocateCoefficients();
+    void clearCoefficients();
+    void buildInteractionLists();
+    // new coordinates of the same points (time stepping), false if the tree was built again
+    bool update(const double *sourceX, const double *sourceY,
+                const double *targetX, const double *targetY);
+    bool update(std::vector<Point> &source, std::vector<Point> &target);
 
     int getClusterThreshold();
     int getNumOfLevels() { return this->numOfLevels; };
+    void setNumThreads(int n);
+    int getNumThreads() { return this->numThreads; };
+    void setScheduler(int scheduler);
+    int getScheduler() { return this->scheduler; };
+    void setM2LEngine(int engine);
+    int getM2LEngine() { return this->m2lEngine; };
+    void setPrecision(int precision);
+    int getPrecision() { return this->precision; };
+    void setVerbosity(int level) { this->verbosity = level; };
+    int getVerbosity() { return this->verbosity; };
+    void setLogStream(std::ostream &out) { this->logStream = &out; };
+    bool isAdaptive() { return this->adaptive; };
+    int getNumOfLeaves() { return this->leaves.size(); };
+    int getNumOfSources() { return this->sources.size(); };
+    int getNumOfTargets() { return this->targets.size(); };
     int getIndex(std::vector<Point> &z, Point &p);
-    Box getBox(int level, int index) { return tree_structure[level][index]; };
+    int findBox(int level, long long index);
+    int getRow(int level, int pos) { return this->levelStart[level] + pos; };
+    Box getBox(int level, long long index);
+    FmmStats& getStats() { return this->stats; };
+    bool enableHardwareCounters();
+    bool enableGpu(int device);            // P2P and M2L of apply on a CUDA device
+    void disableGpu() { this->gpu.close(); };
 
 
     void printX ();
@@ -52,12 +190,78 @@ class FmmTree
     void printBoxInformation();
     void printTreeStructure();
     std::vector<double> solve(std::vector<double> &u);
+    std::vector<double> solve(std::vector<double> &u, FmmStats &stats);
+    void apply(const double *u, double *v);   // solve on the same tree with new charges
+    void applyField(const double *u, std::complex<double> *phi, std::complex<double> *dphi);
+    void solveField(std::vector<double> &u, std::vector<std::complex<double> > &phi,
+                    std::vector<std::complex<double> > &dphi);
+    void applyBatch(const double *u, int numRhs, double *v);   // numRhs charge vectors at once
+    std::vector<double> solveBatch(std::vector<double> &u, int numRhs);
     std::vector<double> solveDirect(std::vector<double> &u);
+    std::vector<double> solveDirect(std::vector<double> &u, const std::vector<int> &targetIndexes);
+    void solveDirectField(std::vector<double> &u, std::vector<std::complex<double> > &phi,
+                          std::vector<std::complex<double> > &dphi);
 
   private:
-    void upwardPass(std::vector<double> &u);
+    // the distributed FMM runs the passes of its local tree itself
+    // (the exchange of the ghost data is done between them)
+    friend class DistributedFmm;
+    // and KernelFmm its passes on the boxes and the lists of the tree
+    template <class Kernel> friend class KernelFmm;
+
+    void runPasses(const double *u);
+    void upwardPass(const double *u);
+    void evaluate(double *v);
+    void evaluateNear();                   // P2P part of evaluate (nearPart)
+    void evaluateFar(double *v);           // L2P and M2P parts of evaluate, v = nearPart + farPart
+    void evaluateField(std::complex<double> *phi, std::complex<double> *dphi);
+    void upwardPassBatch(const double *u);
+    void downwardPass1Batch();
+    void downwardPass2Batch();
+    void evaluateBatch(double *v);
+    // series of the box pos of level 'level' for applyBatch: part 0 (c),
+    // 1 (dtilde) or 2 (d), a p x numRhs matrix stored row by row
+    std::complex<double>* getBatchSeries(int level, int pos, int part)
+    { return &batchCoefficients[level][((size_t)part*tree_structure[level].size() + pos)*potential.getP()*numRhs]; };
     void downwardPass1();
     void downwardPass2();
+
+    // the work of one phase for one box (see the box kernels in FmmTree.cc)
+    void p2mBox(int level, int pos, bool dumpCoefficients);
+    void m2mBox(int level, int pos);
+    void m2lBox(int level, int pos);
+    void applySR(int level, int offsetIndex, const std::complex<double> *c, std::complex<double> *dtilde);
+    void applySRFloat(int level, int offsetIndex, const std::complex<float> *c, std::complex<double> *dtilde);
+    void p2lBox(int level, int pos);
+    void l2lBox(int level, int pos);
+    void l2pBox(int level, int pos);
+    void m2pBox(int level, int pos);
+    void p2pBox(int level, int pos);
+
+    // kinds (priorities) of the tasks of the scheduler TASKS
+    static const int UP_TASK = 0;          // P2M or M2M
+    static const int DOWN1_TASK = 1;       // M2L and P2L
+    static const int DOWN2_TASK = 2;       // L2L
+    static const int EVAL_TASK = 3;        // L2P and M2P
+    static const int NEAR_TASK = 4;        // P2P
+    static const int TASK_TIME_STRIDE = 16;   // >= FmmStats::NUM_PHASES, one cache line apart
+    void buildTaskGraph();
+    void runTasks(const double *u, double *v);
+    bool runGpuPasses(const double *u, double *v);   // false if the device failed
+    void runTask(int task, int thread);
+    double getTaskClock();
+    double directPotential(const double *u, int j, const std::vector<int> &sourcePos, long &ops);
+    void countInteractions();
+    void prepareMixed();
+    void storeFloatC(int level, int pos);
+    std::complex<float>* getFloatC(int level, int pos)
+    { return &coefficientsFloat[level][(size_t)pos*potential.getP()]; };
+
+    bool isNeighbor(int levelA, long long indexA, int levelB, long long indexB);
+    void addLeafLists(int level, int pos, int nLevel, int nPos);
+    void getLeafOrder(std::vector<std::pair<int,int> > &leafOrder);
+    bool moveParticles(Particles &particles, const double *x, const double *y, bool isSource,
+                       const std::vector<std::pair<int,int> > &leafOrder, long long &numMoved);
 };
 
 
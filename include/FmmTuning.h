@@ -0,0 +1,35 @@
+/*
+ * FmmTuning.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef FMMTUNING_H_
+#define FMMTUNING_H_
+
+class FmmTuning
+{
+  public:
+    // model of the error of the series, error(p) = ERROR_CONSTANT * ERROR_RATIO^p
+    // (relative to the largest potential, see FmmTuning.cc)
+    static const double ERROR_CONSTANT;
+    static const double ERROR_RATIO;
+
+    double p2pTime;                        // seconds for one source-target pair of the near field
+    double m2lTime;                        // seconds for one matrix entry of a translation
+
+    FmmTuning();
+
+    void   calibrate(int p);
+
+    static int getP(double relativeError);
+    double getLeafSize(int p);
+    double getEstimatedTime(int numParticles, int p, double leafSize);
+    int    getNumOfLevels(int numParticles, int p);
+    int    getMaxParticlesPerBox(int p);
+};
+
+
+
+
+#endif /* FMMTUNING_H_ */
@@ -0,0 +1,55 @@
+/*
+ * GpuBackend.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef GPUBACKEND_H_
+#define GPUBACKEND_H_
+
+#include <string>
+
+class FmmTree;
+struct GpuState;                           // device buffers and streams (see GpuBackend.cu)
+
+// optional CUDA backend for the near field (P2P) and the S|R translations
+// (M2L) of FmmTree::apply, compiled from src/GpuBackend.cu with FMM2D_USE_CUDA.
+// Without it (src/GpuBackend.cc) open returns false and the tree uses the CPU
+// passes, which remain the reference.
+class GpuBackend
+{
+  public:
+    GpuBackend() : device(-1), uploaded(false), state(NULL) {};
+    ~GpuBackend() { close(); };
+    GpuBackend(const GpuBackend &backend) = delete;
+    GpuBackend& operator=(const GpuBackend &backend) = delete;
+
+    bool open(int device);                 // false if there is no such device (or no CUDA)
+    void close();
+    bool isOpen() { return this->device >= 0; };
+    std::string getDeviceName();
+
+    // the sorted points, the uList and the vList of the leaf boxes and the
+    // S|R matrices of the tree, once for each tree (and again after invalidate)
+    bool upload(FmmTree &tree);            // false if a CUDA call failed
+    bool isUploaded() { return this->uploaded; };
+    void invalidate() { this->uploaded = false; };
+
+    // asynchronous kernels: start sends the input and launches the kernel,
+    // finish waits for it and adds the result on the host (nothing is added
+    // if a CUDA call of the upload, the start or the finish failed)
+    void startNear(FmmTree &tree);         // P2P from the sorted charges of the tree
+    bool finishNear(FmmTree &tree);        // adds to tree.nearPart, false if the device failed
+    void startM2L(FmmTree &tree);          // M2L from the coefficients C of all levels
+    bool finishM2L(FmmTree &tree);         // adds to the coefficients Dtilde, false if the device failed
+
+  private:
+    int device;
+    bool uploaded;
+    GpuState *state;
+};
+
+
+
+
+#endif /* GPUBACKEND_H_ */
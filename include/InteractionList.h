@@ -0,0 +1,42 @@
+/*
+ * InteractionList.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef INTERACTIONLIST_H_
+#define INTERACTIONLIST_H_
+
+#include <vector>
+
+class InteractionList
+{
+  public:
+    // compressed sparse row (CSR) storage of a list of entries for each box
+    // (row) of the tree: the entries of row r are at the positions
+    // start[r], ..., start[r+1]-1 of first and second (two integers per entry,
+    // their meaning depends on the list, see FmmTree::buildInteractionLists)
+    std::vector<int> start;
+    std::vector<int> first;
+    std::vector<int> second;
+
+    InteractionList() {};
+
+    void clear();
+    void add(int row, int a, int b);       // adding an entry (before finalize)
+    void finalize(int numRows);            // building the CSR arrays from the added entries
+
+    int  getBegin(int row) { return this->start[row]; };
+    int  getEnd(int row) { return this->start[row+1]; };
+    int  getFirst(int i) { return this->first[i]; };
+    int  getSecond(int i) { return this->second[i]; };
+    int  size() { return this->first.size(); };
+
+  private:
+    std::vector<int> pendingRow;           // rows of the entries added with add
+};
+
+
+
+
+#endif /* INTERACTIONLIST_H_ */
@@ -0,0 +1,86 @@
+/*
+ * KernelFmm.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef KERNELFMM_H_
+#define KERNELFMM_H_
+
+#include <complex>
+#include <vector>
+
+#include "FmmTree.h"
+#include "FmmStats.h"
+
+// Explanation of KernelFmm:
+//
+// the passes of the FMM for another kernel on the boxes, the interaction lists,
+// the threads and the scheduler of an FmmTree.  The tree is built as usual
+// (uniform or adaptive, and update moves its points), and KernelFmm<Kernel>
+// keeps its own series for each box and calls the phases of the template
+// parameter Kernel for each box:
+//   int  getNumCoeff()                    complex coefficients of a series
+//   int  getNumOfLevels()                 levels of the tables built last
+//   void build(numOfLevels)               translation tables of the levels
+//   p2m, m2m, m2l, p2l, l2l, l2p, m2p, p2p
+// (see YukawaKernel.h for the arguments).  The kernel is a template parameter,
+// so the calls are resolved at compile time.  KernelFmm.cc instantiates the
+// kernels LaplaceKernel and YukawaKernel; a new kernel adds its line there.
+template <class Kernel>
+class KernelFmm
+{
+  public:
+    FmmTree &tree;                         // boxes, lists, threads and scheduler
+    Kernel  &kernel;
+    int      numCoeff;                     // Kernel::getNumCoeff
+
+    // coefficients c, dtilde and d of all boxes of level l in coefficients[l]
+    // (three blocks [box][term], see FmmTree::allocateCoefficients)
+    std::vector<std::vector<std::complex<double> > > coefficients;
+
+    // near field and far field parts of the potentials at the sorted targets
+    std::vector<double> nearPart;
+    std::vector<double> farPart;
+
+    FmmStats stats;                        // counts of the tree and the times of the last apply
+    HardwareCounters counters;
+    std::vector<double> taskTime;          // scheduler TASKS (see FmmTree::runTasks)
+
+    KernelFmm(FmmTree &tree, Kernel &kernel);
+    KernelFmm(const KernelFmm &fmm) = delete;
+    KernelFmm& operator=(const KernelFmm &fmm) = delete;
+
+    void apply(const double *u, double *v);
+    std::vector<double> solve(std::vector<double> &u);
+    std::vector<double> solveDirect(std::vector<double> &u, const std::vector<int> &targetIndexes);
+    FmmStats& getStats() { return this->stats; };
+
+  private:
+    // part 0 (c), 1 (dtilde) or 2 (d) of the box pos of level 'level'
+    std::complex<double>* getSeries(int level, int pos, int part)
+    { return &coefficients[level][((size_t)part*tree.tree_structure[level].size() + pos)*numCoeff]; };
+
+    void prepare();
+    void upwardPass();
+    void downwardPass1();
+    void downwardPass2();
+    void evaluateNear();
+    void evaluateFar(double *v);
+    void runTasks(double *v);
+    void runTask(int task, int thread);
+
+    void p2mBox(int level, int pos);
+    void m2mBox(int level, int pos);
+    void m2lBox(int level, int pos);
+    void p2lBox(int level, int pos);
+    void l2lBox(int level, int pos);
+    void l2pBox(int level, int pos);
+    void m2pBox(int level, int pos);
+    void p2pBox(int level, int pos);
+};
+
+
+
+
+#endif /* KERNELFMM_H_ */
@@ -0,0 +1,59 @@
+/*
+ * LaplaceKernel.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef LAPLACEKERNEL_H_
+#define LAPLACEKERNEL_H_
+
+#include <complex>
+
+#include "Potential.h"
+#include "TranslationOperators.h"
+#include "NearField.h"
+
+// Explanation of LaplaceKernel:
+//
+// the kernel of KernelFmm for the log potential of FmmTree
+//   v[j] = sum_i u[i] log |y[j] - x[i]|
+// with the (scaled) series, the translation matrices and the near field of
+// FmmTree (Potential, TranslationOperators and NearField).  KernelFmm with
+// this kernel gives the potentials of FmmTree::apply (with the default
+// settings) up to rounding; FmmTree::apply itself does not go through the
+// kernel interface.
+class LaplaceKernel
+{
+  public:
+    Potential potential;
+    TranslationOperators operators;
+    NearField nearField;
+    int       numOfLevels;                 // the matrices are the same for every level
+
+    LaplaceKernel(Potential &potential) : potential(potential), numOfLevels(0) {};
+
+    int  getNumCoeff() { return this->potential.getP(); };
+    int  getNumOfLevels() { return this->numOfLevels; };
+    void build(int numOfLevels);
+
+    // the phases of the FMM for one box (see KernelFmm)
+    void p2m(const double *x, const double *y, const double *q, int n, std::complex<double> center,
+             int level, std::complex<double> *c);
+    void m2m(int level, int child, const std::complex<double> *c, std::complex<double> *parentC);
+    void m2l(int level, int offsetIndex, const std::complex<double> *c, std::complex<double> *d);
+    void p2l(const double *x, const double *y, const double *q, int n, std::complex<double> center,
+             int level, std::complex<double> *d);
+    void l2l(int level, int child, const std::complex<double> *parentD, std::complex<double> *d);
+    void l2p(const std::complex<double> *d, std::complex<double> center, int level,
+             const double *x, const double *y, int n, double *v);
+    void m2p(const std::complex<double> *c, std::complex<double> center, int level,
+             const double *x, const double *y, int n, double *v);
+    void p2p(const double *tx, const double *ty, int nt,
+             const double *sx, const double *sy, const double *q, int ns, double *v)
+    { nearField.evaluate(tx, ty, nt, sx, sy, q, ns, v); };
+};
+
+
+
+
+#endif /* LAPLACEKERNEL_H_ */
@@ -0,0 +1,56 @@
+/*
+ * NearField.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef NEARFIELD_H_
+#define NEARFIELD_H_
+
+#include <string>
+#include <complex>
+
+class NearField
+{
+  public:
+    // instruction sets of the kernel (see NearField.cc)
+    static const int SCALAR = 0;
+    static const int AVX2 = 1;
+    static const int AVX512 = 2;
+
+    int    instructionSet;                 // instruction set used by evaluate
+    double tol2;                           // squared distance below which a source is the target itself
+
+    NearField();
+
+    void        evaluate(const double *tx, const double *ty, int nt,
+                         const double *sx, const double *sy, const double *q, int ns,
+                         double *v);
+    void        evaluateField(const double *tx, const double *ty, int nt,
+                              const double *sx, const double *sy, const double *q, int ns,
+                              std::complex<double> *phi, std::complex<double> *dphi);
+    void        evaluateBatch(const double *tx, const double *ty, int nt,
+                              const double *sx, const double *sy, const double *q, int ns,
+                              int numRhs, double *v);
+    // the same as evaluate with float coordinates relative to the box centers
+    void        evaluateMixed(const float *tx, const float *ty, int nt,
+                              const float *sx, const float *sy, const float *q, int ns,
+                              float shiftX, float shiftY, float tol2, double *v);
+
+    int         getInstructionSet() { return this->instructionSet; };
+    void        setInstructionSet(int set);
+    std::string getInstructionSetName();
+
+    static int  getBestInstructionSet();
+
+  private:
+    void        evaluateScalar(const double *tx, const double *ty, int nt,
+                               const double *sx, const double *sy, const double *q, int ns,
+                               double *v);
+    void        logBlock(const double *r2, double *l);
+};
+
+
+
+
+#endif /* NEARFIELD_H_ */
@@ -0,0 +1,66 @@
+/*
+ * ParticleFile.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef PARTICLEFILE_H_
+#define PARTICLEFILE_H_
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+// Explanation of ParticleFile:
+//
+// binary file of points (and one value per point, a charge or a potential)
+// that is memory mapped instead of read, so that a large problem is binned
+// into the tree directly from the page cache without building a vector of
+// Points.  The file is a header of HEADER_SIZE bytes
+//   char     magic[8]      "FMM2DPTS"
+//   uint32_t version       VERSION
+//   uint32_t numColumns    2 (x, y) or 3 (x, y, values)
+//   uint64_t numPoints
+//   uint64_t reserved      0
+// followed by the columns (structure of arrays) of numPoints doubles each in
+// the order x, y, values (native byte order, little endian on x86).
+class ParticleFile
+{
+  public:
+    static const int VERSION = 1;
+    static const size_t HEADER_SIZE = 32;
+
+    char     *data;                        // start of the mapping (the header)
+    size_t    length;                      // length of the mapping in bytes
+    long long numPoints;
+    int       numColumns;
+    bool      writable;
+
+    ParticleFile() : data(NULL), length(0), numPoints(0), numColumns(0), writable(false) {};
+    ~ParticleFile() { close(); };
+    ParticleFile(const ParticleFile &file) = delete;
+    ParticleFile& operator=(const ParticleFile &file) = delete;
+
+    bool      open(const std::string &path);              // read only, false on any error
+    bool      create(const std::string &path, long long numPoints, int numColumns);
+    void      close();
+    bool      isOpen() { return this->data != NULL; };
+
+    long long size() { return this->numPoints; };
+    int       getNumColumns() { return this->numColumns; };
+    const double *getX() { return getColumn(0); };
+    const double *getY() { return getColumn(1); };
+    const double *getValues() { return numColumns > 2 ? getColumn(2) : NULL; };
+    double   *getWritableColumn(int column);              // NULL if not created
+
+    static bool write(const std::string &path, const double *x, const double *y,
+                      const double *values, long long numPoints);
+
+  private:
+    double   *getColumn(int column);
+};
+
+
+
+
+#endif /* PARTICLEFILE_H_ */
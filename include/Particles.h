@@ -0,0 +1,47 @@
+/*
+ * Particles.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef PARTICLES_H_
+#define PARTICLES_H_
+
+#include <vector>
+#include <complex>
+#include <string>
+
+#include "Point.h"
+
+class Particles
+{
+  public:
+
+    // structure of arrays (SoA) for the particles of the tree sorted in
+    // Morton order (the order of the interleaved box index of the particles)
+    // and all of the same length
+    std::vector<double> xCoord;      // x-coordinates of the particles
+    std::vector<double> yCoord;      // y-coordinates of the particles
+    std::vector<double> charge;      // charges of the particles (sources only)
+    std::vector<int>    index;       // index of each particle in the unsorted input vector
+    std::vector<long long> boxIndex; // interleaved index of the box (at level 'level') of each particle
+
+    unsigned int        level;       // refinement level used for sorting
+
+    Particles() : level(0) {};
+
+    void     sort(std::vector<Point> &points, unsigned int level);
+    void     sort(const double *x, const double *y, int numPoints, unsigned int level,
+                  int numThreads);
+    void     getInputPositions(std::vector<int> &position);
+    void     setCharge(std::vector<double> &u);
+    void     setCharge(const double *u);
+    void     getRange(unsigned int boxLevel, long long n, int &begin, int &end);
+
+    int      size() { return this->xCoord.size(); };
+};
+
+
+
+
+#endif /* PARTICLES_H_ */
@@ -26,7 +26,7 @@ class Point
 
     std::string coordToString();
     bool equals(Point &p);
-    int getBoxIndex(unsigned int level);
+    long long getBoxIndex(unsigned int level);
 };
 
 
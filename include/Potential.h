@@ -17,13 +17,44 @@ class Potential
 	int p;
     int DEFAULT_P = 12;
 
-    Potential() { this->p = DEFAULT_P; };
-	Potential(int p)
-	 :
-     p(p)
-	{};
+    // translation kernel with the order p fixed at compile time (see
+    // applyTranslation), NULL if p is not between MIN_FIXED_P and MAX_FIXED_P
+    typedef void (*TranslationKernel)(const std::complex<double> *matrix,
+                                      const std::complex<double> *in,
+                                      std::complex<double> *out);
+    static const int MIN_FIXED_P = 4;
+    static const int MAX_FIXED_P = 32;
+    TranslationKernel translationKernel;
+
+    // the same for the factored S|R translation (see applyFactoredSR), NULL
+    // if p is not between MIN_FIXED_P and MAX_FIXED_P
+    typedef void (*FactoredSRKernel)(const double *pascal, const std::complex<double> *power,
+                                     std::complex<double> logT, const std::complex<double> *in,
+                                     std::complex<double> *out);
+    FactoredSRKernel factoredSRKernel;
+
+    // the same with the matrix and the coefficients in float (mixed precision,
+    // see applyTranslationFloat), the results are added to double coefficients
+    typedef void (*TranslationKernelFloat)(const std::complex<float> *matrix,
+                                           const std::complex<float> *in,
+                                           std::complex<double> *out);
+    typedef void (*FactoredSRKernelFloat)(const float *pascal, const std::complex<float> *power,
+                                          std::complex<double> logT, const std::complex<float> *in,
+                                          std::complex<double> *out);
+    TranslationKernelFloat translationKernelFloat;
+    FactoredSRKernelFloat factoredSRKernelFloat;
+
+    Potential() { setP(DEFAULT_P); };
+	Potential(int p) { setP(p); };
 	int getP() { return p;};
-	void setP(int p) { this->p = p; };
+	void setP(int p) { this->p = p; this->translationKernel = getTranslationKernel(p);
+	                   this->factoredSRKernel = getFactoredSRKernel(p);
+	                   this->translationKernelFloat = getTranslationKernelFloat(p);
+	                   this->factoredSRKernelFloat = getFactoredSRKernelFloat(p); };
+	static TranslationKernel getTranslationKernel(int p);
+	static FactoredSRKernel getFactoredSRKernel(int p);
+	static TranslationKernelFloat getTranslationKernelFloat(int p);
+	static FactoredSRKernelFloat getFactoredSRKernelFloat(int p);
 	std::vector<std::complex<double> > getSR(std::complex<double> from,
 			                                 std::complex<double> to,
 			                                 const std::vector<std::complex<double> > &sCoeff);
@@ -34,6 +65,51 @@ class Potential
 			                                 std::complex<double> to,
 			                                 const std::vector<std::complex<double> > &rCoeff);
 
+	// translation matrices (p x p, stored row by row) for the translation vector t = to - from
+	void getSRMatrix(std::complex<double> t, std::vector<std::complex<double> > &sr);
+	void getSSMatrix(std::complex<double> t, std::vector<std::complex<double> > &ss);
+	void getRRMatrix(std::complex<double> t, std::vector<std::complex<double> > &rr);
+	// factors of the S|R matrix (see applyFactoredSR): the Pascal matrix (the
+	// same for every t) and the powers t^(-j) and log t of the translation vector
+	void getPascalMatrix(std::vector<double> &pascal);
+	void getSRFactors(std::complex<double> t, std::vector<std::complex<double> > &power,
+	                  std::complex<double> &logT);
+	std::vector<std::complex<double> > translate(const std::vector<std::complex<double> > &matrix,
+			                                     const std::vector<std::complex<double> > &coeff);
+
+	// accumulate-in-place versions used by the passes of FmmTree: no vectors are
+	// created and the p results are added to the coefficients at out
+	void applyTranslation(const std::complex<double> *matrix, const std::complex<double> *in,
+			              std::complex<double> *out);
+	// the same for numRhs coefficient vectors at once (p x numRhs, stored row by row)
+	void applyTranslationBatch(const std::complex<double> *matrix, const std::complex<double> *in,
+			                   std::complex<double> *out, int numRhs);
+	// out += S|R(t) in with the factors of the S|R matrix instead of the matrix
+	void applyFactoredSR(const double *pascal, const std::complex<double> *power,
+			             std::complex<double> logT, const std::complex<double> *in,
+			             std::complex<double> *out);
+	// the same with float matrices and coefficients (mixed precision)
+	void applyTranslationFloat(const std::complex<float> *matrix, const std::complex<float> *in,
+			                   std::complex<double> *out);
+	void applyFactoredSRFloat(const float *pascal, const std::complex<float> *power,
+			                  std::complex<double> logT, const std::complex<float> *in,
+			                  std::complex<double> *out);
+	// the series of FmmTree are scaled by the size of their box (see
+	// addSCoeff), scale = 1 gives the plain coefficients
+	void addSCoeff(std::complex<double> xi, std::complex<double> xstar, double u, std::complex<double> *out,
+			       double scale = 1.0);
+	void addRCoeff(std::complex<double> xi, std::complex<double> xstar, double u, std::complex<double> *out,
+			       double scale = 1.0);
+	std::complex<double> evalR(const std::complex<double> *d, std::complex<double> y, std::complex<double> xstar,
+			                   double scale = 1.0);
+	std::complex<double> evalS(const std::complex<double> *c, std::complex<double> y, std::complex<double> xstar,
+			                   double scale = 1.0);
+	// the same and the derivative of the series with respect to y (field, see FmmTree::applyField)
+	std::complex<double> evalR(const std::complex<double> *d, std::complex<double> y, std::complex<double> xstar,
+			                   std::complex<double> &derivative, double scale = 1.0);
+	std::complex<double> evalS(const std::complex<double> *c, std::complex<double> y, std::complex<double> xstar,
+			                   std::complex<double> &derivative, double scale = 1.0);
+
 	std::vector<std::complex<double> > getRCoeff(std::complex<double> xi, std::complex<double> xstar);
 	std::vector<std::complex<double> > getSCoeff(std::complex<double> xi, std::complex<double> xstar);
 
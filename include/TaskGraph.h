@@ -0,0 +1,48 @@
+/*
+ * TaskGraph.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef TASKGRAPH_H_
+#define TASKGRAPH_H_
+
+#include <vector>
+#include <functional>
+
+class TaskGraph
+{
+  public:
+    // tasks 0, ..., size()-1 with the number of tasks each one waits for and
+    // their successors (compressed sparse rows: the successors of task t are
+    // successor[start[t]], ..., successor[start[t+1]-1]).  The kind of a task
+    // is its priority, kind 0 is run first when several tasks are ready
+    std::vector<int> kind;
+    std::vector<int> numDependencies;
+    std::vector<int> start;
+    std::vector<int> successor;
+
+    TaskGraph() : numKinds(0) {};
+
+    void clear();
+    int  addTask(int kind);                // returns the number of the new task
+    void addDependency(int before, int after);   // 'after' waits for 'before' (before finalize)
+    void finalize();                       // building the successor lists
+
+    // runs work(task, thread) for all tasks, each task after the tasks it
+    // waits for, on numThreads threads (thread is 0, ..., numThreads-1)
+    void run(int numThreads, const std::function<void(int, int)> &work);
+
+    int  size() { return this->kind.size(); };
+    bool isEmpty() { return this->kind.empty(); };
+
+  private:
+    int numKinds;
+    std::vector<int> pendingBefore;        // edges added with addDependency
+    std::vector<int> pendingAfter;
+};
+
+
+
+
+#endif /* TASKGRAPH_H_ */
@@ -0,0 +1,78 @@
+/*
+ * TranslationOperators.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef TRANSLATIONOPERATORS_H_
+#define TRANSLATIONOPERATORS_H_
+
+#include <vector>
+#include <complex>
+#include <cmath>
+
+#include "Potential.h"
+
+class TranslationOperators
+{
+  public:
+    // offsets (in cell lengths) of the interaction list E_4 are between -3 and 3
+    // in each direction, so the S|R matrices are kept in one 7 x 7 table of
+    // offsets shared by all levels (the level only enters through the scale of
+    // its series, getScale, and the term getLogScale of the S|R translation)
+    static const int MAX_OFFSET = 3;
+    static const int OFFSETS_PER_SIDE = 2*MAX_OFFSET+1;
+
+    int p;                                 // truncation index of the translated series
+
+    // the series of the boxes of level l are scaled by the cell length
+    // s = 2^(-l) (see Potential::addSCoeff), so the matrices are the same for
+    // every level and only one table of them is kept:
+    // ss[k] - S|S matrix from child k (k = 0,1,2,3) to its parent
+    // rr[k] - R|R matrix from the parent to its child k
+    // sr[m] - S|R matrix between two cells with offset index m (without the
+    //         term log s of the level, see getLogScale)
+    // (all matrices are p x p and stored row by row like in Potential::getSSMatrix)
+    std::vector<std::vector<std::complex<double> > > ss;
+    std::vector<std::vector<std::complex<double> > > rr;
+    std::vector<std::vector<std::complex<double> > > sr;
+
+    // factors of the S|R matrices (see Potential::applyFactoredSR): the Pascal
+    // matrix (p x p, stored column by column) and for each sr[m] the powers
+    // t^(-j), j = 0, ..., p-1 (srPower[m]) and log t (srLog[m])
+    std::vector<double> pascal;
+    std::vector<std::vector<std::complex<double> > > srPower;
+    std::vector<std::complex<double> > srLog;
+
+    // float copies of sr, pascal and srPower for the mixed precision M2L (see
+    // FmmTree::setPrecision), built by buildFloat
+    std::vector<std::vector<std::complex<float> > > srFloat;
+    std::vector<float> pascalFloat;
+    std::vector<std::vector<std::complex<float> > > srPowerFloat;
+
+    TranslationOperators() : p(0) {};
+
+    void build(Potential &potential);
+    void buildFloat();
+    bool hasFloat() { return !this->srFloat.empty(); };
+
+    const std::vector<std::complex<double> >& getSS(int child) { return ss[child]; };
+    const std::vector<std::complex<double> >& getRR(int child) { return rr[child]; };
+    const std::vector<std::complex<double> >& getSR(int dx, int dy) { return sr[getOffsetIndex(dx,dy)]; };
+    const std::vector<std::complex<double> >& getSR(int offsetIndex) { return sr[offsetIndex]; };
+    const std::vector<std::complex<double> >& getSRPower(int offsetIndex) { return srPower[offsetIndex]; };
+    std::complex<double> getSRLog(int offsetIndex) { return srLog[offsetIndex]; };
+
+    // cell length of level l (scale of its series) and its logarithm, which
+    // the S|R translations of level l add to the first coefficient (times the
+    // first coefficient of the S-expansion)
+    static double getScale(int level) { return std::ldexp(1.0, -level); };
+    static double getLogScale(int level) { return -level * std::log(2.0); };
+
+    static int getOffsetIndex(int dx, int dy) { return (dx+MAX_OFFSET)*OFFSETS_PER_SIDE + (dy+MAX_OFFSET); };
+};
+
+
+
+
+#endif /* TRANSLATIONOPERATORS_H_ */
@@ -8,17 +8,62 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <complex>
+#include <stdint.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 class Util
 {
   public:
 	Util () {};
-    int interleave(int x, int y, int level);
-    std::complex<double> uninterleave(int n, int L);
+    long long interleave(int x, int y, int level);
+    std::complex<double> uninterleave(long long n, int L);
+    void uninterleave(long long n, int &x, int &y);
     int setbit(int n, int pos, int setto);
     int getbit(int n, int pos);
 
+    // Morton encoding and decoding without loops (see Util.cc)
+    static inline uint64_t spreadBits(uint32_t v);
+    static inline uint32_t compactBits(uint64_t v);
+    static inline long long mortonKey(uint32_t x, uint32_t y)
+      { return (long long)((spreadBits(x) << 1) | spreadBits(y)); };
+
 };
 
+// moving bit i of v to bit 2i (the odd bits of the result are zero)
+inline uint64_t Util::spreadBits(uint32_t v)
+{
+#ifdef __BMI2__
+  return _pdep_u64(v, 0x5555555555555555ULL);
+#else
+  uint64_t b = v;
+  b = (b | (b << 16)) & 0x0000FFFF0000FFFFULL;
+  b = (b | (b <<  8)) & 0x00FF00FF00FF00FFULL;
+  b = (b | (b <<  4)) & 0x0F0F0F0F0F0F0F0FULL;
+  b = (b | (b <<  2)) & 0x3333333333333333ULL;
+  b = (b | (b <<  1)) & 0x5555555555555555ULL;
+  return b;
+#endif
+}
+
+// moving bit 2i of v to bit i (the inverse of spreadBits, the odd bits of v are ignored)
+inline uint32_t Util::compactBits(uint64_t v)
+{
+#ifdef __BMI2__
+  return (uint32_t)_pext_u64(v, 0x5555555555555555ULL);
+#else
+  uint64_t b = v & 0x5555555555555555ULL;
+  b = (b | (b >>  1)) & 0x3333333333333333ULL;
+  b = (b | (b >>  2)) & 0x0F0F0F0F0F0F0F0FULL;
+  b = (b | (b >>  4)) & 0x00FF00FF00FF00FFULL;
+  b = (b | (b >>  8)) & 0x0000FFFF0000FFFFULL;
+  b = (b | (b >> 16)) & 0x00000000FFFFFFFFULL;
+  return (uint32_t)b;
+#endif
+}
 
 
 
@@ -0,0 +1,93 @@
+/*
+ * YukawaKernel.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef YUKAWAKERNEL_H_
+#define YUKAWAKERNEL_H_
+
+#include <vector>
+#include <complex>
+
+#include "TranslationOperators.h"
+
+// Explanation of YukawaKernel:
+//
+// the kernel of KernelFmm for the Yukawa (screened Coulomb, modified
+// Helmholtz) potential
+//   v[j] = sum_i u[i] K_0(lambda |y[j] - x[i]|)
+// with the modified Bessel function K_0 and the screening parameter lambda > 0.
+// The series of a box with center c have the 2p+1 terms n = -p, ..., p
+//   S-expansion:  sum_n c[n] K_n(y - c)        R-expansion:  sum_n d[n] I_n(y - c)
+// with K_n(z) = K_|n|(lambda |z|) e^(i n arg z) and I_n(z) = I_|n|(lambda |z|) e^(i n arg z)
+// (see YukawaKernel.cc).  The series of a box of level l are scaled with
+// sigma = lambda 2^(-l) / 2 (c[n] |n|! / sigma^|n| and d[n] sigma^|n| / |n|!),
+// so that the coefficients stay of the order of 1 on deep trees.  The
+// translation matrices depend on lambda times the cell length and are kept
+// for each level (build).
+class YukawaKernel
+{
+  public:
+    double lambda;                         // screening parameter
+    int    p;                              // terms -p, ..., p of the series
+    int    numOfLevels;                    // levels of the tables (see build)
+    double tol2;                           // squared distance below which a source is the target itself
+
+    // translation matrices of the scaled series of each level l ((2p+1) x (2p+1),
+    // stored row by row):
+    // ss[l][k] - from child k of level l to its parent (S|S)
+    // rr[l][k] - from the parent to its child k of level l (R|R)
+    // sr[l][m] - between two cells of level l with offset index m (see
+    //            TranslationOperators::getOffsetIndex)
+    std::vector<std::vector<std::vector<std::complex<double> > > > ss;
+    std::vector<std::vector<std::vector<std::complex<double> > > > rr;
+    std::vector<std::vector<std::vector<std::complex<double> > > > sr;
+
+    YukawaKernel(double lambda, int p);
+
+    int  getNumCoeff() { return 2*p+1; };
+    int  getNumOfLevels() { return this->numOfLevels; };
+    void build(int numOfLevels);
+
+    // the phases of the FMM for one box (see KernelFmm), the results are
+    // added to the coefficients and the potentials
+    void p2m(const double *x, const double *y, const double *q, int n, std::complex<double> center,
+             int level, std::complex<double> *c);
+    void m2m(int level, int child, const std::complex<double> *c, std::complex<double> *parentC);
+    void m2l(int level, int offsetIndex, const std::complex<double> *c, std::complex<double> *d);
+    void p2l(const double *x, const double *y, const double *q, int n, std::complex<double> center,
+             int level, std::complex<double> *d);
+    void l2l(int level, int child, const std::complex<double> *parentD, std::complex<double> *d);
+    void l2p(const std::complex<double> *d, std::complex<double> center, int level,
+             const double *x, const double *y, int n, double *v);
+    void m2p(const std::complex<double> *c, std::complex<double> center, int level,
+             const double *x, const double *y, int n, double *v);
+    void p2p(const double *tx, const double *ty, int nt,
+             const double *sx, const double *sy, const double *q, int ns, double *v);
+
+    // scale sigma = lambda 2^(-level) / 2 of the series of a level
+    double getSigma(int level) { return 0.5*lambda*TranslationOperators::getScale(level); };
+
+    // modified Bessel functions of the orders 0, ..., n at x > 0, and the
+    // scaled functions I_k(x) k! / sigma^k and K_k(x) sigma^k / k!
+    static void   besselI(double x, int n, double *i);
+    static void   besselK(double x, int n, double *k);
+    static void   besselIScaled(double x, double sigma, int n, double *i);
+    static void   besselKScaled(double x, double sigma, int n, double *k);
+    static double besselK0(double x);
+
+  private:
+    static void   besselK01(double x, double &k0, double &k1);
+    // the scaled I_n(t) (regular) and K_n(t) (singular) for the orders
+    // n = -m, ..., m (value[m+n])
+    void getI(std::complex<double> t, int m, double sigma, std::vector<std::complex<double> > &value);
+    void getK(std::complex<double> t, int m, double sigma, std::vector<std::complex<double> > &value);
+    void apply(const std::vector<std::complex<double> > &matrix, const std::complex<double> *in,
+               std::complex<double> *out);
+};
+
+
+
+
+#endif /* YUKAWAKERNEL_H_ */
@@ -0,0 +1,124 @@
+/*
+ * fmm2d.h
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifndef FMM2D_H_
+#define FMM2D_H_
+
+/*
+ * Explanation of the C API:
+ *
+ * the FMM of FmmTree behind an opaque handle (a plan) for programs in C,
+ * Fortran (bind(C)), Python (ctypes) and other languages, in the libraries
+ * lib/libfmm2d.a and lib/libfmm2d.so (see the Makefile).  A plan is built once
+ * from the coordinates of the sources and the targets (the points are sorted
+ * into the boxes of an adaptive tree) and then applied to any number of charge
+ * vectors:
+ *
+ *   fmm2d_plan *plan;
+ *   fmm2d_plan_create(sx, sy, ns, tx, ty, nt, fmm2d_get_p(1e-6), 0, &plan);
+ *   fmm2d_plan_apply(plan, q, v);         (v[j] = sum_i q[i] log |y[j] - x[i]|)
+ *   fmm2d_plan_destroy(plan);
+ *
+ * - the points are in the unit square, 0 <= x < 1 and 0 <= y < 1 (the domain of
+ *   FmmTree); the caller scales its points (the potential of the points scaled
+ *   by 1/L differs by log L times the sum of the charges of the other points)
+ * - all arrays belong to the caller and are read or written in place: the
+ *   charges are gathered and the potentials scattered directly from and to
+ *   the arrays of the call, the coordinates are copied once into the sorted
+ *   arrays of the plan
+ * - the library has no global state: different plans can be used at the same
+ *   time from different threads, the calls for one plan must not overlap
+ * - the functions return FMM2D_SUCCESS or an error code, no exception leaves
+ *   the library
+ * The C++ API is FmmTree itself (FmmTree.h); fmm2d::Plan below is a small
+ * C++ owner of a plan of this API.
+ */
+
+#define FMM2D_API_VERSION 1
+
+/* orders p of the series accepted by fmm2d_plan_create (FmmTuning gives 4, ..., 32) */
+#define FMM2D_MIN_P 4
+#define FMM2D_MAX_P 64
+
+#define FMM2D_SUCCESS          0
+#define FMM2D_ERROR_ARGUMENT   1           /* NULL pointer, no points, a point outside the unit square or p out of range */
+#define FMM2D_ERROR_MEMORY     2           /* out of memory */
+#define FMM2D_ERROR_INTERNAL   3           /* any other error of the library */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fmm2d_plan fmm2d_plan;
+
+int  fmm2d_api_version(void);
+
+/* order of the series for a target error relative to the largest potential (FmmTuning::getP) */
+int  fmm2d_get_p(double relative_error);
+
+/* a plan for the sources (source_x[i], source_y[i]) and the targets (target_x[j], target_y[j]),
+ * p terms of the series (FMM2D_MIN_P <= p <= FMM2D_MAX_P) and at most max_points_per_box
+ * points in a leaf box (0: chosen for p by FmmTuning) */
+int  fmm2d_plan_create(const double *source_x, const double *source_y, int num_sources,
+                       const double *target_x, const double *target_y, int num_targets,
+                       int p, int max_points_per_box, fmm2d_plan **plan);
+
+/* potentials[j] = sum_i charges[i] log |y[j] - x[i]| (the pairs with x[i] = y[j] are skipped) */
+int  fmm2d_plan_apply(fmm2d_plan *plan, const double *charges, double *potentials);
+
+/* the same and the gradient of the potential (gradient[2j], gradient[2j+1]),
+ * either potentials or gradient can be NULL */
+int  fmm2d_plan_apply_field(fmm2d_plan *plan, const double *charges, double *potentials,
+                            double *gradient);
+
+/* new coordinates of the same points (time stepping, see FmmTree::update) */
+int  fmm2d_plan_update(fmm2d_plan *plan, const double *source_x, const double *source_y,
+                       const double *target_x, const double *target_y);
+
+/* threads of apply (OpenMP, 1 by default, 0 for the number of threads of OpenMP) */
+int  fmm2d_plan_set_num_threads(fmm2d_plan *plan, int num_threads);
+
+void fmm2d_plan_destroy(fmm2d_plan *plan);
+
+#ifdef __cplusplus
+}
+
+namespace fmm2d
+{
+  // owner of a plan of the C API (not copyable, the plan is destroyed with it)
+  class Plan
+  {
+    public:
+      Plan() : plan(0) {};
+      ~Plan() { fmm2d_plan_destroy(plan); };
+      Plan(const Plan &plan) = delete;
+      Plan& operator=(const Plan &plan) = delete;
+
+      int create(const double *sourceX, const double *sourceY, int numSources,
+                 const double *targetX, const double *targetY, int numTargets,
+                 int p, int maxPointsPerBox = 0)
+      {
+        fmm2d_plan_destroy(plan);
+        plan = 0;
+        return fmm2d_plan_create(sourceX, sourceY, numSources, targetX, targetY, numTargets,
+                                 p, maxPointsPerBox, &plan);
+      };
+      int apply(const double *charges, double *potentials)
+      { return fmm2d_plan_apply(plan, charges, potentials); };
+      int applyField(const double *charges, double *potentials, double *gradient)
+      { return fmm2d_plan_apply_field(plan, charges, potentials, gradient); };
+      int update(const double *sourceX, const double *sourceY, const double *targetX, const double *targetY)
+      { return fmm2d_plan_update(plan, sourceX, sourceY, targetX, targetY); };
+      int setNumThreads(int numThreads) { return fmm2d_plan_set_num_threads(plan, numThreads); };
+      fmm2d_plan* get() { return this->plan; };
+
+    private:
+      fmm2d_plan *plan;
+  };
+}
+#endif
+
+#endif /* FMM2D_H_ */
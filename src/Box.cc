@@ -58,8 +58,10 @@ using namespace std;
  *
  *
  * The series representing the mother function is truncated at the index value p.
- * - Therefore, the coefficient arrays: c, dtilde, and d will have a size of p+1
- *   (since the series index starts counting at zero).
+ * - Therefore, the coefficient arrays: c, dtilde, and d will have a size of p
+ *   (the series index starts counting at zero, so the terms are 0, 1, ..., p-1).
+ *   This is the same size as the coefficient vectors returned by the member
+ *   functions of class Potential, which are added into c, dtilde and d.
  * For each refinement level l, there are 4^l cells
  * - for l = 1, there are 4^1 = 4 cells
  * - for l = 2, there are 4^2 = 16 cells
@@ -84,19 +86,28 @@ class Box
     int DEFAULT_INDEX=0;
 
     int level;                             // refinement level of box
-    int index;                             // cell index of box (or cell)
+    long long index;                       // cell index of box (or cell), 64 bits for deep trees
     int p;                                 // p is the index at which the series are truncated
 
 //    unsigned int nParticlesPerCell = 4;    // points in each cell at lowest refinement level (l = L)
 //    int totalParticles;                     // total particles in domain (unit square)
 
 
-    bool empty;                            // is box empty
+    bool empty;                            // is box empty (no source and no target points)
 
+    std::complex<double> center;           // center of box (computed when the level or index is set)
 
-    std::vector<std::complex<double> > c;
-    std::vector<std::complex<double> > dtilde;
-    std::vector<std::complex<double> > d;
+
+    // coefficients (p terms) of the S-expansion c, of the R-expansion dtilde from
+    // the interaction list and of the R-expansion d of the box.  The box does
+    // not own them: they are views into the coefficient arena of the level of
+    // the box, which is owned by FmmTree (see FmmTree::allocateCoefficients),
+    // and are NULL until setCoefficients is called.  getC, getD and getDtilde
+    // return the storage itself, so the passes of FmmTree can add to the
+    // coefficients in place (see Potential::applyTranslation)
+    std::complex<double> *c;
+    std::complex<double> *dtilde;
+    std::complex<double> *d;
 
     //
     // The number of source points (and target points) in a box will depend
@@ -104,64 +115,103 @@ class Box
     // per box.  As we work up through the levels to level l = 0, the number
     // of particles will increase by a multiple of 4 when going from one level
     // up to the next (four children for each parent)
+    //
+    // The points themselves are stored (sorted in Morton order) in the
+    // Particles arrays of FmmTree.  A box only keeps the range of positions
+    // [xBegin, xEnd) of its source points and [yBegin, yEnd) of its target points
+
+    int xBegin;            // first source point of box
+    int xEnd;              // one past the last source point of box
+    int yBegin;            // first target point of box
+    int yEnd;              // one past the last target point of box
+
+    // The boxes of a level are stored in FmmTree::tree_structure[level] in the
+    // (Morton) order of their index.  Only the boxes with source or target
+    // points are stored (and for an adaptive tree only the boxes that were
+    // created by subdividing a box with too many particles), so the position
+    // and the index of a box are in general different (see FmmTree::findBox).
 
-    std::vector<Point> x;  // source points
-    std::vector<Point> y;  // target points
+    int  parent;           // position of the parent at level-1 (-1 for the box at level 0)
+    int  firstChild;       // position of the first child at level+1 (-1 if box is a leaf)
+    int  numChildren;      // number of children (the children are next to each other)
+    bool leaf;             // box is not subdivided (its particles are handled by the box)
+
+    // The interaction lists of the boxes are stored by FmmTree
+    // (see FmmTree::buildInteractionLists and class InteractionList)
 
     // Creates a new instance of Node
     Box();
-    Box(int level, int index, int p);
+    Box(int level, long long index, int p);
 
     int       getLevel() { return level; };
     void      printLevel() { std::cout << "Box level is " << level << '\n'; };
-    void      setLevel(int i) { this->level = i; };
-    int       getIndex() { return index; };
+    void      setLevel(int i) { this->level = i; updateCenter(); };
+    long long getIndex() { return index; };
     void      printIndex() { std::cout << "Box index is " << index << '\n'; };
-    void      setIndex(int i) { this->index = i; };
-    Point     getCenter();
-    double    getSize() { return std::pow(2.0, -level); };
-
-    void      setP(int p) { this->p = p; };
+    void      setIndex(long long i) { this->index = i; updateCenter(); };
+    Point     getCenter() { return Point(center); };
+    double    getSize() { return std::ldexp(1.0, -level); };
+
+    void      setP(int p);
+    void      setCoefficients(std::complex<double> *c, std::complex<double> *dtilde,
+                              std::complex<double> *d)
+                { this->c = c; this->dtilde = dtilde; this->d = d; };
+    bool      hasCoefficients() { return c != NULL; };
     bool      isEmpty() { return empty; };
 
-    std::vector<std::complex<double> > getC() {return c; };
+    std::complex<double>*              getC() {return c; };
     void                               addToC(std::vector<std::complex<double> > &increment);
+    void                               addToC(const std::complex<double> *increment);
     std::string                        cToString();
     void                               printC();
 
-    std::vector<std::complex<double> > getD() {return d; };
+    std::complex<double>*              getD() {return d; };
     void                               addToD(const std::vector<std::complex<double> > &increment);
+    void                               addToD(const std::complex<double> *increment);
     std::string                        dToString();
     void                               printD();
 
-    std::vector<std::complex<double> > getDtilde() {return dtilde; };
+    std::complex<double>*              getDtilde() {return dtilde; };
     void                               addToDtilde(const std::vector<std::complex<double> > &increment);
+    void                               addToDtilde(const std::complex<double> *increment);
     std::string                        dtildeToString();
     void                               printDtilde();
 
 
-    void               addX(Point &p);
-    int                getSizeX() { return this->x.size(); };
-    std::vector<Point> getX() { return this->x; };
-    void               printSizeX() { std::cout << "Box sizeX is " << x.size() << "\n"; };
+    void               setRangeX(int begin, int end) { this->xBegin = begin; this->xEnd = end; updateEmpty(); };
+    int                getBeginX() { return this->xBegin; };
+    int                getEndX() { return this->xEnd; };
+    int                getSizeX() { return this->xEnd - this->xBegin; };
+    void               printSizeX() { std::cout << "Box sizeX is " << getSizeX() << "\n"; };
+
+    void               setRangeY(int begin, int end) { this->yBegin = begin; this->yEnd = end; updateEmpty(); };
+    int                getBeginY() { return this->yBegin; };
+    int                getEndY() { return this->yEnd; };
+    int                getSizeY() { return this->yEnd - this->yBegin; };
+    void               printSizeY() { std::cout << "Box sizeY is " << getSizeY() << "\n"; };
 
-    void               addY(Point &p);
-    int                getSizeY() { return this->y.size(); };
-    std::vector<Point> getY() { return this->y; };
-    void               printSizeY() { std::cout << "Box sizeY is " << y.size() << "\n"; };
+    int                getParent() { return this->parent; };
+    void               setParent(int i) { this->parent = i; };
+    int                getFirstChild() { return this->firstChild; };
+    int                getNumChildren() { return this->numChildren; };
+    void               setChildren(int first, int num) { this->firstChild = first; this->numChildren = num; };
+    bool               isLeaf() { return this->leaf; };
+    void               setLeaf(bool leaf) { this->leaf = leaf; };
 
     std::string        toString();
-    int                getParentIndex();
-    void               getNeighborsIndex        (std::vector<int> &neighbor_indexes);
-    void               getParentsNeighborsIndex (std::vector<int> &parents_neighbor_indexes);
+    long long          getParentIndex();
+    void               getNeighborsIndex        (std::vector<long long> &neighbor_indexes);
+    void               getParentsNeighborsIndex (std::vector<long long> &parents_neighbor_indexes);
 
-    void               getNeighborsE4Index      (std::vector<int> &neighborE4_indexes);
+    void               getNeighborsE4Index      (std::vector<long long> &neighborE4_indexes);
 
-    void               getChildrenIndex(std::vector<int> &children_indexes);
+    void               getChildrenIndex(std::vector<long long> &children_indexes);
 
   private:
 
-    void               getChildrenIndexOfBox(int levelOfBox, int indexOfBox, std::vector<int> &children_indexes_of_box);
+    void               getChildrenIndexOfBox(int levelOfBox, long long indexOfBox, std::vector<long long> &children_indexes_of_box);
+    void               updateEmpty() { this->empty = (xEnd == xBegin && yEnd == yBegin); };
+    void               updateCenter();
 
 };
 */
@@ -173,61 +223,79 @@ Box::Box()
    index(DEFAULT_INDEX),
    p(DEFAULT_P),
    empty(true),
-   c(p+1),
-   dtilde(p+1),
-   d(p+1)
+   center(0.0, 0.0),
+   c(NULL),
+   dtilde(NULL),
+   d(NULL),
+   xBegin(0),
+   xEnd(0),
+   yBegin(0),
+   yEnd(0),
+   parent(-1),
+   firstChild(-1),
+   numChildren(0),
+   leaf(true)
 {
-  for (int i=0; i<p; ++i)
-  {
-	// intiializing coefficients
-    c[i] = 0.0;
-    dtilde[i] = 0.0;
-    d[i] = 0.0;
-  }
+  // the coefficients are attached (and initialized with zeros) by FmmTree
+  // (see setCoefficients and FmmTree::allocateCoefficients)
+  updateCenter();
 }
 
 
-Box::Box(int level, int index, int p)
+Box::Box(int level, long long index, int p)
    :
    level(level),
    index(index),
    p(p),
    empty(true),
-   c(p+1),
-   dtilde(p+1),
-   d(p+1)
+   center(0.0, 0.0),
+   c(NULL),
+   dtilde(NULL),
+   d(NULL),
+   xBegin(0),
+   xEnd(0),
+   yBegin(0),
+   yEnd(0),
+   parent(-1),
+   firstChild(-1),
+   numChildren(0),
+   leaf(true)
 {
-  for (int i=0; i<p; ++i)
-  {
-	// intiializing coefficients
-    c[i] = 0.0;
-    dtilde[i] = 0.0;
-    d[i] = 0.0;
-  }
+  // the coefficients are attached (and initialized with zeros) by FmmTree
+  // (see setCoefficients and FmmTree::allocateCoefficients)
+  updateCenter();
 }
 
-Point Box::getCenter()
+// The center of the box is used by every expansion and translation of the
+// box, so it is computed once (when the level or the index of the box is set)
+// instead of each time getCenter is called
+void Box::updateCenter()
 {
   Util util;
   std::complex<double> ll_corner = util.uninterleave(this->index, this->level);
   std::complex<double> middle(0.5,0.5);
   ll_corner += middle;
   ll_corner *= getSize();
-  Point center(ll_corner);
-  return center;
+  this->center = ll_corner;
 }
 
 
 void Box::addToC(std::vector<std::complex<double> > &increment)
 {
-  for (unsigned int i=0; i<c.size(); ++i)
+  for (int i=0; i<p && c!=NULL; ++i)
+    c[i] = c[i] + increment[i];
+}
+
+void Box::addToC(const std::complex<double> *increment)
+{
+  for (int i=0; i<p && c!=NULL; ++i)
     c[i] = c[i] + increment[i];
 }
 
 std::string Box::cToString()
 {
   std::string ansc = "        C: ";
-  for (unsigned int i=0; i<c.size(); ++i)
+  for (int i=0; i<p && c!=NULL; ++i)
   {
     ansc+= "(" + std::to_string(c[i].real()) + " " + std::to_string(c[i].imag()) + ") ";
   }
@@ -241,14 +309,20 @@ void Box::printC()
 
 void Box::addToD(const std::vector<std::complex<double> > &increment)
 {
-  for (unsigned int i=0; i<d.size(); ++i)
+  for (int i=0; i<p && d!=NULL; ++i)
+    d[i] = d[i] + increment[i];
+}
+
+void Box::addToD(const std::complex<double> *increment)
+{
+  for (int i=0; i<p && d!=NULL; ++i)
     d[i] = d[i] + increment[i];
 }
 
 std::string Box::dToString()
 {
   std::string ansd = "        D: ";
-  for (unsigned int i=0; i<d.size(); ++i)
+  for (int i=0; i<p && d!=NULL; ++i)
   {
     ansd+= "(" + std::to_string(d[i].real()) + " " + std::to_string(d[i].imag()) + ") ";
   }
@@ -263,14 +337,20 @@ void Box::printD()
 
 void Box::addToDtilde(const std::vector<std::complex<double> > &increment)
 {
-  for (unsigned int i=0; i<dtilde.size(); ++i)
+  for (int i=0; i<p && dtilde!=NULL; ++i)
+    dtilde[i] = dtilde[i] + increment[i];
+}
+
+void Box::addToDtilde(const std::complex<double> *increment)
+{
+  for (int i=0; i<p && dtilde!=NULL; ++i)
     dtilde[i] = dtilde[i] + increment[i];
 }
 
 std::string Box::dtildeToString()
 {
   std::string ansdt = "        Dtilde: ";
-  for (unsigned int i=0; i<dtilde.size(); ++i)
+  for (int i=0; i<p && dtilde!=NULL; ++i)
   {
     ansdt+= "(" + std::to_string(dtilde[i].real()) + " " + std::to_string(dtilde[i].imag()) + ") ";
   }
@@ -283,14 +363,15 @@ void Box::printDtilde()
 }
 
 
-void Box::addX(Point &p)
-{
-  this->x.push_back(p);
-}
-
-void Box::addY(Point &p)
+// the truncation index p may be changed after the box has been constructed
+// The coefficient views no longer match the new p, so they are detached and
+// new coefficients have to be attached with setCoefficients
+void Box::setP(int p)
 {
-  this->y.push_back(p);
+  this->p = p;
+  c = NULL;
+  dtilde = NULL;
+  d = NULL;
 }
 
 std::string Box::toString()
@@ -299,7 +380,7 @@ std::string Box::toString()
   std::string ansc = "        C: ";
   std::string ansdt = "   Dtilde: ";
   std::string ansd = "        D: ";
-  for (unsigned int i=0; i<c.size(); ++i)
+  for (int i=0; i<p && c!=NULL; ++i)
   {
     ansc+= "(" + std::to_string(c[i].real()) + " " + std::to_string(c[i].imag()) + ") ";
     ansdt+="(" + std::to_string(dtilde[i].real()) + " " + std::to_string(dtilde[i].imag()) + ") ";
@@ -380,7 +461,7 @@ std::string Box::toString()
  *          We can see above that cell n=8 at l=2 has parent cell n=2 at l=1
  *
  */
-int Box::getParentIndex()
+long long Box::getParentIndex()
 {
   return index >> 2;
 }
@@ -511,7 +592,7 @@ int Box::getParentIndex()
  *
  */
 
-void Box::getNeighborsIndex(std::vector<int> &neighbor_indexes)
+void Box::getNeighborsIndex(std::vector<long long> &neighbor_indexes)
 {
   // Finding x,y increments (cell lengths) from the lower left corner of
   // the domain to the lower left corner of this Box (cell) using the uninterleave
@@ -521,17 +602,17 @@ void Box::getNeighborsIndex(std::vector<int> &neighbor_indexes)
   neighbor_indexes.resize(0);
   Util util;
 
-  std::complex<double> tmp = util.uninterleave(index,level);
-  int x = (int)tmp.real();
-  int y = (int)tmp.imag();
+  int x, y;
+  util.uninterleave(index, x, y);
+  long long cells = 1LL << level;              // cells along each side at this level
   for (int i=-1; i<=1; i++)
     for (int j=-1; j<=1; j++)
-      if (  (i!=0||j!=0) && x+i>=0 && x+i<std::pow(2, level) && y+j>=0 && y+j<std::pow(2, level))
+      if (  (i!=0||j!=0) && x+i>=0 && x+i<cells && y+j>=0 && y+j<cells)
         neighbor_indexes.push_back(util.interleave(x+i, y+j, level));
 }
 
  // see getNeighborsIndex above for explanation
- void Box::getParentsNeighborsIndex(std::vector<int> &parents_neighbor_indexes)
+ void Box::getParentsNeighborsIndex(std::vector<long long> &parents_neighbor_indexes)
  {
    // Finding x,y increments (cell lengths) from the lower left corner of
    // the domain to the lower left corner of this Box (cell) using the uninterleave
@@ -541,15 +622,15 @@ void Box::getNeighborsIndex(std::vector<int> &neighbor_indexes)
    parents_neighbor_indexes.resize(0);
    Util util;
 
-   int parent_index;
+   long long parent_index;
    parent_index = this->getParentIndex();
 
-   std::complex<double> tmp = util.uninterleave(parent_index, level-1);
-   int x = (int)tmp.real();
-   int y = (int)tmp.imag();
+   int x, y;
+   util.uninterleave(parent_index, x, y);
+   long long cells = 1LL << (level-1);          // cells along each side at the parent level
    for (int i=-1; i<=1; i++)
      for (int j=-1; j<=1; j++)
-       if (  (i!=0||j!=0) && x+i>=0 && x+i<std::pow(2, level-1) && y+j>=0 && y+j<std::pow(2, level-1))
+       if (  (i!=0||j!=0) && x+i>=0 && x+i<cells && y+j>=0 && y+j<cells)
          parents_neighbor_indexes.push_back(util.interleave(x+i, y+j, level-1));
  }
 
@@ -571,17 +652,17 @@ void Box::getNeighborsIndex(std::vector<int> &neighbor_indexes)
  * (4) comparing and removing the indices of this box's near neighbors from the list (set)
  *     of step (3)
  */
-void Box::getNeighborsE4Index(std::vector<int> &neighborE4_indexes)
+void Box::getNeighborsE4Index(std::vector<long long> &neighborE4_indexes)
 {
   neighborE4_indexes.resize(0);
 
   // getting the indexes of the near neighbors of this box
-  std::vector<int> neighbor_indexes;
+  std::vector<long long> neighbor_indexes;
   neighbor_indexes.resize(0);
   this->getNeighborsIndex(neighbor_indexes);
 
   // getting the (parent) indexes of the near neighbors of the parent of this box
-  std::vector<int> parents_neighbor_indexes;
+  std::vector<long long> parents_neighbor_indexes;
   parents_neighbor_indexes.resize(0);
   this->getParentsNeighborsIndex(parents_neighbor_indexes);
 
@@ -592,8 +673,8 @@ void Box::getNeighborsE4Index(std::vector<int> &neighborE4_indexes)
 
 
   // getting the (peer) indexes of the children of the neighbors of the parent
-  std::vector<int> parent_neighbor_children_indexes;
-  std::vector<int> box_children_indexes;
+  std::vector<long long> parent_neighbor_children_indexes;
+  std::vector<long long> box_children_indexes;
   parent_neighbor_children_indexes.resize(0);
   for (unsigned int i=0; i<parents_neighbor_indexes.size(); ++i)
   {
@@ -660,14 +741,14 @@ void Box::getNeighborsE4Index(std::vector<int> &neighborE4_indexes)
  *           (36 + 1 = 37 (ul), 36 + 2 = 38 (lr), and 36 + 3 = 39 (ur))
  *
  */
-void Box::getChildrenIndex(std::vector<int> &children_indexes)
+void Box::getChildrenIndex(std::vector<long long> &children_indexes)
 {
   children_indexes.resize(0);
   for (int i=0; i<4; ++i)
     children_indexes.push_back((this->index<<2)+i);
 }
 
-void Box::getChildrenIndexOfBox(int levelOfBox, int indexOfBox, std::vector<int> &children_indexes_of_box)
+void Box::getChildrenIndexOfBox(int levelOfBox, long long indexOfBox, std::vector<long long> &children_indexes_of_box)
 {
   // need to assert that levelOfBox is between 2 and 8
   // if refinement level is greater than 8, then bitwise operations will be incorrect (8 bits)
@@ -0,0 +1,1028 @@
+/*
+ * DistributedFmm.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#ifdef FMM2D_USE_MPI
+
+#include <complex>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+#include <mpi.h>
+
+#include "DistributedFmm.h"
+#include "FmmTree.h"
+#include "FmmStats.h"
+#include "Box.h"
+#include "Util.h"
+
+/**
+ * Header Interface for Class DistributedFmm
+ *
+class DistributedFmm
+{
+  public:
+    MPI_Comm comm;
+    int      rank;
+    int      numRanks;
+
+    // the partition level is refined by rebalance until no cell costs more than
+    // CELL_FRACTION of the average cost of a rank, at most to MAX_PARTITION_LEVEL
+    // (the coarse tree of every rank has all cells of the partition level)
+    static const int    MAX_PARTITION_LEVEL = 7;
+    static const double CELL_FRACTION;
+
+    int      numOfLevels;                  // levels of the uniform tree
+    int      partitionLevel;               // level of the cells split among the ranks
+    int      costLevel;                    // level of the cells of the keys and the costs
+    Potential potential;
+    int      numThreads;
+
+    // the cells cellStart[r], ..., cellStart[r+1]-1 of the partition level
+    // belong to rank r
+    std::vector<long long> cellStart;
+
+    FmmTree *tree;                         // tree of the points of this rank (owned points)
+
+    // routing of the points of the input of this rank (the u and v of apply) to
+    // the ranks that own them: the input point sendOrder[k] is the k-th point
+    // sent, sendCount[r] of them to rank r, and recvCount[r] owned points come
+    // from rank r (in this order).  Each owned point keeps its origin (rank,
+    // index in the input of that rank) so that the points can be moved again
+    std::vector<int> sourceSendOrder, sourceSendCount, sourceRecvCount;
+    std::vector<int> targetSendOrder, targetSendCount, targetRecvCount;
+    std::vector<long long> sourceKey;      // cell of the cost level of each input source
+    std::vector<long long> targetKey;      // cell of the cost level of each input target
+    std::vector<double> ownedSourceX, ownedSourceY, ownedTargetX, ownedTargetY;
+    std::vector<int>    ownedSourceOrigin, ownedSourceIndex, ownedTargetOrigin, ownedTargetIndex;
+
+    // ghost S-expansions (M2L below the partition level): the boxes of other
+    // ranks in the interaction lists of the boxes of this rank.  ghostC holds
+    // p coefficients for each of them (in the order of the Exchanges), and each
+    // entry of ghostM2L is (row of the box in the tree, ghost box, S|R offset
+    // index) with the level in ghostM2LLevel
+    std::vector<std::complex<double> > ghostC;
+    std::vector<int> ghostM2LRow, ghostM2LLevel, ghostM2LBox, ghostM2LOffset;
+
+    // ghost sources (P2P): the source points of the leaf boxes of other ranks
+    // that are neighbors of the leaf boxes of this rank, ghost leaf g has the
+    // points ghostStart[g], ..., ghostStart[g+1]-1, and each entry of ghostP2P is
+    // (position of the leaf box of this rank, ghost leaf)
+    std::vector<double> ghostX, ghostY, ghostCharge;
+    std::vector<int> ghostStart;
+    std::vector<int> ghostP2PLeaf, ghostP2PBox;
+
+    // Exchange of the ghost data with one other rank (point to point messages):
+    // the boxes (S-expansions) and the source ranges (charges) this rank sends
+    // to it, and the parts of ghostC and ghostCharge it receives from it
+    struct Exchange
+    {
+      int rank;
+      std::vector<std::pair<int,int> > sendBoxes;    // (level, position) in the tree
+      std::vector<std::pair<int,int> > sendRanges;   // [first, second) of the sorted sources
+      int sendCharges;                               // number of charges of sendRanges
+      int firstGhostBox, numGhostBoxes;              // part of ghostC (in boxes)
+      int firstGhostCharge, numGhostCharges;         // part of ghostCharge
+      std::vector<std::complex<double> > sendC;      // send buffers
+      std::vector<double> sendQ;
+    };
+    std::vector<Exchange> exchanges;
+
+    // coarse tree: c and d of all cells of the levels 0, ..., partitionLevel
+    std::vector<std::vector<std::complex<double> > > coarseC;
+    std::vector<std::vector<std::complex<double> > > coarseD;
+    std::vector<std::vector<char> > coarseNeeded;    // cell is an ancestor of a cell of this rank
+
+    std::vector<double> ownedCharge;       // charges and potentials of the owned points
+    std::vector<double> ownedPotential;
+
+    DistributedFmm(int level, const double *sourceX, const double *sourceY, int numSources,
+                   const double *targetX, const double *targetY, int numTargets,
+                   Potential &potential, MPI_Comm comm);
+    ~DistributedFmm();
+    DistributedFmm(const DistributedFmm &fmm) = delete;
+    DistributedFmm& operator=(const DistributedFmm &fmm) = delete;
+
+    void   apply(const double *u, double *v);   // charges and potentials of the input of this rank
+    bool   rebalance();                         // new partition from the costs of the boxes
+    void   setNumThreads(int n);
+
+    int    getOwner(long long cell);            // rank of a cell of the partition level
+    int    getNumOwnedSources() { return this->ownedSourceX.size(); };
+    int    getNumOwnedTargets() { return this->ownedTargetX.size(); };
+    double getImbalance();                      // largest cost of a rank / average cost
+    FmmTree& getTree() { return *this->tree; };
+
+  private:
+    std::vector<double> cellCost;          // cost of each cell of the cost level (all ranks)
+
+    int    getMinPartitionLevel();
+    long long getCostCell(int level, long long index);
+    std::vector<double> getCellWeight(int level);
+    void   partition(const std::vector<double> &weight);
+    void   distribute();
+    void   route(std::vector<long long> &key, std::vector<int> &sendOrder,
+                 std::vector<int> &sendCount, std::vector<int> &recvCount);
+    void   migrate(std::vector<double> &x, std::vector<double> &y,
+                   std::vector<int> &origin, std::vector<int> &index);
+    void   buildGhosts();
+    void   computeCosts();
+    void   coarsePasses();
+};
+ *
+ */
+
+/**
+ * Explanation of DistributedFmm
+ *
+ * Partition:
+ *
+ * The cells of the partition level P (at first the smallest level >= 2 with
+ * at least 16 cells for each rank, below the leaf level) are the units of the
+ * partition.  A cell and all boxes below it belong to one rank, the ranks
+ * getting contiguous ranges of the Morton index of the cells (cellStart), so
+ * the boxes of a rank are close to each other and few of their neighbors
+ * belong to other ranks.  The ranges are chosen so that each rank has about
+ * the same weight (see partition):
+ *  - first the number of points of each cell (sum over all ranks)
+ *  - then (rebalance) the cost of each cell, the floating point operations of
+ *    the interactions of the boxes of the cell (FmmStats::getFlopsPerInteraction
+ *    times the counts of the boxes of the tree of its rank, with the ghost
+ *    interactions, see computeCosts).  The costs are kept for the cells of a
+ *    finer cost level (the leaf level, at most MAX_PARTITION_LEVEL), and
+ *    rebalance refines P until no cell of P has more than CELL_FRACTION of
+ *    the cost of a rank, so that clustered points can be divided
+ *
+ * Each rank can start with any points.  Its points are sent to the ranks that
+ * own them (migrate), and for each apply the charges u of the points of its
+ * input are sent to their owners and the potentials v come back (route).
+ *
+ * The Passes of apply:
+ *
+ * The tree of a rank has the owned points only.  Below the partition level all
+ * boxes of a rank are complete (they have all points of their cell), so the
+ * upward pass of the tree gives the S-expansions of the boxes of the levels
+ * P, ..., numOfLevels-1, and the M2L of the tree is right for the boxes in the
+ * interaction lists that belong to the same rank.  The rest is:
+ *  [1] - the charges are sent to the ranks that own the points
+ *  [2] - the charges of the ghost sources (source points of the leaf boxes
+ *        of this rank that are neighbors of the leaf boxes of other ranks) are
+ *        sent, and the messages of the ghost data of the other ranks are posted
+ *  [3] - the upward pass of the tree
+ *  [4] - the S-expansions of the cells of the partition level are summed over
+ *        all ranks (MPI_Iallreduce, each cell has the S-expansion of its rank
+ *        and zero on the others) and the S-expansions of the ghost boxes (the
+ *        boxes of this rank in the interaction lists of the boxes of other
+ *        ranks, levels > P) are sent
+ *  [5] - while the messages are on their way, the M2L of the tree
+ *        (downwardPass1) and the near field of the owned points
+ *        (FmmTree::evaluateNear) are done
+ *  [6] - waiting for the messages
+ *  [7] - the M2L from the ghost S-expansions (levels > P), and the coarse tree
+ *        (coarsePasses): the M2M, M2L and L2L of the levels 2, ..., P for the
+ *        cells of this rank, the R-expansion of each cell of level P replacing
+ *        the one of the tree (the levels <= P of the tree only have the points
+ *        of this rank)
+ *  [8] - the near field of the ghost sources
+ *  [9] - the L2L and the evaluation of the tree (downwardPass2, evaluateFar)
+ *  [10] - the potentials are sent back to the ranks of the input points
+ *
+ * Every interaction of the serial FMM with the same number of levels is done
+ * once (on the rank of its target box), so the result is the one of FmmTree
+ * (up to rounding).  The coarse tree is computed by every rank, its cost
+ * is small since there are only about 16 cells for each rank.
+ */
+const double DistributedFmm::CELL_FRACTION = 0.125;
+
+DistributedFmm::DistributedFmm(int level, const double *sourceX, const double *sourceY, int numSources,
+                               const double *targetX, const double *targetY, int numTargets,
+                               Potential &potential, MPI_Comm comm)
+       :
+       comm(comm),
+       rank(0),
+       numRanks(1),
+       numOfLevels(level),
+       partitionLevel(2),
+       costLevel(2),
+       potential(potential),
+       numThreads(1),
+       tree(NULL)
+{
+  assert(level>=3 && "DistributedFmm level < 3");
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &numRanks);
+
+  partitionLevel = getMinPartitionLevel();
+  costLevel = std::max(partitionLevel, std::min(numOfLevels-1, (int)MAX_PARTITION_LEVEL));
+
+  // the input points are the first owned points (migrate sends them to their owners)
+  ownedSourceX.assign(sourceX, sourceX + numSources);
+  ownedSourceY.assign(sourceY, sourceY + numSources);
+  ownedTargetX.assign(targetX, targetX + numTargets);
+  ownedTargetY.assign(targetY, targetY + numTargets);
+  ownedSourceOrigin.assign(numSources, rank);
+  ownedTargetOrigin.assign(numTargets, rank);
+  ownedSourceIndex.resize(numSources);
+  ownedTargetIndex.resize(numTargets);
+  for (int i=0; i<numSources; ++i)
+    ownedSourceIndex[i] = i;
+  for (int i=0; i<numTargets; ++i)
+    ownedTargetIndex[i] = i;
+
+  double scale = std::ldexp(1.0, costLevel);
+  sourceKey.resize(numSources);
+  targetKey.resize(numTargets);
+  for (int i=0; i<numSources; ++i)
+    sourceKey[i] = Util::mortonKey((uint32_t)(sourceX[i]*scale), (uint32_t)(sourceY[i]*scale));
+  for (int i=0; i<numTargets; ++i)
+    targetKey[i] = Util::mortonKey((uint32_t)(targetX[i]*scale), (uint32_t)(targetY[i]*scale));
+
+  // first partition: the number of points of each cell
+  int shift = 2*(costLevel - partitionLevel);
+  std::vector<double> weight(1LL << 2*partitionLevel, 0.0);
+  for (int i=0; i<numSources; ++i)
+    weight[sourceKey[i] >> shift] += 1.0;
+  for (int i=0; i<numTargets; ++i)
+    weight[targetKey[i] >> shift] += 1.0;
+  MPI_Allreduce(MPI_IN_PLACE, weight.data(), weight.size(), MPI_DOUBLE, MPI_SUM, comm);
+  partition(weight);
+  distribute();
+
+  // second partition: the cost of each cell
+  rebalance();
+}
+
+DistributedFmm::~DistributedFmm()
+{
+  delete tree;
+}
+
+void DistributedFmm::setNumThreads(int n)
+{
+  numThreads = n;
+  tree->setNumThreads(n);
+  numThreads = tree->getNumThreads();
+}
+
+// the smallest level >= 2 with at least 16 cells for each rank (below the leaf level)
+int DistributedFmm::getMinPartitionLevel()
+{
+  int level = 2;
+  while (level < numOfLevels-1 && (1LL << 2*level) < 16LL*numRanks)
+    level++;
+  return level;
+}
+
+// the cell of the cost level of the box 'index' of level 'level': its ancestor,
+// or its first descendant if the box is above the cost level
+long long DistributedFmm::getCostCell(int level, long long index)
+{
+  if (level >= costLevel)
+    return index >> 2*(level - costLevel);
+  return index << 2*(costLevel - level);
+}
+
+// the costs of the cells of level 'level' <= costLevel
+std::vector<double> DistributedFmm::getCellWeight(int level)
+{
+  int shift = 2*(costLevel - level);
+  std::vector<double> weight(1LL << 2*level, 0.0);
+  for (unsigned int c=0; c<cellCost.size(); ++c)
+    weight[c >> shift] += cellCost[c];
+  return weight;
+}
+
+// rank that owns the cell 'cell' of the partition level
+int DistributedFmm::getOwner(long long cell)
+{
+  return std::upper_bound(cellStart.begin(), cellStart.end(), cell) - cellStart.begin() - 1;
+}
+
+// Explanation of partition:
+//
+// cell c of the partition level goes to the rank r whose part
+// [r*W/numRanks, (r+1)*W/numRanks) of the total weight W contains the middle of
+// the weight of the cell (in the Morton order of the cells).  The ranges are
+// contiguous and a rank can get no cells (more ranks than cells with weight).
+void DistributedFmm::partition(const std::vector<double> &weight)
+{
+  long long numCells = weight.size();
+  double total = 0.0;
+  for (long long c=0; c<numCells; ++c)
+    total += weight[c];
+
+  cellStart.assign(numRanks+1, numCells);
+  cellStart[0] = 0;
+  double sum = 0.0;
+  int r = 1;
+  for (long long c=0; c<numCells && r<numRanks; ++c)
+  {
+    while (r < numRanks && sum + 0.5*weight[c] >= total*r/numRanks)
+      cellStart[r++] = c;
+    sum += weight[c];
+  }
+}
+
+// Explanation of rebalance:
+//
+// a new partition with the cost of each cell (see computeCosts) as weight.
+// Only whole cells of the partition level are given to a rank, so a cell
+// that has a large part of the cost (a cluster of points) can not be split.
+// Starting from the smallest partition level, the level is therefore refined
+// (with more than one rank) while a cell costs more than CELL_FRACTION of the
+// average cost of a rank
+// (the costs of the cells of a level are the sums of the costs of the cost
+// level), up to the cost level.  If the partition is not the current one the
+// points are moved to their new ranks and the trees and the ghost data are
+// built again.  Returns true if the points were moved.  The partition only
+// depends on the points, so after FmmTree-like updates of many points it is
+// worth calling again.
+bool DistributedFmm::rebalance()
+{
+  std::vector<long long> oldStart = cellStart;
+  int oldLevel = partitionLevel;
+  double total = 0.0;
+  for (unsigned int c=0; c<cellCost.size(); ++c)
+    total += cellCost[c];
+
+  partitionLevel = getMinPartitionLevel();
+  std::vector<double> weight = getCellWeight(partitionLevel);
+  while (numRanks > 1 && partitionLevel < costLevel
+         && *std::max_element(weight.begin(), weight.end()) > CELL_FRACTION*total/numRanks)
+    weight = getCellWeight(++partitionLevel);
+  partition(weight);
+  if (partitionLevel == oldLevel && cellStart == oldStart)
+    return false;
+  distribute();
+  return true;
+}
+
+// largest cost of the cells of a rank / average cost of a rank
+double DistributedFmm::getImbalance()
+{
+  int shift = 2*(costLevel - partitionLevel);
+  double total = 0.0;
+  double largest = 0.0;
+  for (int r=0; r<numRanks; ++r)
+  {
+    double cost = 0.0;
+    for (long long c=cellStart[r] << shift; c<(cellStart[r+1] << shift); ++c)
+      cost += cellCost[c];
+    total += cost;
+    largest = std::max(largest, cost);
+  }
+  return total > 0.0 ? largest * numRanks / total : 1.0;
+}
+
+// Explanation of distribute:
+//
+// moving the owned points to their owners (migrate), the routing of the input
+// points (route), the tree of the owned points, the ghost data and the costs
+void DistributedFmm::distribute()
+{
+  migrate(ownedSourceX, ownedSourceY, ownedSourceOrigin, ownedSourceIndex);
+  migrate(ownedTargetX, ownedTargetY, ownedTargetOrigin, ownedTargetIndex);
+  route(sourceKey, sourceSendOrder, sourceSendCount, sourceRecvCount);
+  route(targetKey, targetSendOrder, targetSendCount, targetRecvCount);
+
+  delete tree;
+  tree = new FmmTree(numOfLevels, ownedSourceX.data(), ownedSourceY.data(), ownedSourceX.size(),
+                     ownedTargetX.data(), ownedTargetY.data(), ownedTargetX.size(), potential);
+  tree->setNumThreads(numThreads);
+
+  int p = potential.getP();
+  coarseC.resize(partitionLevel+1);
+  coarseD.resize(partitionLevel+1);
+  coarseNeeded.resize(partitionLevel+1);
+  for (int el=0; el<=partitionLevel; ++el)
+  {
+    coarseC[el].assign((size_t)p << 2*el, std::complex<double>(0.0));
+    coarseD[el].assign((size_t)p << 2*el, std::complex<double>(0.0));
+    coarseNeeded[el].assign(1LL << 2*el, 0);
+  }
+  if (tree->getNumOfLevels() > partitionLevel)
+    for (unsigned int k=0; k<tree->tree_structure[partitionLevel].size(); ++k)
+    {
+      Box& thisBox = tree->tree_structure[partitionLevel][k];
+      if (thisBox.getSizeY() == 0)
+        continue;
+      for (int el=partitionLevel; el>=2; --el)
+        coarseNeeded[el][thisBox.getIndex() >> 2*(partitionLevel-el)] = 1;
+    }
+
+  buildGhosts();
+  computeCosts();
+}
+
+// Explanation of route:
+//
+// the rank of each input point (from the cell 'key' of the point) and the order
+// in which the input points are sent (grouped by rank, in their input order in
+// each group), and the numbers of points sent to and received from each rank.
+// The owned points that a rank receives are therefore in the order of their
+// (rank, index) of origin, which is the order of the owned points (migrate).
+void DistributedFmm::route(std::vector<long long> &key, std::vector<int> &sendOrder,
+                           std::vector<int> &sendCount, std::vector<int> &recvCount)
+{
+  int numPoints = key.size();
+  std::vector<int> owner(numPoints);
+  sendCount.assign(numRanks, 0);
+  for (int i=0; i<numPoints; ++i)
+  {
+    owner[i] = getOwner(key[i] >> 2*(costLevel - partitionLevel));
+    sendCount[owner[i]]++;
+  }
+  std::vector<int> next(numRanks, 0);
+  for (int r=1; r<numRanks; ++r)
+    next[r] = next[r-1] + sendCount[r-1];
+  sendOrder.resize(numPoints);
+  for (int i=0; i<numPoints; ++i)
+    sendOrder[next[owner[i]]++] = i;
+
+  recvCount.assign(numRanks, 0);
+  MPI_Alltoall(sendCount.data(), 1, MPI_INT, recvCount.data(), 1, MPI_INT, comm);
+}
+
+// offsets of the parts of a buffer with the given numbers of entries
+static std::vector<int> getDisplacements(const std::vector<int> &count)
+{
+  std::vector<int> displacement(count.size() + 1, 0);
+  for (unsigned int r=0; r<count.size(); ++r)
+    displacement[r+1] = displacement[r] + count[r];
+  return displacement;
+}
+
+// Explanation of migrate:
+//
+// sends the owned points (coordinates and origin) to their owners for the
+// current cellStart, and sorts the points received by their origin (rank of
+// origin, index in the input of that rank)
+void DistributedFmm::migrate(std::vector<double> &x, std::vector<double> &y,
+                             std::vector<int> &origin, std::vector<int> &index)
+{
+  int numPoints = x.size();
+  double scale = std::ldexp(1.0, partitionLevel);
+  std::vector<int> owner(numPoints);
+  std::vector<int> sendCount(numRanks, 0);
+  for (int i=0; i<numPoints; ++i)
+  {
+    owner[i] = getOwner(Util::mortonKey((uint32_t)(x[i]*scale), (uint32_t)(y[i]*scale)));
+    sendCount[owner[i]]++;
+  }
+  std::vector<int> recvCount(numRanks, 0);
+  MPI_Alltoall(sendCount.data(), 1, MPI_INT, recvCount.data(), 1, MPI_INT, comm);
+  std::vector<int> sendDispl = getDisplacements(sendCount);
+  std::vector<int> recvDispl = getDisplacements(recvCount);
+
+  std::vector<double> sendX(numPoints), sendY(numPoints);
+  std::vector<int> sendOrigin(numPoints), sendIndex(numPoints);
+  std::vector<int> next(sendDispl.begin(), sendDispl.end()-1);
+  for (int i=0; i<numPoints; ++i)
+  {
+    int k = next[owner[i]]++;
+    sendX[k] = x[i];
+    sendY[k] = y[i];
+    sendOrigin[k] = origin[i];
+    sendIndex[k] = index[i];
+  }
+
+  int numReceived = recvDispl[numRanks];
+  std::vector<double> recvX(numReceived), recvY(numReceived);
+  std::vector<int> recvOrigin(numReceived), recvIndex(numReceived);
+  MPI_Alltoallv(sendX.data(), sendCount.data(), sendDispl.data(), MPI_DOUBLE,
+                recvX.data(), recvCount.data(), recvDispl.data(), MPI_DOUBLE, comm);
+  MPI_Alltoallv(sendY.data(), sendCount.data(), sendDispl.data(), MPI_DOUBLE,
+                recvY.data(), recvCount.data(), recvDispl.data(), MPI_DOUBLE, comm);
+  MPI_Alltoallv(sendOrigin.data(), sendCount.data(), sendDispl.data(), MPI_INT,
+                recvOrigin.data(), recvCount.data(), recvDispl.data(), MPI_INT, comm);
+  MPI_Alltoallv(sendIndex.data(), sendCount.data(), sendDispl.data(), MPI_INT,
+                recvIndex.data(), recvCount.data(), recvDispl.data(), MPI_INT, comm);
+
+  std::vector<std::pair<std::pair<int,int>, int> > order(numReceived);
+  for (int k=0; k<numReceived; ++k)
+    order[k] = std::make_pair(std::make_pair(recvOrigin[k], recvIndex[k]), k);
+  std::sort(order.begin(), order.end());
+  x.resize(numReceived);
+  y.resize(numReceived);
+  origin.resize(numReceived);
+  index.resize(numReceived);
+  for (int k=0; k<numReceived; ++k)
+  {
+    int from = order[k].second;
+    x[k] = recvX[from];
+    y[k] = recvY[from];
+    origin[k] = recvOrigin[from];
+    index[k] = recvIndex[from];
+  }
+}
+
+// Explanation of buildGhosts:
+//
+// [1] - for each box of the tree with target points on a level el > P, the
+//       boxes of its interaction list E_4 (children of the neighbors of its
+//       parent that are not its neighbors) that belong to other ranks are
+//       requested from their ranks, and for each leaf box with target points
+//       the neighbors that belong to other ranks
+// [2] - the requests are sent to the ranks (MPI_Alltoallv), and each rank
+//       answers with the boxes it has with source points (S-expansions) and
+//       with the number of source points of the leaf boxes
+// [3] - the boxes and the leaf boxes that have no source points are dropped,
+//       the source points of the leaf boxes are sent (once), and the
+//       Exchange of each rank keeps what is sent to it in each apply
+void DistributedFmm::buildGhosts()
+{
+  Util util;
+  int p = potential.getP();
+  int leafLevel = numOfLevels-1;
+  int treeLevels = tree->getNumOfLevels();
+
+  // requests: (rank, level, index) of the boxes and (rank, index) of the leaf boxes
+  std::vector<std::pair<int, std::pair<int,long long> > > boxRequest;
+  std::vector<std::pair<int, long long> > leafRequest;
+  // each pair (box of this rank, box of the other rank) before the requests are numbered
+  std::vector<int> m2lRow, m2lLevel, m2lOffset, p2pLeaf;
+  std::vector<std::pair<int, std::pair<int,long long> > > m2lBox;
+  std::vector<std::pair<int, long long> > p2pBox;
+
+  for (int el=partitionLevel; el<treeLevels; ++el)                                         // 1
+  {
+    int shift = 2*(el - partitionLevel);
+    int cells = 1 << el;
+    for (unsigned int k=0; k<tree->tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree->tree_structure[el][k];
+      if (thisBox.getSizeY() == 0)
+        continue;
+      int x, y;
+      util.uninterleave(thisBox.getIndex(), x, y);
+      // the M2L of the partition level and above is done by the coarse tree
+      for (int px=(x>>1)-1; el>partitionLevel && px<=(x>>1)+1; ++px)
+        for (int py=(y>>1)-1; py<=(y>>1)+1; ++py)
+        {
+          if (px < 0 || py < 0 || 2*px >= cells || 2*py >= cells)
+            continue;
+          for (int child=0; child<4; ++child)
+          {
+            int cx = 2*px + ((child >> 1) & 1);
+            int cy = 2*py + (child & 1);
+            int dx = cx - x;
+            int dy = cy - y;
+            if (std::abs(dx) <= 1 && std::abs(dy) <= 1)
+              continue;
+            long long index = Util::mortonKey(cx, cy);
+            int owner = getOwner(index >> shift);
+            if (owner == rank)
+              continue;
+            boxRequest.push_back(std::make_pair(owner, std::make_pair(el, index)));
+            m2lRow.push_back(tree->getRow(el, k));
+            m2lLevel.push_back(el);
+            m2lOffset.push_back(TranslationOperators::getOffsetIndex(dx, dy));
+            m2lBox.push_back(std::make_pair(owner, std::make_pair(el, index)));
+          }
+        }
+      if (el != leafLevel)
+        continue;
+      std::vector<long long> neighbors_indexes;
+      thisBox.getNeighborsIndex(neighbors_indexes);
+      for (unsigned int m=0; m<neighbors_indexes.size(); ++m)
+      {
+        int owner = getOwner(neighbors_indexes[m] >> shift);
+        if (owner == rank)
+          continue;
+        leafRequest.push_back(std::make_pair(owner, neighbors_indexes[m]));
+        p2pLeaf.push_back(k);
+        p2pBox.push_back(std::make_pair(owner, neighbors_indexes[m]));
+      }
+    }
+  }
+  std::sort(boxRequest.begin(), boxRequest.end());
+  boxRequest.erase(std::unique(boxRequest.begin(), boxRequest.end()), boxRequest.end());
+  std::sort(leafRequest.begin(), leafRequest.end());
+  leafRequest.erase(std::unique(leafRequest.begin(), leafRequest.end()), leafRequest.end());
+
+  // 2 - the requests (sorted by rank) go to the ranks
+  std::vector<int> boxSendCount(numRanks, 0), leafSendCount(numRanks, 0);
+  std::vector<int> boxLevel(boxRequest.size());
+  std::vector<long long> boxIndex(boxRequest.size()), leafIndex(leafRequest.size());
+  for (unsigned int i=0; i<boxRequest.size(); ++i)
+  {
+    boxSendCount[boxRequest[i].first]++;
+    boxLevel[i] = boxRequest[i].second.first;
+    boxIndex[i] = boxRequest[i].second.second;
+  }
+  for (unsigned int i=0; i<leafRequest.size(); ++i)
+  {
+    leafSendCount[leafRequest[i].first]++;
+    leafIndex[i] = leafRequest[i].second;
+  }
+  std::vector<int> boxRecvCount(numRanks), leafRecvCount(numRanks);
+  MPI_Alltoall(boxSendCount.data(), 1, MPI_INT, boxRecvCount.data(), 1, MPI_INT, comm);
+  MPI_Alltoall(leafSendCount.data(), 1, MPI_INT, leafRecvCount.data(), 1, MPI_INT, comm);
+  std::vector<int> boxSendDispl = getDisplacements(boxSendCount);
+  std::vector<int> boxRecvDispl = getDisplacements(boxRecvCount);
+  std::vector<int> leafSendDispl = getDisplacements(leafSendCount);
+  std::vector<int> leafRecvDispl = getDisplacements(leafRecvCount);
+
+  std::vector<int> askedLevel(boxRecvDispl[numRanks]);
+  std::vector<long long> askedIndex(boxRecvDispl[numRanks]), askedLeaf(leafRecvDispl[numRanks]);
+  MPI_Alltoallv(boxLevel.data(), boxSendCount.data(), boxSendDispl.data(), MPI_INT,
+                askedLevel.data(), boxRecvCount.data(), boxRecvDispl.data(), MPI_INT, comm);
+  MPI_Alltoallv(boxIndex.data(), boxSendCount.data(), boxSendDispl.data(), MPI_LONG_LONG,
+                askedIndex.data(), boxRecvCount.data(), boxRecvDispl.data(), MPI_LONG_LONG, comm);
+  MPI_Alltoallv(leafIndex.data(), leafSendCount.data(), leafSendDispl.data(), MPI_LONG_LONG,
+                askedLeaf.data(), leafRecvCount.data(), leafRecvDispl.data(), MPI_LONG_LONG, comm);
+
+  // the answers: 1 if the box has source points, the number of source points of a leaf box
+  std::vector<int> boxAnswer(askedLevel.size()), leafAnswer(askedLeaf.size());
+  std::vector<int> askedBoxPos(askedLevel.size()), askedLeafPos(askedLeaf.size());
+  for (unsigned int i=0; i<askedLevel.size(); ++i)
+  {
+    askedBoxPos[i] = tree->findBox(askedLevel[i], askedIndex[i]);
+    boxAnswer[i] = (askedBoxPos[i] >= 0
+                    && tree->tree_structure[askedLevel[i]][askedBoxPos[i]].getSizeX() > 0);
+  }
+  for (unsigned int i=0; i<askedLeaf.size(); ++i)
+  {
+    askedLeafPos[i] = tree->findBox(leafLevel, askedLeaf[i]);
+    leafAnswer[i] = askedLeafPos[i] >= 0 ? tree->tree_structure[leafLevel][askedLeafPos[i]].getSizeX() : 0;
+  }
+  std::vector<int> boxFound(boxRequest.size()), leafFound(leafRequest.size());
+  MPI_Alltoallv(boxAnswer.data(), boxRecvCount.data(), boxRecvDispl.data(), MPI_INT,
+                boxFound.data(), boxSendCount.data(), boxSendDispl.data(), MPI_INT, comm);
+  MPI_Alltoallv(leafAnswer.data(), leafRecvCount.data(), leafRecvDispl.data(), MPI_INT,
+                leafFound.data(), leafSendCount.data(), leafSendDispl.data(), MPI_INT, comm);
+
+  // 3 - the Exchange of each rank with ghost data in one of the two directions
+  exchanges.clear();
+  std::vector<int> exchangeOf(numRanks, -1);
+  for (int r=0; r<numRanks; ++r)
+    if (boxSendCount[r] + boxRecvCount[r] + leafSendCount[r] + leafRecvCount[r] > 0)
+    {
+      exchangeOf[r] = exchanges.size();
+      exchanges.push_back(Exchange());
+      Exchange& thisExchange = exchanges.back();
+      thisExchange.rank = r;
+      thisExchange.sendCharges = 0;
+      thisExchange.firstGhostBox = 0;
+      thisExchange.numGhostBoxes = 0;
+      thisExchange.firstGhostCharge = 0;
+      thisExchange.numGhostCharges = 0;
+    }
+
+  // what this rank sends (the boxes and leaf boxes it was asked for and has)
+  std::vector<int> coordCount(numRanks, 0);
+  std::vector<double> sendCoordX, sendCoordY;
+  for (int r=0; r<numRanks; ++r)
+  {
+    for (int i=boxRecvDispl[r]; i<boxRecvDispl[r+1]; ++i)
+      if (boxAnswer[i])
+        exchanges[exchangeOf[r]].sendBoxes.push_back(std::make_pair(askedLevel[i], askedBoxPos[i]));
+    for (int i=leafRecvDispl[r]; i<leafRecvDispl[r+1]; ++i)
+      if (leafAnswer[i] > 0)
+      {
+        Box& thisLeaf = tree->tree_structure[leafLevel][askedLeafPos[i]];
+        exchanges[exchangeOf[r]].sendRanges.push_back(std::make_pair(thisLeaf.getBeginX(), thisLeaf.getEndX()));
+        exchanges[exchangeOf[r]].sendCharges += thisLeaf.getSizeX();
+        coordCount[r] += thisLeaf.getSizeX();
+        for (int j=thisLeaf.getBeginX(); j<thisLeaf.getEndX(); ++j)
+        {
+          sendCoordX.push_back(tree->sources.xCoord[j]);
+          sendCoordY.push_back(tree->sources.yCoord[j]);
+        }
+      }
+  }
+
+  // what this rank receives: ghost boxes (numbered in the order of the
+  // requests) and ghost leaf boxes with their source points
+  std::vector<int> ghostBoxOf(boxRequest.size(), -1), ghostLeafOf(leafRequest.size(), -1);
+  std::vector<int> ghostCoordCount(numRanks, 0);
+  int numGhostBoxes = 0;
+  int numGhostLeaves = 0;
+  ghostStart.assign(1, 0);
+  for (int r=0; r<numRanks; ++r)
+  {
+    if (exchangeOf[r] < 0)
+      continue;
+    Exchange& thisExchange = exchanges[exchangeOf[r]];
+    thisExchange.firstGhostBox = numGhostBoxes;
+    for (int i=boxSendDispl[r]; i<boxSendDispl[r+1]; ++i)
+      if (boxFound[i])
+        ghostBoxOf[i] = numGhostBoxes++;
+    thisExchange.numGhostBoxes = numGhostBoxes - thisExchange.firstGhostBox;
+    thisExchange.firstGhostCharge = ghostStart.back();
+    for (int i=leafSendDispl[r]; i<leafSendDispl[r+1]; ++i)
+      if (leafFound[i] > 0)
+      {
+        ghostLeafOf[i] = numGhostLeaves++;
+        ghostStart.push_back(ghostStart.back() + leafFound[i]);
+      }
+    thisExchange.numGhostCharges = ghostStart.back() - thisExchange.firstGhostCharge;
+    ghostCoordCount[r] = thisExchange.numGhostCharges;
+  }
+  ghostC.assign((size_t)numGhostBoxes*p, std::complex<double>(0.0));
+  ghostX.resize(ghostStart.back());
+  ghostY.resize(ghostStart.back());
+  ghostCharge.assign(ghostStart.back(), 0.0);
+  std::vector<int> coordDispl = getDisplacements(coordCount);
+  std::vector<int> ghostCoordDispl = getDisplacements(ghostCoordCount);
+  MPI_Alltoallv(sendCoordX.data(), coordCount.data(), coordDispl.data(), MPI_DOUBLE,
+                ghostX.data(), ghostCoordCount.data(), ghostCoordDispl.data(), MPI_DOUBLE, comm);
+  MPI_Alltoallv(sendCoordY.data(), coordCount.data(), coordDispl.data(), MPI_DOUBLE,
+                ghostY.data(), ghostCoordCount.data(), ghostCoordDispl.data(), MPI_DOUBLE, comm);
+
+  // the pairs (box of this rank, ghost box) with data
+  ghostM2LRow.clear();
+  ghostM2LLevel.clear();
+  ghostM2LBox.clear();
+  ghostM2LOffset.clear();
+  for (unsigned int i=0; i<m2lBox.size(); ++i)
+  {
+    int request = std::lower_bound(boxRequest.begin(), boxRequest.end(), m2lBox[i]) - boxRequest.begin();
+    if (ghostBoxOf[request] < 0)
+      continue;
+    ghostM2LRow.push_back(m2lRow[i]);
+    ghostM2LLevel.push_back(m2lLevel[i]);
+    ghostM2LBox.push_back(ghostBoxOf[request]);
+    ghostM2LOffset.push_back(m2lOffset[i]);
+  }
+  ghostP2PLeaf.clear();
+  ghostP2PBox.clear();
+  for (unsigned int i=0; i<p2pBox.size(); ++i)
+  {
+    int request = std::lower_bound(leafRequest.begin(), leafRequest.end(), p2pBox[i]) - leafRequest.begin();
+    if (ghostLeafOf[request] < 0)
+      continue;
+    ghostP2PLeaf.push_back(p2pLeaf[i]);
+    ghostP2PBox.push_back(ghostLeafOf[request]);
+  }
+}
+
+// Explanation of computeCosts:
+//
+// the floating point operations of the interactions of the boxes of each cell
+// of the cost level on this rank (the ones of FmmTree::countInteractions for
+// the boxes below the cell, the ghost interactions included), summed over all
+// ranks into cellCost (each cell is on one rank).  A box above the cost level
+// is counted in its first descendant cell (see getCostCell), so its cost stays
+// in the right cell of the levels from its own level down.  The coarse tree is
+// the same on every rank and is not counted.
+void DistributedFmm::computeCosts()
+{
+  int p = potential.getP();
+  double p2m = FmmStats::getFlopsPerInteraction(FmmStats::P2M, p);
+  double m2m = FmmStats::getFlopsPerInteraction(FmmStats::M2M, p);
+  double m2l = FmmStats::getFlopsPerInteraction(FmmStats::M2L, p);
+  double l2l = FmmStats::getFlopsPerInteraction(FmmStats::L2L, p);
+  double l2p = FmmStats::getFlopsPerInteraction(FmmStats::L2P, p);
+  double p2p = FmmStats::getFlopsPerInteraction(FmmStats::P2P, p);
+
+  cellCost.assign(1LL << 2*costLevel, 0.0);
+  int treeLevels = tree->getNumOfLevels();
+  for (int el=partitionLevel; el<treeLevels; ++el)
+  {
+    for (unsigned int k=0; k<tree->tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree->tree_structure[el][k];
+      int row = tree->getRow(el, k);
+      double cost = m2l * (tree->vList.getEnd(row) - tree->vList.getBegin(row));
+      if (el > partitionLevel && thisBox.getSizeX() > 0)
+        cost += m2m;
+      if (el > partitionLevel && thisBox.getSizeY() > 0)
+        cost += l2l;
+      if (thisBox.isLeaf())
+      {
+        cost += p2m * thisBox.getSizeX() + l2p * thisBox.getSizeY();
+        for (int m=tree->uList.getBegin(row); m<tree->uList.getEnd(row); ++m)
+          cost += p2p * thisBox.getSizeY() * (tree->uList.getSecond(m) - tree->uList.getFirst(m));
+      }
+      cellCost[getCostCell(el, thisBox.getIndex())] += cost;
+    }
+  }
+  for (unsigned int i=0; i<ghostM2LRow.size(); ++i)
+  {
+    int el = ghostM2LLevel[i];
+    Box& thisBox = tree->tree_structure[el][ghostM2LRow[i] - tree->levelStart[el]];
+    cellCost[getCostCell(el, thisBox.getIndex())] += m2l;
+  }
+  for (unsigned int i=0; i<ghostP2PLeaf.size(); ++i)
+  {
+    int el = numOfLevels-1;
+    Box& thisLeaf = tree->tree_structure[el][ghostP2PLeaf[i]];
+    int numGhosts = ghostStart[ghostP2PBox[i]+1] - ghostStart[ghostP2PBox[i]];
+    cellCost[getCostCell(el, thisLeaf.getIndex())] += p2p * thisLeaf.getSizeY() * numGhosts;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, cellCost.data(), cellCost.size(), MPI_DOUBLE, MPI_SUM, comm);
+}
+
+// Explanation of coarsePasses:
+//
+// the levels 2, ..., P of the FMM on all cells (dense arrays): coarseC of the
+// partition level is the sum of the S-expansions of all ranks.
+//  [1] - M2M of the levels P-1, ..., 2 for all cells
+//  [2] - for the cells of the levels 2, ..., P that are ancestors of the cells
+//        of this rank with target points (coarseNeeded): M2L of the cells of the
+//        interaction list E_4 and L2L of the parent
+//  [3] - the R-expansion of each cell of this rank on the level P replaces the
+//        R-expansion (coefficients Dtilde) of the box of the tree, and the
+//        coefficients Dtilde of the levels < P of the tree are set to zero, so
+//        downwardPass2 of the tree gives the R-expansions of the coarse tree on
+//        level P and adds them to the levels below
+void DistributedFmm::coarsePasses()
+{
+  Util util;
+  int p = potential.getP();
+  int P = partitionLevel;
+
+  for (int el=P-1; el>=2; --el)                                                            // 1
+  {
+    long long cells = 1LL << 2*el;
+    std::fill(coarseC[el].begin(), coarseC[el].end(), std::complex<double>(0.0));
+    for (long long n=0; n<cells; ++n)
+      for (int k=0; k<4; ++k)
+        potential.applyTranslation(&tree->operators.getSS(k)[0],
+                                   &coarseC[el+1][(size_t)(4*n+k)*p], &coarseC[el][(size_t)n*p]);
+  }
+
+  for (int el=2; el<=P; ++el)                                                              // 2
+  {
+    long long cells = 1LL << 2*el;
+    int side = 1 << el;
+    std::fill(coarseD[el].begin(), coarseD[el].end(), std::complex<double>(0.0));
+    for (long long n=0; n<cells; ++n)
+    {
+      if (!coarseNeeded[el][n])
+        continue;
+      std::complex<double> *thisD = &coarseD[el][(size_t)n*p];
+      int x, y;
+      util.uninterleave(n, x, y);
+      for (int px=(x>>1)-1; px<=(x>>1)+1; ++px)
+        for (int py=(y>>1)-1; py<=(y>>1)+1; ++py)
+        {
+          if (px < 0 || py < 0 || 2*px >= side || 2*py >= side)
+            continue;
+          for (int child=0; child<4; ++child)
+          {
+            int cx = 2*px + ((child >> 1) & 1);
+            int cy = 2*py + (child & 1);
+            if (std::abs(cx - x) <= 1 && std::abs(cy - y) <= 1)
+              continue;
+            tree->applySR(el, TranslationOperators::getOffsetIndex(cx - x, cy - y),
+                          &coarseC[el][(size_t)Util::mortonKey(cx, cy)*p], thisD);
+          }
+        }
+      if (el > 2)
+        potential.applyTranslation(&tree->operators.getRR(n & 3)[0],
+                                   &coarseD[el-1][(size_t)(n >> 2)*p], thisD);
+    }
+  }
+
+  int treeLevels = std::min(tree->getNumOfLevels(), P+1);                                  // 3
+  for (int el=0; el<treeLevels; ++el)
+    for (unsigned int k=0; k<tree->tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree->tree_structure[el][k];
+      if (el < P)
+        std::fill(thisBox.getDtilde(), thisBox.getDtilde() + p, std::complex<double>(0.0));
+      else
+        std::copy(&coarseD[P][(size_t)thisBox.getIndex()*p],
+                  &coarseD[P][(size_t)thisBox.getIndex()*p] + p, thisBox.getDtilde());
+    }
+}
+
+// Explanation of apply:
+//
+// the potentials v at the targets of the input of this rank for the charges u
+// of the sources of the input of this rank, computed by all ranks together
+// (every rank calls apply), see the steps [1] - [10] above
+void DistributedFmm::apply(const double *u, double *v)
+{
+  const int CHARGE_TAG = 1;
+  const int COEFFICIENT_TAG = 2;
+  int p = potential.getP();
+  int P = partitionLevel;
+
+  // 1
+  std::vector<double> sendBuffer(sourceSendOrder.size());
+  for (unsigned int k=0; k<sourceSendOrder.size(); ++k)
+    sendBuffer[k] = u[sourceSendOrder[k]];
+  std::vector<int> sendDispl = getDisplacements(sourceSendCount);
+  std::vector<int> recvDispl = getDisplacements(sourceRecvCount);
+  ownedCharge.resize(recvDispl[numRanks]);
+  MPI_Alltoallv(sendBuffer.data(), sourceSendCount.data(), sendDispl.data(), MPI_DOUBLE,
+                ownedCharge.data(), sourceRecvCount.data(), recvDispl.data(), MPI_DOUBLE, comm);
+
+  // 2
+  std::vector<MPI_Request> requests;
+  for (unsigned int e=0; e<exchanges.size(); ++e)
+  {
+    Exchange& thisExchange = exchanges[e];
+    MPI_Request request;
+    if (thisExchange.numGhostCharges > 0)
+    {
+      MPI_Irecv(&ghostCharge[thisExchange.firstGhostCharge], thisExchange.numGhostCharges,
+                MPI_DOUBLE, thisExchange.rank, CHARGE_TAG, comm, &request);
+      requests.push_back(request);
+    }
+    if (thisExchange.numGhostBoxes > 0)
+    {
+      MPI_Irecv(&ghostC[(size_t)thisExchange.firstGhostBox*p], 2*p*thisExchange.numGhostBoxes,
+                MPI_DOUBLE, thisExchange.rank, COEFFICIENT_TAG, comm, &request);
+      requests.push_back(request);
+    }
+    if (thisExchange.sendCharges > 0)
+    {
+      thisExchange.sendQ.clear();
+      for (unsigned int i=0; i<thisExchange.sendRanges.size(); ++i)
+        for (int j=thisExchange.sendRanges[i].first; j<thisExchange.sendRanges[i].second; ++j)
+          thisExchange.sendQ.push_back(ownedCharge[tree->sources.index[j]]);
+      MPI_Isend(thisExchange.sendQ.data(), thisExchange.sendCharges, MPI_DOUBLE,
+                thisExchange.rank, CHARGE_TAG, comm, &request);
+      requests.push_back(request);
+    }
+  }
+
+  // 3
+  tree->stats.resetPasses();
+  tree->clearCoefficients();
+  tree->upwardPass(ownedCharge.data());
+
+  // 4
+  std::fill(coarseC[P].begin(), coarseC[P].end(), std::complex<double>(0.0));
+  if (tree->getNumOfLevels() > P)
+    for (unsigned int k=0; k<tree->tree_structure[P].size(); ++k)
+    {
+      Box& thisBox = tree->tree_structure[P][k];
+      std::copy(thisBox.getC(), thisBox.getC() + p, &coarseC[P][(size_t)thisBox.getIndex()*p]);
+    }
+  MPI_Request coarseRequest;
+  MPI_Iallreduce(MPI_IN_PLACE, coarseC[P].data(), 2*coarseC[P].size(), MPI_DOUBLE, MPI_SUM,
+                 comm, &coarseRequest);
+  for (unsigned int e=0; e<exchanges.size(); ++e)
+  {
+    Exchange& thisExchange = exchanges[e];
+    if (thisExchange.sendBoxes.empty())
+      continue;
+    thisExchange.sendC.resize(thisExchange.sendBoxes.size()*p);
+    for (unsigned int i=0; i<thisExchange.sendBoxes.size(); ++i)
+    {
+      Box& thisBox = tree->tree_structure[thisExchange.sendBoxes[i].first][thisExchange.sendBoxes[i].second];
+      std::copy(thisBox.getC(), thisBox.getC() + p, &thisExchange.sendC[i*p]);
+    }
+    MPI_Request request;
+    MPI_Isend(thisExchange.sendC.data(), 2*thisExchange.sendC.size(), MPI_DOUBLE,
+              thisExchange.rank, COEFFICIENT_TAG, comm, &request);
+    requests.push_back(request);
+  }
+
+  // 5
+  tree->downwardPass1();
+  tree->evaluateNear();
+
+  // 6
+  MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  MPI_Wait(&coarseRequest, MPI_STATUS_IGNORE);
+
+  // 7
+  for (unsigned int i=0; i<ghostM2LRow.size(); ++i)
+  {
+    int el = ghostM2LLevel[i];
+    Box& thisBox = tree->tree_structure[el][ghostM2LRow[i] - tree->levelStart[el]];
+    tree->applySR(el, ghostM2LOffset[i], &ghostC[(size_t)ghostM2LBox[i]*p], thisBox.getDtilde());
+  }
+  coarsePasses();
+
+  // 8
+  for (unsigned int i=0; i<ghostP2PLeaf.size(); ++i)
+  {
+    Box& thisLeaf = tree->tree_structure[numOfLevels-1][ghostP2PLeaf[i]];
+    int yBegin = thisLeaf.getBeginY();
+    int first = ghostStart[ghostP2PBox[i]];
+    tree->nearField.evaluate(&tree->targets.xCoord[yBegin], &tree->targets.yCoord[yBegin],
+                             thisLeaf.getSizeY(), &ghostX[first], &ghostY[first],
+                             &ghostCharge[first], ghostStart[ghostP2PBox[i]+1] - first,
+                             &tree->nearPart[yBegin]);
+  }
+
+  // 9
+  ownedPotential.resize(tree->targets.size());
+  tree->downwardPass2();
+  tree->evaluateFar(ownedPotential.data());
+
+  // 10
+  sendDispl = getDisplacements(targetRecvCount);
+  recvDispl = getDisplacements(targetSendCount);
+  std::vector<double> recvBuffer(targetSendOrder.size());
+  MPI_Alltoallv(ownedPotential.data(), targetRecvCount.data(), sendDispl.data(), MPI_DOUBLE,
+                recvBuffer.data(), targetSendCount.data(), recvDispl.data(), MPI_DOUBLE, comm);
+  for (unsigned int k=0; k<targetSendOrder.size(); ++k)
+    v[targetSendOrder[k]] = recvBuffer[k];
+}
+
+#endif /* FMM2D_USE_MPI */
@@ -0,0 +1,311 @@
+/*
+ * FmmStats.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+
+#if defined(FMM2D_USE_PERF_EVENT) && defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "FmmStats.h"
+
+/**
+ * Header Interface for Class FmmStats
+ *
+class FmmStats
+{
+  public:
+    static const int BUILD = 0;
+    static const int P2M = 1;
+    static const int M2M = 2;
+    static const int M2L = 3;
+    static const int P2L = 4;
+    static const int L2L = 5;
+    static const int L2P = 6;
+    static const int M2P = 7;
+    static const int P2P = 8;
+    static const int NUM_PHASES = 9;
+
+    double    time[NUM_PHASES];            // wall time (seconds)
+    long long count[NUM_PHASES];           // interactions (see FmmStats.cc)
+    long long flops[NUM_PHASES];           // floating point operations
+    long long cycles[NUM_PHASES];          // hardware counters (-1 if not measured)
+    long long instructions[NUM_PHASES];
+
+    std::vector<int>       boxesPerLevel;  // boxes of each level
+    std::vector<int>       leavesPerLevel; // leaf boxes of each level
+    std::vector<long long> m2lPerLevel;    // S|R translations of each level
+    long long              uListEntries;
+    long long              vListEntries;
+    long long              wListEntries;
+    long long              xListEntries;
+    size_t                 bytes;          // memory of the tree
+
+    FmmStats();
+
+    void        reset();
+    void        resetPasses();
+    double      getTotalTime();
+    long long   getTotalFlops();
+    static std::string getPhaseName(int phase);
+    static double      getFlopsPerInteraction(int phase, int p);
+    std::string toString();
+};
+*/
+
+/**
+ * Explanation of the statistics of FmmTree (FmmTree::getStats)
+ *
+ * The counts of the interactions only depend on the tree, so they are
+ * computed once when the tree is built (FmmTree::countInteractions) and the
+ * passes themselves only measure the time:
+ *  - P2M - source points of the leaf boxes        (one S-expansion each)
+ *  - M2M - child boxes with source points          (one S|S translation each)
+ *  - M2L - entries of the vLists                   (one S|R translation each)
+ *  - P2L - source points of the xList entries      (one R-expansion each)
+ *  - L2L - boxes with target points on the levels l >= 3 (one R|R translation each)
+ *  - L2P - target points of the leaf boxes on the levels l >= 2
+ *  - M2P - target points times wList entries       (one S-expansion evaluated each)
+ *  - P2P - target points times source points of the uList entries (pairs)
+ *
+ * The floating point operations are these counts times the operations of one
+ * interaction (getFlopsPerInteraction), counted from the loops of class
+ * Potential and class NearField, with a complex addition = 2, a complex
+ * multiplication = 6, a complex division by a real = 2, 1/z = 7 and a
+ * logarithm (real or complex) = 1 operation:
+ *  - translation (applyTranslation): p^2 complex multiply-adds and p additions
+ *    8 p^2 + 2 p (the L2L also adds dtilde to d, 2 p more)
+ *  - P2M (addSCoeff): 3 + 10 (p-1)
+ *  - P2L (addRCoeff): 16 + 10 (p-1)
+ *  - L2P (evalR, Horner): 3 + 8 (p-1)
+ *  - M2P (evalS, Horner): 21 + 8 (p-1)
+ *  - P2P (NearField::evaluate): dx, dy, r2, log, product and sum = 8
+ *
+ * When FmmTree is compiled with FMM2D_NO_STATS the passes are not timed (see
+ * PhaseTimer in FmmStats.h), the counts are still available.
+ */
+
+FmmStats::FmmStats()
+   :
+   uListEntries(0),
+   vListEntries(0),
+   wListEntries(0),
+   xListEntries(0),
+   bytes(0)
+{
+  reset();
+}
+
+void FmmStats::reset()
+{
+  for (int k=0; k<NUM_PHASES; ++k)
+  {
+    time[k] = 0.0;
+    count[k] = 0;
+    flops[k] = 0;
+    cycles[k] = -1;
+    instructions[k] = -1;
+  }
+  boxesPerLevel.clear();
+  leavesPerLevel.clear();
+  m2lPerLevel.clear();
+  uListEntries = 0;
+  vListEntries = 0;
+  wListEntries = 0;
+  xListEntries = 0;
+  bytes = 0;
+}
+
+void FmmStats::resetPasses()
+{
+  for (int k=BUILD+1; k<NUM_PHASES; ++k)
+  {
+    time[k] = 0.0;
+    cycles[k] = -1;
+    instructions[k] = -1;
+  }
+}
+
+double FmmStats::getTotalTime()
+{
+  double total = 0.0;
+  for (int k=BUILD+1; k<NUM_PHASES; ++k)
+    total += time[k];
+  return total;
+}
+
+long long FmmStats::getTotalFlops()
+{
+  long long total = 0;
+  for (int k=BUILD+1; k<NUM_PHASES; ++k)
+    total += flops[k];
+  return total;
+}
+
+std::string FmmStats::getPhaseName(int phase)
+{
+  static const char *names[NUM_PHASES]
+    = { "build", "P2M", "M2M", "M2L", "P2L", "L2L", "L2P", "M2P", "P2P" };
+  if (phase < 0 || phase >= NUM_PHASES)
+    return "unknown";
+  return names[phase];
+}
+
+double FmmStats::getFlopsPerInteraction(int phase, int p)
+{
+  switch (phase)
+  {
+    case P2M: return 3.0 + 10.0*(p-1);
+    case M2M: return 8.0*p*p + 2.0*p;
+    case M2L: return 8.0*p*p + 2.0*p;
+    case P2L: return 16.0 + 10.0*(p-1);
+    case L2L: return 8.0*p*p + 4.0*p;
+    case L2P: return 3.0 + 8.0*(p-1);
+    case M2P: return 21.0 + 8.0*(p-1);
+    case P2P: return 8.0;
+    default:  return 0.0;
+  }
+}
+
+// one line for each phase with its time, count, operations and rate,
+// and the counts of the boxes and lists of the tree
+std::string FmmStats::toString()
+{
+  std::ostringstream out;
+  for (int k=0; k<NUM_PHASES; ++k)
+  {
+    out << getPhaseName(k) << ": time " << time[k] << " s";
+    if (k != BUILD)
+    {
+      out << ", count " << count[k] << ", flops " << flops[k];
+      if (time[k] > 0.0)
+        out << ", " << flops[k] / time[k] * 1.0e-9 << " Gflop/s";
+    }
+    if (cycles[k] >= 0)
+      out << ", cycles " << cycles[k] << ", instructions " << instructions[k];
+    out << "\n";
+  }
+  out << "boxes per level:";
+  for (unsigned int l=0; l<boxesPerLevel.size(); ++l)
+    out << " " << boxesPerLevel[l];
+  out << "\nleaves per level:";
+  for (unsigned int l=0; l<leavesPerLevel.size(); ++l)
+    out << " " << leavesPerLevel[l];
+  out << "\nM2L per level:";
+  for (unsigned int l=0; l<m2lPerLevel.size(); ++l)
+    out << " " << m2lPerLevel[l];
+  out << "\nlist entries: u " << uListEntries << ", v " << vListEntries
+      << ", w " << wListEntries << ", x " << xListEntries << "\n";
+  out << "bytes: " << bytes << "\n";
+  return out.str();
+}
+
+// Explanation of HardwareCounters
+//
+// perf_event_open counts the cycles and the instructions of the calling thread
+// (only of the master thread when the passes use several threads).  Without
+// FMM2D_USE_PERF_EVENT (or on other systems) open returns false and the counts
+// of FmmStats stay -1.  The system can also forbid the counters
+// (/proc/sys/kernel/perf_event_paranoid), then open returns false as well.
+#if defined(FMM2D_USE_PERF_EVENT) && defined(__linux__)
+static int openCounter(unsigned long long config)
+{
+  struct perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool HardwareCounters::open()
+{
+  if (isOpen())
+    return true;
+  cyclesFd = openCounter(PERF_COUNT_HW_CPU_CYCLES);
+  instructionsFd = openCounter(PERF_COUNT_HW_INSTRUCTIONS);
+  if (cyclesFd < 0 || instructionsFd < 0)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void HardwareCounters::close()
+{
+  if (cyclesFd >= 0)
+    ::close(cyclesFd);
+  if (instructionsFd >= 0)
+    ::close(instructionsFd);
+  cyclesFd = -1;
+  instructionsFd = -1;
+}
+
+void HardwareCounters::read(long long &cycles, long long &instructions)
+{
+  cycles = -1;
+  instructions = -1;
+  if (!isOpen())
+    return;
+  long long value;
+  if (::read(cyclesFd, &value, sizeof(value)) == (ssize_t)sizeof(value))
+    cycles = value;
+  if (::read(instructionsFd, &value, sizeof(value)) == (ssize_t)sizeof(value))
+    instructions = value;
+}
+#else
+bool HardwareCounters::open() { return false; }
+void HardwareCounters::close() {}
+void HardwareCounters::read(long long &cycles, long long &instructions)
+{
+  cycles = -1;
+  instructions = -1;
+}
+#endif
+
+#ifndef FMM2D_NO_STATS
+PhaseTimer::PhaseTimer(FmmStats &stats, int phase, HardwareCounters &counters)
+   :
+   stats(stats),
+   phase(phase),
+   counters(counters),
+   startCycles(-1),
+   startInstructions(-1)
+{
+  if (counters.isOpen())
+    counters.read(startCycles, startInstructions);
+  start = std::chrono::steady_clock::now();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+  stats.time[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (counters.isOpen())
+  {
+    long long endCycles, endInstructions;
+    counters.read(endCycles, endInstructions);
+    if (startCycles >= 0 && endCycles >= 0)
+    {
+      if (stats.cycles[phase] < 0)
+      {
+        stats.cycles[phase] = 0;
+        stats.instructions[phase] = 0;
+      }
+      stats.cycles[phase] += endCycles - startCycles;
+      stats.instructions[phase] += endInstructions - startInstructions;
+    }
+  }
+}
+#endif
@@ -11,10 +11,26 @@
 #include <limits>
 #include <cmath>
 #include <cassert>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "FmmTree.h"
 #include "Box.h"
 #include "Point.h"
+#include "Particles.h"
+#include "TranslationOperators.h"
+#include "NearField.h"
+#include "InteractionList.h"
+#include "FmmStats.h"
+#include "TaskGraph.h"
+#include "GpuBackend.h"
+#include "Util.h"
 
 
 using namespace std;
@@ -25,50 +41,245 @@ using namespace std;
 class FmmTree
 {
   public:
-    int MAX_NUM_LEVEL=8;
+    int MAX_NUM_LEVEL=32;
     int DEFAULT_NUM_LEVEL=3;
 
+    // verbosity levels of the diagnostic messages (see setVerbosity)
+    static const int SILENT = 0;           // no output (default)
+    static const int INFO = 1;             // size of the tree, passes and statistics of each solve
+    static const int DEBUG = 2;            // also the tree structure and the coefficients of each source point
+
+    // schedulers of the passes of apply (see setScheduler)
+    static const int LEVELS = 0;           // level by level, one parallel loop for each phase and level
+    static const int TASKS = 1;            // a task for each box and phase, no barriers (see runTasks)
+
+    // engines of the S|R translations of apply (see setM2LEngine)
+    static const int MATRIX_M2L = 0;       // p x p complex matrix of each offset
+    static const int FACTORED_M2L = 1;     // scaled coefficients and the Pascal matrix
+
+    // precision of the near field and the translations of apply (see setPrecision)
+    static const int DOUBLE_PRECISION = 0; // all in double
+    static const int MIXED_PRECISION = 1;  // P2P and M2L in float, sums in double
+
     int dimension = 2;
 
-    int numOfLevels;                         // number of levels is l - 1
-    int currLevel;                           // current level is l
+    int numOfLevels;
+    int currLevel;
 
-    std::vector<Point> x;
-    std::vector<Point> y;
+    // the source points x and the target points y are only kept sorted in
+    // Morton order (the input order is in Particles::index)
+    Particles sources;                     // source points x sorted in Morton order
+    Particles targets;                     // target points y sorted in Morton order
 
     Potential potential;
+    TranslationOperators operators;        // S|S, S|R and R|R matrices of the tree
+    NearField nearField;                   // near field kernel (direct calculation, P2P)
 
     std::vector<std::vector<Box> > tree_structure;              // an array of structs
 
+    // coefficient arena of each level (see allocateCoefficients): the
+    // coefficients c, dtilde and d of all boxes of level l are stored in
+    // coefficients[l] (one allocation per level) and the boxes point into it
+    std::vector<std::vector<std::complex<double> > > coefficients;
+
     long numOpsIndirect;
     long numOpsDirect;
 
+    int numThreads;                        // threads used by the passes (see setNumThreads)
+    int scheduler;                         // LEVELS or TASKS
+    int m2lEngine;                         // MATRIX_M2L or FACTORED_M2L
+    int precision;                         // DOUBLE_PRECISION or MIXED_PRECISION
+
+    int verbosity;                         // SILENT, INFO or DEBUG
+    std::ostream *logStream;               // the diagnostic messages are written to *logStream
+
+    // counts and operations of the phases of the FMM (computed once for the
+    // tree) and the wall times of the constructor and of the last apply
+    FmmStats stats;
+    HardwareCounters counters;             // optional, see enableHardwareCounters
+    GpuBackend gpu;                        // optional, see enableGpu
+
+    // near field (P2P) and far field (L2P, M2P) parts of the potential at
+    // the sorted targets (one array each, reused by every apply)
+    std::vector<double> nearPart;
+    std::vector<double> farPart;
+    std::vector<std::complex<double> > phiPart;   // complex potential and field (see applyField)
+    std::vector<std::complex<double> > dphiPart;
+
+    // applyBatch: numRhs series for each box (coefficients c, dtilde and d of
+    // level l in batchCoefficients[l], see getBatchSeries), the sorted charges
+    // (numRhs for each source) and the potentials at the sorted targets
+    int numRhs;
+    std::vector<std::vector<std::complex<double> > > batchCoefficients;
+    std::vector<double> batchCharge;
+    std::vector<double> batchPart;
+
+    bool adaptive;                         // the tree was built with the adaptive constructor
+    int  maxParticlesPerBox;               // adaptive tree: boxes with more points are subdivided
+    std::vector<std::pair<int,int> > leaves;  // (level, position) of the leaf boxes
+
+    // interaction lists of the boxes (compressed sparse rows, built once by
+    // buildInteractionLists).  Box pos of level l is the row levelStart[l] + pos
+    std::vector<int> levelStart;
+    InteractionList vList;                 // (position, S|R offset index) of the E_4 boxes
+    InteractionList uList;                 // source range [xBegin, xEnd) of the near boxes
+    InteractionList wList;                 // (level, position) of the W boxes (adaptive tree)
+    InteractionList xList;                 // source range [xBegin, xEnd) of the X boxes (adaptive tree)
+
+    // scheduler TASKS: the task graph (built by the first apply, see
+    // buildTaskGraph), the box (level, position) of each task and the time of
+    // each thread in the phases (TASK_TIME_STRIDE values for each thread)
+    TaskGraph taskGraph;
+    std::vector<std::pair<int,int> > taskBox;
+    std::vector<double> taskTime;
+
+    // MIXED_PRECISION (built by the first apply after the tree or the points
+    // changed, see prepareMixed): the coordinates of the sorted points relative
+    // to the center of the bounding box of the points of their leaf box and the
+    // charges in float, the shift (target frame minus source frame) and the
+    // self interaction tolerance of each uList entry (three floats) and float
+    // copies of the S-expansions c of each level (stored [box][term])
+    bool mixedReady;
+    std::vector<float> sourceXFloat, sourceYFloat, chargeFloat;
+    std::vector<float> targetXFloat, targetYFloat;
+    std::vector<float> uListShift;
+    std::vector<std::vector<std::complex<float> > > coefficientsFloat;
+
     FmmTree();                                // Constructor
-    FmmTree(int level, Potential potential);  // Constructor
-    FmmTree(int level, std::vector<Point> source, std::vector<Point> target, Potential potential);
+    FmmTree(int level, std::vector<Point> &source, std::vector<Point> &target, Potential &potential);
+    FmmTree(std::vector<Point> &source, std::vector<Point> &target, Potential &potential,
+            int maxParticlesPerBox);          // adaptive tree
+    // the same from arrays of coordinates (for example of a ParticleFile)
+    FmmTree(int level, const double *sourceX, const double *sourceY, int numSources,
+            const double *targetX, const double *targetY, int numTargets, Potential &potential);
+    FmmTree(const double *sourceX, const double *sourceY, int numSources,
+            const double *targetX, const double *targetY, int numTargets, Potential &potential,
+            int maxParticlesPerBox);
+
+    // the boxes point into the coefficient arenas of the tree,
+    // so a tree can not be copied
+    FmmTree(const FmmTree &tree) = delete;
+    FmmTree& operator=(const FmmTree &tree) = delete;
 
     void initStruct();
+    void initAdaptiveStruct();
+    void buildBoxes(int maxLevel, int maxParticles);
+    void allocateCoefficients();
+    void clearCoefficients();
+    void buildInteractionLists();
+    // new coordinates of the same points (time stepping), false if the tree was built again
+    bool update(const double *sourceX, const double *sourceY,
+                const double *targetX, const double *targetY);
+    bool update(std::vector<Point> &source, std::vector<Point> &target);
 
-    int getNumOfLevels() { return this->numOfLevels; };
     int getClusterThreshold();
+    int getNumOfLevels() { return this->numOfLevels; };
+    void setNumThreads(int n);
+    int getNumThreads() { return this->numThreads; };
+    void setScheduler(int scheduler);
+    int getScheduler() { return this->scheduler; };
+    void setM2LEngine(int engine);
+    int getM2LEngine() { return this->m2lEngine; };
+    void setPrecision(int precision);
+    int getPrecision() { return this->precision; };
+    void setVerbosity(int level) { this->verbosity = level; };
+    int getVerbosity() { return this->verbosity; };
+    void setLogStream(std::ostream &out) { this->logStream = &out; };
+    bool isAdaptive() { return this->adaptive; };
+    int getNumOfLeaves() { return this->leaves.size(); };
+    int getNumOfSources() { return this->sources.size(); };
+    int getNumOfTargets() { return this->targets.size(); };
     int getIndex(std::vector<Point> &z, Point &p);
-    Box getBox(int level, int index) { return tree_structure[level][index]; };
+    int findBox(int level, long long index);
+    int getRow(int level, int pos) { return this->levelStart[level] + pos; };
+    Box getBox(int level, long long index);
+    FmmStats& getStats() { return this->stats; };
+    bool enableHardwareCounters();
+    bool enableGpu(int device);            // P2P and M2L of apply on a CUDA device
+    void disableGpu() { this->gpu.close(); };
+
 
     void printX ();
     void printY ();
     void printBoxInformation();
     void printTreeStructure();
     std::vector<double> solve(std::vector<double> &u);
+    std::vector<double> solve(std::vector<double> &u, FmmStats &stats);
+    void apply(const double *u, double *v);   // solve on the same tree with new charges
+    void applyField(const double *u, std::complex<double> *phi, std::complex<double> *dphi);
+    void solveField(std::vector<double> &u, std::vector<std::complex<double> > &phi,
+                    std::vector<std::complex<double> > &dphi);
+    void applyBatch(const double *u, int numRhs, double *v);   // numRhs charge vectors at once
+    std::vector<double> solveBatch(std::vector<double> &u, int numRhs);
     std::vector<double> solveDirect(std::vector<double> &u);
+    std::vector<double> solveDirect(std::vector<double> &u, const std::vector<int> &targetIndexes);
+    void solveDirectField(std::vector<double> &u, std::vector<std::complex<double> > &phi,
+                          std::vector<std::complex<double> > &dphi);
 
   private:
-    void upwardPass(std::vector<double> &u);
+    // the distributed FMM runs the passes of its local tree itself
+    // (the exchange of the ghost data is done between them)
+    friend class DistributedFmm;
+    // and KernelFmm its passes on the boxes and the lists of the tree
+    template <class Kernel> friend class KernelFmm;
+
+    void runPasses(const double *u);
+    void upwardPass(const double *u);
+    void evaluate(double *v);
+    void evaluateNear();                   // P2P part of evaluate (nearPart)
+    void evaluateFar(double *v);           // L2P and M2P parts of evaluate, v = nearPart + farPart
+    void evaluateField(std::complex<double> *phi, std::complex<double> *dphi);
+    void upwardPassBatch(const double *u);
+    void downwardPass1Batch();
+    void downwardPass2Batch();
+    void evaluateBatch(double *v);
+    // series of the box pos of level 'level' for applyBatch: part 0 (c),
+    // 1 (dtilde) or 2 (d), a p x numRhs matrix stored row by row
+    std::complex<double>* getBatchSeries(int level, int pos, int part)
+    { return &batchCoefficients[level][((size_t)part*tree_structure[level].size() + pos)*potential.getP()*numRhs]; };
     void downwardPass1();
     void downwardPass2();
 
+    // the work of one phase for one box (see the box kernels in FmmTree.cc)
+    void p2mBox(int level, int pos, bool dumpCoefficients);
+    void m2mBox(int level, int pos);
+    void m2lBox(int level, int pos);
+    void applySR(int level, int offsetIndex, const std::complex<double> *c, std::complex<double> *dtilde);
+    void applySRFloat(int level, int offsetIndex, const std::complex<float> *c, std::complex<double> *dtilde);
+    void p2lBox(int level, int pos);
+    void l2lBox(int level, int pos);
+    void l2pBox(int level, int pos);
+    void m2pBox(int level, int pos);
+    void p2pBox(int level, int pos);
+
+    // kinds (priorities) of the tasks of the scheduler TASKS
+    static const int UP_TASK = 0;          // P2M or M2M
+    static const int DOWN1_TASK = 1;       // M2L and P2L
+    static const int DOWN2_TASK = 2;       // L2L
+    static const int EVAL_TASK = 3;        // L2P and M2P
+    static const int NEAR_TASK = 4;        // P2P
+    static const int TASK_TIME_STRIDE = 16;   // >= FmmStats::NUM_PHASES, one cache line apart
+    void buildTaskGraph();
+    void runTasks(const double *u, double *v);
+    bool runGpuPasses(const double *u, double *v);   // false if the device failed
+    void runTask(int task, int thread);
+    double getTaskClock();
+    double directPotential(const double *u, int j, const std::vector<int> &sourcePos, long &ops);
+    void countInteractions();
+    void prepareMixed();
+    void storeFloatC(int level, int pos);
+    std::complex<float>* getFloatC(int level, int pos)
+    { return &coefficientsFloat[level][(size_t)pos*potential.getP()]; };
+
+    bool isNeighbor(int levelA, long long indexA, int levelB, long long indexB);
+    void addLeafLists(int level, int pos, int nLevel, int nPos);
+    void getLeafOrder(std::vector<std::pair<int,int> > &leafOrder);
+    bool moveParticles(Particles &particles, const double *x, const double *y, bool isSource,
+                       const std::vector<std::pair<int,int> > &leafOrder, long long &numMoved);
 };
 */
 
+
 // construct the most basic tree (number of refinement levels is 4)
 // that can still use FMM
 FmmTree::FmmTree()
@@ -76,7 +287,18 @@ FmmTree::FmmTree()
        numOfLevels(4),
        currLevel(numOfLevels-1),
        tree_structure(numOfLevels),
-       numOpsIndirect(0)
+       numOpsIndirect(0),
+       numOpsDirect(0),
+       numThreads(1),
+       scheduler(LEVELS),
+       m2lEngine(MATRIX_M2L),
+       precision(DOUBLE_PRECISION),
+       verbosity(SILENT),
+       logStream(&std::cout),
+       numRhs(0),
+       adaptive(false),
+       maxParticlesPerBox(0),
+       mixedReady(false)
 {}
 
 
@@ -97,515 +319,2581 @@ FmmTree::FmmTree(int level, std::vector<Point> &sources, std::vector<Point> &tar
        currLevel(numOfLevels-1),
        potential(potential),
        tree_structure(numOfLevels),
-       numOpsIndirect(0)
+       numOpsIndirect(0),
+       numOpsDirect(0),
+       numThreads(1),
+       scheduler(LEVELS),
+       m2lEngine(MATRIX_M2L),
+       precision(DOUBLE_PRECISION),
+       verbosity(SILENT),
+       logStream(&std::cout),
+       numRhs(0),
+       adaptive(false),
+       maxParticlesPerBox(0),
+       mixedReady(false)
 {
-  // need to assert that levelOfBox is between 0 and 8
-  // if refinement level is greater than 8, then bitwise operations will be incorrect (8 bits)
+  // need to assert that levelOfBox is between 0 and MAX_NUM_LEVEL
+  // the box indices of the highest refinement level MAX_NUM_LEVEL-1 have
+  // 2*31 = 62 bits and fit in a 64-bit integer (see Util::interleave)
   // a refinement level less than 0 does not make sense (not defined)
   // (series approximation convergence not guaranteed)
   // Note: level gives refinement level based on count beginning with 1
   //       levels l = 1, 2, 3, 4, ....
+  //       a uniform tree has 4^(level-1) boxes on its highest level, so
+  //       for a large level most of the boxes are empty (use the adaptive tree)
   assert(level>0 && "FmmTree level < 1");
-  assert(level<=8 && "FmmTree level > 8");
+  assert(level<=MAX_NUM_LEVEL && "FmmTree level > MAX_NUM_LEVEL");
 
-  unsigned int length = sources.size();
-  x.resize(length);
-  y.resize(length);
-  for (unsigned int i=0; i<length; ++i)
-  {
-    x[i] = sources[i];
-    y[i] = targets[i];
-  }
+  // the sources and the targets are independent sets of points (the numbers
+  // of points can be different), each is sorted into the boxes by itself
+  PhaseTimer timer(stats, FmmStats::BUILD, counters);
+  this->sources.sort(sources, numOfLevels-1);
+  this->targets.sort(targets, numOfLevels-1);
+  initStruct();
+}
+
+// Explanation of the adaptive Constructor FmmTree:
+//
+// Instead of refining all boxes to the same level, only the boxes with more
+// than maxParticlesPerBox source points or more than maxParticlesPerBox target
+// points are subdivided (see initAdaptiveStruct).  The number of levels is then
+// given by the densest cluster of points and a box can be a leaf on any level.
+// Empty children are not created.
+FmmTree::FmmTree(std::vector<Point> &sources, std::vector<Point> &targets, Potential &potential,
+                 int maxParticlesPerBox)
+       :
+       numOfLevels(1),
+       currLevel(0),
+       potential(potential),
+       tree_structure(1),
+       numOpsIndirect(0),
+       numOpsDirect(0),
+       numThreads(1),
+       scheduler(LEVELS),
+       m2lEngine(MATRIX_M2L),
+       precision(DOUBLE_PRECISION),
+       verbosity(SILENT),
+       logStream(&std::cout),
+       numRhs(0),
+       adaptive(true),
+       maxParticlesPerBox(maxParticlesPerBox),
+       mixedReady(false)
+{
+  assert(maxParticlesPerBox>0 && "FmmTree maxParticlesPerBox < 1");
+
+  PhaseTimer timer(stats, FmmStats::BUILD, counters);
+  this->sources.sort(sources, MAX_NUM_LEVEL-1);
+  this->targets.sort(targets, MAX_NUM_LEVEL-1);
+  initAdaptiveStruct();
+}
+
+// Explanation of the Constructors FmmTree from arrays of coordinates:
+//
+// the same trees for points given as separate arrays of x- and y-coordinates
+// (for example the columns of a memory mapped ParticleFile).  The points are
+// binned and sorted directly from the arrays (Particles::sort, with the
+// threads of OpenMP, the result does not depend on the number of threads),
+// no vector of Points is built and the arrays are not needed after the
+// constructor.  The charges and potentials of apply are then plain arrays too.
+FmmTree::FmmTree(int level, const double *sourceX, const double *sourceY, int numSources,
+                 const double *targetX, const double *targetY, int numTargets, Potential &potential)
+       :
+       numOfLevels(level),
+       currLevel(numOfLevels-1),
+       potential(potential),
+       tree_structure(numOfLevels),
+       numOpsIndirect(0),
+       numOpsDirect(0),
+       numThreads(1),
+       scheduler(LEVELS),
+       m2lEngine(MATRIX_M2L),
+       precision(DOUBLE_PRECISION),
+       verbosity(SILENT),
+       logStream(&std::cout),
+       numRhs(0),
+       adaptive(false),
+       maxParticlesPerBox(0),
+       mixedReady(false)
+{
+  assert(level>0 && "FmmTree level < 1");
+  assert(level<=MAX_NUM_LEVEL && "FmmTree level > MAX_NUM_LEVEL");
+
+  PhaseTimer timer(stats, FmmStats::BUILD, counters);
+  sources.sort(sourceX, sourceY, numSources, numOfLevels-1, 0);
+  targets.sort(targetX, targetY, numTargets, numOfLevels-1, 0);
   initStruct();
 }
 
+FmmTree::FmmTree(const double *sourceX, const double *sourceY, int numSources,
+                 const double *targetX, const double *targetY, int numTargets, Potential &potential,
+                 int maxParticlesPerBox)
+       :
+       numOfLevels(1),
+       currLevel(0),
+       potential(potential),
+       tree_structure(1),
+       numOpsIndirect(0),
+       numOpsDirect(0),
+       numThreads(1),
+       scheduler(LEVELS),
+       m2lEngine(MATRIX_M2L),
+       precision(DOUBLE_PRECISION),
+       verbosity(SILENT),
+       logStream(&std::cout),
+       numRhs(0),
+       adaptive(true),
+       maxParticlesPerBox(maxParticlesPerBox),
+       mixedReady(false)
+{
+  assert(maxParticlesPerBox>0 && "FmmTree maxParticlesPerBox < 1");
+
+  PhaseTimer timer(stats, FmmStats::BUILD, counters);
+  sources.sort(sourceX, sourceY, numSources, MAX_NUM_LEVEL-1, 0);
+  targets.sort(targetX, targetY, numTargets, MAX_NUM_LEVEL-1, 0);
+  initAdaptiveStruct();
+}
+
 /**
  * Explanation of initStruct()
  *
- * First For Loop:
+ * Sorting of the Particles:
  *
- * Incrementing on i (i is row number of the struct matrix as well as refinement level)
+ * The source particles x and the target particles y are copied (once, by the
+ * constructor) into the structure of arrays sources and targets (class
+ * Particles) and sorted there in the Morton order of their cell index n at the
+ * refinement level numOfLevels-1.
+ *  - getBoxIndex determines the cell index n for each particle x[i] (or y[i])
+ *  - the sorted arrays keep the index i of each particle in x (or y) so the
+ *    charge u[i] can be gathered and the potential v[i] scattered directly
  *
- * Each element of struct (let's say row number i) is initialized as a vector (column corresponding to the row)
- * of Box objects with its size being the number of cells for the refinement level i (4^i)
+ * The particles of a cell are contiguous in the sorted arrays.  Since the
+ * four children of a cell n at level i are the cells 4n, ..., 4n+3 at level i+1,
+ * the descendants of cell n at the level numOfLevels-1 are the cells
+ * n*4^(numOfLevels-1-i), ..., (n+1)*4^(numOfLevels-1-i) - 1, and these are also
+ * contiguous.  Each box therefore only stores the range (first, one past last)
+ * of its source particles and of its target particles (see Particles::getRange)
  *
- * Inside the first for loop is a second loop incrementing on j
- * (j is the column number of the struct matrix as well as the cell index n)
+ * Building the Boxes:
  *
- * Thinking of struct as a matrix.  Each element of the (matrix) struct is also
- * a Box object - Box(i,j,potential.getP()) where
+ * The boxes are created by buildBoxes, which subdivides every box with points
+ * until the level numOfLevels-1 is reached.  Only the boxes with source or target
+ * points are created (sparse storage).  Each element of struct (let's say row
+ * number i) is the vector of the Box objects Box(i,n,potential.getP()) for the
+ * occupied cells n of refinement level i, in the order of the cell index n, where
  * - i is the row number
  *   - with respect to the Box constructor this the refinement level
- * - j is the column number
- *   - with respect to the Box constructor this is the cell index
+ * - n is the cell index (not the column number, unless all 4^i cells are occupied)
  * - p is an integer from the potential object
  *   - with respect to the Box constructor this is the truncation index for the series approximation
  *
- * Second and Third For Loop:
- *
- * The second loop increments over i through each the source particle x[i].
- *  - For the refinement level numOfLevels-1, getBoxIndex determines the cell index n for each source particle x[i]
- *  - The addX member function of Box is called to add the source point x[i] to that cell (or box)
- *
- * The third loop increments over i through each the target particle y[i].
- *  - For the refinement level numOfLevels-1, getBoxIndex determines the cell index n for each source particle y[i]
- *  - The addY member function of Box is called to add the target point y[i] to that cell (or box)
+ * An empty box has no series (its coefficients would all be zero) and takes
+ * no part in the translations, so for sparsely occupied domains most of the
+ * 4^i cells of the finer levels are never allocated or visited.
+ * The boxes of level numOfLevels-1 are the leaves.
  *
  */
 
 void FmmTree::initStruct()
 {
-  int cells_in_tree_structure_i;
+  // the source and target particles were sorted into boxes (cells) for
+  // currLevel (numOfLevel-1) by the constructor
 
-  for (unsigned int i=0; i<tree_structure.size(); ++i)
-  {
-    // creating all 4^i cells (boxes) for refinement level i
-	cells_in_tree_structure_i = std::pow(4,i);
-    tree_structure[i].resize(cells_in_tree_structure_i);
-    // setting index, level and last term p in series sum for cell
-    // in tree_structure at level i
-    for (unsigned int j=0; j<tree_structure[i].size(); ++j)
-    {
-      tree_structure[i][j].setLevel(i);              // refinement level of box (cell) is i
-      tree_structure[i][j].setIndex(j);              // index of box (cell) is j
-      tree_structure[i][j].setP(potential.getP());
+  // every box with points is subdivided (down to level numOfLevels-1)
+  buildBoxes(numOfLevels-1, 0);
 
-    }
-  }
-  // using getBoxIndex to perform sorting of source and target particles
-  // into boxes (cells) for currLevel (numOfLevel-1)
-  std::cout << "x.size() = " << x.size() << "\n";
-  for (unsigned int i=0; i<x.size(); ++i)
-  {
-    tree_structure[numOfLevels-1][x[i].getBoxIndex(numOfLevels-1)].addX(x[i]);
-  }
-  for (unsigned int i=0; i<y.size(); ++i)
-    tree_structure[numOfLevels-1][y[i].getBoxIndex(numOfLevels-1)].addY(y[i]);
+  buildInteractionLists();
 
-}
+  // building the S|S, S|R and R|R translation matrices used by the passes
+  // (see TranslationOperators.cc), once for the tree
+  operators.build(potential);
 
-// getting the largest number of points (source x or target y) in a cell
-// for level numOfLevels-1 (highest refinement level when counting of l
-// starts with l = 0
-int FmmTree::getClusterThreshold()
-{
-  int ans = 0;
-  for (unsigned int i=0; i<tree_structure[numOfLevels-1].size(); ++i)
-  {
-    int xlength = tree_structure[numOfLevels-1][i].getSizeX();
-    int ylength = tree_structure[numOfLevels-1][i].getSizeY();
-    if (xlength>ans)
-      ans = xlength;
-    if (ylength>ans)
-      ans = ylength;
-  }
-  return ans;
+  countInteractions();
 }
 
-// returns index of p in vector z
-// point p must be a point in vector z
-// else index returned is ans = -1
-int FmmTree::getIndex(std::vector<Point> &z, Point &p)
+/**
+ * Explanation of initAdaptiveStruct()
+ *
+ * The particles are sorted (once, by the constructor) in the Morton order of
+ * their cell index at the highest refinement level MAX_NUM_LEVEL-1.  The particles of any box on any
+ * level are then contiguous in the sorted arrays (see initStruct) and the range
+ * of a box is found with Particles::getRange.  Only the boxes with more than
+ * maxParticlesPerBox source or target points are subdivided (see buildBoxes).
+ */
+void FmmTree::initAdaptiveStruct()
 {
-  int ans = -1;
-  for (unsigned int i=0; i<z.size(); ++i)
-    if (z[i].equals(p))
-    {
-      ans = i;
-      i = z.size();
-    }
-  return ans;
+  buildBoxes(MAX_NUM_LEVEL-1, maxParticlesPerBox);
+
+  buildInteractionLists();
+
+  operators.build(potential);
+
+  countInteractions();
 }
 
-void FmmTree::printX()
+/**
+ * Explanation of buildBoxes(maxLevel, maxParticles)
+ *
+ * The tree is built level by level starting with the box at level 0 (the unit
+ * square).  The particles must already be sorted at a level >= maxLevel.
+ *  [1] - for each box of level l (in the Morton order of the boxes)
+ *    [2] - if the box has more than maxParticles source points or target points
+ *          and level l+1 is not beyond maxLevel
+ *      [3] - for each of the four children 4n, ..., 4n+3 of the box (index n)
+ *        [4] - the children that have source or target points are added to
+ *              level l+1 (the children of a box are next to each other)
+ *      [5] - the box is no longer a leaf
+ *  [6] - the boxes of level l+1 are added to the tree if there are any
+ *
+ * Since the boxes of level l are in Morton order and the children of each box
+ * are added in the order 0, 1, 2, 3, the boxes of level l+1 are also in Morton
+ * order (see findBox).  With maxParticles = 0 every box with points is
+ * subdivided and all leaves are on level maxLevel (uniform tree).
+ */
+void FmmTree::buildBoxes(int maxLevel, int maxParticles)
 {
-  for (unsigned int i=0; i<x.size(); ++i)
+  tree_structure.assign(1, std::vector<Box>(1, Box(0, 0, potential.getP())));
+  tree_structure[0][0].setRangeX(0, sources.size());
+  tree_structure[0][0].setRangeY(0, targets.size());
+
+  for (unsigned int l=0; l<tree_structure.size(); ++l)
   {
-    std::string x_coords = this->x[i].coordToString();
-	std::cout << x_coords << '\n';
+    std::vector<Box> children;
+    for (unsigned int pos=0; pos<tree_structure[l].size(); ++pos)                          // 1
+    {
+      Box& thisBox = tree_structure[l][pos];
+      if ((int)l < maxLevel
+          && (thisBox.getSizeX() > maxParticles
+              || thisBox.getSizeY() > maxParticles))                                       // 2
+      {
+        int firstChild = children.size();
+        for (int k=0; k<4; ++k)                                                            // 3
+        {
+          long long childIndex = (thisBox.getIndex() << 2) + k;
+          int xBegin, xEnd, yBegin, yEnd;
+          sources.getRange(l+1, childIndex, xBegin, xEnd);
+          targets.getRange(l+1, childIndex, yBegin, yEnd);
+          if (xEnd > xBegin || yEnd > yBegin)                                              // 4
+          {
+            Box child(l+1, childIndex, potential.getP());
+            child.setParent(pos);
+            child.setRangeX(xBegin, xEnd);
+            child.setRangeY(yBegin, yEnd);
+            children.push_back(child);
+          }
+        }
+        thisBox.setChildren(firstChild, children.size()-firstChild);
+        thisBox.setLeaf(false);                                                            // 5
+      }
+    }
+    if (children.size() > 0)                                                               // 6
+      tree_structure.push_back(children);
   }
 
+  numOfLevels = tree_structure.size();
+  currLevel = numOfLevels-1;
+
+  allocateCoefficients();
 }
 
-void FmmTree::printY()
+/**
+ * Explanation of allocateCoefficients()
+ *
+ * Instead of three small arrays for each box, the coefficients of all boxes of
+ * a level are stored in one array coefficients[l] (arena) of the tree with
+ * 3 * (number of boxes of level l) * p entries:
+ *
+ *   [ c of box 0 | c of box 1 | ... | dtilde of box 0 | ... | d of box 0 | ... ]
+ *
+ * that is three blocks stored as [box][term], with the boxes in the (Morton)
+ * order of tree_structure[l].  Each box only holds pointers to its three
+ * parts (Box::setCoefficients).  The S-expansions of a level, which are read
+ * by the translations of downwardPass1, are then next to each other in memory,
+ * and resetting all coefficients of the tree (clearCoefficients) only fills
+ * one array per level with zeros.
+ */
+void FmmTree::allocateCoefficients()
 {
-  for (unsigned int i=0; i<x.size(); ++i)
+  int p = potential.getP();
+  coefficients.resize(tree_structure.size());
+  for (unsigned int l=0; l<tree_structure.size(); ++l)
   {
-    std::string y_coords = this->y[i].coordToString();
-	std::cout << y_coords << '\n';
+    int levelBoxes = tree_structure[l].size();
+    coefficients[l].assign(3*levelBoxes*p, std::complex<double>(0.0));
+    std::complex<double> *arena = &coefficients[l][0];
+    for (int k=0; k<levelBoxes; ++k)
+    {
+      tree_structure[l][k].setP(p);
+      tree_structure[l][k].setCoefficients(arena + k*p,
+                                           arena + (levelBoxes + k)*p,
+                                           arena + (2*levelBoxes + k)*p);
+    }
   }
+}
 
+// setting all coefficients c, dtilde and d of the tree to zero
+void FmmTree::clearCoefficients()
+{
+  for (unsigned int l=0; l<coefficients.size(); ++l)
+    std::fill(coefficients[l].begin(), coefficients[l].end(), std::complex<double>(0.0));
 }
 
-void FmmTree::printBoxInformation()
+// Explanation of findBox:
+//
+// returns the position of the box with cell index 'index' in tree_structure[level]
+// or -1 if there is no such box (the box is empty or it is inside a leaf box
+// of a lower level).  The boxes of a level are stored in the order of their
+// index (sorted array of the occupied cells), so a binary search is used.
+// When all 4^level boxes of the level are occupied the position is the index.
+int FmmTree::findBox(int level, long long index)
 {
-  for (unsigned int i=0; i<tree_structure[numOfLevels-1].size(); ++i)
+  if (level < 0 || level >= numOfLevels)
+    return -1;
+  std::vector<Box>& boxes = tree_structure[level];
+  if ((long long)boxes.size() == (1LL << 2*level))
+    return (int)index;
+
+  int lo = 0;
+  int hi = boxes.size();
+  while (lo < hi)
   {
-    std::cout << "For the Box at tree_structure[" << numOfLevels-1 << "][" << i << "]" << "\n";
-    tree_structure[numOfLevels-1][i].printLevel();
-    tree_structure[numOfLevels-1][i].printIndex();
-    tree_structure[numOfLevels-1][i].printSizeX();
-    tree_structure[numOfLevels-1][i].printSizeY();
+    int mid = (lo + hi) / 2;
+    if (boxes[mid].getIndex() < index)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  if (lo < (int)boxes.size() && boxes[lo].getIndex() == index)
+    return lo;
+  return -1;
 }
 
+Box FmmTree::getBox(int level, long long index)
+{
+  int pos = findBox(level, index);
+  assert(pos>=0 && "FmmTree::getBox no box with this level and index");
+  return tree_structure[level][pos];
+}
 
-//void FmmTree::printTreeStructure()
-//{
-//  for (int i=0; i<numOfLevels; ++i)
-//  {
-//    std::cout << 'tree structure level' << i
-//    		  << 'has ' << tree_structure[i].size() << 'cells' << '\n';
-    //for (unsigned int j=0; j<tree_structure[i].size(); ++j)
-    //  std::cout << 'cell[' << i << '][' << j << '] has '
-    //            << tree_structure[i][j].getSizeX() << 'points.'
-    //            << '\n';
-//  }
-//}
+// Explanation of isNeighbor:
+//
+// true if box indexA on level levelA and box indexB on level levelB touch
+// (share a side or a corner) or overlap.  The lower left corners and the
+// lengths of both boxes are given in cell lengths of the finer of the two levels.
+bool FmmTree::isNeighbor(int levelA, long long indexA, int levelB, long long indexB)
+{
+  Util util;
+  int level = std::max(levelA, levelB);
+  int cxA, cyA, cxB, cyB;
+  util.uninterleave(indexA, cxA, cyA);
+  util.uninterleave(indexB, cxB, cyB);
+  long long sizeA = 1LL << (level-levelA);
+  long long sizeB = 1LL << (level-levelB);
+  long long xA = cxA * sizeA;
+  long long yA = cyA * sizeA;
+  long long xB = cxB * sizeB;
+  long long yB = cyB * sizeB;
+  return xA <= xB + sizeB && xB <= xA + sizeA
+      && yA <= yB + sizeB && yB <= yA + sizeA;
+}
 
-std::vector<double> FmmTree::solve(std::vector<double> &u)
+/**
+ * Explanation of buildInteractionLists()
+ *
+ * The lists are the ones of the adaptive FMM (Carrier, Greengard and Rokhlin).
+ * For a uniform tree the lists wList and xList are empty, vList is the
+ * interaction list E_4 and uList is the box and its neighbors.
+ *  - vList (boxes at any level l >= 2) - the boxes at the same level which are
+ *    children of the neighbors of the parent and are not neighbors of the box
+ *  - uList (leaf boxes) - the leaf boxes that are neighbors of the leaf box
+ *    (including the box itself, neighbors can be on other levels)
+ *  - wList (leaf boxes) - boxes that are children of neighbors of a leaf box (or
+ *    their descendants) whose parent is a neighbor but who are not neighbors
+ *    of the leaf box
+ *  - xList (boxes at any level) - the leaf boxes that have the box in their wList
+ *
+ * The lists are built once for the tree and are stored for all boxes in
+ * compressed sparse rows (class InteractionList).  Each entry keeps what the
+ * passes need, so the passes do not compute any cell indices:
+ *  - vList: the position of the box and the index of its S|R matrix
+ *    (TranslationOperators::getOffsetIndex of the offset of the two boxes)
+ *  - uList and xList: the range of the source points of the box in the sorted
+ *    arrays sources (the passes only need the points)
+ *  - wList: the level and the position of the box (its S-expansion is needed)
+ *
+ * Only the boxes with source points are added to the lists, since the
+ * series of a box without source points is zero and a translation or direct
+ * calculation from it would only add zeros.  In the same way the lists of a
+ * box without target points are left empty: its R-expansion is never
+ * evaluated (none of its descendants has target points either), so the
+ * sources and the targets can be two different sets of points of any sizes
+ * and the work only depends on where each set has points.
+ *
+ * [1] - for each box with target points at a level l >= 2
+ *   [2] - for each neighbor of the parent (Box::getParentsNeighborsIndex) that
+ *         is in the tree and is not a leaf
+ *     [3] - each child with source points that is not a neighbor of the box
+ *           (the offset of the two boxes is more than one cell in x or y)
+ *           is added to the vList
+ * [4] - for each leaf box
+ *   [5] - each neighbor at the same level (colleague) that is in the tree is
+ *         looked at with addLeafLists
+ *   [6] - the box itself is added to its uList
+ *   (a leaf box without target points is still looked at, it can be in the
+ *    uList or the xList of a box with target points)
+ *
+ * Explanation of addLeafLists(level, pos, nLevel, nPos):
+ *
+ * the box nPos on level nLevel touches the leaf box pos on level level
+ *  - if it is a leaf it is added to the uList of the leaf box.  If it is on a
+ *    finer level, then it is not found as a colleague by the leaf box, so the
+ *    leaf box is also added to its uList
+ *  - otherwise each of its children that touches the leaf box is looked at in the
+ *    same way, and each child that does not touch the leaf box is well separated
+ *    from the leaf box (but not from its parent) and is added to the wList of
+ *    the leaf box.  The leaf box is added to the xList of the child.
+ */
+void FmmTree::buildInteractionLists()
 {
-  std::vector<double> answer;
-  std::cout << "Starting updward pass..." << "\n";
-  upwardPass(u);
-  std::cout << "Completed updward pass..." << "\n";
-  std::cout << "Starting downward pass 1..." << "\n";
-  downwardPass1();
-  std::cout << "Completed downward pass 1..." << "\n";
-  std::cout << "Starting downward pass 2..." << "\n";
-  downwardPass2();
-  std::cout << "Completed downward pass 2..." << "\n";
+  Util util;
 
-  // v is the answer to the potential calculation using FMM
-  // for each target y[i] (element of y), we will have calculated the potential
-  // v[i] due to all the sources x using FMM
-  std::vector<double> v;
-  v.resize(y.size());
+  levelStart.assign(numOfLevels+1, 0);
+  for (int el=0; el<numOfLevels; ++el)
+    levelStart[el+1] = levelStart[el] + tree_structure[el].size();
+  int numRows = levelStart[numOfLevels];
 
-  // Explanation of Nested For Loops in Code Below - could be separate member function of FmmTree
-  //
-  // [0] - for each box at the highest refinement level numOfLevels
-  //       (index starts on zero, so numOfLevels-1)
-  //   [1] - getting a reference thisBox for the box to be worked on
-  //   [2] - getting the target points yPoints of this box
-  //   [3] - if there are target points in this box
-  //     [4] - for each target point yPoints[j]
-  //       [5] - getting a reference thisY for the target point
-  //       [6] - declaring the regular part of the potential calculation
-  //             where the source points x[i] are far enough away from thisBox
-  //             that the potential calculation can be approximated by a series
-  //       [7] - retrieving series coefficients D (could be done outside this loop)
-  //       [8] - retrieving powers of R-expansion for thisY
-  //       [9] - for each of p terms of R-expansion series
-  //        [10] - calculating and adding the first p terms of the series - a
-  //               truncated approximation to the infinite series - and only
-  //               taking real part of series?
-  //      [11] - initializing the singular part of the potential calculation
-  //             where the source points x[i] are too close to approximate
-  //             the potential calculation with a series and the calculation
-  //             must be done directly
-  //      [12] - declaring and collecting the neighbors and this box's indices
-  //             in this line and the two lines above
-  //      [13] - for each near neighbor (including this box)
-  //        [14-15] - obtaining a reference thisNeighborsBox to neighor's box
-  //                  and x-values (sources) thisNeighborsX in neighbor's box
-  //        [16] - if there are source terms thisNeighborsX in neighbor's box
-  //          [17] - for each of the source terms thisNeighborsX[q]
-  //            [18-19] - getting reference thisX and thisU for thisNeighborsX[q]
-  //                      and the charge u for that source particle thisX
-  //            [20-22] - declaring and initializing coordinates for thisX and thisY
-  //            [23-25] - if thisX and thisY are not the same
-  //                      using relative and absolute comparison for the cases
-  //                      where thisXCoord and thisYCoord may be large or small
-  //                      if thisXCoord and thisYCoord are small then maxXYOne is 1
-  //                      and we are comparing absolutely and not relatively
-  //                      (relative comparison - percentages - could be smaller than
-  //                      machine epsilon
-  //              [26-28] - calculating the potential directly (singular part)
-  //                        for thisX on thisY (and taking only real part?)
-  //      [29] - once completing direct calculations on thisY for all sources thisX
-  //             in the near neighbors, then adding the result (singular part) to
-  //             the result from the series approximations to the potential calculation
-  //             for sources far enough away (regular part)
-  //             Making sure to put this final result in the same location (have same index value)
-  //             as the corresponding location (index value) of yPoints[j] = thisY in the vector
-  //             of target points y
-  //
-  for (unsigned int i=0; i<tree_structure[numOfLevels-1].size(); ++i)                       // 0
-  {
-    Box& thisBox = tree_structure[numOfLevels-1][i];                                        // 1
-    std::vector<Point> yPoints = thisBox.getY();                                            // 2
-    if (yPoints.size() > 0)                                                                 // 3
+  vList.clear();
+  uList.clear();
+  wList.clear();
+  xList.clear();
+
+  for (int el=2; el<numOfLevels; ++el)                                                     // 1
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
     {
-      for (unsigned int j=0; j<yPoints.size(); ++j)                                         // 4
+      Box& thisBox = tree_structure[el][k];
+      if (thisBox.getSizeY() == 0)
+        continue;
+      int x, y;
+      util.uninterleave(thisBox.getIndex(), x, y);
+      std::vector<long long> parents_neighbor_indexes;
+      thisBox.getParentsNeighborsIndex(parents_neighbor_indexes);
+      for (unsigned int j=0; j<parents_neighbor_indexes.size(); ++j)                       // 2
       {
-        Point& thisY = yPoints[j];                                                          // 5
-        double regPart = 0.0;                                                               // 6
-        std::vector<std::complex<double> > d = thisBox.getD();                              // 7
-
-        std::vector<std::complex<double> > rVec                                             // 8
-              = potential.getRVector(thisY.getCoord(), thisBox.getCenter().getCoord());
-        numOpsIndirect+=potential.getP();
-        for (unsigned int k=0; k<d.size(); ++k)                                             // 9
-        {
-          regPart += (d[k] * rVec[k]).real();                                               // 10
-          numOpsIndirect++;
-        }
-
-        double sinPart = 0.0;                                                               // 11
-        std::vector<int> neighbors_indexes_and_me;
-        thisBox.getNeighborsIndex(neighbors_indexes_and_me);
-        neighbors_indexes_and_me.push_back(thisBox.getIndex());                             // 12
-
-        for (unsigned int m=0; m<neighbors_indexes_and_me.size(); ++m)                      // 13
+        int pos = findBox(el-1, parents_neighbor_indexes[j]);
+        if (pos < 0 || tree_structure[el-1][pos].isLeaf())
+          continue;
+        Box& thisParentsNeighbor = tree_structure[el-1][pos];
+        int first = thisParentsNeighbor.getFirstChild();
+        for (int c=first; c<first+thisParentsNeighbor.getNumChildren(); ++c)               // 3
         {
-          Box& thisNeighborsBox
-              = tree_structure[numOfLevels-1][neighbors_indexes_and_me[m]];                 // 14
-          std::vector<Point> thisNeighborsX = thisNeighborsBox.getX();                      // 15
-          if (thisNeighborsX.size() > 0)                                                    // 16
-          {
-            for (unsigned int q=0; q<thisNeighborsX.size(); ++q)                            // 17
-            {
-              Point& thisX = thisNeighborsX[q];                                             // 18
-              double thisU = u[getIndex(x, thisX)];                                         // 19
-              std::complex<double> inc, thisYCoord, thisXCoord;                             // 20
-              thisYCoord = thisY.getCoord();                                                // 21
-              thisXCoord = thisX.getCoord();                                                // 22
-              double maxXY = std::max(std::abs(thisXCoord),
-            	                         std::abs(thisYCoord));
-              double maxXYOne = std::max(1.0,maxXY);                                        // 23
-              if (std::abs(thisYCoord-thisXCoord)
-                      <= std::numeric_limits<double>::epsilon()*maxXYOne)                   // 24
-              {
-                // Do nothing - thisYCoord and thisXCoord are the same point
-            	// (up to machine epsilon)
-            	// This can happen when the target and source points are the same
-            	// Specifically, this happens when thisNeighborsBox is thisBox
-            	// (last q-value), and thisX and thisY are a target point and
-            	// a source point in the same box (and the target and source
-            	// points are the same).
-              }
-              else // target and source points thisY and thisX are not the same             // 25
-              {
-                  inc = potential.direct(thisY.getCoord(), thisX.getCoord());               // 26
-                  inc = inc * thisU;                                                        // 27
-                  sinPart += inc.real();                                                    // 28
-                  numOpsIndirect++;
-              }
-            }
-          }
+          Box& child = tree_structure[el][c];
+          int cx, cy;
+          util.uninterleave(child.getIndex(), cx, cy);
+          int dx = cx - x;
+          int dy = cy - y;
+          if (std::abs(dx) > 1 || std::abs(dy) > 1)
+            if (child.getSizeX() > 0)
+              vList.add(getRow(el, k), c, TranslationOperators::getOffsetIndex(dx, dy));
         }
+      }
+    }
 
-        v[getIndex(y, thisY)] = sinPart + regPart;                                          // 29
+  for (int el=0; el<numOfLevels; ++el)                                                     // 4
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree_structure[el][k];
+      if (!thisBox.isLeaf())
+        continue;
+      std::vector<long long> neighbors_indexes;
+      thisBox.getNeighborsIndex(neighbors_indexes);
+      for (unsigned int m=0; m<neighbors_indexes.size(); ++m)                              // 5
+      {
+        int pos = findBox(el, neighbors_indexes[m]);
+        if (pos >= 0)
+          addLeafLists(el, k, el, pos);
       }
+      if (thisBox.getSizeX() > 0 && thisBox.getSizeY() > 0)
+        uList.add(getRow(el, k), thisBox.getBeginX(), thisBox.getEndX());                  // 6
     }
-  }
 
-  return v;
+  vList.finalize(numRows);
+  uList.finalize(numRows);
+  wList.finalize(numRows);
+  xList.finalize(numRows);
 
+  leaves.clear();
+  for (int el=0; el<numOfLevels; ++el)
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+      if (tree_structure[el][k].isLeaf())
+        leaves.push_back(std::make_pair(el, (int)k));
 }
 
-
-
-// Explanation of upwardPass:
-//
-// It seems like the original version of this function
-// should be separate from FmmTree and in another class,
-// since FmmTree has to pass itself as argument in thisBox.getParent(this)
-// However, a work around this pass of tree_structure
-// as an argument to thisBox.getParent(this) was made by only
-// getting indices from class Box member function getParent of parent.
-// This avoids the need to pass tree_structure since no
-// boxes are now being returned from thisBox.getParent(this).
-// The ability to obtain the actual box of the parent was the
-// purpose of passing tree_structure as an argument.
-// The same work arounds for getting children, parent's neighbors
-// and parent's neighbor's children were also done for the related
-// member functions of class Box
-
-void FmmTree::upwardPass(std::vector<double> &u)
+void FmmTree::addLeafLists(int level, int pos, int nLevel, int nPos)
 {
-  for (unsigned int i=0; i<tree_structure[numOfLevels-1].size(); ++i)
+  Box& thisBox = tree_structure[level][pos];
+  Box& thisNeighborsBox = tree_structure[nLevel][nPos];
+  if (thisNeighborsBox.isLeaf())
   {
-    Box& thisBox = tree_structure[numOfLevels-1][i];
-    std::vector<Point> xPoints = thisBox.getX();
-    if (xPoints.size() > 0)
-      for (unsigned int j=0; j<xPoints.size(); ++j)
-      {
-    	Point& thisX = xPoints[j];
-        std::vector<std::complex<double> >
-           B = potential.getSCoeff(thisX.getCoord(), thisBox.getCenter().getCoord());
-        numOpsIndirect++;
-        numOpsIndirect+=potential.getP();        // O(p) flops in getSCoeff
-                                                 // p*(1 subtraction, 1 pow, 1 division, 1 mult by -1)
-        double thisU = u[getIndex(x,thisX)];
-
-        for (unsigned int k=0; k<B.size(); ++k)
-        {
-          B[k] = B[k]*thisU;
-          std::cout << "B[" << k << "] = " << B[k] << "  ";
-          numOpsIndirect++;
-        }
-        thisBox.addToC(B);
-        numOpsIndirect+=potential.getP();
-      }
-
+    if (thisNeighborsBox.getSizeX() > 0 && thisBox.getSizeY() > 0)
+      uList.add(getRow(level, pos), thisNeighborsBox.getBeginX(), thisNeighborsBox.getEndX());
+    if (nLevel > level && thisBox.getSizeX() > 0 && thisNeighborsBox.getSizeY() > 0)
+      uList.add(getRow(nLevel, nPos), thisBox.getBeginX(), thisBox.getEndX());
+    return;
   }
-
-  // Here el stands for refinement level and
-  //      k  stands for box (cell) index
-  for (int el = numOfLevels-1; el>=2; --el)
+  int first = thisNeighborsBox.getFirstChild();
+  for (int c=first; c<first+thisNeighborsBox.getNumChildren(); ++c)
   {
-    std::cout << "Upward pass level " << +el << "\n";
-    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+    Box& child = tree_structure[nLevel+1][c];
+    if (isNeighbor(level, thisBox.getIndex(), nLevel+1, child.getIndex()))
+      addLeafLists(level, pos, nLevel+1, c);
+    else
     {
-      Box& thisBox = tree_structure[el][k];
-      int parentBoxLevel = el-1;
-      Box& parentBox = tree_structure[parentBoxLevel][thisBox.getParentIndex()];
-      numOpsIndirect++;
-      std::complex<double> from = thisBox.getCenter().getCoord();
-      numOpsIndirect++;
-      std::complex<double> to = parentBox.getCenter().getCoord();
-      numOpsIndirect++;
-
-      // translating the thisBox's series that has coeffs thisBoxC
-      // from its center at location 'from' = thisBox.getCenter().getCoord()
-      // to its parent's center at location 'to' = parentBox.getCenter().getCoord()
-      // The new series with parent center can be added to the parent's
-      // C series since the powers for each term of the two series are now the same
-      // see Math.cc file notes for the details
-      std::vector<std::complex<double> > newCoeffs
-        = potential.getSS(from, to, thisBox.getC());
-      parentBox.addToC(newCoeffs);
-      numOpsIndirect+=pow(potential.getP(),2);
-      numOpsIndirect+=potential.getP();
+      if (child.getSizeX() > 0 && thisBox.getSizeY() > 0)
+        wList.add(getRow(level, pos), nLevel+1, c);
+      if (thisBox.getSizeX() > 0 && child.getSizeY() > 0)
+        xList.add(getRow(nLevel+1, c), thisBox.getBeginX(), thisBox.getEndX());
     }
   }
-
 }
 
-// this pass is for the iteraction list E_4
-// (not the neighbors)
-void FmmTree::downwardPass1()
+/**
+ * Explanation of update(sourceX, sourceY, targetX, targetY)
+ *
+ * For time stepping: the points of the tree have moved (the same points in
+ * the same input order, new coordinates) and the tree is updated instead of
+ * being built again.  Usually most points stay in their leaf box and the
+ * boxes, the interaction lists and the translation matrices can all be kept:
+ *
+ * [1] - the leaf boxes are put in Morton order (getLeafOrder)
+ * [2] - for the sources and for the targets (moveParticles)
+ *   [3] - the new key of each point is computed and the points that are no
+ *         longer inside their leaf box are found
+ *   [4] - the points that stayed are still sorted, except inside a leaf box
+ *         of an adaptive tree (the keys are those of the finest level), and are
+ *         sorted by an insertion sort (the work is the number of points that
+ *         changed places).  The points that moved are sorted by their key, and
+ *         both are merged into the new sorted arrays.
+ *   [5] - the new leaf box of each point that moved is found by a binary search
+ *         over the leaf boxes.  If there is no such leaf box (the point moved
+ *         into an empty part of the domain), or the leaf box had no points of
+ *         this set (so it is not in the interaction lists), or (adaptive tree)
+ *         a leaf box would have more than 2 * maxParticlesPerBox points, the
+ *         boxes can not be kept
+ *   [6] - otherwise the ranges of the leaf boxes are set from their new
+ *         numbers of points, and the ranges of the other boxes are the ranges
+ *         of their children
+ *   [7] - (sources) the source ranges of the leaf boxes kept in the uList and
+ *         the xList are replaced by the new ones
+ * [8] - if the boxes can not be kept, the boxes and the lists are built again
+ *       from the sorted points (no sort, see buildBoxes) and the translation
+ *       matrices are only built for new levels (the matrices of a level do not
+ *       depend on the points)
+ *
+ * So there is no sort and, unless the boxes change, no search for neighbors;
+ * the work is a few passes through the points plus the sort of the points that
+ * moved.  The coefficients do not need to be marked, apply computes all of
+ * them for each charge vector.  A box that lost all of its points stays in
+ * the tree (until the boxes are built again) and only adds translations of
+ * zero series.
+ *
+ * Returns true if the boxes were kept and false if they were built again.
+ */
+bool FmmTree::update(const double *sourceX, const double *sourceY,
+                     const double *targetX, const double *targetY)
 {
-  std::vector<int> thisBoxNeighborsE4Indexes;
-  std::complex<double> from;
-  std::complex<double> to;
-
-  for (int el=2; el<numOfLevels; ++el)
+  stats.time[FmmStats::BUILD] = 0.0;
+  stats.cycles[FmmStats::BUILD] = -1;
+  stats.instructions[FmmStats::BUILD] = -1;
+  PhaseTimer timer(stats, FmmStats::BUILD, counters);
+  mixedReady = false;                    // the coordinates changed (see prepareMixed)
+  gpu.invalidate();                      // and the copy of the sorted points on the device
+
+  std::vector<std::pair<int,int> > leafOrder;
+  getLeafOrder(leafOrder);                                                                 // 1
+  long long numMoved = 0;
+  bool keepSources = moveParticles(sources, sourceX, sourceY, true, leafOrder, numMoved);  // 2
+  bool keepTargets = moveParticles(targets, targetX, targetY, false, leafOrder, numMoved);
+  bool kept = keepSources && keepTargets;
+
+  if (kept)
   {
+    if (numMoved > 0)
+      countInteractions();
+  }
+  else                                                                                     // 8
+  {
+    if (adaptive)
+      buildBoxes(MAX_NUM_LEVEL-1, maxParticlesPerBox);
+    else
+      buildBoxes(numOfLevels-1, 0);
+    buildInteractionLists();
+    if (potential.getP() != operators.p)
+      operators.build(potential);
+    countInteractions();
+  }
 
-	for (unsigned int k=0; k<tree_structure[el].size(); ++k)
-    {
-      // getting the neighbor indices and interaction list index
-      thisBoxNeighborsE4Indexes.resize(0);
-      Box& thisBox = tree_structure[el][k];
-      thisBox.getNeighborsE4Index(thisBoxNeighborsE4Indexes);
-
-      // translating the far field series with old coefficients C to
-      // a near field series with new coefficients Dtilde (see Main.cc notes)
-      for (unsigned int j=0; j<thisBoxNeighborsE4Indexes.size(); ++j)
-      {
-        Box& thisBoxE4Neighbor = tree_structure[el][thisBoxNeighborsE4Indexes[j]];
-        from = thisBoxE4Neighbor.getCenter().getCoord();
-        ++numOpsIndirect;
-        to = thisBox.getCenter().getCoord();
-        ++numOpsIndirect;
-
-        std::vector<std::complex<double> > newCoeffs
-                                           = potential.getSR(from, to, thisBoxE4Neighbor.getC());
+  if (verbosity >= INFO)
+    *logStream << "Update: " << numMoved << " points changed their leaf box, "
+               << (kept ? "boxes kept" : "boxes built again") << "\n";
+  return kept;
+}
 
-        thisBox.addToDtilde(newCoeffs);
-      }
+bool FmmTree::update(std::vector<Point> &source, std::vector<Point> &target)
+{
+  assert((int)source.size() == sources.size() && "FmmTree::update number of sources changed");
+  assert((int)target.size() == targets.size() && "FmmTree::update number of targets changed");
+  std::vector<double> sx(source.size()), sy(source.size());
+  std::vector<double> tx(target.size()), ty(target.size());
+  for (unsigned int i=0; i<source.size(); ++i)
+  {
+    sx[i] = source[i].getCoord().real();
+    sy[i] = source[i].getCoord().imag();
+  }
+  for (unsigned int i=0; i<target.size(); ++i)
+  {
+    tx[i] = target[i].getCoord().real();
+    ty[i] = target[i].getCoord().imag();
+  }
+  return update(sx.size() > 0 ? &sx[0] : NULL, sy.size() > 0 ? &sy[0] : NULL,
+                tx.size() > 0 ? &tx[0] : NULL, ty.size() > 0 ? &ty[0] : NULL);
+}
 
+// the (level, position) of the leaf boxes in Morton order (the order of their
+// points in the sorted arrays), a depth first walk with the children of each
+// box in their order
+void FmmTree::getLeafOrder(std::vector<std::pair<int,int> > &leafOrder)
+{
+  leafOrder.clear();
+  std::vector<std::pair<int,int> > stack(1, std::make_pair(0, 0));
+  while (!stack.empty())
+  {
+    int el = stack.back().first;
+    int pos = stack.back().second;
+    stack.pop_back();
+    Box& thisBox = tree_structure[el][pos];
+    if (thisBox.isLeaf())
+    {
+      leafOrder.push_back(std::make_pair(el, pos));
+      continue;
     }
-
+    int first = thisBox.getFirstChild();
+    for (int c=first+thisBox.getNumChildren()-1; c>=first; --c)
+      stack.push_back(std::make_pair(el+1, c));
   }
 }
 
-
-void FmmTree::downwardPass2()
+// steps [3] - [7] of update for the sources (isSource) or the targets.  The
+// points are always updated, false if the boxes can not be kept (then the
+// ranges of the boxes are not changed)
+bool FmmTree::moveParticles(Particles &particles, const double *x, const double *y, bool isSource,
+                            const std::vector<std::pair<int,int> > &leafOrder, long long &numMoved)
 {
-  std::complex<double> from, to;
-  std::vector<int> children_indexes;
+  int numPoints = particles.size();
+  unsigned int level = particles.level;
+  int numLeaves = leafOrder.size();
+
+  // the keys are computed in the input order (the order of x and y) and then
+  // gathered into the sorted order, x[i] * 2^level is the same as std::ldexp
+  std::vector<long long> inputKey(numPoints);
+  std::vector<long long> key(numPoints);
+  double scale = std::ldexp(1.0, level);
+  #pragma omp parallel num_threads(numThreads)
+  {
+    #pragma omp for schedule(static)
+    for (int i=0; i<numPoints; ++i)                                                        // 3
+      inputKey[i] = Util::mortonKey((uint32_t)(x[i]*scale), (uint32_t)(y[i]*scale));
+    #pragma omp for schedule(static)
+    for (int j=0; j<numPoints; ++j)
+      key[j] = inputKey[particles.index[j]];
+  }
 
-  for (unsigned int i=0; i<tree_structure[2].size(); ++i)
+  // keys [leafFirst[k], leafEnd[k]) of the points inside leaf box k, its
+  // current range and its new number of points
+  std::vector<long long> leafFirst(numLeaves), leafEnd(numLeaves);
+  std::vector<int> begin(numLeaves), end(numLeaves), count(numLeaves);
+  std::vector<int> stayed;                            // positions of the points that stayed
+  std::vector<std::pair<long long,int> > moved;       // (new key, position) of the other points
+  stayed.reserve(numPoints);
+  for (int k=0; k<numLeaves; ++k)
   {
-	std::vector<std::complex<double> > DtildeCoeffs
-	  = tree_structure[2][i].getDtilde();
-	tree_structure[2][i].addToD(DtildeCoeffs);
-    numOpsIndirect+=potential.getP();
+    Box& thisLeaf = tree_structure[leafOrder[k].first][leafOrder[k].second];
+    int shift = 2*(level - thisLeaf.getLevel());
+    leafFirst[k] = thisLeaf.getIndex() << shift;
+    leafEnd[k] = (thisLeaf.getIndex() + 1) << shift;
+    begin[k] = isSource ? thisLeaf.getBeginX() : thisLeaf.getBeginY();
+    end[k] = isSource ? thisLeaf.getEndX() : thisLeaf.getEndY();
+    count[k] = 0;
+    for (int j=begin[k]; j<end[k]; ++j)
+      if (key[j] < leafFirst[k] || key[j] >= leafEnd[k])
+        moved.push_back(std::make_pair(key[j], j));
+      else
+      {
+        stayed.push_back(j);
+        count[k]++;
+      }
   }
+  numMoved += moved.size();
 
-  for (int el=2; el<numOfLevels-1; ++el)
+  for (unsigned int a=1; a<stayed.size(); ++a)                                             // 4
+  {
+    int j = stayed[a];
+    unsigned int b = a;
+    for (; b>0 && key[stayed[b-1]] > key[j]; --b)
+      stayed[b] = stayed[b-1];
+    stayed[b] = j;
+  }
+  std::sort(moved.begin(), moved.end());
+
+  std::vector<double> xSorted(numPoints), ySorted(numPoints);
+  std::vector<int> indexSorted(numPoints);
+  std::vector<long long> keySorted(numPoints);
+  unsigned int s = 0;
+  unsigned int m = 0;
+  for (int pos=0; pos<numPoints; ++pos)
+  {
+    int from;
+    if (m == moved.size() || (s < stayed.size() && key[stayed[s]] <= moved[m].first))
+      from = stayed[s++];
+    else
+      from = moved[m++].second;
+    int i = particles.index[from];
+    xSorted[pos] = x[i];
+    ySorted[pos] = y[i];
+    indexSorted[pos] = i;
+    keySorted[pos] = key[from];
+  }
+  particles.xCoord.swap(xSorted);
+  particles.yCoord.swap(ySorted);
+  particles.index.swap(indexSorted);
+  particles.boxIndex.swap(keySorted);
+
+  if (moved.empty())
+    return true;
+  for (unsigned int a=0; a<moved.size(); ++a)                                              // 5
   {
-    for (unsigned int m=0; m<tree_structure[el].size(); ++m)
+    int k = std::upper_bound(leafFirst.begin(), leafFirst.end(), moved[a].first)
+            - leafFirst.begin() - 1;
+    if (k < 0 || moved[a].first >= leafEnd[k] || end[k] == begin[k])
+      return false;
+    count[k]++;
+  }
+  if (adaptive)
+    for (int k=0; k<numLeaves; ++k)
+      if (count[k] > 2*maxParticlesPerBox)
+        return false;
+
+  // new range of the leaf box that started at each position (sources, see [7])
+  std::vector<int> newBegin, newEnd;
+  if (isSource)
+  {
+    newBegin.assign(numPoints, 0);
+    newEnd.assign(numPoints, 0);
+  }
+  int first = 0;
+  for (int k=0; k<numLeaves; ++k)                                                          // 6
+  {
+    Box& thisLeaf = tree_structure[leafOrder[k].first][leafOrder[k].second];
+    if (isSource)
     {
-      Box& thisBox = tree_structure[el][m];
-      from = thisBox.getCenter().getCoord();
-      numOpsIndirect++;
-      children_indexes.resize(0);
-      thisBox.getChildrenIndex(children_indexes);
-      for (unsigned int k=0; k<children_indexes.size(); ++k)
+      if (end[k] > begin[k])
       {
-    	Box& thisBoxChild = tree_structure[el+1][children_indexes[k]];
-        to = thisBoxChild.getCenter().getCoord();
-        numOpsIndirect++;
-    	std::vector<std::complex<double> > newCoeffs
-    	  = potential.getRR(from, to, thisBox.getD());
-
-        thisBoxChild.addToD(newCoeffs);
-        numOpsIndirect+=std::pow(potential.getP(),2);
-
-    	std::vector<std::complex<double> > DtildeCoeffs
-    	  = thisBoxChild.getDtilde();
-        thisBoxChild.addToD(DtildeCoeffs);
-        numOpsIndirect+=potential.getP()*2;
-       }
+        newBegin[begin[k]] = first;
+        newEnd[begin[k]] = first + count[k];
+      }
+      thisLeaf.setRangeX(first, first + count[k]);
     }
+    else
+      thisLeaf.setRangeY(first, first + count[k]);
+    first += count[k];
   }
+  for (int el=numOfLevels-2; el>=0; --el)
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree_structure[el][k];
+      if (thisBox.isLeaf())
+        continue;
+      Box& firstChild = tree_structure[el+1][thisBox.getFirstChild()];
+      Box& lastChild = tree_structure[el+1][thisBox.getFirstChild() + thisBox.getNumChildren() - 1];
+      if (isSource)
+        thisBox.setRangeX(firstChild.getBeginX(), lastChild.getEndX());
+      else
+        thisBox.setRangeY(firstChild.getBeginY(), lastChild.getEndY());
+    }
 
+  if (isSource)                                                                            // 7
+  {
+    InteractionList *lists[2] = { &uList, &xList };
+    for (int l=0; l<2; ++l)
+      for (int e=0; e<lists[l]->size(); ++e)
+      {
+        int oldBegin = lists[l]->first[e];
+        if (lists[l]->second[e] == oldBegin)
+          continue;
+        lists[l]->first[e] = newBegin[oldBegin];
+        lists[l]->second[e] = newEnd[oldBegin];
+      }
+  }
+  return true;
 }
 
-
-std::vector<double> FmmTree::solveDirect(std::vector<double> &u)
+// Explanation of setNumThreads:
+//
+// Sets the number of threads used by the upward pass, the downward passes and
+// the near field calculation of solve (and by solveDirect).  The passes go
+// through the tree level by level and the boxes of a level are shared among
+// the threads.  A value n < 1 uses the number of threads given by OpenMP
+// (for example set with the environment variable OMP_NUM_THREADS).
+// Without OpenMP (code not compiled with -fopenmp) the passes are serial and
+// the number of threads is always 1.
+void FmmTree::setNumThreads(int n)
 {
-  std::vector<double> v(y.size());
-  std::complex<double> potential_direct_calculation;
+#ifdef _OPENMP
+  if (n < 1)
+    n = omp_get_max_threads();
+#else
+  n = 1;
+#endif
+  this->numThreads = n;
+}
 
-  for (unsigned int j=0; j<v.size(); ++j)
+// getting the largest number of points (source x or target y) in a leaf
+// box (for a uniform tree the boxes of level numOfLevels-1, the highest
+// refinement level when counting of l starts with l = 0)
+int FmmTree::getClusterThreshold()
+{
+  int ans = 0;
+  for (unsigned int i=0; i<leaves.size(); ++i)
   {
-    for (unsigned int i=0; i<x.size(); ++i)
-    {
-      // taking care of relative and absolute difference
-      // issues for when x[i] and y[j] are both small
-      // or both large (see explanation in FmmTree member function solve
-      // above)
-      double maxXY = std::max(std::abs(y[j].getCoord()),
-      	                         std::abs(x[i].getCoord()));
-      double maxXYOne = std::max(1.0,maxXY);
-      if (std::abs(y[j].getCoord()-x[i].getCoord())
-                <= std::numeric_limits<double>::epsilon()*maxXYOne)
-      {
-        // Do nothing - y[j] and x[i] are the same point
-    	// (up to machine epsilon)
-    	// This happens when the target and source points are the same.
-    	// Specifically, this happens when y[j] and x[i] are a target
-    	// point and a source point in the same box (and the target
-    	// and source points are the same).
-    	// Also, physically it does not make sense for a particle y[j] to act
-    	// on itself
-      }
-      else // target and source points y[j] and x[i] are not the same
-      {
-        potential_direct_calculation
-          = u[i] * potential.direct(y[j].getCoord(),
-      		                        x[i].getCoord());
-        v[j] += potential_direct_calculation.real();
-        numOpsDirect++;
-      }
-    }
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    int xlength = thisBox.getSizeX();
+    int ylength = thisBox.getSizeY();
+    if (xlength>ans)
+      ans = xlength;
+    if (ylength>ans)
+      ans = ylength;
   }
+  return ans;
+}
 
+// returns index of p in vector z
+// point p must be a point in vector z
+// else index returned is ans = -1
+// Note: this is a linear search through z.  The passes of the FMM do not
+//       use it, since each box stores the indices of its points (see Box::addX)
+int FmmTree::getIndex(std::vector<Point> &z, Point &p)
+{
+  int ans = -1;
+  for (unsigned int i=0; i<z.size(); ++i)
+    if (z[i].equals(p))
+    {
+      ans = i;
+      i = z.size();
+    }
+  return ans;
+}
+
+// The print functions are diagnostic dumps of the tree written to the log
+// stream (see setLogStream), independently of the verbosity.  With the
+// verbosity DEBUG apply calls printTreeStructure before the passes.
+void FmmTree::printX()
+{
+  std::vector<int> position;
+  sources.getInputPositions(position);
+  for (unsigned int i=0; i<position.size(); ++i)
+  {
+    Point thisX(std::complex<double>(sources.xCoord[position[i]], sources.yCoord[position[i]]));
+	*logStream << thisX.coordToString() << '\n';
+  }
+
+}
+
+void FmmTree::printY()
+{
+  std::vector<int> position;
+  targets.getInputPositions(position);
+  for (unsigned int i=0; i<position.size(); ++i)
+  {
+    Point thisY(std::complex<double>(targets.xCoord[position[i]], targets.yCoord[position[i]]));
+	*logStream << thisY.coordToString() << '\n';
+  }
+
+}
+
+void FmmTree::printBoxInformation()
+{
+  for (unsigned int i=0; i<leaves.size(); ++i)
+  {
+    *logStream << "For the Box at tree_structure[" << leaves[i].first << "]["
+               << leaves[i].second << "]" << "\n";
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    *logStream << "Box level is " << thisBox.getLevel() << "\n"
+               << "Box index is " << thisBox.getIndex() << "\n"
+               << "Box sizeX is " << thisBox.getSizeX() << "\n"
+               << "Box sizeY is " << thisBox.getSizeY() << "\n";
+  }
+}
+
+
+void FmmTree::printTreeStructure()
+{
+  for (int i=0; i<numOfLevels; ++i)
+  {
+    int numLeaves = 0;
+    for (unsigned int j=0; j<tree_structure[i].size(); ++j)
+      if (tree_structure[i][j].isLeaf())
+        ++numLeaves;
+    *logStream << "tree structure level " << i
+               << " has " << tree_structure[i].size() << " cells ("
+               << numLeaves << " leaves)" << '\n';
+  }
+}
+
+std::vector<double> FmmTree::solve(std::vector<double> &u)
+{
+  // v is the answer to the potential calculation using FMM
+  // for each target y[i] (element of y), we will have calculated the potential
+  // v[i] due to all the sources x using FMM
+  std::vector<double> v(targets.size());
+  assert((int)u.size() >= sources.size() && "FmmTree::solve fewer charges than sources");
+  if (v.size() > 0)
+    apply(u.size() > 0 ? &u[0] : NULL, &v[0]);
+  return v;
+}
+
+// the same as solve(u), the statistics of the tree (with the times of the
+// passes of this solve) are copied to stats
+std::vector<double> FmmTree::solve(std::vector<double> &u, FmmStats &stats)
+{
+  std::vector<double> v = solve(u);
+  stats = this->stats;
+  return v;
+}
+
+// Explanation of apply:
+//
+// The tree (boxes, sorted particles, interaction lists and translation
+// matrices) only depends on the source and target points and is built once by
+// the constructor.  apply only does the numerical part of the FMM for the
+// charges u (one for each source point x[i]) and writes the potentials to v
+// (one for each target point y[j]), so it can be called many times on the same
+// tree with new charges (for example for the matrix-vector products of an
+// iterative solver):
+//   - all coefficients c, dtilde and d of the tree are set to zero
+//     (the passes add to them)
+//   - upward pass (P2M, M2M), downward pass 1 (M2L, P2L) and
+//     downward pass 2 (L2L)
+//   - evaluation of the potentials at the target points (L2P, M2P, P2P,
+//     see evaluate)
+//
+// With the scheduler TASKS (see setScheduler) the passes and the evaluation
+// are tasks of one graph instead (runTasks), and with a GPU (see enableGpu)
+// the P2P and the M2L are done on the device (runGpuPasses).
+//
+// Each phase is timed separately (class PhaseTimer) and the wall times of the
+// last apply are kept in stats (see getStats).  Nothing is written unless the
+// verbosity is set (setVerbosity): INFO writes the size of the tree, the passes
+// and the statistics, DEBUG also the tree structure and the S-expansion
+// coefficients of each source point (only for small test problems).  The operations of the phases
+// are counted once for the tree (see countInteractions) and are added to
+// numOpsIndirect for each apply.
+void FmmTree::apply(const double *u, double *v)
+{
+  // the coefficients of the source points (DEBUG) are only written by the passes
+  // (runGpuPasses returns false and closes the device if the upload failed)
+  bool onGpu = gpu.isOpen() && runGpuPasses(u, v);
+  if (!onGpu && scheduler == TASKS && verbosity < DEBUG)
+    runTasks(u, v);
+  else if (!onGpu)
+  {
+    runPasses(u);
+
+    if (verbosity >= INFO)
+      *logStream << "Starting evaluation..." << "\n";
+    evaluate(v);
+  }
+
+  numOpsIndirect += stats.getTotalFlops();
+  if (verbosity >= INFO)
+    *logStream << stats.toString();
+}
+
+// Explanation of applyField:
+//
+// the same passes as apply, but the evaluation (see evaluateField) keeps the
+// complex values of the series and also their derivatives with respect to y:
+//   phi[j]  = sum_i u[i] log(y[j] - x[i])      (complex potential)
+//   dphi[j] = sum_i u[i] / (y[j] - x[i])       (its derivative, the field)
+// The real part of phi[j] is the potential v[j] of apply.  The gradient of
+// the potential is (Re dphi[j], -Im dphi[j]), that is conj(dphi[j]).
+// The R-expansions d and the S-expansions c are the same for both, so the
+// field costs one extra Horner sum per series and no further tree pass.
+// The imaginary part of phi is the sum of u[i] arg(y[j] - x[i]) and, as the
+// logarithm itself, is only defined up to multiples of 2 pi u[i] (the
+// expansions and the direct sum can use different branches); dphi is exact.
+// Either phi or dphi can be NULL.
+void FmmTree::applyField(const double *u, std::complex<double> *phi, std::complex<double> *dphi)
+{
+  runPasses(u);
+
+  if (verbosity >= INFO)
+    *logStream << "Starting field evaluation..." << "\n";
+  evaluateField(phi, dphi);
+
+  numOpsIndirect += stats.getTotalFlops();
+  if (verbosity >= INFO)
+    *logStream << stats.toString();
+}
+
+void FmmTree::solveField(std::vector<double> &u, std::vector<std::complex<double> > &phi,
+                         std::vector<std::complex<double> > &dphi)
+{
+  assert((int)u.size() >= sources.size() && "FmmTree::solveField fewer charges than sources");
+  phi.resize(targets.size());
+  dphi.resize(targets.size());
+  if (targets.size() > 0)
+    applyField(u.size() > 0 ? &u[0] : NULL, &phi[0], &dphi[0]);
+}
+
+// the part of apply (and applyField) before the evaluation: the charges u
+// are gathered, the coefficients are reset and the three passes are done
+void FmmTree::runPasses(const double *u)
+{
+  stats.resetPasses();
+  clearCoefficients();
+
+  if (verbosity >= INFO)
+    *logStream << "FmmTree: " << sources.size() << " sources, " << targets.size()
+               << " targets, " << numOfLevels << " levels, " << leaves.size()
+               << " leaves, p = " << potential.getP() << "\n";
+  if (verbosity >= DEBUG)
+    printTreeStructure();
+
+  if (verbosity >= INFO)
+    *logStream << "Starting upward pass..." << "\n";
+  upwardPass(u);
+
+  if (verbosity >= INFO)
+    *logStream << "Starting downward pass 1..." << "\n";
+  downwardPass1();
+
+  if (verbosity >= INFO)
+    *logStream << "Starting downward pass 2..." << "\n";
+  downwardPass2();
+}
+
+// Explanation of enableHardwareCounters:
+//
+// opens the hardware counters (cycles and instructions, see class
+// HardwareCounters) so that the following solves also count them for each
+// phase.  Returns false if the counters are not available (the code was not
+// compiled with FMM2D_USE_PERF_EVENT or the system does not allow them).
+bool FmmTree::enableHardwareCounters()
+{
+  return counters.open();
+}
+
+// Explanation of enableGpu:
+//
+// opens the CUDA device 'device' (class GpuBackend) so that the following
+// applies do the near field (P2P) and the S|R translations (M2L) on it, see
+// runGpuPasses.  Returns false if the code was not compiled with
+// FMM2D_USE_CUDA (src/GpuBackend.cu) or there is no such device; the CPU
+// passes are then used as before.  disableGpu goes back to the CPU passes.
+bool FmmTree::enableGpu(int device)
+{
+  return gpu.open(device);
+}
+
+/**
+ * Explanation of runGpuPasses(u, v)
+ *
+ * apply with the P2P and the M2L on the GPU (GpuBackend) and the rest on the
+ * host, overlapped with the device:
+ * [1] - the tree is sent to the device if it was built or changed since the
+ *       last apply (the points, the uList and vList, the S|R matrices)
+ * [2] - the charges are gathered into the sorted order and the P2P kernel is
+ *       started (asynchronous), the host does the upward pass meanwhile
+ * [3] - the S-expansions of all levels are sent and the M2L kernel is started,
+ *       the host does the P2L of the xList (adaptive tree) meanwhile
+ * [4] - the R-expansions of the M2L are added, then the L2L on the host
+ * [5] - waiting for the near field, then the L2P and M2P (evaluateFar)
+ * The times of M2L and P2P in stats are the time the host spent starting the
+ * kernels and waiting for them.  The sums of the device are done in another
+ * order, so the potentials agree with the CPU passes up to rounding.
+ *
+ * If a CUDA call fails the device is closed (disableGpu) and its part is done
+ * on the host: returns false if the upload failed (nothing was computed,
+ * apply runs the CPU passes), and a kernel that failed is replaced by the
+ * host M2L or P2P of the same apply.
+ */
+bool FmmTree::runGpuPasses(const double *u, double *v)
+{
+  stats.resetPasses();
+  clearCoefficients();
+  if (!gpu.isUploaded() && !gpu.upload(*this))                                              // 1
+  {
+    disableGpu();
+    if (verbosity >= INFO)
+      *logStream << "GPU upload failed, using the CPU passes" << "\n";
+    return false;
+  }
+  bool failed = false;
+
+  nearPart.assign(targets.size(), 0.0);
+  {
+  PhaseTimer timer(stats, FmmStats::P2P, counters);                                         // 2
+  sources.setCharge(u);
+  gpu.startNear(*this);                  // copies the charges, upwardPass gathers them again
+  }
+  upwardPass(u);
+
+  {
+  PhaseTimer timer(stats, FmmStats::M2L, counters);                                         // 3
+  gpu.startM2L(*this);
+  }
+  if (xList.size() > 0)
+  {
+    PhaseTimer timer(stats, FmmStats::P2L, counters);
+    for (int el=2; el<numOfLevels; ++el)
+    {
+      int levelBoxes = tree_structure[el].size();
+      #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+      for (int k=0; k<levelBoxes; ++k)
+        p2lBox(el, k);
+    }
+  }
+  {
+  PhaseTimer timer(stats, FmmStats::M2L, counters);                                         // 4
+  if (!gpu.finishM2L(*this))
+  {
+    failed = true;
+    for (int el=2; el<numOfLevels; ++el)
+    {
+      int levelBoxes = tree_structure[el].size();
+      #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+      for (int k=0; k<levelBoxes; ++k)
+        m2lBox(el, k);
+    }
+  }
+  }
+  downwardPass2();
+
+  bool nearDone;
+  {
+  PhaseTimer timer(stats, FmmStats::P2P, counters);                                         // 5
+  nearDone = gpu.finishNear(*this);
+  }
+  if (!nearDone)
+  {
+    failed = true;
+    evaluateNear();
+  }
+  evaluateFar(v);
+
+  if (failed)
+  {
+    disableGpu();
+    if (verbosity >= INFO)
+      *logStream << "GPU kernel failed, using the CPU passes" << "\n";
+  }
+  return true;
+}
+
+void FmmTree::evaluate(double *v)
+{
+  // Explanation of the Loops in Code Below
+  //
+  // The three parts of the potential are done in three loops over the leaf
+  // boxes (one phase each, so they can be timed separately).  Each part is
+  // kept for the sorted target points in nearPart or farPart:
+  //
+  // P2P:
+  // [0] - for each leaf box (for a uniform tree the boxes at the highest
+  //       refinement level numOfLevels, index starts on zero, so numOfLevels-1)
+  //   [1] - getting a reference thisBox for the box to be worked on
+  //   [2] - getting the range of positions [yBegin, yEnd) of the target points
+  //         of this box in the sorted arrays targets (class Particles)
+  //   [3] - if there are target points in this box
+  //     [4] - initializing the singular part nearPart of the potential calculation
+  //           for each target point of the box, where the source points x[i] are
+  //           too close to approximate the potential calculation with a series and
+  //           the calculation must be done directly
+  //     [5] - for each box in the uList (near neighbors including this box)
+  //       [6-7] - obtaining the range [xBegin, xEnd) of the sources of the neighbor's
+  //               box in the sorted arrays sources (class Particles), which is
+  //               stored in the uList
+  //       [8] - calculating the potential directly (singular part) for all
+  //             sources of the neighbor's box on all targets of thisBox with
+  //             the near field kernel (class NearField, vector instructions).
+  //             The sources and targets of the two boxes are contiguous in the
+  //             sorted arrays and the charges were gathered into the sorted
+  //             order by upwardPass.  A target point and a source point that
+  //             are the same point (up to machine epsilon) are skipped.  This
+  //             happens when the box of the uList entry is thisBox and the target and
+  //             source points are the same.
+  // L2P:
+  //   [9] - for each target point at position j of the sorted arrays
+  //     [10] - getting the coordinates thisYCoord of the target point
+  //     [11] - initializing the regular part farPart of the potential calculation
+  //            where the source points x[i] are far enough away from thisBox
+  //            that the potential calculation can be approximated by a series
+  //     [12] - evaluating the R-expansion of thisBox (series coefficients D)
+  //            at thisY (Potential::evalR), that is adding the first p terms
+  //            of the series - a truncated approximation to the infinite
+  //            series - and only taking real part of series?
+  //            (a leaf box on level 0 or 1 has no R-expansion)
+  // M2P:
+  //   [13] - adding the S-expansions (far field series with coefficients C)
+  //          of the boxes in the wList of thisBox (adaptive tree only).
+  //          These boxes are small and well separated from thisBox but
+  //          their parents are neighbors of thisBox
+  // [14] - adding the result (singular part) to the result from the series
+  //        approximations to the potential calculation for sources far
+  //        enough away (regular part)
+  //        Making sure to put this final result in the same location (have same index value)
+  //        as the corresponding location of the target point in the vector
+  //        of target points y (this index targets.index[j] was stored when sorting the points)
+  //
+  // The leaf boxes are shared among the threads (each target point is written by one box only).
+  // The sums are done in the same order as in a single loop over the
+  // leaf boxes (0 + R-expansion + wList, then near part + far part).
+  //
+  // The P2P loop (evaluateNear) does not need the R-expansions, so it can also
+  // be done before downwardPass2 (see DistributedFmm::apply), and the other
+  // loops and [14] are done by evaluateFar.
+  //
+  evaluateNear();
+  evaluateFar(v);
+}
+
+void FmmTree::evaluateNear()
+{
+  int leafBoxes = leaves.size();
+  int numTargets = targets.size();
+  nearPart.assign(numTargets, 0.0);                                                         // 4
+
+  PhaseTimer timer(stats, FmmStats::P2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)                                                           // 0
+    p2pBox(leaves[i].first, leaves[i].second);
+}
+
+void FmmTree::evaluateFar(double *v)
+{
+  int leafBoxes = leaves.size();
+  int numTargets = targets.size();
+  farPart.assign(numTargets, 0.0);                                                          // 11
+
+  {
+  PhaseTimer timer(stats, FmmStats::L2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    l2pBox(leaves[i].first, leaves[i].second);
+  }
+
+  if (wList.size() > 0)
+  {
+  PhaseTimer timer(stats, FmmStats::M2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    m2pBox(leaves[i].first, leaves[i].second);
+  }
+
+  for (int j=0; j<numTargets; ++j)
+    v[targets.index[j]] = nearPart[j] + farPart[j];                                         // 14
+}
+
+// Explanation of evaluateField:
+//
+// the three parts of evaluate with the complex values (and the derivatives)
+// of the series instead of their real parts: the near field kernel
+// NearField::evaluateField (P2P), Potential::evalR with derivative (L2P) and
+// Potential::evalS with derivative (M2P).  The parts are added for each
+// sorted target in phiPart and dphiPart and then written to the positions of
+// the targets in y.
+void FmmTree::evaluateField(std::complex<double> *phi, std::complex<double> *dphi)
+{
+  int leafBoxes = leaves.size();
+  int numTargets = targets.size();
+  phiPart.assign(numTargets, std::complex<double>(0.0));
+  dphiPart.assign(numTargets, std::complex<double>(0.0));
+  std::complex<double> *phiSorted = (phi != NULL) ? &phiPart[0] : NULL;
+
+  {
+  PhaseTimer timer(stats, FmmStats::P2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    int yBegin = thisBox.getBeginY();
+    int yEnd = thisBox.getEndY();
+    if (yEnd == yBegin)
+      continue;
+    int row = getRow(leaves[i].first, leaves[i].second);
+    for (int m=uList.getBegin(row); m<uList.getEnd(row); ++m)
+    {
+      int xBegin = uList.getFirst(m);
+      nearField.evaluateField(&targets.xCoord[yBegin], &targets.yCoord[yBegin], yEnd - yBegin,
+                              &sources.xCoord[xBegin], &sources.yCoord[xBegin],
+                              &sources.charge[xBegin], uList.getSecond(m) - xBegin,
+                              phiSorted != NULL ? phiSorted + yBegin : NULL, &dphiPart[yBegin]);
+    }
+  }
+  }
+
+  {
+  PhaseTimer timer(stats, FmmStats::L2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    if (thisBox.getLevel() < 2)
+      continue;
+    std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+    for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+    {
+      std::complex<double> thisYCoord(targets.xCoord[j], targets.yCoord[j]);
+      std::complex<double> derivative;
+      phiPart[j] += potential.evalR(thisBox.getD(), thisYCoord, thisBoxCenter, derivative,
+                                    TranslationOperators::getScale(leaves[i].first));
+      dphiPart[j] += derivative;
+    }
+  }
+  }
+
+  if (wList.size() > 0)
+  {
+  PhaseTimer timer(stats, FmmStats::M2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    int row = getRow(leaves[i].first, leaves[i].second);
+    for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+    {
+      std::complex<double> thisYCoord(targets.xCoord[j], targets.yCoord[j]);
+      for (int m=wList.getBegin(row); m<wList.getEnd(row); ++m)
+      {
+        Box& thisWBox = tree_structure[wList.getFirst(m)][wList.getSecond(m)];
+        std::complex<double> derivative;
+        phiPart[j] += potential.evalS(thisWBox.getC(), thisYCoord, thisWBox.getCenter().getCoord(),
+                                      derivative, TranslationOperators::getScale(wList.getFirst(m)));
+        dphiPart[j] += derivative;
+      }
+    }
+  }
+  }
+
+  for (int j=0; j<numTargets; ++j)
+  {
+    if (phi != NULL)
+      phi[targets.index[j]] = phiPart[j];
+    if (dphi != NULL)
+      dphi[targets.index[j]] = dphiPart[j];
+  }
+}
+
+
+
+// Explanation of upwardPass:
+//
+// It seems like the original version of this function
+// should be separate from FmmTree and in another class,
+// since FmmTree has to pass itself as argument in thisBox.getParent(this)
+// However, a work around this pass of tree_structure
+// as an argument to thisBox.getParent(this) was made by only
+// getting indices from class Box member function getParent of parent.
+// This avoids the need to pass tree_structure since no
+// boxes are now being returned from thisBox.getParent(this).
+// The ability to obtain the actual box of the parent was the
+// purpose of passing tree_structure as an argument.
+// The same work arounds for getting children, parent's neighbors
+// and parent's neighbor's children were also done for the related
+// member functions of class Box
+//
+// The S-expansions of the leaf boxes (which for an adaptive tree are on
+// different levels) are formed first from their source points (P2M).  The
+// boxes that are not leaves then collect the series of their children level by
+// level, starting with the highest refinement level (M2M).  The series are only
+// needed down to level 2 (the interaction lists start at level 2).
+//
+// Parallel execution (see setNumThreads):
+// The boxes of one level are shared among the threads.  Each box only writes
+// to its own coefficients, so instead of each child adding its translated
+// series to its parent (two children could add to the same parent at the same
+// time), each parent collects the series of its children in the order
+// 0, 1, 2, 3.  The sums are then done in the same order as in a serial run and
+// the results do not depend on the number of threads.
+
+void FmmTree::upwardPass(const double *u)
+{
+  // gathering the charges u into the (Morton) order of the sorted source points
+  sources.setCharge(u);
+  if (precision == MIXED_PRECISION)
+    prepareMixed();
+
+  bool dumpCoefficients = (verbosity >= DEBUG);
+  {
+  PhaseTimer timer(stats, FmmStats::P2M, counters);
+  int leafBoxes = leaves.size();
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    p2mBox(leaves[i].first, leaves[i].second, dumpCoefficients);
+  }
+
+  // Here el stands for refinement level of the parents and
+  //      k  stands for box (cell) position of a parent in tree_structure[el]
+  // The children at level el+1 (el+1 >= 3) are translated to their parents
+  PhaseTimer timer(stats, FmmStats::M2M, counters);
+  for (int el = numOfLevels-2; el>=2; --el)
+  {
+    if (verbosity >= DEBUG)
+      *logStream << "Upward pass level " << +(el+1) << "\n";
+    int parentBoxes = tree_structure[el].size();
+    #pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int k=0; k<parentBoxes; ++k)
+      m2mBox(el, k);
+  }
+
+}
+
+// this pass is for the iteraction list E_4 (vList, M2L)
+// (not the neighbors) and, for an adaptive tree, the xList (P2L): the source
+// points of the (larger) leaf boxes in the xList of a box are well separated
+// from the box and are added directly to its R-expansion (coefficients Dtilde)
+// Each box of a level only adds to its own coefficients Dtilde, so the
+// boxes of a level are shared among the threads.  The M2L of a level is done
+// before its P2L, so each box adds its terms in the same order as before
+// the two phases were timed separately.
+void FmmTree::downwardPass1()
+{
+  for (int el=2; el<numOfLevels; ++el)
+  {
+    int levelBoxes = tree_structure[el].size();
+    {
+    PhaseTimer timer(stats, FmmStats::M2L, counters);
+    #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+    for (int k=0; k<levelBoxes; ++k)
+      m2lBox(el, k);
+    }
+
+    if (xList.size() == 0)
+      continue;
+    PhaseTimer timer(stats, FmmStats::P2L, counters);
+    #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+    for (int k=0; k<levelBoxes; ++k)
+      p2lBox(el, k);
+  }
+}
+
+
+// As in upwardPass, each child collects the translated series of its parent
+// (instead of the parent adding to its children) so that the boxes of a
+// level can be shared among the threads.  The boxes without target points
+// (only source points) are skipped, their R-expansions are never evaluated.
+void FmmTree::downwardPass2()
+{
+  if (numOfLevels < 3)
+    return;
+
+  PhaseTimer timer(stats, FmmStats::L2L, counters);
+  int levelTwoBoxes = tree_structure[2].size();
+  #pragma omp parallel for schedule(static) num_threads(numThreads)
+  for (int i=0; i<levelTwoBoxes; ++i)
+    l2lBox(2, i);
+
+  for (int el=2; el<numOfLevels-1; ++el)
+  {
+    int childBoxes = tree_structure[el+1].size();
+    #pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int m=0; m<childBoxes; ++m)
+    {
+      if (tree_structure[el+1][m].getSizeY() == 0)     // no target points, series is not needed
+        continue;
+      l2lBox(el+1, m);
+    }
+  }
+
+}
+
+// Explanation of the box kernels:
+//
+// the work of one phase of the FMM for one box (level, pos), used by the
+// passes (a parallel loop over the boxes of a level for each phase) and by the
+// tasks of runTasks.  Each kernel only writes the coefficients (or the parts
+// nearPart, farPart of the potential) of its own box, and always in the same
+// order, so the results do not depend on the scheduler or the threads.
+
+// P2M: S-expansion (coefficients C) of the source points of a leaf box
+void FmmTree::p2mBox(int level, int pos, bool dumpCoefficients)
+{
+  Box& thisBox = tree_structure[level][pos];
+  int xBegin = thisBox.getBeginX();
+  int xEnd = thisBox.getEndX();
+  if (xEnd == xBegin)
+    return;
+  std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+  // coefficients of one source point (one vector for the box, reused)
+  std::vector<std::complex<double> > B(potential.getP());
+  for (int j=xBegin; j<xEnd; ++j)
+  {
+    std::complex<double> thisXCoord(sources.xCoord[j], sources.yCoord[j]);
+    std::fill(B.begin(), B.end(), std::complex<double>(0.0));
+    potential.addSCoeff(thisXCoord, thisBoxCenter, sources.charge[j], &B[0],
+                        TranslationOperators::getScale(level));
+    if (dumpCoefficients)
+    {
+      #pragma omp critical
+      {
+        for (unsigned int k=0; k<B.size(); ++k)
+          *logStream << "B[" << k << "] = " << B[k] << "  ";
+        *logStream << "\n";
+      }
+    }
+    thisBox.addToC(B);
+  }
+  if (precision == MIXED_PRECISION)
+    storeFloatC(level, pos);
+}
+
+// M2M: the parent box (level, pos) collects the series of its children
+void FmmTree::m2mBox(int level, int pos)
+{
+  Box& parentBox = tree_structure[level][pos];
+  int firstChild = parentBox.getFirstChild();
+  for (int m=firstChild; m<firstChild+parentBox.getNumChildren(); ++m)
+  {
+    Box& thisBox = tree_structure[level+1][m];
+    if (thisBox.getSizeX() == 0)          // no source points, series is zero
+      continue;
+
+    // translating the thisBox's series that has coeffs thisBoxC
+    // from its center at location 'from' = thisBox.getCenter().getCoord()
+    // to its parent's center at location 'to' = parentBox.getCenter().getCoord()
+    // The new series with parent center can be added to the parent's
+    // C series since the powers for each term of the two series are now the same
+    // see Math.cc file notes for the details
+    // The (scaled) S|S matrix only depends on the position (last two bits of
+    // the index) of thisBox in its parent, and is taken from operators
+    // (added in place to the coefficients of parentBox)
+    potential.applyTranslation(&operators.getSS(thisBox.getIndex() & 3)[0],
+                               thisBox.getC(), parentBox.getC());
+  }
+  if (precision == MIXED_PRECISION)
+    storeFloatC(level, pos);
+}
+
+// M2L: the S-expansions of the boxes of the vList
+void FmmTree::m2lBox(int level, int pos)
+{
+  Box& thisBox = tree_structure[level][pos];
+  int row = getRow(level, pos);
+
+  // translating the far field series with old coefficients C to
+  // a near field series with new coefficients Dtilde (see Main.cc notes)
+  // the vList stores the position of the interaction list box and the
+  // index of the S|R matrix of its offset from thisBox
+  // (in float for MIXED_PRECISION, see setPrecision)
+  if (precision == MIXED_PRECISION)
+  {
+    for (int j=vList.getBegin(row); j<vList.getEnd(row); ++j)
+      applySRFloat(level, vList.getSecond(j), getFloatC(level, vList.getFirst(j)), thisBox.getDtilde());
+    return;
+  }
+  for (int j=vList.getBegin(row); j<vList.getEnd(row); ++j)
+  {
+    Box& thisBoxE4Neighbor = tree_structure[level][vList.getFirst(j)];
+    applySR(level, vList.getSecond(j), thisBoxE4Neighbor.getC(), thisBox.getDtilde());
+  }
+}
+
+// dtilde += S|R c for the S|R matrix of an offset at a level, with the
+// engine of setM2LEngine.  The scaled matrices of all levels are the same
+// except for the term log s of the cell length s (see TranslationOperators.cc)
+void FmmTree::applySR(int level, int offsetIndex, const std::complex<double> *c,
+                      std::complex<double> *dtilde)
+{
+  double logScale = TranslationOperators::getLogScale(level);
+  if (m2lEngine == FACTORED_M2L)
+  {
+    potential.applyFactoredSR(&operators.pascal[0], &operators.getSRPower(offsetIndex)[0],
+                              operators.getSRLog(offsetIndex) + logScale, c, dtilde);
+    return;
+  }
+  potential.applyTranslation(&operators.getSR(offsetIndex)[0], c, dtilde);
+  dtilde[0] += c[0] * logScale;
+}
+
+// the same with the float copies of the S-expansion and of the S|R matrices
+// (MIXED_PRECISION), the term log s is added in double
+void FmmTree::applySRFloat(int level, int offsetIndex, const std::complex<float> *c,
+                           std::complex<double> *dtilde)
+{
+  double logScale = TranslationOperators::getLogScale(level);
+  if (m2lEngine == FACTORED_M2L)
+  {
+    potential.applyFactoredSRFloat(&operators.pascalFloat[0], &operators.srPowerFloat[offsetIndex][0],
+                                   operators.getSRLog(offsetIndex) + logScale, c, dtilde);
+    return;
+  }
+  potential.applyTranslationFloat(&operators.srFloat[offsetIndex][0], c, dtilde);
+  dtilde[0] += std::complex<double>(c[0]) * logScale;
+}
+
+// P2L: the source points of the boxes of the xList
+void FmmTree::p2lBox(int level, int pos)
+{
+  Box& thisBox = tree_structure[level][pos];
+  int row = getRow(level, pos);
+
+  // R-expansions (about the center of thisBox) of the source points of
+  // the boxes in the xList (the xList stores the range of the points)
+  std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+  double scale = TranslationOperators::getScale(level);
+  for (int j=xList.getBegin(row); j<xList.getEnd(row); ++j)
+  {
+    for (int q=xList.getFirst(j); q<xList.getSecond(j); ++q)
+    {
+      std::complex<double> thisXCoord(sources.xCoord[q], sources.yCoord[q]);
+      potential.addRCoeff(thisXCoord, thisBoxCenter, sources.charge[q], thisBox.getDtilde(), scale);
+    }
+  }
+}
+
+// L2L: D = R|R (D of the parent) + Dtilde (on level 2 only Dtilde)
+void FmmTree::l2lBox(int level, int pos)
+{
+  Box& thisBoxChild = tree_structure[level][pos];
+  if (level > 2)
+  {
+    Box& thisBox = tree_structure[level-1][thisBoxChild.getParent()];
+    // R|R matrix from the parent to its child at level 'level'
+    potential.applyTranslation(&operators.getRR(thisBoxChild.getIndex() & 3)[0],
+                               thisBox.getD(), thisBoxChild.getD());
+  }
+  thisBoxChild.addToD(thisBoxChild.getDtilde());
+}
+
+// L2P: the R-expansion of a leaf box at its target points (see evaluate)
+void FmmTree::l2pBox(int level, int pos)
+{
+  Box& thisBox = tree_structure[level][pos];
+  if (level < 2)                                                                            // 12
+    return;
+  std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+  for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)                                 // 9
+  {
+    std::complex<double> thisYCoord(targets.xCoord[j], targets.yCoord[j]);                  // 10
+    farPart[j] += potential.evalR(thisBox.getD(), thisYCoord, thisBoxCenter,
+                                  TranslationOperators::getScale(level)).real();
+  }
+}
+
+// M2P: the S-expansions of the boxes of the wList at the target points of a leaf box
+void FmmTree::m2pBox(int level, int pos)
+{
+  Box& thisBox = tree_structure[level][pos];
+  int row = getRow(level, pos);
+  if (wList.getBegin(row) == wList.getEnd(row))
+    return;
+  for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+  {
+    std::complex<double> thisYCoord(targets.xCoord[j], targets.yCoord[j]);
+    for (int m=wList.getBegin(row); m<wList.getEnd(row); ++m)                               // 13
+    {
+      Box& thisWBox = tree_structure[wList.getFirst(m)][wList.getSecond(m)];
+      farPart[j] += potential.evalS(thisWBox.getC(), thisYCoord, thisWBox.getCenter().getCoord(),
+                                    TranslationOperators::getScale(wList.getFirst(m))).real();
+    }
+  }
+}
+
+// P2P: the source points of the boxes of the uList at the target points of a leaf box
+void FmmTree::p2pBox(int level, int pos)
+{
+  Box& thisBox = tree_structure[level][pos];                                                // 1
+  int yBegin = thisBox.getBeginY();                                                         // 2
+  int yEnd = thisBox.getEndY();
+  if (yEnd == yBegin)                                                                       // 3
+    return;
+  int row = getRow(level, pos);
+  if (precision == MIXED_PRECISION)
+  {
+    // float coordinates relative to the points of the leaf boxes (see prepareMixed)
+    for (int m=uList.getBegin(row); m<uList.getEnd(row); ++m)
+    {
+      int xBegin = uList.getFirst(m);
+      int numSources = uList.getSecond(m) - xBegin;
+      nearField.evaluateMixed(&targetXFloat[yBegin], &targetYFloat[yBegin], yEnd - yBegin,
+                              &sourceXFloat[xBegin], &sourceYFloat[xBegin],
+                              &chargeFloat[xBegin], numSources,
+                              uListShift[3*m], uListShift[3*m+1], uListShift[3*m+2], &nearPart[yBegin]);
+    }
+    return;
+  }
+  for (int m=uList.getBegin(row); m<uList.getEnd(row); ++m)                                 // 5
+  {
+    int xBegin = uList.getFirst(m);                                                         // 6-7
+    int numSources = uList.getSecond(m) - xBegin;
+    nearField.evaluate(&targets.xCoord[yBegin], &targets.yCoord[yBegin], yEnd - yBegin,     // 8
+                       &sources.xCoord[xBegin], &sources.yCoord[xBegin],
+                       &sources.charge[xBegin], numSources, &nearPart[yBegin]);
+  }
+}
+
+// Explanation of setScheduler:
+//
+// LEVELS (default): apply runs the passes level by level, one parallel loop
+// for each phase and level, with a barrier at the end of each loop.  On the
+// coarse levels (16 boxes on level 2, 64 on level 3) most threads wait.
+// TASKS: apply runs the work of each box as a task of a graph (see runTasks)
+// that starts as soon as the series it needs are done, and the near field
+// (which needs no series) fills the gaps.  The results are the same (the
+// kernels of the boxes do the same sums in the same order).
+void FmmTree::setScheduler(int scheduler)
+{
+  assert((scheduler == LEVELS || scheduler == TASKS) && "FmmTree::setScheduler unknown scheduler");
+  this->scheduler = scheduler;
+}
+
+// Explanation of setM2LEngine:
+//
+// MATRIX_M2L (default): each S|R translation is the product of a p x p
+// complex matrix (one for each offset, see TranslationOperators)
+// with the coefficients of the source box.
+// FACTORED_M2L: the S|R matrix is written as diagonal (powers of t) times
+// Pascal matrix times diagonal (see Potential::applyFactoredSR), and the
+// translation is the product of the one real Pascal matrix with the scaled
+// coefficients.  Half of the multiply-adds of the matrix and no matrix for
+// each offset to load, the results agree with MATRIX_M2L to rounding.  The
+// engine is used by apply (both schedulers) and by DistributedFmm below the
+// partition level, applyBatch and the GPU keep the matrices.
+void FmmTree::setM2LEngine(int engine)
+{
+  assert((engine == MATRIX_M2L || engine == FACTORED_M2L) && "FmmTree::setM2LEngine unknown engine");
+  this->m2lEngine = engine;
+}
+
+// Explanation of setPrecision:
+//
+// DOUBLE_PRECISION (default): all phases in double.
+// MIXED_PRECISION: the two phases that dominate apply, the near field (P2P)
+// and the S|R translations (M2L), work on floats (twice as many values in a
+// SIMD register and half of the memory traffic) and add their results to
+// double sums:
+//   - P2P: the coordinates are kept as floats relative to the center of the
+//     points of their leaf box (absolute float coordinates or coordinates
+//     relative to the center of the box would lose the digits of the small
+//     distances of a tight cluster) and each uList entry gets the float shift
+//     between the two leaves (see prepareMixed and NearField::evaluateMixed)
+//   - M2L: the S-expansions c of each box are rounded to float after the P2M
+//     or M2M of the box (storeFloatC) and multiplied with float copies of the
+//     S|R matrices (or of their factors for FACTORED_M2L), the products of a
+//     row are summed in float and the rows are added to the double R-expansions
+//     (Potential::applyTranslationFloat)
+// The series themselves (P2M, M2M, L2L, L2P) stay in double.  The rounding
+// error of a pair is about eps_float times the extent of the points of the two
+// leaves over their distance.  The error relative to the largest potential is
+// about 1e-7 for the uniform, clustered and tight points of bench/Benchmark.cc
+// (up to 1e-6 for a cluster of width 1e-6 in a uniform tree), instead of the
+// truncation error of p.  It is larger where the points of neighbouring leaves
+// are far closer to each other than to the other points of their leaves, and
+// pairs closer than the rounding are skipped as self interactions, so the mode
+// is meant for target errors above 1e-6.  The float
+// data is built by the first apply after the tree or the points changed
+// (prepareMixed).  Used by apply and applyField (both schedulers), applyBatch,
+// the GPU and the ghost data of DistributedFmm stay in double.
+void FmmTree::setPrecision(int precision)
+{
+  assert((precision == DOUBLE_PRECISION || precision == MIXED_PRECISION)
+         && "FmmTree::setPrecision unknown precision");
+  this->precision = precision;
+}
+
+// MIXED_PRECISION: the float copies of c of the box (level, pos)
+void FmmTree::storeFloatC(int level, int pos)
+{
+  int p = potential.getP();
+  const std::complex<double> *c = tree_structure[level][pos].getC();
+  std::complex<float> *cFloat = getFloatC(level, pos);
+  for (int i=0; i<p; ++i)
+    cFloat[i] = std::complex<float>(c[i]);
+}
+
+/**
+ * Explanation of prepareMixed()
+ *
+ * The float data of MIXED_PRECISION (see setPrecision), called by the passes
+ * after the charges are gathered (once for each apply):
+ * 1 - after the tree or the points changed (countInteractions and update
+ *     clear mixedReady): the coordinates of the points of each leaf box
+ *     relative to the frame of the leaf box, the center of the bounding box of
+ *     its sources and targets (the center of the box if it has no points), the
+ *     float copies of the S|R matrices and the arenas of the float S-expansions.
+ *     A frame at the center of the box would round the coordinates of a
+ *     cluster that fills a small part of the box to eps times the box size
+ *     (a cluster of width 1e-6 in a box of level 4 lost all the digits of its
+ *     distances); relative to the points the rounding is eps times the extent
+ *     of the points
+ * 2 - the source leaf box of each uList entry (the source range of an entry is
+ *     the whole range of one leaf box), the shift between the two frames
+ *     (computed in double and rounded once) and the tolerance of the self
+ *     interaction test, 2 (eps (|shift| + r_target + r_source))^2 with the
+ *     half extents r of the points of the two leaves (the rounding of the float
+ *     distances, at least the smallest normal float).  The pairs of one leaf
+ *     have the shift 0, so a target and a source at the same point give r2 = 0
+ * 3 - the charges of the sorted sources in float (each apply)
+ */
+void FmmTree::prepareMixed()
+{
+  if (!mixedReady)
+  {
+    int p = potential.getP();
+    sourceXFloat.resize(sources.size());                                                    // 1
+    sourceYFloat.resize(sources.size());
+    targetXFloat.resize(targets.size());
+    targetYFloat.resize(targets.size());
+    std::vector<int> sourceLeaf(sources.size(), -1);
+    std::vector<std::complex<double> > frame(leaves.size());
+    std::vector<double> radius(leaves.size(), 0.0);
+    for (unsigned int i=0; i<leaves.size(); ++i)
+    {
+      Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+      double minX = 1.0, maxX = 0.0, minY = 1.0, maxY = 0.0;
+      for (int j=thisBox.getBeginX(); j<thisBox.getEndX(); ++j)
+      {
+        minX = std::min(minX, sources.xCoord[j]);  maxX = std::max(maxX, sources.xCoord[j]);
+        minY = std::min(minY, sources.yCoord[j]);  maxY = std::max(maxY, sources.yCoord[j]);
+      }
+      for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+      {
+        minX = std::min(minX, targets.xCoord[j]);  maxX = std::max(maxX, targets.xCoord[j]);
+        minY = std::min(minY, targets.yCoord[j]);  maxY = std::max(maxY, targets.yCoord[j]);
+      }
+      if (minX > maxX)                                     // no points: the center of the box
+        frame[i] = thisBox.getCenter().getCoord();
+      else
+      {
+        frame[i] = std::complex<double>(0.5*(minX + maxX), 0.5*(minY + maxY));
+        radius[i] = 0.5*std::max(maxX - minX, maxY - minY);
+      }
+      for (int j=thisBox.getBeginX(); j<thisBox.getEndX(); ++j)
+      {
+        sourceXFloat[j] = (float)(sources.xCoord[j] - frame[i].real());
+        sourceYFloat[j] = (float)(sources.yCoord[j] - frame[i].imag());
+        sourceLeaf[j] = i;
+      }
+      for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+      {
+        targetXFloat[j] = (float)(targets.xCoord[j] - frame[i].real());
+        targetYFloat[j] = (float)(targets.yCoord[j] - frame[i].imag());
+      }
+    }
+    if (!operators.hasFloat())
+      operators.buildFloat();
+    coefficientsFloat.resize(tree_structure.size());
+    for (unsigned int l=0; l<tree_structure.size(); ++l)
+      coefficientsFloat[l].assign((size_t)tree_structure[l].size()*p, std::complex<float>(0.0f));
+
+    float eps = std::numeric_limits<float>::epsilon();                                       // 2
+    uListShift.assign(3*uList.size(), 0.0f);
+    for (unsigned int i=0; i<leaves.size(); ++i)
+    {
+      int row = getRow(leaves[i].first, leaves[i].second);
+      for (int m=uList.getBegin(row); m<uList.getEnd(row); ++m)
+      {
+        if (uList.getFirst(m) == uList.getSecond(m))
+          continue;
+        int source = sourceLeaf[uList.getFirst(m)];
+        std::complex<double> shift = frame[i] - frame[source];
+        double error = eps * (std::abs(shift) + radius[i] + radius[source]);
+        uListShift[3*m] = (float)shift.real();
+        uListShift[3*m+1] = (float)shift.imag();
+        uListShift[3*m+2] = std::max((float)(2.0*error*error), std::numeric_limits<float>::min());
+      }
+    }
+    mixedReady = true;
+  }
+
+  chargeFloat.assign(sources.charge.begin(), sources.charge.end());                        // 3
+}
+
+/**
+ * Explanation of buildTaskGraph()
+ *
+ * The tasks of apply for the scheduler TASKS, built on the first apply after
+ * the tree or its interaction lists changed (countInteractions clears it).
+ * The kind of a task is its priority (TaskGraph::run takes the ready task of
+ * the smallest kind first), so the series that other tasks wait for come
+ * first and the near field last:
+ *   UP_TASK       P2M of a leaf box, M2M of a box of level >= 2 that is not a leaf
+ *   DOWN1_TASK    M2L and P2L of a box of level >= 2 with target points
+ *   DOWN2_TASK    L2L of a box of level >= 2 with target points
+ *   EVAL_TASK     L2P and M2P of a leaf box with target points
+ *   NEAR_TASK     P2P of a leaf box with target points
+ * Dependencies (a task waits for the tasks that write the series it reads):
+ * [1] - UP of a box that is not a leaf waits for the UP of its children
+ * [2] - DOWN1 of a box waits for the UP of the boxes of its vList
+ * [3] - DOWN2 waits for DOWN1 of its box and for DOWN2 of its parent (level > 2)
+ * [4] - EVAL waits for DOWN2 of its box (level >= 2) and for the UP of the
+ *       boxes of its wList
+ * NEAR only needs the charges and can run at any time.
+ */
+void FmmTree::buildTaskGraph()
+{
+  taskGraph.clear();
+  taskBox.clear();
+  int numRows = levelStart[numOfLevels];
+  std::vector<int> upTask(numRows, -1), down1Task(numRows, -1), down2Task(numRows, -1);
+
+  for (int el=0; el<numOfLevels; ++el)
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree_structure[el][k];
+      int row = getRow(el, k);
+      if (thisBox.isLeaf() || el >= 2)
+      {
+        upTask[row] = taskGraph.addTask(UP_TASK);
+        taskBox.push_back(std::make_pair(el, (int)k));
+      }
+      if (el >= 2 && thisBox.getSizeY() > 0)
+      {
+        down1Task[row] = taskGraph.addTask(DOWN1_TASK);
+        taskBox.push_back(std::make_pair(el, (int)k));
+        down2Task[row] = taskGraph.addTask(DOWN2_TASK);
+        taskBox.push_back(std::make_pair(el, (int)k));
+      }
+    }
+
+  for (int el=0; el<numOfLevels; ++el)
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree_structure[el][k];
+      int row = getRow(el, k);
+      if (!thisBox.isLeaf() && el >= 2)                                                     // 1
+        for (int m=thisBox.getFirstChild(); m<thisBox.getFirstChild()+thisBox.getNumChildren(); ++m)
+          taskGraph.addDependency(upTask[getRow(el+1, m)], upTask[row]);
+      if (down1Task[row] < 0)
+        continue;
+      for (int j=vList.getBegin(row); j<vList.getEnd(row); ++j)                             // 2
+        taskGraph.addDependency(upTask[getRow(el, vList.getFirst(j))], down1Task[row]);
+      taskGraph.addDependency(down1Task[row], down2Task[row]);                              // 3
+      if (el > 2)
+        taskGraph.addDependency(down2Task[getRow(el-1, thisBox.getParent())], down2Task[row]);
+    }
+
+  for (unsigned int i=0; i<leaves.size(); ++i)
+  {
+    int el = leaves[i].first;
+    int row = getRow(el, leaves[i].second);
+    if (tree_structure[el][leaves[i].second].getSizeY() == 0)
+      continue;
+    int evalTask = taskGraph.addTask(EVAL_TASK);
+    taskBox.push_back(leaves[i]);
+    if (el >= 2)                                                                            // 4
+      taskGraph.addDependency(down2Task[row], evalTask);
+    for (int m=wList.getBegin(row); m<wList.getEnd(row); ++m)
+    {
+      int wTask = upTask[getRow(wList.getFirst(m), wList.getSecond(m))];
+      if (wTask >= 0)
+        taskGraph.addDependency(wTask, evalTask);
+    }
+    taskGraph.addTask(NEAR_TASK);
+    taskBox.push_back(leaves[i]);
+  }
+  taskGraph.finalize();
+}
+
+/**
+ * Explanation of runTasks(u, v)
+ *
+ * apply with the scheduler TASKS: the charges are gathered, the coefficients
+ * and the two parts of the potential are set to zero, the tasks of the graph
+ * are run (runTask) and the potentials are put into the input order of the
+ * targets (as in evaluateFar).  The phases overlap, so their wall times can
+ * not be measured one by one: the time of a phase in stats is the time the
+ * threads spent in its tasks divided by the number of threads (the sum over
+ * the phases is the time of the passes, less the time the threads waited for
+ * a ready task).  The hardware counters are not read for the tasks.
+ */
+void FmmTree::runTasks(const double *u, double *v)
+{
+  stats.resetPasses();
+  clearCoefficients();
+  sources.setCharge(u);
+  if (precision == MIXED_PRECISION)
+    prepareMixed();
+  nearPart.assign(targets.size(), 0.0);
+  farPart.assign(targets.size(), 0.0);
+  if (taskGraph.isEmpty())
+    buildTaskGraph();
+
+  if (verbosity >= INFO)
+    *logStream << "FmmTree: " << sources.size() << " sources, " << targets.size()
+               << " targets, " << numOfLevels << " levels, " << leaves.size()
+               << " leaves, p = " << potential.getP() << ", " << taskGraph.size() << " tasks" << "\n";
+
+  taskTime.assign(numThreads*TASK_TIME_STRIDE, 0.0);
+  taskGraph.run(numThreads, [this](int task, int thread) { runTask(task, thread); });
+  for (int t=0; t<numThreads; ++t)
+    for (int k=FmmStats::BUILD+1; k<FmmStats::NUM_PHASES; ++k)
+      stats.time[k] += taskTime[t*TASK_TIME_STRIDE + k] / numThreads;
+
+  for (int j=0; j<targets.size(); ++j)
+    v[targets.index[j]] = nearPart[j] + farPart[j];
+}
+
+// the kernels of one task (see buildTaskGraph) and their times
+void FmmTree::runTask(int task, int thread)
+{
+  int level = taskBox[task].first;
+  int pos = taskBox[task].second;
+  double *time = &taskTime[thread*TASK_TIME_STRIDE];
+  double start = getTaskClock();
+  switch (taskGraph.kind[task])
+  {
+    case UP_TASK:
+      if (tree_structure[level][pos].isLeaf())
+      {
+        p2mBox(level, pos, false);
+        time[FmmStats::P2M] += getTaskClock() - start;
+      }
+      else
+      {
+        m2mBox(level, pos);
+        time[FmmStats::M2M] += getTaskClock() - start;
+      }
+      break;
+    case DOWN1_TASK:
+      m2lBox(level, pos);
+      if (xList.size() > 0)
+      {
+        double middle = getTaskClock();
+        time[FmmStats::M2L] += middle - start;
+        p2lBox(level, pos);
+        time[FmmStats::P2L] += getTaskClock() - middle;
+      }
+      else
+        time[FmmStats::M2L] += getTaskClock() - start;
+      break;
+    case DOWN2_TASK:
+      l2lBox(level, pos);
+      time[FmmStats::L2L] += getTaskClock() - start;
+      break;
+    case EVAL_TASK:
+      l2pBox(level, pos);
+      if (wList.size() > 0)
+      {
+        double middle = getTaskClock();
+        time[FmmStats::L2P] += middle - start;
+        m2pBox(level, pos);
+        time[FmmStats::M2P] += getTaskClock() - middle;
+      }
+      else
+        time[FmmStats::L2P] += getTaskClock() - start;
+      break;
+    case NEAR_TASK:
+      p2pBox(level, pos);
+      time[FmmStats::P2P] += getTaskClock() - start;
+      break;
+  }
+}
+
+// seconds of a steady clock for the times of the tasks (0 with FMM2D_NO_STATS)
+double FmmTree::getTaskClock()
+{
+#ifdef FMM2D_NO_STATS
+  return 0.0;
+#else
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Explanation of countInteractions:
+//
+// The number of interactions of each phase (see FmmStats.cc) only depends on
+// the boxes and the interaction lists, so they are counted once after the
+// tree is built.  The memory of the tree (bytes) counts the particles, the
+// boxes, the coefficient arenas, the interaction lists and the translation
+// matrices (not the copies x and y of the points).
+void FmmTree::countInteractions()
+{
+  taskGraph.clear();                     // built again by the next apply with TASKS
+  gpu.invalidate();                      // and sent again by the next apply with a GPU
+  mixedReady = false;                    // and the float data of MIXED_PRECISION
+  int p = potential.getP();
+  for (int k=FmmStats::BUILD+1; k<FmmStats::NUM_PHASES; ++k)
+    stats.count[k] = 0;
+  stats.boxesPerLevel.assign(numOfLevels, 0);
+  stats.leavesPerLevel.assign(numOfLevels, 0);
+  stats.m2lPerLevel.assign(numOfLevels, 0);
+
+  for (int el=0; el<numOfLevels; ++el)
+  {
+    stats.boxesPerLevel[el] = tree_structure[el].size();
+    for (unsigned int k=0; k<tree_structure[el].size(); ++k)
+    {
+      Box& thisBox = tree_structure[el][k];
+      int row = getRow(el, k);
+      if (el >= 3 && thisBox.getSizeX() > 0)
+        stats.count[FmmStats::M2M]++;
+      if (el >= 3 && thisBox.getSizeY() > 0)
+        stats.count[FmmStats::L2L]++;
+      stats.m2lPerLevel[el] += vList.getEnd(row) - vList.getBegin(row);
+      for (int j=xList.getBegin(row); j<xList.getEnd(row); ++j)
+        stats.count[FmmStats::P2L] += xList.getSecond(j) - xList.getFirst(j);
+      if (!thisBox.isLeaf())
+        continue;
+      stats.leavesPerLevel[el]++;
+      long long numTargets = thisBox.getSizeY();
+      stats.count[FmmStats::P2M] += thisBox.getSizeX();
+      if (el >= 2)
+        stats.count[FmmStats::L2P] += numTargets;
+      stats.count[FmmStats::M2P] += numTargets * (wList.getEnd(row) - wList.getBegin(row));
+      for (int m=uList.getBegin(row); m<uList.getEnd(row); ++m)
+        stats.count[FmmStats::P2P] += numTargets * (uList.getSecond(m) - uList.getFirst(m));
+    }
+  }
+  stats.count[FmmStats::M2L] = vList.size();
+
+  for (int k=FmmStats::BUILD+1; k<FmmStats::NUM_PHASES; ++k)
+    stats.flops[k] = (long long)(stats.count[k] * FmmStats::getFlopsPerInteraction(k, p));
+
+  stats.uListEntries = uList.size();
+  stats.vListEntries = vList.size();
+  stats.wListEntries = wList.size();
+  stats.xListEntries = xList.size();
+
+  size_t bytes = 0;
+  bytes += (sources.size() + targets.size())
+           * (3*sizeof(double) + sizeof(int) + sizeof(long long));
+  for (int el=0; el<numOfLevels; ++el)
+    bytes += tree_structure[el].size()*sizeof(Box)
+             + coefficients[el].size()*sizeof(std::complex<double>);
+  InteractionList *lists[4] = { &uList, &vList, &wList, &xList };
+  for (int k=0; k<4; ++k)
+    bytes += (lists[k]->start.size() + 2*lists[k]->first.size())*sizeof(int);
+  for (unsigned int m=0; m<operators.ss.size(); ++m)
+    bytes += operators.ss[m].size()*sizeof(std::complex<double>);
+  for (unsigned int m=0; m<operators.rr.size(); ++m)
+    bytes += operators.rr[m].size()*sizeof(std::complex<double>);
+  for (unsigned int m=0; m<operators.sr.size(); ++m)
+    bytes += (operators.sr[m].size() + operators.srPower[m].size() + 1)*sizeof(std::complex<double>);
+  bytes += operators.pascal.size()*sizeof(double);
+  stats.bytes = bytes;
+}
+
+
+// Explanation of applyBatch:
+//
+// the FMM for numRhs charge vectors on the same tree at once (for example
+// for block Krylov methods or several species of particles).  The charges of
+// vector r are u[r*N], ..., u[r*N + N-1] with N sources (the vectors are
+// the columns of an N x numRhs matrix stored column by column) and the
+// potentials of vector r are written to v[r*M], ..., v[r*M + M-1] with
+// M targets.  Each result is the same as apply for the charges of its
+// column (up to rounding).
+//
+// Each box keeps numRhs series, a p x numRhs matrix of coefficients, stored
+// row by row (the numRhs coefficients of the same term are next to each
+// other, see getBatchSeries):
+//   - P2M and P2L: the coefficients of a point with charge 1 are computed once
+//     and multiplied with its numRhs charges
+//   - M2M, M2L and L2L: each translation matrix is multiplied with the p x numRhs
+//     matrix of the series (Potential::applyTranslationBatch), so a matrix is
+//     loaded once for all charge vectors instead of once for each of them
+//   - L2P and M2P: the powers of y - center are computed once for each target
+//   - P2P: the logarithm of each pair is computed once (NearField::evaluateBatch)
+// The work that only depends on the points is done once for all charge vectors
+// and the translations, which dominate the FMM, become matrix-matrix products.
+void FmmTree::applyBatch(const double *u, int numRhs, double *v)
+{
+  assert(numRhs > 0 && "FmmTree::applyBatch numRhs < 1");
+  this->numRhs = numRhs;
+  int p = potential.getP();
+
+  stats.resetPasses();
+  batchCoefficients.resize(numOfLevels);
+  for (int el=0; el<numOfLevels; ++el)
+    batchCoefficients[el].assign((size_t)3*tree_structure[el].size()*p*numRhs,
+                                 std::complex<double>(0.0));
+
+  if (verbosity >= INFO)
+    *logStream << "Starting batch of " << numRhs << " charge vectors..." << "\n";
+  upwardPassBatch(u);
+  downwardPass1Batch();
+  downwardPass2Batch();
+  evaluateBatch(v);
+
+  numOpsIndirect += numRhs * stats.getTotalFlops();
+  if (verbosity >= INFO)
+    *logStream << stats.toString();
+}
+
+std::vector<double> FmmTree::solveBatch(std::vector<double> &u, int numRhs)
+{
+  assert((int)u.size() >= sources.size()*numRhs && "FmmTree::solveBatch fewer charges than sources");
+  std::vector<double> v((size_t)targets.size()*numRhs);
+  if (v.size() > 0)
+    applyBatch(u.size() > 0 ? &u[0] : NULL, numRhs, &v[0]);
+  return v;
+}
+
+// upwardPass for applyBatch (see upwardPass and applyBatch)
+void FmmTree::upwardPassBatch(const double *u)
+{
+  int p = potential.getP();
+  int numSources = sources.size();
+  batchCharge.resize((size_t)numSources*numRhs);
+  for (int j=0; j<numSources; ++j)
+    for (int r=0; r<numRhs; ++r)
+      batchCharge[(size_t)j*numRhs + r] = u[(size_t)r*numSources + sources.index[j]];
+
+  {
+  PhaseTimer timer(stats, FmmStats::P2M, counters);
+  int leafBoxes = leaves.size();
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    if (thisBox.getSizeX() == 0)
+      continue;
+    std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+    std::complex<double> *c = getBatchSeries(leaves[i].first, leaves[i].second, 0);
+    std::vector<std::complex<double> > B(p);
+    for (int j=thisBox.getBeginX(); j<thisBox.getEndX(); ++j)
+    {
+      std::complex<double> thisXCoord(sources.xCoord[j], sources.yCoord[j]);
+      std::fill(B.begin(), B.end(), std::complex<double>(0.0));
+      potential.addSCoeff(thisXCoord, thisBoxCenter, 1.0, &B[0],
+                          TranslationOperators::getScale(leaves[i].first));
+      const double *q = &batchCharge[(size_t)j*numRhs];
+      for (int k=0; k<p; ++k)
+        for (int r=0; r<numRhs; ++r)
+          c[k*numRhs + r] += q[r] * B[k];
+    }
+  }
+  }
+
+  PhaseTimer timer(stats, FmmStats::M2M, counters);
+  for (int el = numOfLevels-2; el>=2; --el)
+  {
+    int parentBoxes = tree_structure[el].size();
+    #pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int k=0; k<parentBoxes; ++k)
+    {
+      Box& parentBox = tree_structure[el][k];
+      int firstChild = parentBox.getFirstChild();
+      for (int m=firstChild; m<firstChild+parentBox.getNumChildren(); ++m)
+      {
+        Box& thisBox = tree_structure[el+1][m];
+        if (thisBox.getSizeX() == 0)
+          continue;
+        potential.applyTranslationBatch(&operators.getSS(thisBox.getIndex() & 3)[0],
+                                        getBatchSeries(el+1, m, 0), getBatchSeries(el, k, 0), numRhs);
+      }
+    }
+  }
+}
+
+// downwardPass1 for applyBatch
+void FmmTree::downwardPass1Batch()
+{
+  int p = potential.getP();
+  for (int el=2; el<numOfLevels; ++el)
+  {
+    int levelBoxes = tree_structure[el].size();
+    {
+    PhaseTimer timer(stats, FmmStats::M2L, counters);
+    double logScale = TranslationOperators::getLogScale(el);
+    #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+    for (int k=0; k<levelBoxes; ++k)
+    {
+      int row = getRow(el, k);
+      std::complex<double> *dtilde = getBatchSeries(el, k, 1);
+      for (int j=vList.getBegin(row); j<vList.getEnd(row); ++j)
+      {
+        const std::complex<double> *c = getBatchSeries(el, vList.getFirst(j), 0);
+        potential.applyTranslationBatch(&operators.getSR(vList.getSecond(j))[0], c, dtilde, numRhs);
+        for (int r=0; r<numRhs; ++r)                   // term log s of the level (see applySR)
+          dtilde[r] += c[r] * logScale;
+      }
+    }
+    }
+
+    if (xList.size() == 0)
+      continue;
+    PhaseTimer timer(stats, FmmStats::P2L, counters);
+    #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+    for (int k=0; k<levelBoxes; ++k)
+    {
+      Box& thisBox = tree_structure[el][k];
+      int row = getRow(el, k);
+      if (xList.getBegin(row) == xList.getEnd(row))
+        continue;
+      std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+      double scale = TranslationOperators::getScale(el);
+      std::complex<double> *dtilde = getBatchSeries(el, k, 1);
+      std::vector<std::complex<double> > B(p);
+      for (int j=xList.getBegin(row); j<xList.getEnd(row); ++j)
+        for (int q=xList.getFirst(j); q<xList.getSecond(j); ++q)
+        {
+          std::complex<double> thisXCoord(sources.xCoord[q], sources.yCoord[q]);
+          std::fill(B.begin(), B.end(), std::complex<double>(0.0));
+          potential.addRCoeff(thisXCoord, thisBoxCenter, 1.0, &B[0], scale);
+          const double *charge = &batchCharge[(size_t)q*numRhs];
+          for (int t=0; t<p; ++t)
+            for (int r=0; r<numRhs; ++r)
+              dtilde[t*numRhs + r] += charge[r] * B[t];
+        }
+    }
+  }
+}
+
+// downwardPass2 for applyBatch
+void FmmTree::downwardPass2Batch()
+{
+  if (numOfLevels < 3)
+    return;
+
+  int n = potential.getP()*numRhs;
+  PhaseTimer timer(stats, FmmStats::L2L, counters);
+  int levelTwoBoxes = tree_structure[2].size();
+  #pragma omp parallel for schedule(static) num_threads(numThreads)
+  for (int i=0; i<levelTwoBoxes; ++i)
+  {
+    std::complex<double> *d = getBatchSeries(2, i, 2);
+    const std::complex<double> *dtilde = getBatchSeries(2, i, 1);
+    for (int k=0; k<n; ++k)
+      d[k] += dtilde[k];
+  }
+
+  for (int el=2; el<numOfLevels-1; ++el)
+  {
+    int childBoxes = tree_structure[el+1].size();
+    #pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int m=0; m<childBoxes; ++m)
+    {
+      Box& thisBoxChild = tree_structure[el+1][m];
+      if (thisBoxChild.getSizeY() == 0)
+        continue;
+      std::complex<double> *d = getBatchSeries(el+1, m, 2);
+      potential.applyTranslationBatch(&operators.getRR(thisBoxChild.getIndex() & 3)[0],
+                                      getBatchSeries(el, thisBoxChild.getParent(), 2), d, numRhs);
+      const std::complex<double> *dtilde = getBatchSeries(el+1, m, 1);
+      for (int k=0; k<n; ++k)
+        d[k] += dtilde[k];
+    }
+  }
+}
+
+// evaluate for applyBatch: the near field, the R-expansions and the
+// S-expansions of the wList are added for each sorted target in batchPart
+// (numRhs potentials for each target) and then written to v (see applyBatch)
+void FmmTree::evaluateBatch(double *v)
+{
+  int p = potential.getP();
+  int leafBoxes = leaves.size();
+  int numTargets = targets.size();
+  batchPart.assign((size_t)numTargets*numRhs, 0.0);
+
+  {
+  PhaseTimer timer(stats, FmmStats::P2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    int yBegin = thisBox.getBeginY();
+    int yEnd = thisBox.getEndY();
+    if (yEnd == yBegin)
+      continue;
+    int row = getRow(leaves[i].first, leaves[i].second);
+    for (int m=uList.getBegin(row); m<uList.getEnd(row); ++m)
+    {
+      int xBegin = uList.getFirst(m);
+      nearField.evaluateBatch(&targets.xCoord[yBegin], &targets.yCoord[yBegin], yEnd - yBegin,
+                              &sources.xCoord[xBegin], &sources.yCoord[xBegin],
+                              &batchCharge[(size_t)xBegin*numRhs], uList.getSecond(m) - xBegin,
+                              numRhs, &batchPart[(size_t)yBegin*numRhs]);
+    }
+  }
+  }
+
+  // the real part of sum_k coeff[k] z^k for the numRhs series of a box, with
+  // the powers z^k (or log z and z^(-k)) computed once for each target
+  {
+  PhaseTimer timer(stats, FmmStats::L2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    if (thisBox.getLevel() < 2 || thisBox.getSizeY() == 0)
+      continue;
+    std::complex<double> thisBoxCenter = thisBox.getCenter().getCoord();
+    const std::complex<double> *d = getBatchSeries(leaves[i].first, leaves[i].second, 2);
+    double scale = TranslationOperators::getScale(leaves[i].first);
+    std::vector<std::complex<double> > power(p);
+    for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+    {
+      std::complex<double> z = (std::complex<double>(targets.xCoord[j], targets.yCoord[j]) - thisBoxCenter) / scale;
+      power[0] = 1.0;
+      for (int k=1; k<p; ++k)
+        power[k] = power[k-1] * z;
+      double *vj = &batchPart[(size_t)j*numRhs];
+      for (int k=0; k<p; ++k)
+        for (int r=0; r<numRhs; ++r)
+          vj[r] += d[k*numRhs + r].real()*power[k].real() - d[k*numRhs + r].imag()*power[k].imag();
+    }
+  }
+  }
+
+  if (wList.size() > 0)
+  {
+  PhaseTimer timer(stats, FmmStats::M2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+  {
+    Box& thisBox = tree_structure[leaves[i].first][leaves[i].second];
+    int row = getRow(leaves[i].first, leaves[i].second);
+    if (wList.getBegin(row) == wList.getEnd(row))
+      continue;
+    std::vector<std::complex<double> > power(p);
+    for (int j=thisBox.getBeginY(); j<thisBox.getEndY(); ++j)
+    {
+      std::complex<double> thisYCoord(targets.xCoord[j], targets.yCoord[j]);
+      double *vj = &batchPart[(size_t)j*numRhs];
+      for (int m=wList.getBegin(row); m<wList.getEnd(row); ++m)
+      {
+        int wLevel = wList.getFirst(m);
+        int wPos = wList.getSecond(m);
+        std::complex<double> z = thisYCoord - tree_structure[wLevel][wPos].getCenter().getCoord();
+        std::complex<double> w = TranslationOperators::getScale(wLevel) / z;
+        power[0] = std::log(z);
+        if (p > 1)
+          power[1] = w;
+        for (int k=2; k<p; ++k)
+          power[k] = power[k-1] * w;
+        const std::complex<double> *c = getBatchSeries(wLevel, wPos, 0);
+        for (int k=0; k<p; ++k)
+          for (int r=0; r<numRhs; ++r)
+            vj[r] += c[k*numRhs + r].real()*power[k].real() - c[k*numRhs + r].imag()*power[k].imag();
+      }
+    }
+  }
+  }
+
+  for (int j=0; j<numTargets; ++j)
+    for (int r=0; r<numRhs; ++r)
+      v[(size_t)r*numTargets + targets.index[j]] = batchPart[(size_t)j*numRhs + r];
+}
+
+
+std::vector<double> FmmTree::solveDirect(std::vector<double> &u)
+{
+  std::vector<double> v(targets.size());
+  std::vector<int> sourcePos, targetPos;
+  sources.getInputPositions(sourcePos);
+  targets.getInputPositions(targetPos);
+  long ops = 0;
+  int numTargets = v.size();
+
+  // the targets are shared among the threads (each thread sums over all sources)
+  #pragma omp parallel for schedule(static) num_threads(numThreads) reduction(+:ops)
+  for (int j=0; j<numTargets; ++j)
+    v[j] = directPotential(&u[0], targetPos[j], sourcePos, ops);
+  numOpsDirect += ops;
+
+  return v;
+}
+
+// the same as solveDirect(u) but only for the targets y[targetIndexes[k]]:
+// the potential of target y[targetIndexes[k]] is returned in position k
+// (for example to check the FMM for a sample of the targets of a large problem)
+std::vector<double> FmmTree::solveDirect(std::vector<double> &u, const std::vector<int> &targetIndexes)
+{
+  std::vector<double> v(targetIndexes.size());
+  std::vector<int> sourcePos, targetPos;
+  sources.getInputPositions(sourcePos);
+  targets.getInputPositions(targetPos);
+  long ops = 0;
+  int numTargets = v.size();
+
+  #pragma omp parallel for schedule(static) num_threads(numThreads) reduction(+:ops)
+  for (int k=0; k<numTargets; ++k)
+    v[k] = directPotential(&u[0], targetPos[targetIndexes[k]], sourcePos, ops);
+  numOpsDirect += ops;
+
+  return v;
+}
+
+// complex potential and field (see applyField) by the direct sum over all
+// pairs (O(N^2), to check applyField), skipping the pairs of the same point
+// as solveDirect.  The logarithm is the principal value for each pair.
+void FmmTree::solveDirectField(std::vector<double> &u, std::vector<std::complex<double> > &phi,
+                               std::vector<std::complex<double> > &dphi)
+{
+  phi.assign(targets.size(), std::complex<double>(0.0));
+  dphi.assign(targets.size(), std::complex<double>(0.0));
+  std::vector<int> sourcePos, targetPos;
+  sources.getInputPositions(sourcePos);
+  targets.getInputPositions(targetPos);
+  long ops = 0;
+  int numSources = sources.size();
+  int numTargets = targets.size();
+
+  #pragma omp parallel for schedule(static) num_threads(numThreads) reduction(+:ops)
+  for (int j=0; j<numTargets; ++j)
+  {
+    std::complex<double> yj(targets.xCoord[targetPos[j]], targets.yCoord[targetPos[j]]);
+    for (int i=0; i<numSources; ++i)
+    {
+      std::complex<double> xi(sources.xCoord[sourcePos[i]], sources.yCoord[sourcePos[i]]);
+      std::complex<double> z = yj - xi;
+      double maxXYOne = std::max(1.0, std::max(std::abs(yj), std::abs(xi)));
+      if (std::abs(z) <= std::numeric_limits<double>::epsilon()*maxXYOne)
+        continue;
+      phi[j] += u[i] * potential.direct(yj, xi);
+      dphi[j] += u[i] / z;
+      ops++;
+    }
+  }
+  numOpsDirect += ops;
+}
+
+// potential at the target in position j of the sorted targets of all sources
+// x[i] with charges u[i] (direct sum), x[i] is in position sourcePos[i] of the
+// sorted sources (see Particles::getInputPositions), the sum is in the order
+// of the input
+double FmmTree::directPotential(const double *u, int j, const std::vector<int> &sourcePos, long &ops)
+{
+  double v = 0.0;
+  std::complex<double> potential_direct_calculation;
+  std::complex<double> yj(targets.xCoord[j], targets.yCoord[j]);
+  for (unsigned int i=0; i<sourcePos.size(); ++i)
+  {
+    std::complex<double> xi(sources.xCoord[sourcePos[i]], sources.yCoord[sourcePos[i]]);
+    // taking care of relative and absolute difference
+    // issues for when x[i] and y[j] are both small
+    // or both large (see explanation in FmmTree member function solve
+    // above)
+    double maxXY = std::max(std::abs(yj), std::abs(xi));
+    double maxXYOne = std::max(1.0,maxXY);
+    if (std::abs(yj-xi) <= std::numeric_limits<double>::epsilon()*maxXYOne)
+    {
+      // Do nothing - y[j] and x[i] are the same point
+  	// (up to machine epsilon)
+  	// This happens when the target and source points are the same.
+  	// Specifically, this happens when y[j] and x[i] are a target
+  	// point and a source point in the same box (and the target
+  	// and source points are the same).
+  	// Also, physically it does not make sense for a particle y[j] to act
+  	// on itself
+    }
+    else // target and source points y[j] and x[i] are not the same
+    {
+      potential_direct_calculation = u[i] * potential.direct(yj, xi);
+      v += potential_direct_calculation.real();
+      ops++;
+    }
+  }
   return v;
 }
@@ -0,0 +1,203 @@
+/*
+ * FmmTuning.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include "FmmTuning.h"
+#include "NearField.h"
+#include "Potential.h"
+
+/**
+ * Header Interface for Class FmmTuning
+ *
+class FmmTuning
+{
+  public:
+    static const double ERROR_CONSTANT;
+    static const double ERROR_RATIO;
+
+    double p2pTime;                        // seconds for one source-target pair of the near field
+    double m2lTime;                        // seconds for one matrix entry of a translation
+
+    FmmTuning();
+
+    void   calibrate(int p);
+
+    static int getP(double relativeError);
+    double getLeafSize(int p);
+    double getEstimatedTime(int numParticles, int p, double leafSize);
+    int    getNumOfLevels(int numParticles, int p);
+    int    getMaxParticlesPerBox(int p);
+};
+*/
+
+/**
+ * Explanation of class FmmTuning
+ *
+ * The two parameters of the FMM are the index p at which the series are
+ * truncated and the number of particles s of a leaf box (the depth of the
+ * tree).  p is set by the accuracy that is needed, s by the time.  FmmTuning
+ * chooses both from the target error and the number of particles only (no
+ * trial trees are built):
+ *
+ * (1) getP - the error of the series of a box from the interaction list E_4
+ *     decreases like a geometric series in p.  For the test problems (uniform
+ *     points, error relative to the largest potential) the error is close to
+ *
+ *       error(p) = ERROR_CONSTANT * ERROR_RATIO^p = 0.1 * 0.4^p
+ *
+ *     (p = 4: 1.3e-3, p = 12: 3.5e-7, p = 20: 9.7e-10, p = 30: 3.0e-14), so the
+ *     smallest p with error(p) <= relativeError is used
+ *
+ * (2) getLeafSize - with N particles and s particles per leaf box there are
+ *     about N/s leaf boxes and 4/3 N/s boxes on all levels.  The time is
+ *
+ *       T(s) = N * 9 s * p2pTime                         (near field, 9 boxes)
+ *            + 4/3 N/s * (27 + 2) p^2 * m2lTime          (translations: E_4 has
+ *                                                       up to 27 boxes, plus the
+ *                                                       M2M and L2L of the box)
+ *            + N * 2 p * m2lTime                         (P2M and L2P)
+ *
+ *     The near field grows and the translations shrink with s, and T(s) is
+ *     smallest for
+ *
+ *       s = p * sqrt(4/3 * 29 / 9 * m2lTime / p2pTime)
+ *
+ * (3) getNumOfLevels - for the uniform tree the leaf boxes on level L-1 have
+ *     s = N / 4^(L-1) particles, and the number of levels L with the smallest
+ *     T(s) is used.  With one or two levels there are no translations and all
+ *     pairs are done directly (near field of N pairs for each target).
+ *
+ * (4) getMaxParticlesPerBox - for the adaptive tree a box is subdivided if it
+ *     has more than maxParticlesPerBox particles.  The four children of such a
+ *     box then have about a quarter of them, so the leaf boxes have about
+ *     0.4 * maxParticlesPerBox particles on average and maxParticlesPerBox = 2.5 s
+ *
+ * p2pTime and m2lTime are set to the values of a recent x86-64 processor by
+ * the constructor.  calibrate(p) measures them on the machine where the
+ * program runs (a few milliseconds): the near field kernel (class NearField)
+ * for 256 targets and 256 sources, and a translation (Potential::applyTranslation)
+ * with a p x p matrix.
+ */
+
+const double FmmTuning::ERROR_CONSTANT = 0.1;
+const double FmmTuning::ERROR_RATIO = 0.4;
+
+FmmTuning::FmmTuning()
+   :
+   p2pTime(2.0e-9),
+   m2lTime(1.5e-9)
+{}
+
+// smallest p with ERROR_CONSTANT * ERROR_RATIO^p <= relativeError
+// between the orders of the fixed-order translations (see Potential.cc);
+// an error that is not positive (or NaN) gets the most accurate order
+int FmmTuning::getP(double relativeError)
+{
+  if (!(relativeError > 0.0))
+    return Potential::MAX_FIXED_P;
+  double p = std::ceil(std::log(relativeError / ERROR_CONSTANT) / std::log(ERROR_RATIO));
+  p = std::min(std::max(p, (double)Potential::MIN_FIXED_P), (double)Potential::MAX_FIXED_P);
+  return (int)p;
+}
+
+double FmmTuning::getLeafSize(int p)
+{
+  return p * std::sqrt(4.0/3.0 * 29.0 / 9.0 * m2lTime / p2pTime);
+}
+
+double FmmTuning::getEstimatedTime(int numParticles, int p, double leafSize)
+{
+  double n = numParticles;
+  double s = std::max(leafSize, 1.0);
+  double nearPairs = std::min(9.0*s, n);                   // pairs for each target
+  double time = n * nearPairs * p2pTime;
+  if (9.0*s < n)                                           // boxes of E_4 exist
+    time += 4.0/3.0 * n / s * 29.0 * p * p * m2lTime + n * 2.0 * p * m2lTime;
+  return time;
+}
+
+// number of levels (levels 0, ..., L-1, see FmmTree(level, x, y, potential))
+// of the uniform tree with the smallest estimated time
+int FmmTuning::getNumOfLevels(int numParticles, int p)
+{
+  int bestLevels = 1;
+  double bestTime = getEstimatedTime(numParticles, p, numParticles);
+  for (int levels=2; levels<=16; ++levels)
+  {
+    double s = numParticles / std::pow(4.0, levels-1);
+    double time = getEstimatedTime(numParticles, p, s);
+    if (time < bestTime)
+    {
+      bestTime = time;
+      bestLevels = levels;
+    }
+    if (s < 1.0)
+      break;
+  }
+  return bestLevels;
+}
+
+int FmmTuning::getMaxParticlesPerBox(int p)
+{
+  return std::max(1, (int)std::floor(2.5 * getLeafSize(p) + 0.5));
+}
+
+// Explanation of calibrate:
+//
+// each kernel is run until at least a millisecond has passed and the time of
+// one call is divided by the number of pairs (near field) or matrix entries
+// (translation).  The points and the coefficients are arbitrary (but well
+// separated points, so the logarithm is always evaluated)
+void FmmTuning::calibrate(int p)
+{
+  typedef std::chrono::steady_clock Clock;
+  const double MIN_TIME = 1.0e-3;
+
+  int n = 256;
+  std::vector<double> tx(n), ty(n), sx(n), sy(n), q(n), v(n, 0.0);
+  for (int i=0; i<n; ++i)
+  {
+    tx[i] = (i % 16) / 16.0;
+    ty[i] = (i / 16) / 16.0;
+    sx[i] = tx[i] + 1.0/32.0;
+    sy[i] = ty[i] + 1.0/64.0;
+    q[i] = 1.0;
+  }
+  NearField nearField;
+  long calls = 0;
+  double elapsed = 0.0;
+  Clock::time_point start = Clock::now();
+  while (elapsed < MIN_TIME)
+  {
+    nearField.evaluate(&tx[0], &ty[0], n, &sx[0], &sy[0], &q[0], n, &v[0]);
+    ++calls;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  p2pTime = elapsed / ((double)calls * n * n);
+
+  Potential potential(p);
+  std::vector<std::complex<double> > matrix(p*p), in(p), out(p, 0.0);
+  for (int i=0; i<p*p; ++i)
+    matrix[i] = std::complex<double>(1.0/(i+1), -1.0/(i+2));
+  for (int i=0; i<p; ++i)
+    in[i] = std::complex<double>(0.5, 0.25/(i+1));
+  calls = 0;
+  elapsed = 0.0;
+  start = Clock::now();
+  while (elapsed < MIN_TIME)
+  {
+    for (int k=0; k<100; ++k)
+      potential.applyTranslation(&matrix[0], &in[0], &out[0]);
+    calls += 100;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  m2lTime = elapsed / ((double)calls * p * p);
+}
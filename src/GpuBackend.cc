@@ -0,0 +1,85 @@
+/*
+ * GpuBackend.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+// the CUDA implementation of GpuBackend is in GpuBackend.cu (compiled with
+// nvcc -DFMM2D_USE_CUDA), without CUDA there is no device
+
+#ifndef FMM2D_USE_CUDA
+
+#include <string>
+
+#include "GpuBackend.h"
+
+/**
+ * Header Interface for Class GpuBackend
+ *
+class GpuBackend
+{
+  public:
+    GpuBackend() : device(-1), uploaded(false), state(NULL) {};
+    ~GpuBackend() { close(); };
+    GpuBackend(const GpuBackend &backend) = delete;
+    GpuBackend& operator=(const GpuBackend &backend) = delete;
+
+    bool open(int device);                 // false if there is no such device (or no CUDA)
+    void close();
+    bool isOpen() { return this->device >= 0; };
+    std::string getDeviceName();
+
+    bool upload(FmmTree &tree);            // false if a CUDA call failed
+    bool isUploaded() { return this->uploaded; };
+    void invalidate() { this->uploaded = false; };
+
+    void startNear(FmmTree &tree);         // P2P from the sorted charges of the tree
+    bool finishNear(FmmTree &tree);        // adds to tree.nearPart, false if the device failed
+    void startM2L(FmmTree &tree);          // M2L from the coefficients C of all levels
+    bool finishM2L(FmmTree &tree);         // adds to the coefficients Dtilde, false if the device failed
+
+  private:
+    int device;
+    bool uploaded;
+    GpuState *state;
+};
+*/
+
+bool GpuBackend::open(int)
+{
+  return false;
+}
+
+void GpuBackend::close()
+{
+}
+
+std::string GpuBackend::getDeviceName()
+{
+  return "none";
+}
+
+bool GpuBackend::upload(FmmTree &)
+{
+  return false;
+}
+
+void GpuBackend::startNear(FmmTree &)
+{
+}
+
+bool GpuBackend::finishNear(FmmTree &)
+{
+  return false;
+}
+
+void GpuBackend::startM2L(FmmTree &)
+{
+}
+
+bool GpuBackend::finishM2L(FmmTree &)
+{
+  return false;
+}
+
+#endif /* FMM2D_USE_CUDA */
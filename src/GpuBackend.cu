@@ -0,0 +1,468 @@
+/*
+ * GpuBackend.cu
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+// compiled with nvcc -DFMM2D_USE_CUDA (see README.md), replaces GpuBackend.cc
+
+#ifdef FMM2D_USE_CUDA
+
+#include <complex>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cassert>
+
+#include <cuda_runtime.h>
+#include <cuComplex.h>
+
+#include "GpuBackend.h"
+#include "FmmTree.h"
+#include "Box.h"
+#include "TranslationOperators.h"
+
+/**
+ * Header Interface for Class GpuBackend
+ *
+class GpuBackend
+{
+  public:
+    GpuBackend() : device(-1), uploaded(false), state(NULL) {};
+    ~GpuBackend() { close(); };
+    GpuBackend(const GpuBackend &backend) = delete;
+    GpuBackend& operator=(const GpuBackend &backend) = delete;
+
+    bool open(int device);                 // false if there is no such device (or no CUDA)
+    void close();
+    bool isOpen() { return this->device >= 0; };
+    std::string getDeviceName();
+
+    bool upload(FmmTree &tree);            // false if a CUDA call failed
+    bool isUploaded() { return this->uploaded; };
+    void invalidate() { this->uploaded = false; };
+
+    void startNear(FmmTree &tree);         // P2P from the sorted charges of the tree
+    bool finishNear(FmmTree &tree);        // adds to tree.nearPart, false if the device failed
+    void startM2L(FmmTree &tree);          // M2L from the coefficients C of all levels
+    bool finishM2L(FmmTree &tree);         // adds to the coefficients Dtilde, false if the device failed
+
+  private:
+    int device;
+    bool uploaded;
+    GpuState *state;
+};
+*/
+
+/**
+ * Explanation of GpuBackend
+ *
+ * The sorted points (Morton order, class Particles) and the interaction lists
+ * of the tree are uploaded once (upload), and each apply only sends the
+ * charges and the S-expansions and gets back the near field and the
+ * R-expansions of the translations.  Two CUDA streams keep the two parts
+ * independent, so the P2P kernel runs while the host does the upward pass,
+ * and the M2L kernel while the host does the P2L, L2L and L2P work that does
+ * not need the translated series (see FmmTree::runGpuPasses).
+ *
+ * P2P (p2pKernel): one thread block for each leaf box with target points and
+ * one thread for each target (the block loops over the targets if there are
+ * more than P2P_THREADS).  The sources of each uList entry are a contiguous
+ * range of the sorted arrays; they are loaded in tiles of P2P_THREADS points
+ * into shared memory and every thread adds the tile to the potential of its
+ * target (tiled all-pairs).  The same kernel as NearField::evaluateScalar,
+ * 0.5 sum q log r^2 without the pairs closer than tol2.
+ *
+ * M2L (m2lKernel): one thread block for each box with vList entries and one
+ * thread for each of the p terms of its R-expansion.  For each entry the S-
+ * expansion of the source box is loaded into shared memory and each thread
+ * does one row of the p x p S|R matrix (a batch of small complex
+ * matrix-vector products).  The matrices of all levels are stored transposed
+ * (column by column), so the threads of a warp read consecutive elements.
+ *
+ * The sums are done in another order than on the CPU, so the results agree
+ * with the CPU passes up to rounding.
+ */
+
+// threads per block of the P2P kernel and size of its tiles of sources
+static const int P2P_THREADS = 128;
+
+struct GpuState
+{
+  cudaStream_t nearStream;
+  cudaStream_t farStream;
+
+  // P2P: the sorted points, the target range (yBegin, yEnd) of each leaf box
+  // with targets and its uList (source ranges from leafListStart[b] on)
+  int numSources, numTargets, numLeaves;
+  double *sourceX, *sourceY, *charge, *targetX, *targetY, *nearPart;
+  int *leafRange, *leafListStart, *listRange;
+  double *hostCharge, *hostNearPart;        // pinned copies
+
+  // M2L: the rows of the boxes with vList entries, their entries (row of the
+  // source box, matrix of the offset) and the matrices of all levels
+  int p, numRows, numM2LRows;
+  int *m2lRow, *m2lStart, *m2lSource, *m2lMatrix;
+  cuDoubleComplex *matrices, *c, *dtilde;
+  std::complex<double> *hostC, *hostDtilde;    // pinned, numRows * p
+  std::vector<int> hostM2LRow;
+  double tol2;
+
+  cudaError_t error;                       // first failed CUDA call since the upload (see cudaCheck)
+};
+
+// a CUDA call can fail at any time (out of device memory, a reset or lost
+// device), so the first error is kept in the state: upload and the finish
+// calls report it and FmmTree goes back to the CPU passes (as when open fails)
+static bool cudaCheck(GpuState *state, cudaError_t error)
+{
+  if (error != cudaSuccess && state->error == cudaSuccess)
+    state->error = error;
+  return error == cudaSuccess;
+}
+
+template <typename T>
+static T* deviceCopy(GpuState *state, const std::vector<T> &host)
+{
+  T *device = NULL;
+  if (!cudaCheck(state, cudaMalloc((void**)&device, (host.size() > 0 ? host.size() : 1)*sizeof(T))))
+    return NULL;
+  if (host.size() > 0)
+    cudaCheck(state, cudaMemcpy(device, &host[0], host.size()*sizeof(T), cudaMemcpyHostToDevice));
+  return device;
+}
+
+__global__ void p2pKernel(const int *leafRange, const int *leafListStart, const int *listRange,
+                          const double *sx, const double *sy, const double *q,
+                          const double *tx, const double *ty, double tol2, double *v)
+{
+  __shared__ double tileX[P2P_THREADS];
+  __shared__ double tileY[P2P_THREADS];
+  __shared__ double tileQ[P2P_THREADS];
+
+  int leaf = blockIdx.x;
+  int yBegin = leafRange[2*leaf];
+  int yEnd = leafRange[2*leaf+1];
+  for (int j0=yBegin; j0<yEnd; j0+=blockDim.x)
+  {
+    int j = j0 + threadIdx.x;
+    bool active = (j < yEnd);
+    double x = active ? tx[j] : 0.0;
+    double y = active ? ty[j] : 0.0;
+    double sum = 0.0;
+    for (int m=leafListStart[leaf]; m<leafListStart[leaf+1]; ++m)
+    {
+      int xEnd = listRange[2*m+1];
+      for (int i0=listRange[2*m]; i0<xEnd; i0+=blockDim.x)
+      {
+        int tile = min((int)blockDim.x, xEnd - i0);
+        __syncthreads();
+        if ((int)threadIdx.x < tile)
+        {
+          tileX[threadIdx.x] = sx[i0 + threadIdx.x];
+          tileY[threadIdx.x] = sy[i0 + threadIdx.x];
+          tileQ[threadIdx.x] = q[i0 + threadIdx.x];
+        }
+        __syncthreads();
+        if (active)
+          for (int k=0; k<tile; ++k)
+          {
+            double dx = x - tileX[k];
+            double dy = y - tileY[k];
+            double r2 = dx*dx + dy*dy;
+            sum += (r2 > tol2) ? tileQ[k] * log(r2) : 0.0;
+          }
+      }
+    }
+    if (active)
+      v[j] = 0.5 * sum;
+  }
+}
+
+__global__ void m2lKernel(int p, const int *m2lRow, const int *m2lStart, const int *m2lSource,
+                          const int *m2lMatrix, const cuDoubleComplex *matrices,
+                          const cuDoubleComplex *c, cuDoubleComplex *dtilde)
+{
+  extern __shared__ cuDoubleComplex sourceC[];
+
+  int b = blockIdx.x;
+  int i = threadIdx.x;
+  cuDoubleComplex sum = make_cuDoubleComplex(0.0, 0.0);
+  for (int e=m2lStart[b]; e<m2lStart[b+1]; ++e)
+  {
+    __syncthreads();
+    if (i < p)
+      sourceC[i] = c[(size_t)m2lSource[e]*p + i];
+    __syncthreads();
+    if (i < p)
+    {
+      // column k of the transposed matrix is row i of the S|R matrix
+      const cuDoubleComplex *matrix = matrices + (size_t)m2lMatrix[e]*p*p + i;
+      for (int k=0; k<p; ++k)
+        sum = cuCfma(matrix[k*p], sourceC[k], sum);
+    }
+  }
+  if (i < p)
+    dtilde[(size_t)m2lRow[b]*p + i] = sum;
+}
+
+bool GpuBackend::open(int device)
+{
+  close();
+  int numDevices = 0;
+  if (cudaGetDeviceCount(&numDevices) != cudaSuccess || device < 0 || device >= numDevices)
+    return false;
+  if (cudaSetDevice(device) != cudaSuccess)
+    return false;
+  state = new GpuState();
+  if (cudaStreamCreate(&state->nearStream) != cudaSuccess)
+  {
+    delete state;
+    state = NULL;
+    return false;
+  }
+  if (cudaStreamCreate(&state->farStream) != cudaSuccess)
+  {
+    cudaStreamDestroy(state->nearStream);
+    delete state;
+    state = NULL;
+    return false;
+  }
+  this->device = device;
+  uploaded = false;
+  return true;
+}
+
+// frees the buffers of the last upload (the streams stay) and clears the error
+static void freeBuffers(GpuState *state)
+{
+  void *deviceBuffers[] = { state->sourceX, state->sourceY, state->charge, state->targetX,
+                            state->targetY, state->nearPart, state->leafRange, state->leafListStart,
+                            state->listRange, state->m2lRow, state->m2lStart, state->m2lSource,
+                            state->m2lMatrix, state->matrices, state->c, state->dtilde };
+  for (unsigned int k=0; k<sizeof(deviceBuffers)/sizeof(deviceBuffers[0]); ++k)
+    if (deviceBuffers[k] != NULL)
+      cudaFree(deviceBuffers[k]);
+  void *hostBuffers[] = { state->hostCharge, state->hostNearPart, state->hostC, state->hostDtilde };
+  for (unsigned int k=0; k<sizeof(hostBuffers)/sizeof(hostBuffers[0]); ++k)
+    if (hostBuffers[k] != NULL)
+      cudaFreeHost(hostBuffers[k]);
+  cudaStream_t nearStream = state->nearStream;
+  cudaStream_t farStream = state->farStream;
+  *state = GpuState();
+  state->nearStream = nearStream;
+  state->farStream = farStream;
+}
+
+void GpuBackend::close()
+{
+  if (device < 0)
+    return;
+  cudaSetDevice(device);
+  freeBuffers(state);
+  cudaStreamDestroy(state->nearStream);
+  cudaStreamDestroy(state->farStream);
+  delete state;
+  state = NULL;
+  device = -1;
+  uploaded = false;
+}
+
+std::string GpuBackend::getDeviceName()
+{
+  if (device < 0)
+    return "none";
+  cudaDeviceProp properties;
+  if (cudaGetDeviceProperties(&properties, device) != cudaSuccess)
+    return "unknown";
+  return properties.name;
+}
+
+// Explanation of upload:
+//
+// [1] - the sorted points and the target ranges and uLists of the leaf boxes
+//       with targets (the source ranges of the uList)
+// [2] - the vList of each box with entries: the source box as a row of the
+//       tree (levelStart[l] + position, so the S-expansions of all levels are
+//       one array of numRows * p coefficients) and the index of its matrix
+//       among the S|R matrices of all levels (level * 49 + offset index)
+// [3] - the S|R matrices of each level, transposed and with the term log s of
+//       the level (see TranslationOperators.cc) in the entry [0][0], so that
+//       the kernel needs no other data of the level, and the pinned buffers
+//       of apply
+// If a CUDA call fails the buffers are freed again and upload returns false.
+bool GpuBackend::upload(FmmTree &tree)
+{
+  assert(device >= 0 && "GpuBackend::upload not open");
+  freeBuffers(state);
+  uploaded = false;
+  if (!cudaCheck(state, cudaSetDevice(device)))
+    return false;
+
+  int p = tree.potential.getP();
+  state->p = p;
+  state->tol2 = tree.nearField.tol2;
+  state->numSources = tree.sources.size();
+  state->numTargets = tree.targets.size();
+
+  std::vector<int> leafRange, leafListStart(1, 0), listRange;                // 1
+  for (unsigned int i=0; i<tree.leaves.size(); ++i)
+  {
+    Box& thisBox = tree.tree_structure[tree.leaves[i].first][tree.leaves[i].second];
+    if (thisBox.getSizeY() == 0)
+      continue;
+    int row = tree.getRow(tree.leaves[i].first, tree.leaves[i].second);
+    leafRange.push_back(thisBox.getBeginY());
+    leafRange.push_back(thisBox.getEndY());
+    for (int m=tree.uList.getBegin(row); m<tree.uList.getEnd(row); ++m)
+    {
+      listRange.push_back(tree.uList.getFirst(m));
+      listRange.push_back(tree.uList.getSecond(m));
+    }
+    leafListStart.push_back(listRange.size()/2);
+  }
+  state->numLeaves = leafListStart.size()-1;
+  state->sourceX = deviceCopy(state, tree.sources.xCoord);
+  state->sourceY = deviceCopy(state, tree.sources.yCoord);
+  state->targetX = deviceCopy(state, tree.targets.xCoord);
+  state->targetY = deviceCopy(state, tree.targets.yCoord);
+  state->leafRange = deviceCopy(state, leafRange);
+  state->leafListStart = deviceCopy(state, leafListStart);
+  state->listRange = deviceCopy(state, listRange);
+  cudaCheck(state, cudaMalloc((void**)&state->charge, std::max(state->numSources, 1)*sizeof(double)));
+  cudaCheck(state, cudaMalloc((void**)&state->nearPart, std::max(state->numTargets, 1)*sizeof(double)));
+  cudaCheck(state, cudaMallocHost((void**)&state->hostCharge, std::max(state->numSources, 1)*sizeof(double)));
+  cudaCheck(state, cudaMallocHost((void**)&state->hostNearPart, std::max(state->numTargets, 1)*sizeof(double)));
+
+  const int numOffsets = TranslationOperators::OFFSETS_PER_SIDE*TranslationOperators::OFFSETS_PER_SIDE;
+  int numOfLevels = tree.getNumOfLevels();
+  state->numRows = tree.levelStart[numOfLevels];
+  std::vector<int> m2lStart(1, 0), m2lSource, m2lMatrix;                    // 2
+  state->hostM2LRow.clear();
+  for (int el=2; el<numOfLevels; ++el)
+    for (unsigned int k=0; k<tree.tree_structure[el].size(); ++k)
+    {
+      int row = tree.getRow(el, k);
+      if (tree.vList.getBegin(row) == tree.vList.getEnd(row))
+        continue;
+      state->hostM2LRow.push_back(row);
+      for (int j=tree.vList.getBegin(row); j<tree.vList.getEnd(row); ++j)
+      {
+        m2lSource.push_back(tree.getRow(el, tree.vList.getFirst(j)));
+        m2lMatrix.push_back(el*numOffsets + tree.vList.getSecond(j));
+      }
+      m2lStart.push_back(m2lSource.size());
+    }
+  state->numM2LRows = state->hostM2LRow.size();
+  state->m2lRow = deviceCopy(state, state->hostM2LRow);
+  state->m2lStart = deviceCopy(state, m2lStart);
+  state->m2lSource = deviceCopy(state, m2lSource);
+  state->m2lMatrix = deviceCopy(state, m2lMatrix);
+
+  std::vector<cuDoubleComplex> matrices((size_t)std::max(numOfLevels, 1)*numOffsets*p*p,    // 3
+                                        make_cuDoubleComplex(0.0, 0.0));
+  for (int el=2; el<numOfLevels; ++el)
+    for (int m=0; m<numOffsets && m<(int)tree.operators.sr.size(); ++m)
+    {
+      const std::vector<std::complex<double> > &sr = tree.operators.sr[m];
+      if ((int)sr.size() != p*p)
+        continue;
+      cuDoubleComplex *transposed = &matrices[((size_t)el*numOffsets + m)*p*p];
+      for (int i=0; i<p; ++i)
+        for (int k=0; k<p; ++k)
+          transposed[(size_t)k*p + i] = make_cuDoubleComplex(sr[i*p+k].real(), sr[i*p+k].imag());
+      transposed[0].x += TranslationOperators::getLogScale(el);
+    }
+  state->matrices = deviceCopy(state, matrices);
+  size_t coefficientBytes = (size_t)std::max(state->numRows, 1)*p*sizeof(cuDoubleComplex);
+  cudaCheck(state, cudaMalloc((void**)&state->c, coefficientBytes));
+  cudaCheck(state, cudaMalloc((void**)&state->dtilde, coefficientBytes));
+  cudaCheck(state, cudaMallocHost((void**)&state->hostC, coefficientBytes));
+  cudaCheck(state, cudaMallocHost((void**)&state->hostDtilde, coefficientBytes));
+  if (state->error != cudaSuccess)
+  {
+    freeBuffers(state);
+    return false;
+  }
+  uploaded = true;
+  return true;
+}
+
+void GpuBackend::startNear(FmmTree &tree)
+{
+  if (state->numLeaves == 0 || state->error != cudaSuccess)
+    return;
+  std::copy(tree.sources.charge.begin(), tree.sources.charge.end(), state->hostCharge);
+  cudaCheck(state, cudaMemcpyAsync(state->charge, state->hostCharge, state->numSources*sizeof(double),
+                            cudaMemcpyHostToDevice, state->nearStream));
+  p2pKernel<<<state->numLeaves, P2P_THREADS, 0, state->nearStream>>>(
+      state->leafRange, state->leafListStart, state->listRange, state->sourceX, state->sourceY,
+      state->charge, state->targetX, state->targetY, state->tol2, state->nearPart);
+  cudaCheck(state, cudaGetLastError());
+  cudaCheck(state, cudaMemcpyAsync(state->hostNearPart, state->nearPart, state->numTargets*sizeof(double),
+                            cudaMemcpyDeviceToHost, state->nearStream));
+}
+
+// the targets of the leaf boxes without targets do not exist, so every
+// target gets its value from the kernel
+bool GpuBackend::finishNear(FmmTree &tree)
+{
+  if (state->numLeaves == 0)
+    return state->error == cudaSuccess;
+  cudaCheck(state, cudaStreamSynchronize(state->nearStream));
+  if (state->error != cudaSuccess)
+    return false;
+  for (int j=0; j<state->numTargets; ++j)
+    tree.nearPart[j] += state->hostNearPart[j];
+  return true;
+}
+
+void GpuBackend::startM2L(FmmTree &tree)
+{
+  if (state->numM2LRows == 0 || state->error != cudaSuccess)
+    return;
+  int p = state->p;
+  for (int el=2; el<tree.getNumOfLevels(); ++el)
+  {
+    int levelBoxes = tree.tree_structure[el].size();
+    if (levelBoxes > 0)
+      std::copy(tree.tree_structure[el][0].getC(), tree.tree_structure[el][0].getC() + (size_t)levelBoxes*p,
+                state->hostC + (size_t)tree.levelStart[el]*p);
+  }
+  size_t first = (size_t)tree.levelStart[2]*p;
+  size_t bytes = ((size_t)state->numRows*p - first)*sizeof(cuDoubleComplex);
+  cudaCheck(state, cudaMemcpyAsync(state->c + first, state->hostC + first, bytes,
+                            cudaMemcpyHostToDevice, state->farStream));
+  int threads = ((p + 31)/32)*32;
+  m2lKernel<<<state->numM2LRows, threads, p*sizeof(cuDoubleComplex), state->farStream>>>(
+      p, state->m2lRow, state->m2lStart, state->m2lSource, state->m2lMatrix, state->matrices,
+      state->c, state->dtilde);
+  cudaCheck(state, cudaGetLastError());
+  cudaCheck(state, cudaMemcpyAsync(state->hostDtilde + first, state->dtilde + first, bytes,
+                            cudaMemcpyDeviceToHost, state->farStream));
+}
+
+bool GpuBackend::finishM2L(FmmTree &tree)
+{
+  if (state->numM2LRows == 0)
+    return state->error == cudaSuccess;
+  int p = state->p;
+  cudaCheck(state, cudaStreamSynchronize(state->farStream));
+  if (state->error != cudaSuccess)
+    return false;
+  int el = 2;
+  for (int b=0; b<state->numM2LRows; ++b)
+  {
+    int row = state->hostM2LRow[b];
+    while (row >= tree.levelStart[el+1])
+      ++el;
+    Box& thisBox = tree.tree_structure[el][row - tree.levelStart[el]];
+    std::complex<double> *dtilde = thisBox.getDtilde();
+    const std::complex<double> *result = state->hostDtilde + (size_t)row*p;
+    for (int i=0; i<p; ++i)
+      dtilde[i] += result[i];
+  }
+  return true;
+}
+
+#endif /* FMM2D_USE_CUDA */
@@ -0,0 +1,87 @@
+/*
+ * InteractionList.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+
+#include "InteractionList.h"
+
+/**
+ * Header Interface for Class InteractionList
+ *
+class InteractionList
+{
+  public:
+    std::vector<int> start;
+    std::vector<int> first;
+    std::vector<int> second;
+
+    InteractionList() {};
+
+    void clear();
+    void add(int row, int a, int b);       // adding an entry (before finalize)
+    void finalize(int numRows);            // building the CSR arrays from the added entries
+
+    int  getBegin(int row) { return this->start[row]; };
+    int  getEnd(int row) { return this->start[row+1]; };
+    int  getFirst(int i) { return this->first[i]; };
+    int  getSecond(int i) { return this->second[i]; };
+    int  size() { return this->first.size(); };
+
+  private:
+    std::vector<int> pendingRow;           // rows of the entries added with add
+};
+*/
+
+void InteractionList::clear()
+{
+  start.clear();
+  first.clear();
+  second.clear();
+  pendingRow.clear();
+}
+
+// the entries can be added to the rows in any order (the lists of the
+// adaptive FMM add entries to other boxes than the one being looked at)
+void InteractionList::add(int row, int a, int b)
+{
+  pendingRow.push_back(row);
+  first.push_back(a);
+  second.push_back(b);
+}
+
+/**
+ * Explanation of finalize
+ *
+ * The added entries are sorted by their row with a counting sort:
+ * [1] - the number of entries of each row r is counted in start[r+1]
+ * [2] - a running sum gives the position start[r] of the first entry of row r
+ * [3] - each entry is placed at the next free position of its row
+ * The entries of a row keep the order in which they were added, so the passes
+ * of FmmTree add the contributions of the boxes of a list in the same order
+ * as when the lists were vectors of the boxes.
+ */
+void InteractionList::finalize(int numRows)
+{
+  int numEntries = pendingRow.size();
+  start.assign(numRows+1, 0);
+  for (int i=0; i<numEntries; ++i)                                       // 1
+    ++start[pendingRow[i]+1];
+  for (int r=0; r<numRows; ++r)                                          // 2
+    start[r+1] += start[r];
+
+  std::vector<int> next(start.begin(), start.end()-1);
+  std::vector<int> sortedFirst(numEntries);
+  std::vector<int> sortedSecond(numEntries);
+  for (int i=0; i<numEntries; ++i)                                       // 3
+  {
+    int pos = next[pendingRow[i]]++;
+    sortedFirst[pos] = first[i];
+    sortedSecond[pos] = second[i];
+  }
+  first.swap(sortedFirst);
+  second.swap(sortedSecond);
+  std::vector<int>().swap(pendingRow);
+}
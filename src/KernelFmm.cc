@@ -0,0 +1,433 @@
+/*
+ * KernelFmm.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <complex>
+#include <vector>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "KernelFmm.h"
+#include "FmmTree.h"
+#include "FmmStats.h"
+#include "Box.h"
+#include "LaplaceKernel.h"
+#include "YukawaKernel.h"
+
+/**
+ * Header Interface for Class KernelFmm
+ *
+template <class Kernel>
+class KernelFmm
+{
+  public:
+    FmmTree &tree;                         // boxes, lists, threads and scheduler
+    Kernel  &kernel;
+    int      numCoeff;                     // Kernel::getNumCoeff
+
+    // coefficients c, dtilde and d of all boxes of level l in coefficients[l]
+    // (three blocks [box][term], see FmmTree::allocateCoefficients)
+    std::vector<std::vector<std::complex<double> > > coefficients;
+
+    // near field and far field parts of the potentials at the sorted targets
+    std::vector<double> nearPart;
+    std::vector<double> farPart;
+
+    FmmStats stats;                        // counts of the tree and the times of the last apply
+    HardwareCounters counters;
+    std::vector<double> taskTime;          // scheduler TASKS (see FmmTree::runTasks)
+
+    KernelFmm(FmmTree &tree, Kernel &kernel);
+    KernelFmm(const KernelFmm &fmm) = delete;
+    KernelFmm& operator=(const KernelFmm &fmm) = delete;
+
+    void apply(const double *u, double *v);
+    std::vector<double> solve(std::vector<double> &u);
+    std::vector<double> solveDirect(std::vector<double> &u, const std::vector<int> &targetIndexes);
+    FmmStats& getStats() { return this->stats; };
+*/
+
+template <class Kernel>
+KernelFmm<Kernel>::KernelFmm(FmmTree &tree, Kernel &kernel)
+       :
+       tree(tree),
+       kernel(kernel),
+       numCoeff(kernel.getNumCoeff())
+{}
+
+// Explanation of apply:
+//
+// the potentials v of the kernel for the charges u (both in the order of the
+// input points of the tree), with the passes of FmmTree::apply: P2M and M2M
+// (upwardPass), M2L and P2L (downwardPass1), L2L (downwardPass2), P2P
+// (evaluateNear) and L2P and M2P (evaluateFar), or with the task graph of the
+// tree for the scheduler FmmTree::TASKS.  The tree only provides the boxes and
+// the lists: its precision, M2L engine and GPU are not used.
+template <class Kernel>
+void KernelFmm<Kernel>::apply(const double *u, double *v)
+{
+  prepare();
+  tree.sources.setCharge(u);
+  if (tree.scheduler == FmmTree::TASKS)
+  {
+    runTasks(v);
+    return;
+  }
+  upwardPass();
+  downwardPass1();
+  downwardPass2();
+  evaluateNear();
+  evaluateFar(v);
+}
+
+template <class Kernel>
+std::vector<double> KernelFmm<Kernel>::solve(std::vector<double> &u)
+{
+  assert((int)u.size() >= tree.sources.size() && "KernelFmm::solve fewer charges than sources");
+  std::vector<double> v(tree.targets.size());
+  if (tree.targets.size() > 0)
+    apply(u.size() > 0 ? &u[0] : NULL, &v[0]);
+  return v;
+}
+
+// the direct sums (Kernel::p2p with all sources) at the targets
+// targetIndexes (indexes of the input), for checking the error of apply
+template <class Kernel>
+std::vector<double> KernelFmm<Kernel>::solveDirect(std::vector<double> &u, const std::vector<int> &targetIndexes)
+{
+  assert((int)u.size() >= tree.sources.size() && "KernelFmm::solveDirect fewer charges than sources");
+  tree.sources.setCharge(u.size() > 0 ? &u[0] : NULL);
+  std::vector<int> position;
+  tree.targets.getInputPositions(position);
+  int numTargets = targetIndexes.size();
+  int numSources = tree.sources.size();
+  std::vector<double> v(numTargets, 0.0);
+  if (numSources == 0)
+    return v;
+  #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+  for (int k=0; k<numTargets; ++k)
+  {
+    int j = position[targetIndexes[k]];
+    kernel.p2p(&tree.targets.xCoord[j], &tree.targets.yCoord[j], 1,
+               &tree.sources.xCoord[0], &tree.sources.yCoord[0], &tree.sources.charge[0],
+               numSources, &v[k]);
+  }
+  return v;
+}
+
+// the tables of the kernel for the levels of the tree (built again when the
+// tree changed its depth), the coefficients set to zero and the counts of the
+// interactions of the tree (the operations per interaction of FmmStats are
+// those of the log kernel and are not counted)
+template <class Kernel>
+void KernelFmm<Kernel>::prepare()
+{
+  int numOfLevels = tree.getNumOfLevels();
+  if (kernel.getNumOfLevels() != numOfLevels)
+    kernel.build(numOfLevels);
+  numCoeff = kernel.getNumCoeff();
+  coefficients.resize(numOfLevels);
+  for (int l=0; l<numOfLevels; ++l)
+    coefficients[l].assign(3*tree.tree_structure[l].size()*(size_t)numCoeff, std::complex<double>(0.0));
+
+  stats = tree.stats;
+  stats.resetPasses();
+  for (int k=FmmStats::BUILD+1; k<FmmStats::NUM_PHASES; ++k)
+    stats.flops[k] = 0;
+  nearPart.assign(tree.targets.size(), 0.0);
+  farPart.assign(tree.targets.size(), 0.0);
+}
+
+// the loops of FmmTree::upwardPass, downwardPass1, downwardPass2,
+// evaluateNear and evaluateFar (see there for the order of the sums)
+template <class Kernel>
+void KernelFmm<Kernel>::upwardPass()
+{
+  {
+  PhaseTimer timer(stats, FmmStats::P2M, counters);
+  int leafBoxes = tree.leaves.size();
+  #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    p2mBox(tree.leaves[i].first, tree.leaves[i].second);
+  }
+
+  PhaseTimer timer(stats, FmmStats::M2M, counters);
+  for (int el=tree.numOfLevels-2; el>=2; --el)
+  {
+    int parentBoxes = tree.tree_structure[el].size();
+    #pragma omp parallel for schedule(static) num_threads(tree.numThreads)
+    for (int k=0; k<parentBoxes; ++k)
+      m2mBox(el, k);
+  }
+}
+
+template <class Kernel>
+void KernelFmm<Kernel>::downwardPass1()
+{
+  for (int el=2; el<tree.numOfLevels; ++el)
+  {
+    int levelBoxes = tree.tree_structure[el].size();
+    {
+    PhaseTimer timer(stats, FmmStats::M2L, counters);
+    #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+    for (int k=0; k<levelBoxes; ++k)
+      m2lBox(el, k);
+    }
+
+    if (tree.xList.size() == 0)
+      continue;
+    PhaseTimer timer(stats, FmmStats::P2L, counters);
+    #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+    for (int k=0; k<levelBoxes; ++k)
+      p2lBox(el, k);
+  }
+}
+
+template <class Kernel>
+void KernelFmm<Kernel>::downwardPass2()
+{
+  if (tree.numOfLevels < 3)
+    return;
+
+  PhaseTimer timer(stats, FmmStats::L2L, counters);
+  int levelTwoBoxes = tree.tree_structure[2].size();
+  #pragma omp parallel for schedule(static) num_threads(tree.numThreads)
+  for (int i=0; i<levelTwoBoxes; ++i)
+    l2lBox(2, i);
+
+  for (int el=2; el<tree.numOfLevels-1; ++el)
+  {
+    int childBoxes = tree.tree_structure[el+1].size();
+    #pragma omp parallel for schedule(static) num_threads(tree.numThreads)
+    for (int m=0; m<childBoxes; ++m)
+    {
+      if (tree.tree_structure[el+1][m].getSizeY() == 0)
+        continue;
+      l2lBox(el+1, m);
+    }
+  }
+}
+
+template <class Kernel>
+void KernelFmm<Kernel>::evaluateNear()
+{
+  int leafBoxes = tree.leaves.size();
+  PhaseTimer timer(stats, FmmStats::P2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    p2pBox(tree.leaves[i].first, tree.leaves[i].second);
+}
+
+template <class Kernel>
+void KernelFmm<Kernel>::evaluateFar(double *v)
+{
+  int leafBoxes = tree.leaves.size();
+  {
+  PhaseTimer timer(stats, FmmStats::L2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    l2pBox(tree.leaves[i].first, tree.leaves[i].second);
+  }
+
+  if (tree.wList.size() > 0)
+  {
+  PhaseTimer timer(stats, FmmStats::M2P, counters);
+  #pragma omp parallel for schedule(dynamic,16) num_threads(tree.numThreads)
+  for (int i=0; i<leafBoxes; ++i)
+    m2pBox(tree.leaves[i].first, tree.leaves[i].second);
+  }
+
+  for (int j=0; j<tree.targets.size(); ++j)
+    v[tree.targets.index[j]] = nearPart[j] + farPart[j];
+}
+
+// the task graph of the tree (see FmmTree::buildTaskGraph) with the box
+// kernels of KernelFmm
+template <class Kernel>
+void KernelFmm<Kernel>::runTasks(double *v)
+{
+  if (tree.taskGraph.isEmpty())
+    tree.buildTaskGraph();
+  int numThreads = tree.numThreads;
+  taskTime.assign(numThreads*FmmTree::TASK_TIME_STRIDE, 0.0);
+  tree.taskGraph.run(numThreads, [this](int task, int thread) { runTask(task, thread); });
+  for (int t=0; t<numThreads; ++t)
+    for (int k=FmmStats::BUILD+1; k<FmmStats::NUM_PHASES; ++k)
+      stats.time[k] += taskTime[t*FmmTree::TASK_TIME_STRIDE + k] / numThreads;
+
+  for (int j=0; j<tree.targets.size(); ++j)
+    v[tree.targets.index[j]] = nearPart[j] + farPart[j];
+}
+
+template <class Kernel>
+void KernelFmm<Kernel>::runTask(int task, int thread)
+{
+  int level = tree.taskBox[task].first;
+  int pos = tree.taskBox[task].second;
+  double *time = &taskTime[thread*FmmTree::TASK_TIME_STRIDE];
+  double start = tree.getTaskClock();
+  switch (tree.taskGraph.kind[task])
+  {
+    case FmmTree::UP_TASK:
+      if (tree.tree_structure[level][pos].isLeaf())
+      {
+        p2mBox(level, pos);
+        time[FmmStats::P2M] += tree.getTaskClock() - start;
+      }
+      else
+      {
+        m2mBox(level, pos);
+        time[FmmStats::M2M] += tree.getTaskClock() - start;
+      }
+      break;
+    case FmmTree::DOWN1_TASK:
+      m2lBox(level, pos);
+      p2lBox(level, pos);
+      time[FmmStats::M2L] += tree.getTaskClock() - start;
+      break;
+    case FmmTree::DOWN2_TASK:
+      l2lBox(level, pos);
+      time[FmmStats::L2L] += tree.getTaskClock() - start;
+      break;
+    case FmmTree::EVAL_TASK:
+      l2pBox(level, pos);
+      m2pBox(level, pos);
+      time[FmmStats::L2P] += tree.getTaskClock() - start;
+      break;
+    case FmmTree::NEAR_TASK:
+      p2pBox(level, pos);
+      time[FmmStats::P2P] += tree.getTaskClock() - start;
+      break;
+  }
+}
+
+// Explanation of the box kernels:
+//
+// the same as the box kernels of FmmTree (see FmmTree.cc) with the phases of
+// the kernel: each one only writes the series (or the potentials) of its own
+// box.
+
+// P2M: S-expansion of the source points of a leaf box
+template <class Kernel>
+void KernelFmm<Kernel>::p2mBox(int level, int pos)
+{
+  Box& thisBox = tree.tree_structure[level][pos];
+  int xBegin = thisBox.getBeginX();
+  if (thisBox.getEndX() == xBegin)
+    return;
+  kernel.p2m(&tree.sources.xCoord[xBegin], &tree.sources.yCoord[xBegin], &tree.sources.charge[xBegin],
+             thisBox.getEndX() - xBegin, thisBox.getCenter().getCoord(), level, getSeries(level, pos, 0));
+}
+
+// M2M: the parent box collects the series of its children
+template <class Kernel>
+void KernelFmm<Kernel>::m2mBox(int level, int pos)
+{
+  Box& parentBox = tree.tree_structure[level][pos];
+  int firstChild = parentBox.getFirstChild();
+  for (int m=firstChild; m<firstChild+parentBox.getNumChildren(); ++m)
+  {
+    Box& thisBox = tree.tree_structure[level+1][m];
+    if (thisBox.getSizeX() == 0)
+      continue;
+    kernel.m2m(level+1, thisBox.getIndex() & 3, getSeries(level+1, m, 0), getSeries(level, pos, 0));
+  }
+}
+
+// M2L: the S-expansions of the boxes of the vList
+template <class Kernel>
+void KernelFmm<Kernel>::m2lBox(int level, int pos)
+{
+  int row = tree.getRow(level, pos);
+  std::complex<double> *dtilde = getSeries(level, pos, 1);
+  for (int j=tree.vList.getBegin(row); j<tree.vList.getEnd(row); ++j)
+    kernel.m2l(level, tree.vList.getSecond(j), getSeries(level, tree.vList.getFirst(j), 0), dtilde);
+}
+
+// P2L: the source points of the boxes of the xList
+template <class Kernel>
+void KernelFmm<Kernel>::p2lBox(int level, int pos)
+{
+  Box& thisBox = tree.tree_structure[level][pos];
+  int row = tree.getRow(level, pos);
+  std::complex<double> *dtilde = getSeries(level, pos, 1);
+  for (int j=tree.xList.getBegin(row); j<tree.xList.getEnd(row); ++j)
+  {
+    int xBegin = tree.xList.getFirst(j);
+    kernel.p2l(&tree.sources.xCoord[xBegin], &tree.sources.yCoord[xBegin], &tree.sources.charge[xBegin],
+               tree.xList.getSecond(j) - xBegin, thisBox.getCenter().getCoord(), level, dtilde);
+  }
+}
+
+// L2L: d = R|R (d of the parent) + dtilde (on level 2 only dtilde)
+template <class Kernel>
+void KernelFmm<Kernel>::l2lBox(int level, int pos)
+{
+  Box& thisBoxChild = tree.tree_structure[level][pos];
+  std::complex<double> *d = getSeries(level, pos, 2);
+  if (level > 2)
+    kernel.l2l(level, thisBoxChild.getIndex() & 3, getSeries(level-1, thisBoxChild.getParent(), 2), d);
+  const std::complex<double> *dtilde = getSeries(level, pos, 1);
+  for (int k=0; k<numCoeff; ++k)
+    d[k] += dtilde[k];
+}
+
+// L2P: the R-expansion of a leaf box at its target points
+template <class Kernel>
+void KernelFmm<Kernel>::l2pBox(int level, int pos)
+{
+  Box& thisBox = tree.tree_structure[level][pos];
+  int yBegin = thisBox.getBeginY();
+  if (level < 2 || thisBox.getEndY() == yBegin)
+    return;
+  kernel.l2p(getSeries(level, pos, 2), thisBox.getCenter().getCoord(), level,
+             &tree.targets.xCoord[yBegin], &tree.targets.yCoord[yBegin], thisBox.getEndY() - yBegin,
+             &farPart[yBegin]);
+}
+
+// M2P: the S-expansions of the boxes of the wList at the target points of a leaf box
+template <class Kernel>
+void KernelFmm<Kernel>::m2pBox(int level, int pos)
+{
+  Box& thisBox = tree.tree_structure[level][pos];
+  int row = tree.getRow(level, pos);
+  int yBegin = thisBox.getBeginY();
+  if (thisBox.getEndY() == yBegin)
+    return;
+  for (int m=tree.wList.getBegin(row); m<tree.wList.getEnd(row); ++m)
+  {
+    int wLevel = tree.wList.getFirst(m);
+    int wPos = tree.wList.getSecond(m);
+    kernel.m2p(getSeries(wLevel, wPos, 0), tree.tree_structure[wLevel][wPos].getCenter().getCoord(), wLevel,
+               &tree.targets.xCoord[yBegin], &tree.targets.yCoord[yBegin], thisBox.getEndY() - yBegin,
+               &farPart[yBegin]);
+  }
+}
+
+// P2P: the source points of the boxes of the uList at the target points of a leaf box
+template <class Kernel>
+void KernelFmm<Kernel>::p2pBox(int level, int pos)
+{
+  Box& thisBox = tree.tree_structure[level][pos];
+  int yBegin = thisBox.getBeginY();
+  int yEnd = thisBox.getEndY();
+  if (yEnd == yBegin)
+    return;
+  int row = tree.getRow(level, pos);
+  for (int m=tree.uList.getBegin(row); m<tree.uList.getEnd(row); ++m)
+  {
+    int xBegin = tree.uList.getFirst(m);
+    kernel.p2p(&tree.targets.xCoord[yBegin], &tree.targets.yCoord[yBegin], yEnd - yBegin,
+               &tree.sources.xCoord[xBegin], &tree.sources.yCoord[xBegin], &tree.sources.charge[xBegin],
+               tree.uList.getSecond(m) - xBegin, &nearPart[yBegin]);
+  }
+}
+
+// the kernels of the library (a new kernel adds its instantiation here)
+template class KernelFmm<LaplaceKernel>;
+template class KernelFmm<YukawaKernel>;
@@ -0,0 +1,82 @@
+/*
+ * LaplaceKernel.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <complex>
+
+#include "LaplaceKernel.h"
+#include "Potential.h"
+#include "TranslationOperators.h"
+
+/**
+ * Header Interface for Class LaplaceKernel
+ *
+class LaplaceKernel
+{
+  public:
+    Potential potential;
+    TranslationOperators operators;
+    NearField nearField;
+    int       numOfLevels;                 // the matrices are the same for every level
+
+    LaplaceKernel(Potential &potential) : potential(potential), numOfLevels(0) {};
+*/
+
+// the scaled matrices are the same for all levels (see TranslationOperators.cc)
+void LaplaceKernel::build(int numOfLevels)
+{
+  this->numOfLevels = numOfLevels;
+  if (operators.p != potential.getP())
+    operators.build(potential);
+}
+
+void LaplaceKernel::p2m(const double *x, const double *y, const double *q, int n,
+                        std::complex<double> center, int level, std::complex<double> *c)
+{
+  double scale = TranslationOperators::getScale(level);
+  for (int j=0; j<n; ++j)
+    potential.addSCoeff(std::complex<double>(x[j], y[j]), center, q[j], c, scale);
+}
+
+void LaplaceKernel::m2m(int level, int child, const std::complex<double> *c, std::complex<double> *parentC)
+{
+  potential.applyTranslation(&operators.getSS(child)[0], c, parentC);
+}
+
+// the S|R matrix and the term log s of the level (see FmmTree::applySR)
+void LaplaceKernel::m2l(int level, int offsetIndex, const std::complex<double> *c, std::complex<double> *d)
+{
+  potential.applyTranslation(&operators.getSR(offsetIndex)[0], c, d);
+  d[0] += c[0] * TranslationOperators::getLogScale(level);
+}
+
+void LaplaceKernel::p2l(const double *x, const double *y, const double *q, int n,
+                        std::complex<double> center, int level, std::complex<double> *d)
+{
+  double scale = TranslationOperators::getScale(level);
+  for (int j=0; j<n; ++j)
+    potential.addRCoeff(std::complex<double>(x[j], y[j]), center, q[j], d, scale);
+}
+
+void LaplaceKernel::l2l(int level, int child, const std::complex<double> *parentD, std::complex<double> *d)
+{
+  potential.applyTranslation(&operators.getRR(child)[0], parentD, d);
+}
+
+void LaplaceKernel::l2p(const std::complex<double> *d, std::complex<double> center, int level,
+                        const double *x, const double *y, int n, double *v)
+{
+  double scale = TranslationOperators::getScale(level);
+  for (int j=0; j<n; ++j)
+    v[j] += potential.evalR(d, std::complex<double>(x[j], y[j]), center, scale).real();
+}
+
+void LaplaceKernel::m2p(const std::complex<double> *c, std::complex<double> center, int level,
+                        const double *x, const double *y, int n, double *v)
+{
+  double scale = TranslationOperators::getScale(level);
+  for (int j=0; j<n; ++j)
+    v[j] += potential.evalS(c, std::complex<double>(x[j], y[j]), center, scale).real();
+}
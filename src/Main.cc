@@ -1355,15 +1355,14 @@
 #include "Potential.h"
 #include "FmmTree.h"
 #include "Example1.h"
+#include "FmmTuning.h"
 
 using namespace std;
 
 int main()
 {
-  int p = 5;            // p may be upper index of summation in series approximation
-  int MAX_NUM_LEVEL = 8;                       // code's maximum refinement level possible
-  int DEFAULT_NUM_LEVEL = 3;                   // default refinement level
-  int maxClusterThreshold = 5;                 // threshold for particles per cell
+  double targetError = 1.0e-6;                 // error relative to the largest potential
+  int verbosity = FmmTree::SILENT;             // FmmTree::INFO or DEBUG for diagnostic messages
 
   // number of refinement levels is 4 (1, 2, 3, 4)
   // if count starts on 0, then number of refinement
@@ -1373,51 +1372,44 @@ int main()
   std::vector<Point>  y = example1.getY();
   std::vector<double> u = example1.getU();
 
+  // p (upper index of summation in the series approximation) follows from
+  // the target error, and the refinement level of the uniform tree and the
+  // threshold for particles per cell of the adaptive tree follow from a cost
+  // model of the near field and the translations (class FmmTuning).  The
+  // model is calibrated with a short measurement of both kernels on this
+  // machine, and no trial trees are built.
+  FmmTuning tuning;
+  int p = FmmTuning::getP(targetError);
+  tuning.calibrate(p);
+  int lowest_level_L = tuning.getNumOfLevels(x.size(), p);
+  int maxClusterThreshold = tuning.getMaxParticlesPerBox(p);
 
   Potential potential(p);
 
-  // This is the 'build' member function of FmmTree.
-  // The call was recursive so took it out of class FmmTree.
-  // Build determines the refinement level for cells to stay
-  // below the maximum cluster
-  // threshold (maximum number of particles per cell)
-  int lowest_level_L = MAX_NUM_LEVEL;
-  for (int i=DEFAULT_NUM_LEVEL; i<MAX_NUM_LEVEL; ++i)
-  {
-    FmmTree trial_tree(i, x, y, potential);
-    int trial_tree_num_of_levels = trial_tree.getNumOfLevels();
-    int trial_tree_cluster_threshold = trial_tree.getClusterThreshold();
-    if (trial_tree_cluster_threshold <= maxClusterThreshold)
-    {
-      lowest_level_L = trial_tree_num_of_levels;
-      i = MAX_NUM_LEVEL; // kick out of for loop
-    }
-    else
-    { // do nothing - lowest_level_L will be MAX_NUM_LEVEL
-    }
-  }
-
-  // for our constructed problem above, the refinement level that
-  // allows 4 points per box (cell) is L = 4.  This value is for
-  // when counting the levels with level l = 1 as the first level.
+  // The count of the levels starts with l = 1 for lowest_level_L.
   // However, in C++ the index for counts starts with zero.
   // So, you will see the counts start with l = 0.  This means
-  // that the refinement level that allows 4 points per box is
-  // L = 4 - 1 = 3 when counting the levels of refinement starts
+  // that the highest refinement level of the tree is
+  // lowest_level_L - 1 when counting the levels of refinement starts
   // with l = 0.
+  std::cout << "p = " << p << "\n";
   std::cout << "lowest_level_L = " << lowest_level_L << "\n";
+  std::cout << "maxClusterThreshold = " << maxClusterThreshold << "\n";
 
   FmmTree fmmtree(lowest_level_L, x, y, potential);
+  fmmtree.setVerbosity(verbosity);
 
   std::vector<double> indirect = fmmtree.solve(u);
   std::vector<double> direct = fmmtree.solveDirect(u);
 
 
-  for (unsigned int i=0; i<direct.size(); ++i)
-  {
-    std::cout << "direct[" << i << "] = " << direct[i] << " versus "
-    		  << "indirect[" << i << "] = " << indirect[i] << "\n";
-  }
+  // all potentials are only listed for the diagnostic output
+  if (verbosity >= FmmTree::DEBUG)
+    for (unsigned int i=0; i<direct.size(); ++i)
+    {
+      std::cout << "direct[" << i << "] = " << direct[i] << " versus "
+    		    << "indirect[" << i << "] = " << indirect[i] << "\n";
+    }
 
 
   double error = 0.0;
@@ -1430,6 +1422,23 @@ int main()
 
   std::cout << "Error = " << error << "\n";
 
+  // the same points with an adaptive tree, where only the boxes with more
+  // than maxClusterThreshold points are subdivided
+  FmmTree adaptive_tree(x, y, potential, maxClusterThreshold);
+  adaptive_tree.setVerbosity(verbosity);
+  std::vector<double> adaptive = adaptive_tree.solve(u);
+
+  double adaptive_error = 0.0;
+  for (unsigned int i = 0; i<direct.size(); ++i)
+  {
+	  double tmp = std::abs(direct[i]-adaptive[i]);
+	  if (tmp>adaptive_error)
+        adaptive_error = tmp;
+  }
+
+  std::cout << "Adaptive tree levels = " << adaptive_tree.getNumOfLevels() << "\n";
+  std::cout << "Adaptive Error = " << adaptive_error << "\n";
+
   std::cout << "Finished" << "\n";
 
 
@@ -0,0 +1,663 @@
+/*
+ * NearField.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <complex>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define NEARFIELD_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "NearField.h"
+
+/**
+ * Header Interface for Class NearField
+ *
+class NearField
+{
+  public:
+    static const int SCALAR = 0;
+    static const int AVX2 = 1;
+    static const int AVX512 = 2;
+
+    int    instructionSet;                 // instruction set used by evaluate
+    double tol2;                           // squared distance below which a source is the target itself
+
+    NearField();
+
+    void        evaluate(const double *tx, const double *ty, int nt,
+                         const double *sx, const double *sy, const double *q, int ns,
+                         double *v);
+    void        evaluateField(const double *tx, const double *ty, int nt,
+                              const double *sx, const double *sy, const double *q, int ns,
+                              std::complex<double> *phi, std::complex<double> *dphi);
+    void        evaluateBatch(const double *tx, const double *ty, int nt,
+                              const double *sx, const double *sy, const double *q, int ns,
+                              int numRhs, double *v);
+    // the same as evaluate with float coordinates relative to the box centers
+    void        evaluateMixed(const float *tx, const float *ty, int nt,
+                              const float *sx, const float *sy, const float *q, int ns,
+                              float shiftX, float shiftY, float tol2, double *v);
+
+    int         getInstructionSet() { return this->instructionSet; };
+    void        setInstructionSet(int set);
+    std::string getInstructionSetName();
+
+    static int  getBestInstructionSet();
+
+  private:
+    void        evaluateScalar(const double *tx, const double *ty, int nt,
+                               const double *sx, const double *sy, const double *q, int ns,
+                               double *v);
+    void        logBlock(const double *r2, double *l);
+};
+*/
+
+/**
+ * Explanation of the near field kernel (P2P)
+ *
+ * For the target points (tx[i], ty[i]), i < nt, and the source points
+ * (sx[j], sy[j]) with charges q[j], j < ns, evaluate adds the potentials
+ *
+ *   v[i] += sum_j q[j] Re log(y_i - x_j) = sum_j q[j] 0.5 log(dx^2 + dy^2)
+ *
+ * with dx = tx[i] - sx[j] and dy = ty[i] - sy[j].  Only the real part of the
+ * complex logarithm of Potential::direct is needed, and it only depends on the
+ * squared distance r2 = dx^2 + dy^2 (no complex arithmetic, no square root).
+ *
+ * The points are given as separate arrays of coordinates (structure of arrays,
+ * see class Particles) so that 4 (AVX2) or 8 (AVX-512) sources are handled at
+ * once in the vector registers.  The logarithm of the vector instructions is
+ * computed in the kernel (see logAVX2 below).
+ *
+ * Self interaction:
+ * FmmTree::solve skips the pairs where the target and the source are the same
+ * point, |y - x| <= eps max(1, |x|, |y|).  All points are in the unit square,
+ * so max(1, |x|, |y|) <= sqrt(2), and here the pairs with r2 <= tol2 = 2 eps^2
+ * are skipped.  Instead of a branch, the contribution of the pair is computed
+ * anyway and then masked out (set to zero) with a vector comparison.
+ *
+ * The instruction set is chosen when the program runs (getBestInstructionSet),
+ * so the code can be compiled without -mavx2 and still runs on any x86-64
+ * processor; the scalar version is used on other processors and compilers.
+ */
+NearField::NearField()
+       :
+       instructionSet(getBestInstructionSet()),
+       tol2(2.0*std::numeric_limits<double>::epsilon()*std::numeric_limits<double>::epsilon())
+{}
+
+int NearField::getBestInstructionSet()
+{
+#ifdef NEARFIELD_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return AVX2;
+#endif
+  return SCALAR;
+}
+
+// selecting the instruction set (for example SCALAR to compare with the
+// vector versions).  An instruction set the processor does not have is
+// replaced by the best one it has.
+void NearField::setInstructionSet(int set)
+{
+  int best = getBestInstructionSet();
+  if (set < SCALAR || set > best)
+    set = best;
+  this->instructionSet = set;
+}
+
+std::string NearField::getInstructionSetName()
+{
+  if (instructionSet == AVX512)
+    return "AVX-512";
+  if (instructionSet == AVX2)
+    return "AVX2";
+  return "scalar";
+}
+
+void NearField::evaluateScalar(const double *tx, const double *ty, int nt,
+                               const double *sx, const double *sy, const double *q, int ns,
+                               double *v)
+{
+  for (int i=0; i<nt; ++i)
+  {
+    double sum = 0.0;
+    for (int j=0; j<ns; ++j)
+    {
+      double dx = tx[i] - sx[j];
+      double dy = ty[i] - sy[j];
+      double r2 = dx*dx + dy*dy;
+      sum += (r2 > tol2) ? q[j] * std::log(r2) : 0.0;
+    }
+    v[i] += 0.5 * sum;
+  }
+}
+
+#ifdef NEARFIELD_X86_SIMD
+
+// the AVX-512 intrinsics of g++ 12 use undefined registers for the unused
+// lanes, which -Wall reports as (maybe) uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+/**
+ * Explanation of logAVX2 (and logAVX512)
+ *
+ * natural logarithm of 4 (8) positive doubles r.  With r = m 2^e where
+ * sqrt(1/2) <= m < sqrt(2),
+ *
+ *   log r = e log 2 + log m    and    log m = 2 atanh(s) = 2 (s + s^3/3 + s^5/5 + ...)
+ *
+ * with s = (m-1)/(m+1), |s| <= 0.172.  Eleven terms of the series give double
+ * precision (0.172^23/23 < 1e-18).
+ *  - the exponent e and the mantissa m in [1,2) are read from the bits of r:
+ *    the biased exponent (bits 52-62) is turned into a double by putting it into
+ *    the mantissa bits of 2^52 and subtracting 2^52 (there is no AVX2
+ *    instruction converting 64 bit integers to doubles)
+ *  - if m >= sqrt(2) then m is halved and e increased by one (with masks)
+ *  - log 2 is split into a high part (exact product with e) and a low part
+ * Zero, denormal, infinite and NaN values of r are not handled; the kernel
+ * masks out the pairs with r2 <= tol2 (and r2 is finite).
+ */
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+static const double TWO52 = 4503599627370496.0;
+
+__attribute__((target("avx2,fma")))
+static inline __m256d logAVX2(__m256d r)
+{
+  const __m256i mantissaMask = _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL);
+  const __m256i one = _mm256_set1_epi64x(0x3FF0000000000000LL);
+  __m256i bits = _mm256_castpd_si256(r);
+
+  __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52),
+                                                                 _mm256_castpd_si256(_mm256_set1_pd(TWO52)))),
+                            _mm256_set1_pd(TWO52 + 1023.0));
+  __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), one));
+
+  __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GE_OQ);
+  m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+  e = _mm256_add_pd(e, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+
+  __m256d s = _mm256_div_pd(_mm256_sub_pd(m, _mm256_set1_pd(1.0)), _mm256_add_pd(m, _mm256_set1_pd(1.0)));
+  __m256d s2 = _mm256_mul_pd(s, s);
+  __m256d poly = _mm256_set1_pd(1.0/21.0);
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/19.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/17.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/15.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/13.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/11.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/9.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/7.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/5.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0/3.0));
+  poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(1.0));
+  __m256d logm = _mm256_mul_pd(_mm256_add_pd(s, s), poly);
+
+  return _mm256_fmadd_pd(e, _mm256_set1_pd(LN2_HI),
+                         _mm256_fmadd_pd(e, _mm256_set1_pd(LN2_LO), logm));
+}
+
+__attribute__((target("avx2,fma")))
+static void evaluateAVX2(const double *tx, const double *ty, int nt,
+                         const double *sx, const double *sy, const double *q, int ns,
+                         double tol2, double *v)
+{
+  int nsVec = ns - ns % 4;
+  const __m256d tol = _mm256_set1_pd(tol2);
+  for (int i=0; i<nt; ++i)
+  {
+    __m256d x = _mm256_set1_pd(tx[i]);
+    __m256d y = _mm256_set1_pd(ty[i]);
+    __m256d acc = _mm256_setzero_pd();
+    for (int j=0; j<nsVec; j+=4)
+    {
+      __m256d dx = _mm256_sub_pd(x, _mm256_loadu_pd(sx+j));
+      __m256d dy = _mm256_sub_pd(y, _mm256_loadu_pd(sy+j));
+      __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+      __m256d far = _mm256_cmp_pd(r2, tol, _CMP_GT_OQ);          // not the target itself
+      __m256d term = _mm256_mul_pd(_mm256_loadu_pd(q+j), logAVX2(_mm256_max_pd(r2, tol)));
+      acc = _mm256_add_pd(acc, _mm256_and_pd(far, term));
+    }
+    __m128d sum2 = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(sum2, _mm_unpackhi_pd(sum2, sum2)));
+    for (int j=nsVec; j<ns; ++j)
+    {
+      double dx = tx[i] - sx[j];
+      double dy = ty[i] - sy[j];
+      double r2 = dx*dx + dy*dy;
+      sum += (r2 > tol2) ? q[j] * std::log(r2) : 0.0;
+    }
+    v[i] += 0.5 * sum;
+  }
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d logAVX512(__m512d r)
+{
+  const __m512i mantissaMask = _mm512_set1_epi64(0x000FFFFFFFFFFFFFLL);
+  const __m512i one = _mm512_set1_epi64(0x3FF0000000000000LL);
+  __m512i bits = _mm512_castpd_si512(r);
+
+  __m512d e = _mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(_mm512_srli_epi64(bits, 52),
+                                                                 _mm512_castpd_si512(_mm512_set1_pd(TWO52)))),
+                            _mm512_set1_pd(TWO52 + 1023.0));
+  __m512d m = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits, mantissaMask), one));
+
+  __mmask8 big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(M_SQRT2), _CMP_GE_OQ);
+  m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+  e = _mm512_mask_add_pd(e, big, e, _mm512_set1_pd(1.0));
+
+  __m512d s = _mm512_div_pd(_mm512_sub_pd(m, _mm512_set1_pd(1.0)), _mm512_add_pd(m, _mm512_set1_pd(1.0)));
+  __m512d s2 = _mm512_mul_pd(s, s);
+  __m512d poly = _mm512_set1_pd(1.0/21.0);
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/19.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/17.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/15.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/13.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/11.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/9.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/7.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/5.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0/3.0));
+  poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(1.0));
+  __m512d logm = _mm512_mul_pd(_mm512_add_pd(s, s), poly);
+
+  return _mm512_fmadd_pd(e, _mm512_set1_pd(LN2_HI),
+                         _mm512_fmadd_pd(e, _mm512_set1_pd(LN2_LO), logm));
+}
+
+__attribute__((target("avx512f")))
+static void evaluateAVX512(const double *tx, const double *ty, int nt,
+                           const double *sx, const double *sy, const double *q, int ns,
+                           double tol2, double *v)
+{
+  int nsVec = ns - ns % 8;
+  const __m512d tol = _mm512_set1_pd(tol2);
+  for (int i=0; i<nt; ++i)
+  {
+    __m512d x = _mm512_set1_pd(tx[i]);
+    __m512d y = _mm512_set1_pd(ty[i]);
+    __m512d acc = _mm512_setzero_pd();
+    for (int j=0; j<nsVec; j+=8)
+    {
+      __m512d dx = _mm512_sub_pd(x, _mm512_loadu_pd(sx+j));
+      __m512d dy = _mm512_sub_pd(y, _mm512_loadu_pd(sy+j));
+      __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+      __mmask8 far = _mm512_cmp_pd_mask(r2, tol, _CMP_GT_OQ);      // not the target itself
+      __m512d l = logAVX512(_mm512_max_pd(r2, tol));
+      acc = _mm512_mask3_fmadd_pd(_mm512_loadu_pd(q+j), l, acc, far);
+    }
+    // the remaining sources are loaded with a mask (the other lanes are zero)
+    if (nsVec < ns)
+    {
+      __mmask8 rest = (__mmask8)((1u << (ns - nsVec)) - 1);
+      __m512d dx = _mm512_sub_pd(x, _mm512_maskz_loadu_pd(rest, sx+nsVec));
+      __m512d dy = _mm512_sub_pd(y, _mm512_maskz_loadu_pd(rest, sy+nsVec));
+      __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+      __mmask8 far = _mm512_cmp_pd_mask(r2, tol, _CMP_GT_OQ) & rest;
+      __m512d l = logAVX512(_mm512_max_pd(r2, tol));
+      acc = _mm512_mask3_fmadd_pd(_mm512_maskz_loadu_pd(rest, q+nsVec), l, acc, far);
+    }
+    v[i] += 0.5 * _mm512_reduce_add_pd(acc);
+  }
+}
+
+// logarithms of LOG_BLOCK (8) squared distances for evaluateBatch, with the
+// pairs r2 <= tol2 (the target itself) set to zero
+__attribute__((target("avx512f")))
+static void logBlockAVX512(const double *r2, double tol2, double *l)
+{
+  __m512d r = _mm512_loadu_pd(r2);
+  __mmask8 far = _mm512_cmp_pd_mask(r, _mm512_set1_pd(tol2), _CMP_GT_OQ);
+  _mm512_storeu_pd(l, _mm512_maskz_mov_pd(far, logAVX512(_mm512_max_pd(r, _mm512_set1_pd(tol2)))));
+}
+
+__attribute__((target("avx2,fma")))
+static void logBlockAVX2(const double *r2, double tol2, double *l)
+{
+  const __m256d tol = _mm256_set1_pd(tol2);
+  for (int k=0; k<8; k+=4)
+  {
+    __m256d r = _mm256_loadu_pd(r2+k);
+    __m256d far = _mm256_cmp_pd(r, tol, _CMP_GT_OQ);
+    _mm256_storeu_pd(l+k, _mm256_and_pd(far, logAVX2(_mm256_max_pd(r, tol))));
+  }
+}
+
+/**
+ * Explanation of logAVX2Float (and logAVX512Float) and the mixed kernels
+ *
+ * the same logarithm as logAVX2 for 8 (16) floats: the exponent bits are
+ * 23-30 and are converted with the integer to float instruction, and five
+ * terms of the series give float precision (2 0.172^11/11 < 1e-9).  log 2 is
+ * split as in the float logarithm of the Cephes library.
+ *
+ * evaluateMixedAVX2 (evaluateMixedAVX512) handles 8 (16) sources at once
+ * with the float coordinates of evaluateMixed.  The terms q log r2 are
+ * converted to double (two vectors of 4 (8) doubles) and summed in double, so
+ * the sums over many sources do not lose the float digits.
+ */
+static const float LN2F_HI = 0.693359375f;
+static const float LN2F_LO = -2.12194440e-4f;
+
+__attribute__((target("avx2,fma")))
+static inline __m256 logAVX2Float(__m256 r)
+{
+  __m256i bits = _mm256_castps_si256(r);
+  __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                                                 _mm256_set1_epi32(0x3F800000)));
+
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps((float)M_SQRT2), _CMP_GE_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+  e = _mm256_add_ps(e, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+
+  __m256 s = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_add_ps(m, _mm256_set1_ps(1.0f)));
+  __m256 s2 = _mm256_mul_ps(s, s);
+  __m256 poly = _mm256_set1_ps(1.0f/9.0f);
+  poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f/7.0f));
+  poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f/5.0f));
+  poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f/3.0f));
+  poly = _mm256_fmadd_ps(poly, s2, _mm256_set1_ps(1.0f));
+  __m256 logm = _mm256_mul_ps(_mm256_add_ps(s, s), poly);
+
+  return _mm256_fmadd_ps(e, _mm256_set1_ps(LN2F_HI),
+                         _mm256_fmadd_ps(e, _mm256_set1_ps(LN2F_LO), logm));
+}
+
+__attribute__((target("avx2,fma")))
+static void evaluateMixedAVX2(const float *tx, const float *ty, int nt,
+                              const float *sx, const float *sy, const float *q, int ns,
+                              float shiftX, float shiftY, float tol2, double *v)
+{
+  int nsVec = ns - ns % 8;
+  const __m256 tol = _mm256_set1_ps(tol2);
+  for (int i=0; i<nt; ++i)
+  {
+    float xi = tx[i] + shiftX;
+    float yi = ty[i] + shiftY;
+    __m256 x = _mm256_set1_ps(xi);
+    __m256 y = _mm256_set1_ps(yi);
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    for (int j=0; j<nsVec; j+=8)
+    {
+      __m256 dx = _mm256_sub_ps(x, _mm256_loadu_ps(sx+j));
+      __m256 dy = _mm256_sub_ps(y, _mm256_loadu_ps(sy+j));
+      __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+      __m256 far = _mm256_cmp_ps(r2, tol, _CMP_GT_OQ);           // not the target itself
+      __m256 term = _mm256_and_ps(far, _mm256_mul_ps(_mm256_loadu_ps(q+j),
+                                                     logAVX2Float(_mm256_max_ps(r2, tol))));
+      acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(term)));
+      acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(term, 1)));
+    }
+    __m256d acc = _mm256_add_pd(acc0, acc1);
+    __m128d sum2 = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(sum2, _mm_unpackhi_pd(sum2, sum2)));
+    for (int j=nsVec; j<ns; ++j)
+    {
+      float dx = xi - sx[j];
+      float dy = yi - sy[j];
+      float r2 = dx*dx + dy*dy;
+      sum += (r2 > tol2) ? (double)(q[j] * std::log(r2)) : 0.0;
+    }
+    v[i] += 0.5 * sum;
+  }
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 logAVX512Float(__m512 r)
+{
+  __m512i bits = _mm512_castps_si512(r);
+  __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(127)));
+  __m512 m = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)),
+                                                 _mm512_set1_epi32(0x3F800000)));
+
+  __mmask16 big = _mm512_cmp_ps_mask(m, _mm512_set1_ps((float)M_SQRT2), _CMP_GE_OQ);
+  m = _mm512_mask_mul_ps(m, big, m, _mm512_set1_ps(0.5f));
+  e = _mm512_mask_add_ps(e, big, e, _mm512_set1_ps(1.0f));
+
+  __m512 s = _mm512_div_ps(_mm512_sub_ps(m, _mm512_set1_ps(1.0f)), _mm512_add_ps(m, _mm512_set1_ps(1.0f)));
+  __m512 s2 = _mm512_mul_ps(s, s);
+  __m512 poly = _mm512_set1_ps(1.0f/9.0f);
+  poly = _mm512_fmadd_ps(poly, s2, _mm512_set1_ps(1.0f/7.0f));
+  poly = _mm512_fmadd_ps(poly, s2, _mm512_set1_ps(1.0f/5.0f));
+  poly = _mm512_fmadd_ps(poly, s2, _mm512_set1_ps(1.0f/3.0f));
+  poly = _mm512_fmadd_ps(poly, s2, _mm512_set1_ps(1.0f));
+  __m512 logm = _mm512_mul_ps(_mm512_add_ps(s, s), poly);
+
+  return _mm512_fmadd_ps(e, _mm512_set1_ps(LN2F_HI),
+                         _mm512_fmadd_ps(e, _mm512_set1_ps(LN2F_LO), logm));
+}
+
+// adds the 16 float terms (the lanes not in mask are zero) to two vectors of 8 doubles
+__attribute__((target("avx512f")))
+static inline void addMixedTerms(__m512 q, __m512 l, __mmask16 mask, __m512d &acc0, __m512d &acc1)
+{
+  __m512 term = _mm512_maskz_mul_ps(mask, q, l);
+  acc0 = _mm512_add_pd(acc0, _mm512_cvtps_pd(_mm512_castps512_ps256(term)));
+  acc1 = _mm512_add_pd(acc1, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(term), 1))));
+}
+
+__attribute__((target("avx512f")))
+static void evaluateMixedAVX512(const float *tx, const float *ty, int nt,
+                                const float *sx, const float *sy, const float *q, int ns,
+                                float shiftX, float shiftY, float tol2, double *v)
+{
+  int nsVec = ns - ns % 16;
+  const __m512 tol = _mm512_set1_ps(tol2);
+  for (int i=0; i<nt; ++i)
+  {
+    __m512 x = _mm512_set1_ps(tx[i] + shiftX);
+    __m512 y = _mm512_set1_ps(ty[i] + shiftY);
+    __m512d acc0 = _mm512_setzero_pd();
+    __m512d acc1 = _mm512_setzero_pd();
+    for (int j=0; j<nsVec; j+=16)
+    {
+      __m512 dx = _mm512_sub_ps(x, _mm512_loadu_ps(sx+j));
+      __m512 dy = _mm512_sub_ps(y, _mm512_loadu_ps(sy+j));
+      __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+      __mmask16 far = _mm512_cmp_ps_mask(r2, tol, _CMP_GT_OQ);     // not the target itself
+      addMixedTerms(_mm512_loadu_ps(q+j), logAVX512Float(_mm512_max_ps(r2, tol)), far, acc0, acc1);
+    }
+    if (nsVec < ns)
+    {
+      __mmask16 rest = (__mmask16)((1u << (ns - nsVec)) - 1);
+      __m512 dx = _mm512_sub_ps(x, _mm512_maskz_loadu_ps(rest, sx+nsVec));
+      __m512 dy = _mm512_sub_ps(y, _mm512_maskz_loadu_ps(rest, sy+nsVec));
+      __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+      __mmask16 far = _mm512_cmp_ps_mask(r2, tol, _CMP_GT_OQ) & rest;
+      addMixedTerms(_mm512_maskz_loadu_ps(rest, q+nsVec), logAVX512Float(_mm512_max_ps(r2, tol)),
+                    far, acc0, acc1);
+    }
+    v[i] += 0.5 * _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+  }
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+void NearField::evaluate(const double *tx, const double *ty, int nt,
+                         const double *sx, const double *sy, const double *q, int ns,
+                         double *v)
+{
+#ifdef NEARFIELD_X86_SIMD
+  if (instructionSet == AVX512)
+  {
+    evaluateAVX512(tx, ty, nt, sx, sy, q, ns, tol2, v);
+    return;
+  }
+  if (instructionSet == AVX2)
+  {
+    evaluateAVX2(tx, ty, nt, sx, sy, q, ns, tol2, v);
+    return;
+  }
+#endif
+  evaluateScalar(tx, ty, nt, sx, sy, q, ns, v);
+}
+
+// Explanation of evaluateMixed:
+//
+// the near field of evaluate in float (mixed precision, see
+// FmmTree::setPrecision): the coordinates are floats relative to the center of
+// the leaf box of each point, and (shiftX, shiftY) is the center of the box of
+// the targets minus the center of the box of the sources, so
+//   dx = (tx[i] + shiftX) - sx[j]
+// is the distance of the points with an error of about the float epsilon
+// times the size of the box (not times 1, as with absolute float coordinates).
+// The centers of the boxes are multiples of the cell length 2^-l, so shiftX
+// and shiftY are exact floats.  The pairs with r2 <= tol2 are skipped (the
+// target itself).  The logarithms and products are floats and the sums over
+// the sources are doubles.  With AVX2 (AVX-512) 8 (16) sources are handled at
+// once, twice as many as in evaluate.
+void NearField::evaluateMixed(const float *tx, const float *ty, int nt,
+                              const float *sx, const float *sy, const float *q, int ns,
+                              float shiftX, float shiftY, float tol2, double *v)
+{
+#ifdef NEARFIELD_X86_SIMD
+  if (instructionSet == AVX512)
+  {
+    evaluateMixedAVX512(tx, ty, nt, sx, sy, q, ns, shiftX, shiftY, tol2, v);
+    return;
+  }
+  if (instructionSet == AVX2)
+  {
+    evaluateMixedAVX2(tx, ty, nt, sx, sy, q, ns, shiftX, shiftY, tol2, v);
+    return;
+  }
+#endif
+  for (int i=0; i<nt; ++i)
+  {
+    float xi = tx[i] + shiftX;
+    float yi = ty[i] + shiftY;
+    double sum = 0.0;
+    for (int j=0; j<ns; ++j)
+    {
+      float dx = xi - sx[j];
+      float dy = yi - sy[j];
+      float r2 = dx*dx + dy*dy;
+      sum += (r2 > tol2) ? (double)(q[j] * std::log(r2)) : 0.0;
+    }
+    v[i] += 0.5 * sum;
+  }
+}
+
+// Explanation of evaluateField:
+//
+// adds the complex potentials and their derivatives (the field, see
+// FmmTree::applyField)
+//
+//   phi[i]  += sum_j q[j] log(y_i - x_j)    and    dphi[i] += sum_j q[j] / (y_i - x_j)
+//
+// with the same self interaction test as evaluate.  With z = dx + i dy the
+// derivative is q conj(z) / r2 (no complex division), and the logarithm is
+// 0.5 log(r2) + i atan2(dy, dx).  phi (or dphi) can be NULL when only the
+// field (or the potential) is needed, the atan2 is then not computed.  This kernel is scalar: the
+// derivative needs no logarithm, so it costs less than the potential.
+void NearField::evaluateField(const double *tx, const double *ty, int nt,
+                              const double *sx, const double *sy, const double *q, int ns,
+                              std::complex<double> *phi, std::complex<double> *dphi)
+{
+  for (int i=0; i<nt; ++i)
+  {
+    double logSum = 0.0;
+    double argSum = 0.0;
+    double fx = 0.0;
+    double fy = 0.0;
+    for (int j=0; j<ns; ++j)
+    {
+      double dx = tx[i] - sx[j];
+      double dy = ty[i] - sy[j];
+      double r2 = dx*dx + dy*dy;
+      if (r2 <= tol2)
+        continue;
+      double s = q[j] / r2;
+      fx += s * dx;
+      fy -= s * dy;
+      if (phi != NULL)
+      {
+        logSum += q[j] * std::log(r2);
+        argSum += q[j] * std::atan2(dy, dx);
+      }
+    }
+    if (phi != NULL)
+      phi[i] += std::complex<double>(0.5 * logSum, argSum);
+    if (dphi != NULL)
+      dphi[i] += std::complex<double>(fx, fy);
+  }
+}
+
+static const int LOG_BLOCK = 8;
+
+void NearField::logBlock(const double *r2, double *l)
+{
+#ifdef NEARFIELD_X86_SIMD
+  if (instructionSet == AVX512)
+  {
+    logBlockAVX512(r2, tol2, l);
+    return;
+  }
+  if (instructionSet == AVX2)
+  {
+    logBlockAVX2(r2, tol2, l);
+    return;
+  }
+#endif
+  for (int k=0; k<LOG_BLOCK; ++k)
+    l[k] = (r2[k] > tol2) ? std::log(r2[k]) : 0.0;
+}
+
+// Explanation of evaluateBatch:
+//
+// the near field of numRhs charge vectors at once (see FmmTree::applyBatch):
+// q holds the charges of source j at j*numRhs, ..., j*numRhs + numRhs-1 and
+// v the potentials of target i at i*numRhs + r.  The logarithm of each pair
+// only depends on the points, so it is computed once (LOG_BLOCK sources at a
+// time with the vector logarithm) and is then multiplied with the numRhs
+// charges of the source, which are contiguous.  The cost of the logarithms
+// is shared by all charge vectors.
+void NearField::evaluateBatch(const double *tx, const double *ty, int nt,
+                              const double *sx, const double *sy, const double *q, int ns,
+                              int numRhs, double *v)
+{
+  double r2[LOG_BLOCK];
+  double l[LOG_BLOCK];
+  for (int i=0; i<nt; ++i)
+  {
+    double *vi = v + (size_t)i*numRhs;
+    for (int j0=0; j0<ns; j0+=LOG_BLOCK)
+    {
+      int nb = std::min(LOG_BLOCK, ns - j0);
+      for (int k=0; k<LOG_BLOCK; ++k)
+      {
+        int j = j0 + std::min(k, nb-1);            // the last block is padded with its last source
+        double dx = tx[i] - sx[j];
+        double dy = ty[i] - sy[j];
+        r2[k] = dx*dx + dy*dy;
+      }
+      logBlock(r2, l);
+      for (int k=0; k<nb; ++k)
+      {
+        double lk = 0.5 * l[k];
+        const double *qj = q + (size_t)(j0+k)*numRhs;
+        for (int r=0; r<numRhs; ++r)
+          vi[r] += qj[r] * lk;
+      }
+    }
+  }
+}
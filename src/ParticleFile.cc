@@ -0,0 +1,210 @@
+/*
+ * ParticleFile.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <string>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ParticleFile.h"
+
+/**
+ * Header Interface for Class ParticleFile
+ *
+class ParticleFile
+{
+  public:
+    static const int VERSION = 1;
+    static const size_t HEADER_SIZE = 32;
+
+    char     *data;                        // start of the mapping (the header)
+    size_t    length;                      // length of the mapping in bytes
+    long long numPoints;
+    int       numColumns;
+    bool      writable;
+
+    ParticleFile() : data(NULL), length(0), numPoints(0), numColumns(0), writable(false) {};
+    ~ParticleFile() { close(); };
+    ParticleFile(const ParticleFile &file) = delete;
+    ParticleFile& operator=(const ParticleFile &file) = delete;
+
+    bool      open(const std::string &path);              // read only, false on any error
+    bool      create(const std::string &path, long long numPoints, int numColumns);
+    void      close();
+    bool      isOpen() { return this->data != NULL; };
+
+    long long size() { return this->numPoints; };
+    int       getNumColumns() { return this->numColumns; };
+    const double *getX() { return getColumn(0); };
+    const double *getY() { return getColumn(1); };
+    const double *getValues() { return numColumns > 2 ? getColumn(2) : NULL; };
+    double   *getWritableColumn(int column);              // NULL if not created
+
+    static bool write(const std::string &path, const double *x, const double *y,
+                      const double *values, long long numPoints);
+
+  private:
+    double   *getColumn(int column);
+};
+ *
+ */
+
+static const char MAGIC[8] = {'F','M','M','2','D','P','T','S'};
+
+// pointer to the first double of a column (the columns follow the header)
+double *ParticleFile::getColumn(int column)
+{
+  if (data == NULL || column >= numColumns)
+    return NULL;
+  return reinterpret_cast<double *>(data + HEADER_SIZE) + (size_t)column*numPoints;
+}
+
+double *ParticleFile::getWritableColumn(int column)
+{
+  return writable ? getColumn(column) : NULL;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Explanation of ParticleFile::open:
+//
+// maps the file read only and checks the header (magic, version, number of
+// columns and that the file is long enough for the columns).  Nothing is read
+// here, the pages are loaded by the first access (for example by the sort of
+// the FmmTree constructor from arrays) and can be dropped by the kernel again,
+// so the file can be larger than the free memory.
+bool ParticleFile::open(const std::string &path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat status;
+  if (fstat(fd, &status) != 0 || (size_t)status.st_size < HEADER_SIZE)
+  {
+    ::close(fd);
+    return false;
+  }
+  size_t fileLength = status.st_size;
+  void *map = mmap(NULL, fileLength, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);                             // the mapping stays valid
+  if (map == MAP_FAILED)
+    return false;
+
+  char *header = static_cast<char *>(map);
+  uint32_t version, columns;
+  uint64_t points;
+  std::memcpy(&version, header + 8, 4);
+  std::memcpy(&columns, header + 12, 4);
+  std::memcpy(&points, header + 16, 8);
+  if (std::memcmp(header, MAGIC, 8) != 0 || version != (uint32_t)VERSION
+      || columns < 2 || columns > 3
+      || points > (fileLength - HEADER_SIZE)/(columns*sizeof(double)))
+  {
+    munmap(map, fileLength);
+    return false;
+  }
+  madvise(map, fileLength, MADV_SEQUENTIAL);
+
+  data = header;
+  length = fileLength;
+  numPoints = points;
+  numColumns = columns;
+  writable = false;
+  return true;
+}
+
+// Explanation of ParticleFile::create:
+//
+// creates (or truncates) the file for numPoints points with numColumns columns,
+// writes the header and maps it writable.  The columns are then filled through
+// getWritableColumn, for example the potentials of FmmTree::apply
+//   apply(in.getValues(), out.getWritableColumn(2))
+// and are written back by the kernel (at the latest by close).
+bool ParticleFile::create(const std::string &path, long long numPoints, int numColumns)
+{
+  close();
+  if (numPoints < 0 || numColumns < 2 || numColumns > 3)
+    return false;
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  size_t fileLength = HEADER_SIZE + (size_t)numColumns*numPoints*sizeof(double);
+  if (ftruncate(fd, fileLength) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, fileLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  char *header = static_cast<char *>(map);
+  uint32_t version = VERSION, columns = numColumns;
+  uint64_t points = numPoints, reserved = 0;
+  std::memcpy(header, MAGIC, 8);
+  std::memcpy(header + 8, &version, 4);
+  std::memcpy(header + 12, &columns, 4);
+  std::memcpy(header + 16, &points, 8);
+  std::memcpy(header + 24, &reserved, 8);
+
+  data = header;
+  length = fileLength;
+  this->numPoints = numPoints;
+  this->numColumns = numColumns;
+  writable = true;
+  return true;
+}
+
+void ParticleFile::close()
+{
+  if (data != NULL)
+  {
+    if (writable)
+      msync(data, length, MS_SYNC);
+    munmap(data, length);
+  }
+  data = NULL;
+  length = 0;
+  numPoints = 0;
+  numColumns = 0;
+  writable = false;
+}
+
+#else
+
+// no memory mapping on this system
+bool ParticleFile::open(const std::string &) { return false; }
+bool ParticleFile::create(const std::string &, long long, int) { return false; }
+void ParticleFile::close() {}
+
+#endif
+
+// writes the points x, y (and the values, if not NULL) in the format of
+// ParticleFile (for example to convert an input into a file for open)
+bool ParticleFile::write(const std::string &path, const double *x, const double *y,
+                         const double *values, long long numPoints)
+{
+  ParticleFile file;
+  if (!file.create(path, numPoints, values != NULL ? 3 : 2))
+    return false;
+  size_t bytes = (size_t)numPoints*sizeof(double);
+  if (bytes > 0)
+  {
+    std::memcpy(file.getWritableColumn(0), x, bytes);
+    std::memcpy(file.getWritableColumn(1), y, bytes);
+    if (values != NULL)
+      std::memcpy(file.getWritableColumn(2), values, bytes);
+  }
+  file.close();
+  return true;
+}
@@ -0,0 +1,249 @@
+/*
+ * Particles.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <complex>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Particles.h"
+#include "Point.h"
+#include "Util.h"
+
+/**
+ * Header Interface for Class Particles
+ *
+class Particles
+{
+  public:
+
+    std::vector<double> xCoord;      // x-coordinates of the particles
+    std::vector<double> yCoord;      // y-coordinates of the particles
+    std::vector<double> charge;      // charges of the particles (sources only)
+    std::vector<int>    index;       // index of each particle in the unsorted input vector
+    std::vector<long long> boxIndex; // interleaved index of the box (at level 'level') of each particle
+
+    unsigned int        level;       // refinement level used for sorting
+
+    Particles() : level(0) {};
+
+    void     sort(std::vector<Point> &points, unsigned int level);
+    void     sort(const double *x, const double *y, int numPoints, unsigned int level,
+                  int numThreads);
+    void     getInputPositions(std::vector<int> &position);
+    void     setCharge(std::vector<double> &u);
+    void     setCharge(const double *u);
+    void     getRange(unsigned int boxLevel, long long n, int &begin, int &end);
+
+    int      size() { return this->xCoord.size(); };
+};
+*/
+
+/**
+ * Explanation of sort
+ *
+ * The points are sorted by the interleaved (Morton) index of the box that
+ * contains them at refinement level 'level'.  The index is the one computed by
+ * Point::getBoxIndex (see Point.cc and Util.cc for the bit interleaving).
+ * At level l the box indices are the integers 0, 1, ..., 4^l - 1 and have 2l bits.
+ * The sort is a radix sort (least significant digit first) going through the
+ * bits of the box indices 8 bits (one digit) at a time:
+ *
+ * [1] - the box index (key) of each point is computed
+ * [2] - for each digit (bits 0-7, 8-15, ... of the keys)
+ *   [3] - the number of points with each digit value 0, ..., 255 is counted
+ *         (a digit with the same value for all points does not change the
+ *         order and is skipped, for example the high bits of clustered points)
+ *   [4] - a running sum of the counts gives the position of the first point
+ *         with each digit value
+ *   [5] - the points (their input index and their key) are placed (in their
+ *         current order) at the next free position for their digit value
+ *
+ * The keys are moved together with the input indices, so each step reads
+ * both arrays in order instead of looking up the key of each point in the
+ * input order.  The keys are 64-bit integers (levels up to 31).
+ *
+ * Since each step keeps the order of the points with the same digit value,
+ * after the last digit the points are sorted by their box index and the
+ * points of a box keep the order they had in the input vector.
+ *
+ * Example: level l = 1 (4 boxes, 2 bits, one digit) and points in boxes 3, 0, 3, 1
+ *
+ *          counts (boxes 0,1,2,3)  1 1 0 2
+ *          first positions         0 1 2 2
+ *          sorted box indices      0 1 3 3
+ *          sorted (input) indices  1 3 0 2
+ *
+ * The particles of a box (and, since the Morton order keeps the four children
+ * of a box next to each other, the particles of every box on the levels above)
+ * are then contiguous in memory and a box only needs to know the range of
+ * positions [begin, end) of its particles (see getRange).
+ *
+ * The work is proportional to the number of points times the number of digits,
+ * and does not depend on the number of boxes 4^l (a deep tree with mostly empty
+ * boxes does not need an array with an entry for every box).
+ */
+void Particles::sort(std::vector<Point> &points, unsigned int level)
+{
+  int numPoints = points.size();
+  std::vector<double> x(numPoints);
+  std::vector<double> y(numPoints);
+  for (int i=0; i<numPoints; ++i)
+  {
+    x[i] = points[i].getCoord().real();
+    y[i] = points[i].getCoord().imag();
+  }
+  sort(numPoints > 0 ? &x[0] : NULL, numPoints > 0 ? &y[0] : NULL, numPoints, level, 1);
+}
+
+// Explanation of sort (coordinate arrays):
+//
+// the same sort for points given as two arrays of coordinates x and y (for
+// example the columns of a memory mapped particle file, see class
+// ParticleFile), so no vector of Points is needed.  The box index of a point
+// is the one of Point::getBoxIndex.
+//
+// With numThreads > 1 (or numThreads < 1 for the number of threads given by
+// OpenMP) the steps [1], [3] and [5] are shared among the threads: each thread
+// counts the digits of its own (contiguous) part of the points, the running
+// sum [4] goes through the digit values and, for each value, through the
+// threads in order, and each thread then places its points starting at its own
+// position for each digit value.  The points of the threads are placed in the
+// order of the threads, so the sort is still stable and the result does not
+// depend on the number of threads.
+void Particles::sort(const double *x, const double *y, int numPoints, unsigned int level,
+                     int numThreads)
+{
+#ifdef _OPENMP
+  if (numThreads < 1)
+    numThreads = omp_get_max_threads();
+#else
+  numThreads = 1;
+#endif
+  if (numPoints < 65536)                        // not worth the threads
+    numThreads = 1;
+  this->level = level;
+
+  std::vector<long long> key(numPoints);
+  std::vector<int> order(numPoints);
+  #pragma omp parallel for schedule(static) num_threads(numThreads)
+  for (int i=0; i<numPoints; ++i)                                       // 1
+  {
+    key[i] = Util::mortonKey((uint32_t)std::ldexp(x[i], level),
+                             (uint32_t)std::ldexp(y[i], level));
+    order[i] = i;
+  }
+
+  std::vector<long long> sortedKey(numPoints);
+  std::vector<int> sorted(numPoints);
+  std::vector<int> start(256*numThreads + 1);
+  for (unsigned int shift=0; shift<2*level; shift+=8)                   // 2
+  {
+    bool skip = false;
+    #pragma omp parallel num_threads(numThreads)
+    {
+#ifdef _OPENMP
+      int t = omp_get_thread_num();
+      int threads = omp_get_num_threads();
+#else
+      int t = 0;
+      int threads = 1;
+#endif
+      int chunk = (numPoints + threads - 1) / threads;
+      int begin = std::min(numPoints, t*chunk);
+      int end = std::min(numPoints, begin + chunk);
+      // start[digit*threads + t + 1] counts the points of thread t with the digit
+      int *count = &start[1];
+      for (int digit=0; digit<256; ++digit)
+        count[digit*threads + t] = 0;
+      for (int i=begin; i<end; ++i)                                     // 3
+        ++count[((key[i] >> shift) & 255)*threads + t];
+      #pragma omp barrier
+      #pragma omp single
+      {
+        int digitCount = 0;
+        int first = (numPoints > 0) ? (int)((key[0] >> shift) & 255) : 0;
+        for (int k=0; k<threads; ++k)
+          digitCount += count[first*threads + k];
+        skip = (numPoints == 0 || digitCount == numPoints);
+        start[0] = 0;
+        for (int k=0; k<256*threads; ++k)                               // 4
+          start[k+1] += start[k];
+      }
+      if (!skip)
+      {
+        for (int i=begin; i<end; ++i)                                   // 5
+        {
+          int pos = start[((key[i] >> shift) & 255)*threads + t]++;
+          sorted[pos] = order[i];
+          sortedKey[pos] = key[i];
+        }
+      }
+    }
+    if (skip)
+      continue;
+    order.swap(sorted);
+    key.swap(sortedKey);
+  }
+
+  xCoord.resize(numPoints);
+  yCoord.resize(numPoints);
+  charge.assign(numPoints, 0.0);
+  index.swap(order);
+  boxIndex.swap(key);
+  #pragma omp parallel for schedule(static) num_threads(numThreads)
+  for (int pos=0; pos<numPoints; ++pos)
+  {
+    int i = index[pos];
+    xCoord[pos] = x[i];
+    yCoord[pos] = y[i];
+  }
+}
+
+// the position in the sorted arrays of each point of the input
+// (position[index[pos]] = pos, the inverse of index)
+void Particles::getInputPositions(std::vector<int> &position)
+{
+  position.resize(index.size());
+  for (unsigned int pos=0; pos<index.size(); ++pos)
+    position[index[pos]] = pos;
+}
+
+// Explanation of getRange:
+//
+// Returns the range of positions [begin, end) of the particles in box n of
+// level boxLevel (boxLevel <= level).  The descendants of box n at the level
+// 'level' used for sorting have the indices n*4^(level-boxLevel), ...,
+// (n+1)*4^(level-boxLevel) - 1, that is the indices with the first bits equal to n
+// (see FmmTree::initStruct).  Since the particles are sorted by these indices
+// a binary search gives the first and one past the last of them.
+void Particles::getRange(unsigned int boxLevel, long long n, int &begin, int &end)
+{
+  int shift = 2*(level - boxLevel);
+  begin = std::lower_bound(boxIndex.begin(), boxIndex.end(), n << shift) - boxIndex.begin();
+  end   = std::lower_bound(boxIndex.begin()+begin, boxIndex.end(), (n+1) << shift) - boxIndex.begin();
+}
+
+// gathering the charges u (given in the order of the input vector of
+// the points) into the sorted order of the particles
+void Particles::setCharge(std::vector<double> &u)
+{
+  for (unsigned int i=0; i<index.size(); ++i)
+    charge[i] = u[index[i]];
+}
+
+void Particles::setCharge(const double *u)
+{
+  for (unsigned int i=0; i<index.size(); ++i)
+    charge[i] = u[index[i]];
+}
@@ -34,7 +34,7 @@ class Point
 
     std::string coordToString();
     bool equals(Point &p);
-    int getBoxIndex(unsigned int level);
+    long long getBoxIndex(unsigned int level);
 };
  */
 
@@ -514,10 +514,11 @@ bool Point::equals(Point &p)
  */
 
 
-int Point::getBoxIndex(unsigned int level)
+// The scaling by 2^level is exact (only the exponent of the coordinates
+// changes), so std::ldexp gives the same cells as std::pow(2,level) without
+// computing the power for each point.
+long long Point::getBoxIndex(unsigned int level)
 {
-  Util util;
-  return util.interleave(std::floor(coord.real()*std::pow(2,level)),
-		                 std::floor(coord.imag()*std::pow(2,level)),
-		                 level);
+  return Util::mortonKey((uint32_t)std::ldexp(coord.real(), level),
+                         (uint32_t)std::ldexp(coord.imag(), level));
 }
@@ -9,6 +9,8 @@
 #include <complex>
 #include <cmath>
 #include <iostream>
+#include <cstddef>
+#include <algorithm>
 
 #include "Potential.h"
 
@@ -21,13 +23,44 @@ class Potential
 	int p;
     int DEFAULT_P = 12;
 
-    Potential() { this->p = DEFAULT_P; };
-	Potential(int p)
-	 :
-     p(p)
-	{};
+    // translation kernel with the order p fixed at compile time (see
+    // applyTranslation), NULL if p is not between MIN_FIXED_P and MAX_FIXED_P
+    typedef void (*TranslationKernel)(const std::complex<double> *matrix,
+                                      const std::complex<double> *in,
+                                      std::complex<double> *out);
+    static const int MIN_FIXED_P = 4;
+    static const int MAX_FIXED_P = 32;
+    TranslationKernel translationKernel;
+
+    // the same for the factored S|R translation (see applyFactoredSR), NULL
+    // if p is not between MIN_FIXED_P and MAX_FIXED_P
+    typedef void (*FactoredSRKernel)(const double *pascal, const std::complex<double> *power,
+                                     std::complex<double> logT, const std::complex<double> *in,
+                                     std::complex<double> *out);
+    FactoredSRKernel factoredSRKernel;
+
+    // the same with the matrix and the coefficients in float (mixed precision,
+    // see applyTranslationFloat), the results are added to double coefficients
+    typedef void (*TranslationKernelFloat)(const std::complex<float> *matrix,
+                                           const std::complex<float> *in,
+                                           std::complex<double> *out);
+    typedef void (*FactoredSRKernelFloat)(const float *pascal, const std::complex<float> *power,
+                                          std::complex<double> logT, const std::complex<float> *in,
+                                          std::complex<double> *out);
+    TranslationKernelFloat translationKernelFloat;
+    FactoredSRKernelFloat factoredSRKernelFloat;
+
+    Potential() { setP(DEFAULT_P); };
+	Potential(int p) { setP(p); };
 	int getP() { return p;};
-	void setP(int p) { this->p = p; };
+	void setP(int p) { this->p = p; this->translationKernel = getTranslationKernel(p);
+	                   this->factoredSRKernel = getFactoredSRKernel(p);
+	                   this->translationKernelFloat = getTranslationKernelFloat(p);
+	                   this->factoredSRKernelFloat = getFactoredSRKernelFloat(p); };
+	static TranslationKernel getTranslationKernel(int p);
+	static FactoredSRKernel getFactoredSRKernel(int p);
+	static TranslationKernelFloat getTranslationKernelFloat(int p);
+	static FactoredSRKernelFloat getFactoredSRKernelFloat(int p);
 	std::vector<std::complex<double> > getSR(std::complex<double> from,
 			                                 std::complex<double> to,
 			                                 const std::vector<std::complex<double> > &sCoeff);
@@ -38,6 +71,51 @@ class Potential
 			                                 std::complex<double> to,
 			                                 const std::vector<std::complex<double> > &rCoeff);
 
+	// translation matrices (p x p, stored row by row) for the translation vector t = to - from
+	void getSRMatrix(std::complex<double> t, std::vector<std::complex<double> > &sr);
+	void getSSMatrix(std::complex<double> t, std::vector<std::complex<double> > &ss);
+	void getRRMatrix(std::complex<double> t, std::vector<std::complex<double> > &rr);
+	// factors of the S|R matrix (see applyFactoredSR): the Pascal matrix (the
+	// same for every t) and the powers t^(-j) and log t of the translation vector
+	void getPascalMatrix(std::vector<double> &pascal);
+	void getSRFactors(std::complex<double> t, std::vector<std::complex<double> > &power,
+	                  std::complex<double> &logT);
+	std::vector<std::complex<double> > translate(const std::vector<std::complex<double> > &matrix,
+			                                     const std::vector<std::complex<double> > &coeff);
+
+	// accumulate-in-place versions used by the passes of FmmTree: no vectors are
+	// created and the p results are added to the coefficients at out
+	void applyTranslation(const std::complex<double> *matrix, const std::complex<double> *in,
+			              std::complex<double> *out);
+	// the same for numRhs coefficient vectors at once (p x numRhs, stored row by row)
+	void applyTranslationBatch(const std::complex<double> *matrix, const std::complex<double> *in,
+			                   std::complex<double> *out, int numRhs);
+	// out += S|R(t) in with the factors of the S|R matrix instead of the matrix
+	void applyFactoredSR(const double *pascal, const std::complex<double> *power,
+			             std::complex<double> logT, const std::complex<double> *in,
+			             std::complex<double> *out);
+	// the same with float matrices and coefficients (mixed precision)
+	void applyTranslationFloat(const std::complex<float> *matrix, const std::complex<float> *in,
+			                   std::complex<double> *out);
+	void applyFactoredSRFloat(const float *pascal, const std::complex<float> *power,
+			                  std::complex<double> logT, const std::complex<float> *in,
+			                  std::complex<double> *out);
+	// the series of FmmTree are scaled by the size of their box (see
+	// addSCoeff), scale = 1 gives the plain coefficients
+	void addSCoeff(std::complex<double> xi, std::complex<double> xstar, double u, std::complex<double> *out,
+			       double scale = 1.0);
+	void addRCoeff(std::complex<double> xi, std::complex<double> xstar, double u, std::complex<double> *out,
+			       double scale = 1.0);
+	std::complex<double> evalR(const std::complex<double> *d, std::complex<double> y, std::complex<double> xstar,
+			                   double scale = 1.0);
+	std::complex<double> evalS(const std::complex<double> *c, std::complex<double> y, std::complex<double> xstar,
+			                   double scale = 1.0);
+	// the same and the derivative of the series with respect to y (field, see FmmTree::applyField)
+	std::complex<double> evalR(const std::complex<double> *d, std::complex<double> y, std::complex<double> xstar,
+			                   std::complex<double> &derivative, double scale = 1.0);
+	std::complex<double> evalS(const std::complex<double> *c, std::complex<double> y, std::complex<double> xstar,
+			                   std::complex<double> &derivative, double scale = 1.0);
+
 	std::vector<std::complex<double> > getRCoeff(std::complex<double> xi, std::complex<double> xstar);
 	std::vector<std::complex<double> > getSCoeff(std::complex<double> xi, std::complex<double> xstar);
 
@@ -53,12 +131,37 @@ std::vector<std::complex<double> > Potential::getSCoeff(std::complex<double> xi,
 		                                                std::complex<double> xstar)
 {
   std::vector<std::complex<double> > ans(p);
-  ans[0].real(1.0); ans[0].imag(0.0);                    // first coefficient of S-expansions is 1
+  addSCoeff(xi, xstar, 1.0, &ans[0]);                    // first coefficient of S-expansions is 1
+  return ans;
+}
+
+// Explanation of addSCoeff:
+//
+// adds u times the S-expansion coefficients of the source xi (see getSCoeff)
+// to the p coefficients at out, without creating a vector:
+//   out[0] += u    and    out[i] += -u ((xi - xstar)/scale)^i / i
+// The powers are formed by repeated multiplication instead of with pow.
+//
+// Scaled coefficients: with the size s of the box as scale the coefficients
+// are c[i] / s^i of the plain coefficients c[i] (and the R-expansion
+// coefficients are d[i] s^i, see addRCoeff and evalR).  The powers
+// (xi - xstar)^i of the plain coefficients are of the order of s^i, and at
+// the deep levels of a tree (s = 2^-l) they and the powers t^-(i+j) of the
+// translation matrices underflow or overflow long before p is large.  The
+// scaled coefficients are of the order of 1 at every level, and the scaled
+// translation matrices only depend on the offset of the boxes in box sizes
+// (see TranslationOperators::build)
+void Potential::addSCoeff(std::complex<double> xi, std::complex<double> xstar, double u,
+		                  std::complex<double> *out, double scale)
+{
+  std::complex<double> z = (xi - xstar) / scale;
+  std::complex<double> power = u;
+  out[0] += u;
   for (int i=1; i<p; ++i)
   {
-    ans[i] = -1.0 * pow((xi - xstar), i)/ ((double) i);  // type cast on i
+    power *= z;
+    out[i] -= power / ((double) i);                      // type cast on i
   }
-  return ans;
 }
 
 
@@ -69,12 +172,11 @@ std::vector<std::complex<double> > Potential::getSCoeff(std::complex<double> xi,
  * We follow the work of Yang Wang's Master Thesis.  See the notes in Main.cc
  * for the S|S translation and its development
  */
-std::vector<std::complex<double> > Potential::getSR(std::complex<double> from, std::complex<double> to,
-		                                            const std::vector<std::complex<double> > &sCoeff)
+void Potential::getSRMatrix(std::complex<double> t, std::vector<std::complex<double> > &sr)
 {
-  std::complex<double> t = to - from;
   // SR transformation matrix with size p x p
-  std::vector<std::vector<std::complex<double> > > sr(p, std::vector<std::complex<double> >(p));
+  // (stored row by row, entry sr[i][j] of the comments is sr[i*p+j])
+  sr.assign(p*p, 0.0);
 
   // std::log(z) computes the complex natural logarithm of a complex value z
   // according to cppreference - the returned value is in the range of [-i \pi, i \pi]
@@ -120,15 +222,15 @@ std::vector<std::complex<double> > Potential::getSR(std::complex<double> from, s
   //           = ln(1) + i \pi
   //           = 0 + i \pi
   //           = i \pi
-  sr[0][0] = std::log(t);
+  sr[0] = std::log(t);
 
   // first row and column of SR translation matrix
   // see Main.cc notes for matrix (transpose)
-  sr[1][0] = 1.0/t;
+  sr[p] = 1.0/t;
   for (int i=2; i<p; ++i)  // first column (following Wang)
-    sr[i][0] = -1.0 * sr[i-1][0] * double(i-1) / ( double(i) * t );
+    sr[i*p] = -1.0 * sr[(i-1)*p] * double(i-1) / ( double(i) * t );
   for (int j=1; j<p; ++j)  // first row
-    sr[0][j] = 1.0 / std::pow(t,j);
+    sr[j] = 1.0 / std::pow(t,j);
 
   // Working down from row to row following Yang Wang's thesis
   // Rows of Wang's thesis corresponds to columns of tranformation
@@ -150,6 +252,9 @@ std::vector<std::complex<double> > Potential::getSR(std::complex<double> from, s
   //        - divide by 2 = i
   //        - multiply by 3 = i + j - 1
   //
+  //    (the power of t is one more than for the row above, since
+  //     sr[i][j] = (-1)^i (i+j-1)!/(i!(j-1)!) / t^(i+j))
+  //
   //    j = 3 (column 3)
   //        - multiply by a negative
   //        - divide by a power of t
@@ -190,28 +295,15 @@ std::vector<std::complex<double> > Potential::getSR(std::complex<double> from, s
   //
   for (int i=1; i<p; ++i)
     for (int j=1; j<p; ++j)
-      sr[i][j] = (-1.0) * sr[i-1][j] * double(i+j-1) / double(i);
-
-  std::vector<std::complex<double> > ans(p);
-
-
-  // Performing the translation:
-  // Following the notes in Main.cc, the translation of the series to the new location (new series)
-  // results in a change of the coefficients of the original series (and a change of center)
-  // The new coefficients are obtained through a linear combination of the coefficients of
-  // the series centered at the old location (old series).  In Main.cc, we can see that the
-  // linear combination for each coefficient is a row/vector multiply where the row comes from
-  // the matrix (transpose matrix in notes) that has just been created above.  The vector is
-  // made up of the coefficients of the old series
-  for (int i=0; i<p; ++i)
-  {
-    ans[i] = 0.0;
-    for (int j=0; j<p; ++j)
-      ans[i] += sr[i][j] * sCoeff[j];
-  }
-
-  return ans;
+      sr[i*p+j] = (-1.0) * sr[(i-1)*p+j] * double(i+j-1) / (double(i) * t);
+}
 
+std::vector<std::complex<double> > Potential::getSR(std::complex<double> from, std::complex<double> to,
+		                                            const std::vector<std::complex<double> > &sCoeff)
+{
+  std::vector<std::complex<double> > sr;
+  getSRMatrix(to - from, sr);
+  return translate(sr, sCoeff);
 }
 
 
@@ -221,23 +313,23 @@ std::vector<std::complex<double> > Potential::getSR(std::complex<double> from, s
  * We follow the work of Yang Wang's Master Thesis.  See the notes in Main.cc
  * for the S|S translation and its development
  */
-std::vector<std::complex<double> > Potential::getSS(std::complex<double> from, std::complex<double> to,
-		                                            const std::vector<std::complex<double> > &sCoeff)
+void Potential::getSSMatrix(std::complex<double> t, std::vector<std::complex<double> > &ss)
 {
-  std::complex<double> t = to - from;
   // SS transformation matrix with size p x p
-  std::vector<std::vector<std::complex<double> > > ss(p, std::vector<std::complex<double> >(p));
+  // (stored row by row, entry ss[i][j] of the comments is ss[i*p+j])
+  ss.assign(p*p, 0.0);
 
   // main diagonal of ss (SS transformation/translation matrix)
   for (int i=0; i<p; ++i)
-      ss[i][i] = 1.0;
+      ss[i*p+i] = 1.0;
 
   // first colum of ss
   // The first column is defined recursively where multiplication by (double)(i-1)
   // cancels out the previous division
-  ss[1][0] = t;                     // first column (0) second row (1)
+  ss[p] = t;                     // first column (0) second row (1)
+  // (ss[i][0] = (-1)^(i+1) t^i / i, so each row also picks up a factor of t)
   for (int i=2; i<p; ++i)           // first column rest of the rows
-      ss[i][0] = ss[i-1][0] * (double)(i-1) * (-1.0) / (double)(i);
+      ss[i*p] = ss[(i-1)*p] * t * (double)(i-1) * (-1.0) / (double)(i);
 
   // The lower triangular part of ss matrix working per row from left to right
   // note that the coefficient progression along a row are just the progression
@@ -247,61 +339,49 @@ std::vector<std::complex<double> > Potential::getSS(std::complex<double> from, s
   // Example: Row 6
   //          i = 5
   //            j = i-1 = 4 (first term to left of diagonal of ones
-  //              ss[i][j] = (-1.0)*ss[i][j+1] * (double)j / (double)(i-j)
-  //              ss[5][4] = (-1.0)*1.0*4.0/(5.0-4.0) = -4.0
+  //              ss[i][j] = (-1.0)*t*ss[i][j+1] * (double)j / (double)(i-j)
+  //              ss[5][4] = (-1.0)*t*1.0*4.0/(5.0-4.0) = -4.0t
   //            j = i-2 = 3 (second term from left)
-  //              ss[i][j] = (-1.0)*ss[i][j+1] * (double)j / (double)(i-j)
-  //              ss[5][3] = (-1.0)*(-4.0)*(3.0)/(5.0-3.0) = 12.0/2.0 = 6.0
+  //              ss[i][j] = (-1.0)*t*ss[i][j+1] * (double)j / (double)(i-j)
+  //              ss[5][3] = (-1.0)*t*(-4.0t)*(3.0)/(5.0-3.0) = 12.0t^2/2.0 = 6.0t^2
   //            j = i-3 = 5-3 = 2
-  //              ss[i][j] = (-1.0)*ss[i][j+1] * (double)j / (double)(i-j)
-  //              ss[5][2] = (-1.0)*(6.0)*(2.0)/(5.0-2.0) = -12.0/3.0 = -4.0
+  //              ss[i][j] = (-1.0)*t*ss[i][j+1] * (double)j / (double)(i-j)
+  //              ss[5][2] = (-1.0)*t*(6.0t^2)*(2.0)/(5.0-2.0) = -12.0t^3/3.0 = -4.0t^3
   //            j = i-4 = 5-4 = 1
-  //              ss[i][j] = (-1.0)*ss[i][j+1] * (double)j / (double)(i-j)
-  //              ss[5][1] = (-1.0)*(-4.0)*(1.0)/(5.0-1.0) = 4.0/4.0 = 1.0
+  //              ss[i][j] = (-1.0)*t*ss[i][j+1] * (double)j / (double)(i-j)
+  //              ss[5][1] = (-1.0)*t*(-4.0t^3)*(1.0)/(5.0-1.0) = 4.0t^4/4.0 = t^4
+  // (the entry ss[i][j] is the binomial coefficient times t^(i-j), the power of t
+  //  being the difference between the row and column index)
   // More explanation can be found in Main.cc at S|S translation
   for (int i=1; i<p; ++i)           // all rows after first row (row 0)
       for (int j=i-1; j>=1; --j)    // lower triangular elements
-          ss[i][j]= (-1.0) * ss[i][j+1] * ((double)j/(double)(i-j));
+          ss[i*p+j]= (-1.0) * t * ss[i*p+j+1] * ((double)j/(double)(i-j));
 
   // The entries in the upper triangular part of the ss matrix are all zero
   // (all entries to the right of the main diagonal of ones have value zero)
   for (int i=0; i<p; ++i)           // all rows
       for (int j=i+1; j<p; ++j)     // upper triangular part of p x p matrix
-          ss[i][j]=0.0;
+          ss[i*p+j]=0.0;
 
   // We now have the ss translation matrix
+}
 
-  // Performing the translation:
-  // Following the notes in Main.cc, the translation of the series to the new location (new series)
-  // results in a change of the coefficients of the original series (and a change of center)
-  // The new coefficients are obtained through a linear combination of the coefficients of
-  // the series centered at the old location (old series).  In Main.cc, we can see that the
-  // linear combination for each coefficient is a row/vector multiply where the row comes from
-  // the matrix (transpose matrix in notes) that has just been created above.  The vector is
-  // made up of the coefficients of the old series
-  std::vector<std::complex<double> > ans(p);
-  for (int i=0; i<p; ++i)
-  {
-    ans[i] = 0.0;                                   // initializing ans
-    for (int j=0; j<p; ++j)
-    {
-      ans[i] = ans[i] + (sCoeff[j] * ss[i][j]);     // row/vector multiply
-    }
-  }
-
-  return ans;
-
+std::vector<std::complex<double> > Potential::getSS(std::complex<double> from, std::complex<double> to,
+		                                            const std::vector<std::complex<double> > &sCoeff)
+{
+  std::vector<std::complex<double> > ss;
+  getSSMatrix(to - from, ss);
+  return translate(ss, sCoeff);
 }
 
-std::vector<std::complex<double> > Potential::getRR(std::complex<double> from, std::complex<double> to,
-		                                            const std::vector<std::complex<double> > &rCoeff)
+void Potential::getRRMatrix(std::complex<double> t, std::vector<std::complex<double> > &rr)
 {
-  std::complex<double>  t = to - from;
-  std::vector<std::vector<std::complex<double> > > rr(p, std::vector<std::complex<double> >(p));
+  // (stored row by row, entry rr[i][j] of the comments is rr[i*p+j])
+  rr.assign(p*p, 0.0);
   for (int i=0; i<p; ++i)
-    rr[i][i] = 1.0;            // main diagonal
+    rr[i*p+i] = 1.0;            // main diagonal
   for (int j=1; j<p; ++j)
-    rr[0][j] = rr[0][j-1] * t; // first row
+    rr[j] = rr[j-1] * t; // first row
 
   /**
    *  In the for loop
@@ -349,34 +429,507 @@ std::vector<std::complex<double> > Potential::getRR(std::complex<double> from, s
    */
   for (int i=1; i<p; ++i)      // upper triangular part of matrix
     for (int j=i+1; j<p; j++)  // (columns after main diagonal)
-      rr[i][j]
-           = rr[i-1][j] * double(j-i+1) / (t * double(i)) ;
+      rr[i*p+j]
+           = rr[(i-1)*p+j] * double(j-i+1) / (t * double(i)) ;
 
   for (int i=1; i<p; i++)      // lower triangular part of matrix
     for (int j=0; j<i; j++)    // (columns before main diagonal)
-      rr[i][j] = 0.0;
-
-  // Performing the translation:
-  // Following the notes in Main.cc, the translation of the series to the new location (new series)
-  // results in a change of the coefficients of the original series (and a change of center)
-  // The new coefficients are obtained through a linear combination of the coefficients of
-  // the series centered at the old location (old series).  In Main.cc, we can see that the
-  // linear combination for each coefficient is a row/vector multiply where the row comes from
-  // the matrix (transpose matrix in Main.cc notes) that has just been created above.  The vector
-  // of the matrix-vector product is made up of the coefficients of the old series.  The
-  // For each row i of the matrix, the row-vector products are given below.
-  std::vector<std::complex<double> > ans(p);
-  for (int i=0; i<p; i++)
+      rr[i*p+j] = 0.0;
+}
+
+std::vector<std::complex<double> > Potential::getRR(std::complex<double> from, std::complex<double> to,
+		                                            const std::vector<std::complex<double> > &rCoeff)
+{
+  std::vector<std::complex<double> > rr;
+  getRRMatrix(to - from, rr);
+  return translate(rr, rCoeff);
+}
+
+// Performing the translation:
+// Following the notes in Main.cc, the translation of the series to the new location (new series)
+// results in a change of the coefficients of the original series (and a change of center)
+// The new coefficients are obtained through a linear combination of the coefficients of
+// the series centered at the old location (old series).  In Main.cc, we can see that the
+// linear combination for each coefficient is a row/vector multiply where the row comes from
+// the matrix (transpose matrix in notes) created by getSSMatrix, getSRMatrix or getRRMatrix.
+// The vector is made up of the coefficients of the old series
+std::vector<std::complex<double> > Potential::translate(const std::vector<std::complex<double> > &matrix,
+		                                                const std::vector<std::complex<double> > &coeff)
+{
+  std::vector<std::complex<double> > ans(p);       // initializing ans with zeros
+  applyTranslation(&matrix[0], &coeff[0], &ans[0]);
+  return ans;
+}
+
+// same as translate, but the new coefficients are added to the p coefficients
+// at out (for example the coefficients of the parent box in the upward pass)
+// instead of being returned in a new vector.  in and out must not overlap.
+// For the usual orders the kernel with the order fixed at compile time
+// is used (see applyTranslationFixed below)
+void Potential::applyTranslation(const std::complex<double> *matrix, const std::complex<double> *in,
+		                         std::complex<double> *out)
+{
+  if (translationKernel != NULL)
   {
-    ans[i] = 0.0;
-    for (int j=0; j<p; j++)
+    translationKernel(matrix, in, out);
+    return;
+  }
+  for (int i=0; i<p; ++i)
+  {
+    std::complex<double> sum = 0.0;
+    const std::complex<double> *row = matrix + i*p;
+    for (int j=0; j<p; ++j)
+      sum += row[j] * in[j];                        // row/vector multiply
+    out[i] += sum;
+  }
+}
+
+// Explanation of applyTranslationBatch:
+//
+// the translation of numRhs series at once (see FmmTree::applyBatch): in and
+// out are p x numRhs matrices stored row by row (term i of series r at
+// i*numRhs + r), and out += matrix * in is a matrix-matrix product instead of
+// numRhs matrix-vector products.  Each element of the matrix is loaded once
+// for BATCH_BLOCK series, and the loop over the series of a block has a
+// constant trip count and contiguous data, so the compiler can keep the
+// sums in (vector) registers.  The sums of each series are added in the same
+// order as in applyTranslationFixed.
+static const int BATCH_BLOCK = 8;
+
+void Potential::applyTranslationBatch(const std::complex<double> *matrix, const std::complex<double> *in,
+		                              std::complex<double> *out, int numRhs)
+{
+  const double *m = reinterpret_cast<const double*>(matrix);
+  const double *x = reinterpret_cast<const double*>(in);
+  double *y = reinterpret_cast<double*>(out);
+  for (int r0=0; r0<numRhs; r0+=BATCH_BLOCK)
+  {
+    int nr = std::min(BATCH_BLOCK, numRhs - r0);
+    for (int i=0; i<p; ++i)
     {
-      ans[i] = ans[i] + ( rr[i][j] * rCoeff[j] );
+      const double *row = m + 2*i*p;
+      double sumRe[BATCH_BLOCK] = { 0.0 };
+      double sumIm[BATCH_BLOCK] = { 0.0 };
+      if (nr == BATCH_BLOCK)
+        for (int j=0; j<p; ++j)
+        {
+          const double *xj = x + 2*(j*numRhs + r0);
+          for (int r=0; r<BATCH_BLOCK; ++r)
+          {
+            sumRe[r] += row[2*j]*xj[2*r] - row[2*j+1]*xj[2*r+1];
+            sumIm[r] += row[2*j]*xj[2*r+1] + row[2*j+1]*xj[2*r];
+          }
+        }
+      else
+        for (int j=0; j<p; ++j)
+        {
+          const double *xj = x + 2*(j*numRhs + r0);
+          for (int r=0; r<nr; ++r)
+          {
+            sumRe[r] += row[2*j]*xj[2*r] - row[2*j+1]*xj[2*r+1];
+            sumIm[r] += row[2*j]*xj[2*r+1] + row[2*j+1]*xj[2*r];
+          }
+        }
+      double *yi = y + 2*(i*numRhs + r0);
+      for (int r=0; r<nr; ++r)
+      {
+        yi[2*r]   += sumRe[r];
+        yi[2*r+1] += sumIm[r];
+      }
     }
   }
+}
 
-  return ans;
+/**
+ * Explanation of applyTranslationFixed<P> and getTranslationKernel
+ *
+ * The translations (M2M, M2L and L2L) are the inner loops of the FMM, and
+ * with the order p only known when the program runs the compiler can neither
+ * unroll the loops over the p x p matrix nor keep the sums in registers.
+ * applyTranslationFixed<P> is the same row/vector multiply with the order P
+ * as a template parameter, so the trip counts are constants, and it is
+ * instantiated for every order P = MIN_FIXED_P, ..., MAX_FIXED_P.
+ *
+ * The complex numbers are handled as pairs (real part, imaginary part) of
+ * doubles (std::complex<double> has this layout).  The products are computed as
+ *   (a + ib)(c + id) = (ac - bd) + i(ad + bc)
+ * which is what operator* of std::complex does, but without the checks for
+ * infinities and NaNs of operator* (these prevent the compiler from
+ * vectorizing the loops).  The sums are added in the same order as in the
+ * loop of applyTranslation, so both give the same results.
+ *
+ * getTranslationKernel(p) is the (thin) runtime dispatcher: it returns the
+ * instantiation for the order p, or NULL for an order outside the range, and
+ * is called by setP, so the choice is made once and not for each translation.
+ * The order p itself follows from the requested accuracy (see Main.cc notes).
+ *
+ * The real type T of the matrix, the coefficients and the sums is the second
+ * template parameter: double, or float for the mixed precision M2L (see
+ * applyTranslationFloat), where the sums of each row are floats and are
+ * added to the double coefficients at out.
+ */
+template <int P, typename T>
+static void applyTranslationFixed(const std::complex<T> *matrix,
+                                  const std::complex<T> *in,
+                                  std::complex<double> *out)
+{
+  const T *m = reinterpret_cast<const T*>(matrix);
+  const T *x = reinterpret_cast<const T*>(in);
+  double *y = reinterpret_cast<double*>(out);
+  for (int i=0; i<P; ++i)
+  {
+    const T *row = m + 2*i*P;
+    T sumRe = 0.0;
+    T sumIm = 0.0;
+    for (int j=0; j<P; ++j)
+    {
+      sumRe += row[2*j]*x[2*j] - row[2*j+1]*x[2*j+1];
+      sumIm += row[2*j]*x[2*j+1] + row[2*j+1]*x[2*j];
+    }
+    y[2*i]   += sumRe;
+    y[2*i+1] += sumIm;
+  }
+}
 
+// table of the instantiations for P = MIN_FIXED_P, ..., MAX_FIXED_P, built
+// with template recursion from P = MAX_FIXED_P down to MIN_FIXED_P
+template <int P, typename T>
+struct FixedKernelTable
+{
+  typedef void (*Kernel)(const std::complex<T> *, const std::complex<T> *, std::complex<double> *);
+  static void fill(Kernel *table)
+  {
+    table[P - Potential::MIN_FIXED_P] = &applyTranslationFixed<P,T>;
+    FixedKernelTable<P-1,T>::fill(table);
+  }
+};
+
+template <typename T>
+struct FixedKernelTable<Potential::MIN_FIXED_P - 1, T>
+{
+  typedef void (*Kernel)(const std::complex<T> *, const std::complex<T> *, std::complex<double> *);
+  static void fill(Kernel *) {}
+};
+
+template <typename T>
+struct FixedKernels
+{
+  typename FixedKernelTable<Potential::MAX_FIXED_P,T>::Kernel
+      table[Potential::MAX_FIXED_P - Potential::MIN_FIXED_P + 1];
+  FixedKernels() { FixedKernelTable<Potential::MAX_FIXED_P,T>::fill(table); }
+};
+
+Potential::TranslationKernel Potential::getTranslationKernel(int p)
+{
+  static const FixedKernels<double> kernels;    // filled once (thread safe in C++11)
+  if (p < MIN_FIXED_P || p > MAX_FIXED_P)
+    return NULL;
+  return kernels.table[p - MIN_FIXED_P];
+}
+
+Potential::TranslationKernelFloat Potential::getTranslationKernelFloat(int p)
+{
+  static const FixedKernels<float> kernels;
+  if (p < MIN_FIXED_P || p > MAX_FIXED_P)
+    return NULL;
+  return kernels.table[p - MIN_FIXED_P];
+}
+
+/**
+ * Explanation of the factored S|R translation (applyFactoredSR)
+ *
+ * The entries of the S|R matrix (see getSRMatrix) for i, j >= 1 are
+ *   sr[i][j] = (-1)^i (i+j-1)! / (i! (j-1)!) t^(-i-j)
+ *            = (-1)^i t^(-i)  C(i+j-1, i)  t^(-j)
+ * that is, the matrix is a diagonal matrix times the Pascal matrix
+ * C(i+j-1, i) times a diagonal matrix.  The Pascal matrix is the same for
+ * every translation vector t (and every level), only the powers t^(-j)
+ * depend on t.  The first row and the first column are
+ *   sr[0][0] = log t,  sr[0][j] = t^(-j)  and  sr[i][0] = (-1)^(i+1) / (i t^i)
+ * and C(j-1, 0) = 1, so row 0 is the Pascal row 0 plus c[0] log t, and column
+ * 0 is (-1)^i t^(-i) times -1/i.  With x[j] = c[j] t^(-j) (the scaled
+ * coefficients of the source box) the translation is
+ *
+ * [1] - x[j] = c[j] t^(-j) for j = 1, ..., p-1
+ * [2] - y[i] = sum_{j>=1} C(i+j-1, i) x[j] for i = 0, ..., p-1
+ *       (real matrix times complex vector: 2 multiply-adds for each entry
+ *       instead of the 4 of a complex multiply-add)
+ * [3] - d[0] += c[0] log t + y[0]
+ *       d[i] += (-1)^i t^(-i) (y[i] - c[0]/i) for i = 1, ..., p-1
+ *
+ * The scaled coefficients x[j] and sums y[i] are of the order of 1 (c[j] is
+ * of the order of the box size to the j, and |t| is 2 or more box sizes), so
+ * the factored form has the accuracy of the matrix.  A faster form with the
+ * Pascal matrix written as a Hankel matrix (factorials on the diagonals) and
+ * a convolution done by FFT loses this: the factorials grow faster than any
+ * power of the box size, and the FFT was accurate to only 1e-9 at p = 12 and
+ * 1e-2 at p = 16.
+ *
+ * The Pascal matrix is stored column by column, column j at pascal[j*p]
+ * (column 0 is not used), so that [2] adds a column times x[j] to the sums,
+ * and the powers t^(-j), j = 0, ..., p-1 at power.  Instead of the 40 p x p
+ * complex matrices (see TranslationOperators) only the one
+ * real p x p matrix and p + 1 complex numbers for each offset are used.
+ * applyFactoredSRFixed<P,T> is the version with the order as a template
+ * parameter (see applyTranslationFixed, T is double or float).  The term
+ * c[0] log t is computed in double.
+ */
+template <int P, typename T>
+static void applyFactoredSRFixed(const T *pascal, const std::complex<T> *power,
+                                 std::complex<double> logT, const std::complex<T> *in,
+                                 std::complex<double> *out)
+{
+  const T *w = reinterpret_cast<const T*>(power);
+  const T *c = reinterpret_cast<const T*>(in);
+  double *d = reinterpret_cast<double*>(out);
+
+  T xRe[P], xIm[P], yRe[P], yIm[P];
+  for (int j=1; j<P; ++j)                                                        // 1
+  {
+    xRe[j] = c[2*j]*w[2*j] - c[2*j+1]*w[2*j+1];
+    xIm[j] = c[2*j]*w[2*j+1] + c[2*j+1]*w[2*j];
+  }
+
+  for (int i=0; i<P; ++i)                                                        // 2
+  {
+    yRe[i] = 0.0;
+    yIm[i] = 0.0;
+  }
+  for (int j=1; j<P; ++j)
+  {
+    const T *column = pascal + j*P;
+    for (int i=0; i<P; ++i)
+    {
+      yRe[i] += column[i]*xRe[j];
+      yIm[i] += column[i]*xIm[j];
+    }
+  }
+
+  d[0] += c[0]*logT.real() - c[1]*logT.imag() + yRe[0];                        // 3
+  d[1] += c[0]*logT.imag() + c[1]*logT.real() + yIm[0];
+  for (int i=1; i<P; ++i)
+  {
+    T aRe = yRe[i] - c[0]/i;
+    T aIm = yIm[i] - c[1]/i;
+    T sign = (i & 1) ? -1.0 : 1.0;
+    d[2*i]   += sign*(w[2*i]*aRe - w[2*i+1]*aIm);
+    d[2*i+1] += sign*(w[2*i]*aIm + w[2*i+1]*aRe);
+  }
+}
+
+template <int P, typename T>
+struct FactoredKernelTable
+{
+  typedef void (*Kernel)(const T *, const std::complex<T> *, std::complex<double>,
+                         const std::complex<T> *, std::complex<double> *);
+  static void fill(Kernel *table)
+  {
+    table[P - Potential::MIN_FIXED_P] = &applyFactoredSRFixed<P,T>;
+    FactoredKernelTable<P-1,T>::fill(table);
+  }
+};
+
+template <typename T>
+struct FactoredKernelTable<Potential::MIN_FIXED_P - 1, T>
+{
+  typedef void (*Kernel)(const T *, const std::complex<T> *, std::complex<double>,
+                         const std::complex<T> *, std::complex<double> *);
+  static void fill(Kernel *) {}
+};
+
+template <typename T>
+struct FactoredKernels
+{
+  typename FactoredKernelTable<Potential::MAX_FIXED_P,T>::Kernel
+      table[Potential::MAX_FIXED_P - Potential::MIN_FIXED_P + 1];
+  FactoredKernels() { FactoredKernelTable<Potential::MAX_FIXED_P,T>::fill(table); }
+};
+
+Potential::FactoredSRKernel Potential::getFactoredSRKernel(int p)
+{
+  static const FactoredKernels<double> kernels;
+  if (p < MIN_FIXED_P || p > MAX_FIXED_P)
+    return NULL;
+  return kernels.table[p - MIN_FIXED_P];
+}
+
+Potential::FactoredSRKernelFloat Potential::getFactoredSRKernelFloat(int p)
+{
+  static const FactoredKernels<float> kernels;
+  if (p < MIN_FIXED_P || p > MAX_FIXED_P)
+    return NULL;
+  return kernels.table[p - MIN_FIXED_P];
+}
+
+// Pascal matrix C(i+j-1, i), column j at pascal[j*p] (column 0 is zero),
+// each column computed with C(i+j, i+1) = C(i+j-1, i) (i+j)/(i+1)
+void Potential::getPascalMatrix(std::vector<double> &pascal)
+{
+  pascal.assign(p*p, 0.0);
+  for (int j=1; j<p; ++j)
+  {
+    double binomial = 1.0;                               // C(j-1, 0)
+    for (int i=0; i<p; ++i)
+    {
+      pascal[j*p+i] = binomial;
+      binomial = binomial * (i+j) / (i+1);
+    }
+  }
+}
+
+// powers t^(-j), j = 0, ..., p-1 and log t of the translation vector t
+void Potential::getSRFactors(std::complex<double> t, std::vector<std::complex<double> > &power,
+                             std::complex<double> &logT)
+{
+  power.assign(p, 0.0);
+  std::complex<double> inverse = 1.0 / t;
+  power[0] = 1.0;
+  for (int j=1; j<p; ++j)
+    power[j] = power[j-1] * inverse;
+  logT = std::log(t);
+}
+
+// out += S|R(t) in (see the explanation above), for the orders without a
+// fixed kernel the scaled coefficients are computed again for each row
+void Potential::applyFactoredSR(const double *pascal, const std::complex<double> *power,
+                                std::complex<double> logT, const std::complex<double> *in,
+                                std::complex<double> *out)
+{
+  if (factoredSRKernel != NULL)
+  {
+    factoredSRKernel(pascal, power, logT, in, out);
+    return;
+  }
+  for (int i=0; i<p; ++i)
+  {
+    std::complex<double> sum = 0.0;
+    for (int j=1; j<p; ++j)
+      sum += pascal[j*p+i] * (in[j] * power[j]);
+    if (i == 0)
+      out[0] += in[0] * logT + sum;
+    else
+      out[i] += ((i & 1) ? -power[i] : power[i]) * (sum - in[0] / double(i));
+  }
+}
+
+// Explanation of applyTranslationFloat and applyFactoredSRFloat:
+//
+// applyTranslation and applyFactoredSR with the matrix (factors) and the
+// coefficients in float, for the M2L of the mixed precision mode (see
+// FmmTree::setPrecision).  The p products of a row are summed in float and
+// the sums are added to the double coefficients at out, so the accumulation
+// over the boxes of the interaction list is in double.  The fixed kernels
+// are the float instantiations of applyTranslationFixed and
+// applyFactoredSRFixed.
+void Potential::applyTranslationFloat(const std::complex<float> *matrix, const std::complex<float> *in,
+                                      std::complex<double> *out)
+{
+  if (translationKernelFloat != NULL)
+  {
+    translationKernelFloat(matrix, in, out);
+    return;
+  }
+  for (int i=0; i<p; ++i)
+  {
+    std::complex<float> sum = 0.0f;
+    const std::complex<float> *row = matrix + i*p;
+    for (int j=0; j<p; ++j)
+      sum += row[j] * in[j];
+    out[i] += std::complex<double>(sum);
+  }
+}
+
+void Potential::applyFactoredSRFloat(const float *pascal, const std::complex<float> *power,
+                                     std::complex<double> logT, const std::complex<float> *in,
+                                     std::complex<double> *out)
+{
+  if (factoredSRKernelFloat != NULL)
+  {
+    factoredSRKernelFloat(pascal, power, logT, in, out);
+    return;
+  }
+  for (int i=0; i<p; ++i)
+  {
+    std::complex<float> sum = 0.0f;
+    for (int j=1; j<p; ++j)
+      sum += pascal[j*p+i] * (in[j] * power[j]);
+    if (i == 0)
+      out[0] += std::complex<double>(in[0]) * logT + std::complex<double>(sum);
+    else
+      out[i] += std::complex<double>(((i & 1) ? -power[i] : power[i]) * (sum - in[0] / float(i)));
+  }
+}
+
+// Explanation of evalR and evalS:
+//
+// value at y of the R-expansion (near field series) with coefficients d and of
+// the S-expansion (far field series) with coefficients c about xstar, that is
+//   evalR = sum_{k<p} d[k] z^k    and    evalS = c[0] log z + sum_{1<=k<p} c[k] z^(-k)
+// with z = y - xstar.  These are the sums of the products of the coefficients
+// with getRVector and getSVector, evaluated with Horner's rule (no vector of
+// powers is needed)
+std::complex<double> Potential::evalR(const std::complex<double> *d, std::complex<double> y,
+		                              std::complex<double> xstar, double scale)
+{
+  std::complex<double> z = (y - xstar) / scale;
+  std::complex<double> sum = d[p-1];
+  for (int k=p-2; k>=0; --k)
+    sum = sum * z + d[k];
+  return sum;
+}
+
+std::complex<double> Potential::evalS(const std::complex<double> *c, std::complex<double> y,
+		                              std::complex<double> xstar, double scale)
+{
+  std::complex<double> z = y - xstar;
+  std::complex<double> w = scale / z;
+  std::complex<double> sum = 0.0;
+  for (int k=p-1; k>=1; --k)
+    sum = (sum + c[k]) * w;
+  return c[0] * std::log(z) + sum;
+}
+
+// Explanation of evalR and evalS with derivative:
+//
+// the value of the series (as above) and its derivative with respect to y
+//   evalR' = sum_{1<=k<p} k d[k] z^(k-1)
+//   evalS' = c[0] / z - sum_{1<=k<p} k c[k] z^(-k-1)
+// both with the same Horner loop as the value: the derivative of the Horner
+// sum s = s z + d[k] is s' = s' z + s (taken before s is updated), and for
+// the S-expansion sum_k k c[k] w^k with w = 1/z is summed like the value
+// (with scaled coefficients z/scale and scale/z, and the derivative with
+// respect to z/scale is divided by scale)
+std::complex<double> Potential::evalR(const std::complex<double> *d, std::complex<double> y,
+		                              std::complex<double> xstar, std::complex<double> &derivative,
+		                              double scale)
+{
+  std::complex<double> z = (y - xstar) / scale;
+  std::complex<double> sum = d[p-1];
+  std::complex<double> dsum = 0.0;
+  for (int k=p-2; k>=0; --k)
+  {
+    dsum = dsum * z + sum;
+    sum = sum * z + d[k];
+  }
+  derivative = dsum / scale;
+  return sum;
+}
+
+std::complex<double> Potential::evalS(const std::complex<double> *c, std::complex<double> y,
+		                              std::complex<double> xstar, std::complex<double> &derivative,
+		                              double scale)
+{
+  std::complex<double> z = y - xstar;
+  std::complex<double> w = scale / z;
+  std::complex<double> sum = 0.0;
+  std::complex<double> dsum = 0.0;
+  for (int k=p-1; k>=1; --k)
+  {
+    sum = (sum + c[k]) * w;
+    dsum = (dsum + ((double) k) * c[k]) * w;
+  }
+  derivative = (c[0] - dsum) / z;
+  return c[0] * std::log(z) + sum;
 }
 
 // powers of the R-expansion power series (see Main.cc discussion for details).
@@ -388,6 +941,56 @@ std::vector<std::complex<double> > Potential::getRVector(std::complex<double> y,
   return rVec;
 }
 
+// powers of the S-expansion series (see Main.cc discussion for details)
+// the first term is log(y - xstar) and the others are the negative powers
+// (y - xstar)^(-i) (the counterpart of getRVector for the far field series)
+std::vector<std::complex<double> > Potential::getSVector(std::complex<double> y, std::complex<double> xstar)
+{
+  std::vector<std::complex<double> > sVec(p);
+  std::complex<double> z = y - xstar;
+  sVec[0] = std::log(z);
+  if (p > 1)
+    sVec[1] = 1.0/z;
+  for (int i=2; i<p; ++i)
+    sVec[i] = sVec[i-1] / z;
+  return sVec;
+}
+
+// Explanation of getRCoeff:
+//
+// coefficients of the R-expansion (near field series about xstar) of the
+// potential log(y - xi) of a single source xi, for points y with
+// |y - xstar| < |xi - xstar| (the source is far from xstar)
+//
+// With z = y - xstar,
+//   log(y - xi) = log((xstar - xi) + z)
+//               = log(xstar - xi) + log(1 + z/(xstar - xi))
+//               = log(xstar - xi) - sum_{i>=1} z^i / (i (xi - xstar)^i)
+// so the coefficients are
+//   ans[0] = log(xstar - xi)    and    ans[i] = -1 / (i (xi - xstar)^i)
+std::vector<std::complex<double> > Potential::getRCoeff(std::complex<double> xi,
+		                                                std::complex<double> xstar)
+{
+  std::vector<std::complex<double> > ans(p);
+  addRCoeff(xi, xstar, 1.0, &ans[0]);
+  return ans;
+}
+
+// adds u times the R-expansion coefficients of the source xi (see getRCoeff)
+// to the p coefficients at out, scaled by scale^i (see addSCoeff)
+void Potential::addRCoeff(std::complex<double> xi, std::complex<double> xstar, double u,
+		                  std::complex<double> *out, double scale)
+{
+  std::complex<double> inv = scale/(xi - xstar);
+  std::complex<double> power = u;
+  out[0] += u * std::log(xstar - xi);
+  for (int i=1; i<p; ++i)
+  {
+    power *= inv;
+    out[i] -= power / ((double) i);
+  }
+}
+
 // direct (exact) calculation of the potential acting on yj by xi
 std::complex<double> Potential::direct(std::complex<double> yj, std::complex<double> xi)
 {
@@ -0,0 +1,183 @@
+/*
+ * TaskGraph.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "TaskGraph.h"
+
+/**
+ * Header Interface for Class TaskGraph
+ *
+class TaskGraph
+{
+  public:
+    std::vector<int> kind;
+    std::vector<int> numDependencies;
+    std::vector<int> start;
+    std::vector<int> successor;
+
+    TaskGraph() : numKinds(0) {};
+
+    void clear();
+    int  addTask(int kind);                // returns the number of the new task
+    void addDependency(int before, int after);   // 'after' waits for 'before' (before finalize)
+    void finalize();                       // building the successor lists
+
+    void run(int numThreads, const std::function<void(int, int)> &work);
+
+    int  size() { return this->kind.size(); };
+    bool isEmpty() { return this->kind.empty(); };
+
+  private:
+    int numKinds;
+    std::vector<int> pendingBefore;        // edges added with addDependency
+    std::vector<int> pendingAfter;
+};
+*/
+
+/**
+ * Explanation of TaskGraph
+ *
+ * A directed acyclic graph of tasks: a task can run as soon as all tasks it
+ * depends on are done, so there are no barriers between groups of tasks (for
+ * FmmTree the levels and the phases of the FMM, see FmmTree::runTasks).
+ * The graph is built once (addTask, addDependency, finalize) and can be run
+ * many times.
+ *
+ * run:
+ * [1] - each task gets a counter with the number of tasks it waits for, the
+ *       tasks without dependencies are ready
+ * [2] - each thread takes a ready task of the smallest kind (the ready tasks of
+ *       one kind are a stack, the last task that became ready is taken first,
+ *       so a thread tends to continue with the data it has just written)
+ * [3] - after the task the counters of its successors are decreased, the tasks
+ *       whose counter reaches zero become ready
+ * [4] - a thread without a ready task waits (yield) until the other threads
+ *       make tasks ready or all tasks are done
+ * The ready stacks are protected by one mutex, each task takes it at most
+ * twice, so the tasks should not be too small (FmmTree uses one task for the
+ * work of one box).  The order of the tasks depends on the threads, so the
+ * work of a task must not depend on it (each task of FmmTree writes only the
+ * coefficients of its own box, in a fixed order).
+ * Without OpenMP (or for numThreads = 1) the tasks run on the calling thread.
+ */
+void TaskGraph::clear()
+{
+  kind.clear();
+  numDependencies.clear();
+  start.clear();
+  successor.clear();
+  pendingBefore.clear();
+  pendingAfter.clear();
+  numKinds = 0;
+}
+
+int TaskGraph::addTask(int kind)
+{
+  assert(kind>=0 && "TaskGraph::addTask kind < 0");
+  this->kind.push_back(kind);
+  numDependencies.push_back(0);
+  numKinds = std::max(numKinds, kind+1);
+  return this->kind.size()-1;
+}
+
+void TaskGraph::addDependency(int before, int after)
+{
+  assert(before>=0 && before<size() && after>=0 && after<size() && "TaskGraph::addDependency no such task");
+  pendingBefore.push_back(before);
+  pendingAfter.push_back(after);
+  numDependencies[after]++;
+}
+
+// the successors of each task with a counting sort of the edges (as in
+// InteractionList::finalize)
+void TaskGraph::finalize()
+{
+  int numTasks = size();
+  int numEdges = pendingBefore.size();
+  start.assign(numTasks+1, 0);
+  for (int i=0; i<numEdges; ++i)
+    ++start[pendingBefore[i]+1];
+  for (int t=0; t<numTasks; ++t)
+    start[t+1] += start[t];
+
+  std::vector<int> next(start.begin(), start.end()-1);
+  successor.resize(numEdges);
+  for (int i=0; i<numEdges; ++i)
+    successor[next[pendingBefore[i]]++] = pendingAfter[i];
+  std::vector<int>().swap(pendingBefore);
+  std::vector<int>().swap(pendingAfter);
+}
+
+void TaskGraph::run(int numThreads, const std::function<void(int, int)> &work)
+{
+  int numTasks = size();
+  if (numTasks == 0)
+    return;
+
+  std::vector<std::atomic<int> > remaining(numTasks);                    // 1
+  std::vector<std::vector<int> > ready(numKinds);
+  for (int t=numTasks-1; t>=0; --t)
+  {
+    remaining[t].store(numDependencies[t], std::memory_order_relaxed);
+    if (numDependencies[t] == 0)
+      ready[kind[t]].push_back(t);
+  }
+  std::mutex readyMutex;
+  std::atomic<int> numDone(0);
+
+  #pragma omp parallel num_threads(numThreads)
+  {
+#ifdef _OPENMP
+    int thread = omp_get_thread_num();
+#else
+    int thread = 0;
+#endif
+    std::vector<int> newReady;
+    while (numDone.load() < numTasks)
+    {
+      int task = -1;
+      {
+      std::lock_guard<std::mutex> lock(readyMutex);                      // 2
+      for (int k=0; k<numKinds && task<0; ++k)
+        if (!ready[k].empty())
+        {
+          task = ready[k].back();
+          ready[k].pop_back();
+        }
+      }
+      if (task < 0)                                                      // 4
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      work(task, thread);
+
+      newReady.clear();                                                  // 3
+      for (int i=start[task]; i<start[task+1]; ++i)
+        if (remaining[successor[i]].fetch_sub(1) == 1)
+          newReady.push_back(successor[i]);
+      if (!newReady.empty())
+      {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        for (unsigned int i=0; i<newReady.size(); ++i)
+          ready[kind[newReady[i]]].push_back(newReady[i]);
+      }
+      numDone++;
+    }
+  }
+}
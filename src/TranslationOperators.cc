@@ -0,0 +1,184 @@
+/*
+ * TranslationOperators.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <cassert>
+#include <complex>
+#include <cmath>
+#include <cstdlib>
+
+#include "TranslationOperators.h"
+#include "Potential.h"
+
+/**
+ * Header Interface for Class TranslationOperators
+ *
+class TranslationOperators
+{
+  public:
+    static const int MAX_OFFSET = 3;
+    static const int OFFSETS_PER_SIDE = 2*MAX_OFFSET+1;
+
+    int p;                                 // truncation index of the translated series
+
+    // the series of the boxes of level l are scaled by the cell length
+    // s = 2^(-l) (see Potential::addSCoeff), so the matrices are the same for
+    // every level and only one table of them is kept:
+    // ss[k] - S|S matrix from child k (k = 0,1,2,3) to its parent
+    // rr[k] - R|R matrix from the parent to its child k
+    // sr[m] - S|R matrix between two cells with offset index m (without the
+    //         term log s of the level, see getLogScale)
+    // (all matrices are p x p and stored row by row like in Potential::getSSMatrix)
+    std::vector<std::vector<std::complex<double> > > ss;
+    std::vector<std::vector<std::complex<double> > > rr;
+    std::vector<std::vector<std::complex<double> > > sr;
+
+    // factors of the S|R matrices (see Potential::applyFactoredSR): the Pascal
+    // matrix (p x p, stored column by column) and for each sr[m] the powers
+    // t^(-j), j = 0, ..., p-1 (srPower[m]) and log t (srLog[m])
+    std::vector<double> pascal;
+    std::vector<std::vector<std::complex<double> > > srPower;
+    std::vector<std::complex<double> > srLog;
+
+    // float copies of sr, pascal and srPower for the mixed precision M2L (see
+    // FmmTree::setPrecision), built by buildFloat
+    std::vector<std::vector<std::complex<float> > > srFloat;
+    std::vector<float> pascalFloat;
+    std::vector<std::vector<std::complex<float> > > srPowerFloat;
+
+    TranslationOperators() : p(0) {};
+
+    void build(Potential &potential);
+    void buildFloat();
+    bool hasFloat() { return !this->srFloat.empty(); };
+
+    const std::vector<std::complex<double> >& getSS(int child) { return ss[child]; };
+    const std::vector<std::complex<double> >& getRR(int child) { return rr[child]; };
+    const std::vector<std::complex<double> >& getSR(int dx, int dy) { return sr[getOffsetIndex(dx,dy)]; };
+    const std::vector<std::complex<double> >& getSR(int offsetIndex) { return sr[offsetIndex]; };
+    const std::vector<std::complex<double> >& getSRPower(int offsetIndex) { return srPower[offsetIndex]; };
+    std::complex<double> getSRLog(int offsetIndex) { return srLog[offsetIndex]; };
+
+    // cell length of level l (scale of its series) and its logarithm, which
+    // the S|R translations of level l add to the first coefficient (times the
+    // first coefficient of the S-expansion)
+    static double getScale(int level) { return std::ldexp(1.0, -level); };
+    static double getLogScale(int level) { return -level * std::log(2.0); };
+
+    static int getOffsetIndex(int dx, int dy) { return (dx+MAX_OFFSET)*OFFSETS_PER_SIDE + (dy+MAX_OFFSET); };
+};
+*/
+
+/**
+ * Explanation of build
+ *
+ * The translation matrices of Potential only depend on the translation vector
+ * t = to - from.  In the quadtree the vector t is determined by the level and
+ * the relative position of the two cells, so only a few different matrices
+ * are needed for the whole tree:
+ *
+ * S|S and R|R (child k at level l and its parent at level l-1)
+ *   - the child index k = n & 3 (last two bits of the cell index n) gives the
+ *     position of the child inside its parent (see Box::getChildrenIndex).
+ *     The odd bit is the x-increment and the even bit the y-increment
+ *     (same as in Util::interleave):
+ *
+ *               -------------
+ *               |  1  |  3  |
+ *               -------------
+ *               |  0  |  2  |
+ *               -------------
+ *
+ *   - with cell length s = 2^(-l) the center of the child is (xb + 0.5)s, (yb + 0.5)s
+ *     and the center of the parent is s, s (relative to the lower left corner of the parent)
+ *     S|S:  t = parent center - child center = ((0.5 - xb)s, (0.5 - yb)s)
+ *     R|R:  t = child center - parent center = ((xb - 0.5)s, (yb - 0.5)s)
+ *   - 4 matrices for each translation
+ *
+ * S|R (cells at the same level l)
+ *   - the source cell is dx, dy cell lengths away from the target cell
+ *     (dx, dy between -3 and 3, see Box::getNeighborsE4Index)
+ *     S|R:  t = target center - source center = (-dx s, -dy s)
+ *   - the cells of the interaction list are not neighbors, so the 9 offsets with
+ *     |dx| <= 1 and |dy| <= 1 are never used (40 matrices)
+ *   - the factors of each S|R matrix (powers of t and log t) for the factored
+ *     M2L (see FmmTree::setM2LEngine), and the Pascal matrix of all of them
+ *
+ * The series of a box are scaled by its cell length (see Potential::addSCoeff):
+ * the S-expansion coefficients are c[j] / s^j and the R-expansion coefficients
+ * d[i] s^i.  For a translation from a series scaled by a to one scaled by b
+ * the scaled matrix is M[i][j] a^j / b^i, and the translation vector t is
+ * tau s with tau the vector of the table above for s = 1.  The entries of
+ * the matrices at t = tau s are the ones at tau times a power of s:
+ *   S|S[i][j] ~ t^(i-j),  R|R[i][j] ~ t^(j-i)  and  S|R[i][j] ~ t^-(i+j)
+ * (see getSSMatrix, getRRMatrix and getSRMatrix), so the powers of s cancel
+ * and the scaled matrices are
+ *   S|S:  SS(tau)[i][j] / 2^i    (a = s, b = 2s)
+ *   R|R:  RR(tau)[i][j] / 2^j    (a = 2s, b = s)
+ *   S|R:  SR(tau)[i][j]          (a = b = s)
+ * for every level.  The only exception is S|R[0][0] = log t = log tau + log s,
+ * so the S|R translations of level l add c[0] log s to the first R-expansion
+ * coefficient (see getLogScale and FmmTree::applySR).  The table is built with
+ * the vectors tau (no powers of 2^(-l)), and the entries stay between
+ * 2^(-p) and 2^p even for p = 40 and 30 levels.
+ *
+ * The matrices are built once and are then used for every box in the upward
+ * and downward passes (and every call to solve).
+ */
+void TranslationOperators::build(Potential &potential)
+{
+  this->p = potential.getP();
+  assert(p >= 2 && "TranslationOperators::build p < 2");
+
+  ss.assign(4, std::vector<std::complex<double> >());
+  rr.assign(4, std::vector<std::complex<double> >());
+  sr.assign(OFFSETS_PER_SIDE*OFFSETS_PER_SIDE, std::vector<std::complex<double> >());
+  srPower.assign(OFFSETS_PER_SIDE*OFFSETS_PER_SIDE, std::vector<std::complex<double> >());
+  srLog.assign(OFFSETS_PER_SIDE*OFFSETS_PER_SIDE, 0.0);
+  potential.getPascalMatrix(pascal);
+  srFloat.clear();                       // built again by buildFloat (if needed)
+  pascalFloat.clear();
+  srPowerFloat.clear();
+
+  for (int k=0; k<4; ++k)
+  {
+    double xb = (k >> 1) & 1;
+    double yb = k & 1;
+    std::complex<double> tau(0.5-xb, 0.5-yb);
+    potential.getSSMatrix(tau, ss[k]);
+    potential.getRRMatrix(-tau, rr[k]);
+    for (int i=0; i<p; ++i)
+      for (int j=0; j<p; ++j)
+      {
+        ss[k][i*p+j] *= std::ldexp(1.0, -i);           // powers of 2 (exact)
+        rr[k][i*p+j] *= std::ldexp(1.0, -j);
+      }
+  }
+
+  for (int dx=-MAX_OFFSET; dx<=MAX_OFFSET; ++dx)
+    for (int dy=-MAX_OFFSET; dy<=MAX_OFFSET; ++dy)
+      if (std::abs(dx) > 1 || std::abs(dy) > 1)
+      {
+        std::complex<double> tau(-dx, -dy);
+        int m = getOffsetIndex(dx,dy);
+        potential.getSRMatrix(tau, sr[m]);
+        potential.getSRFactors(tau, srPower[m], srLog[m]);
+      }
+}
+
+// float copies of the S|R matrices and factors (rounded once), used by the
+// M2L of the mixed precision mode
+void TranslationOperators::buildFloat()
+{
+  srFloat.assign(sr.size(), std::vector<std::complex<float> >());
+  srPowerFloat.assign(srPower.size(), std::vector<std::complex<float> >());
+  for (unsigned int m=0; m<sr.size(); ++m)
+  {
+    srFloat[m].assign(sr[m].begin(), sr[m].end());
+    srPowerFloat[m].assign(srPower[m].begin(), srPower[m].end());
+  }
+  pascalFloat.assign(pascal.begin(), pascal.end());
+}
@@ -6,6 +6,7 @@
 
 #include <complex>
 #include <cmath>
+#include <stdint.h>
 
 #include "Util.h"
 
@@ -17,11 +18,17 @@ class Util
 {
   public:
     Util() {};
-    int interleave(int x, int y, int level);
-    std::complex<double> uninterleave(int n, int L);
+    long long interleave(int x, int y, int level);
+    std::complex<double> uninterleave(long long n, int L);
+    void uninterleave(long long n, int &x, int &y);
     int setbit(int n, int pos, int setto);
     int getbit(int n, int pos);
 
+    // Morton encoding and decoding without loops (see Util.cc)
+    static inline uint64_t spreadBits(uint32_t v);
+    static inline uint32_t compactBits(uint64_t v);
+    static inline long long mortonKey(uint32_t x, uint32_t y)
+      { return (long long)((spreadBits(x) << 1) | spreadBits(y)); };
 };
 *
 */
@@ -39,20 +46,14 @@ class Util
 // horizontal increments (x) to the right of the lower left hand corner
 // of the domain and vertical increments (y) upward to reach the
 // lower left hand corner of the cell of interest
-int Util::interleave(int x, int y, int level)
+//
+// The bits of x become the odd bits and the bits of y the even bits of
+// the index (bit i of x is bit 2i+1 and bit i of y is bit 2i), see the
+// explanation of the bit tricks below.  The index has 2*level bits and is a
+// 64-bit integer, so the levels 0, ..., 31 can be used.
+long long Util::interleave(int x, int y, int level)
 {
-  if (x == 0 && y == 0)
-    return 0;
-  else
-  {
-    int ans = 0;
-    for (int i=0; i<level; ++i)
-    {
-      ans = setbit(ans, (level-i)*2-1, getbit(x, level-i-1));
-      ans = setbit(ans, (level-i)*2-2, getbit(y, level-i-1));
-    }
-    return ans;
-  }
+  return mortonKey((uint32_t)x, (uint32_t)y);
 }
 
 /**
@@ -204,29 +205,45 @@ int Util::interleave(int x, int y, int level)
  *   by the function
  */
 
-std::complex<double> Util::uninterleave(int n, int L)
+std::complex<double> Util::uninterleave(long long n, int L)
 {
-  std::complex<double> ll_box_corner;
-  if (n==0)
-  {
-    ll_box_corner.real(0.0); ll_box_corner.imag(0.0);
-  }
-  else
-  {
-    int xInt = 0;
-    int yInt = 0;
-    for (int i=0; i<L; ++i)
-    {
-      xInt = setbit(xInt, L-i-1, getbit(n, (L-i-1)*2+1));
-      yInt = setbit(yInt, L-i-1, getbit(n, (L-i-1)*2));
-    }
-    ll_box_corner.real(xInt); ll_box_corner.imag(yInt);
-  }
-  return ll_box_corner;
+  int xInt, yInt;
+  uninterleave(n, xInt, yInt);
+  return std::complex<double>(xInt, yInt);
 }
 
+// the same as uninterleave(n, L) above but returning the number of cell
+// lengths x (horizontal) and y (vertical) as integers
+void Util::uninterleave(long long n, int &x, int &y)
+{
+  x = (int)compactBits((uint64_t)n >> 1);
+  y = (int)compactBits((uint64_t)n);
+}
 
-
+/**
+ * Explanation of the bit tricks of spreadBits and compactBits (Util.h)
+ *
+ * The loops over the bits of interleave and uninterleave, which are explained
+ * above (setbit and getbit, one bit at a time), are replaced by a fixed number
+ * of shifts and masks (magic numbers).  spreadBits moves bit i of a 32-bit
+ * integer to bit 2i of a 64-bit integer.  It first moves the upper 16 bits
+ * up by 16 positions, then in each half the upper 8 bits up by 8 positions
+ * and so on:
+ *
+ *   ................................ponmlkjihgfedcbaPONMLKJIHGFEDCBA   v
+ *   ................ponmlkjihgfedcba................PONMLKJIHGFEDCBA   shift 16, mask 0x0000FFFF0000FFFF
+ *   ........ponmlkji........hgfedcba........PONMLKJI........HGFEDCBA   shift  8, mask 0x00FF00FF00FF00FF
+ *   ....ponm....lkji....hgfe....dcba....PONM....LKJI....HGFE....DCBA   shift  4, mask 0x0F0F0F0F0F0F0F0F
+ *   ..po..nm..lk..ji..hg..fe..dc..ba..PO..NM..LK..JI..HG..FE..DC..BA   shift  2, mask 0x3333333333333333
+ *   .p.o.n.m.l.k.j.i.h.g.f.e.d.c.b.a.P.O.N.M.L.K.J.I.H.G.F.E.D.C.B.A   shift  1, mask 0x5555555555555555
+ *
+ * (a dot is a zero bit).  compactBits does the same steps backwards.  The index
+ * of the cell is then (spreadBits(x) << 1) | spreadBits(y) without any branches,
+ * which the compiler can inline into the loops over the points (Point::getBoxIndex
+ * and Particles::sort).  When the code is compiled for processors with the BMI2
+ * instructions (for example with -mbmi2 or -march=native) the two functions are
+ * single instructions (PDEP and PEXT with the mask 0x5555555555555555).
+ */
 
 /** Explanation of setbit and getbit member functions
  *
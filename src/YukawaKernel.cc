@@ -0,0 +1,496 @@
+/*
+ * YukawaKernel.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+
+#include "YukawaKernel.h"
+#include "TranslationOperators.h"
+
+/**
+ * Header Interface for Class YukawaKernel
+ *
+class YukawaKernel
+{
+  public:
+    double lambda;                         // screening parameter
+    int    p;                              // terms -p, ..., p of the series
+    int    numOfLevels;                    // levels of the tables (see build)
+    double tol2;                           // squared distance below which a source is the target itself
+
+    // translation matrices of the scaled series of each level l ((2p+1) x (2p+1),
+    // stored row by row):
+    // ss[l][k] - from child k of level l to its parent (S|S)
+    // rr[l][k] - from the parent to its child k of level l (R|R)
+    // sr[l][m] - between two cells of level l with offset index m (see
+    //            TranslationOperators::getOffsetIndex)
+    std::vector<std::vector<std::vector<std::complex<double> > > > ss;
+    std::vector<std::vector<std::vector<std::complex<double> > > > rr;
+    std::vector<std::vector<std::vector<std::complex<double> > > > sr;
+
+    YukawaKernel(double lambda, int p);
+
+    int  getNumCoeff() { return 2*p+1; };
+*/
+
+/**
+ * Explanation of the Yukawa expansions
+ *
+ * With K_n(z) = K_|n|(lambda |z|) e^(i n arg z) and I_n(z) = I_|n|(lambda |z|) e^(i n arg z)
+ * for a vector z (a complex number) the addition theorems (Graf) are
+ *   K_n(u + v) = sum_m (-1)^m K_(n-m)(u) I_m(v)      for |v| < |u|
+ *   I_n(u + v) = sum_m I_(n-m)(u) I_m(v)             for all u, v
+ * (the sums are over all integers m) and they give all phases of the FMM
+ * for a box with center c (the sums truncated to n, m = -p, ..., p):
+ * 1 - P2M: K_0(y - x) = sum_n c[n] K_n(y - c) with c[n] = I_-n(x - c)
+ * 2 - M2M: the S-expansion of the child (center c) about its parent (center c'),
+ *     c'[k] = sum_n I_(n-k)(c - c') c[n]
+ * 3 - M2L: the S-expansion of the box c as an R-expansion about the center c'
+ *     of a well separated box, d[m] = sum_n (-1)^m K_(n-m)(c' - c) c[n]
+ * 4 - P2L: K_0(y - x) = sum_m d[m] I_m(y - c) with d[m] = K_-m(x - c)
+ * 5 - L2L: the R-expansion of the parent (center c') about its child (center c),
+ *     d[k] = sum_m I_(m-k)(c - c') d'[m], the Bessel functions of 2
+ * 6 - L2P and M2P: the real parts of the series at the targets
+ * The potential is real, so c[-n] = conj(c[n]) and d[-n] = conj(d[n]); all
+ * 2p+1 terms are kept so that the translations are plain matrix products.
+ * The truncation error falls like that of the Laplace series (p the same),
+ * and faster when lambda times the box size is large.
+ *
+ * Explanation of the scaled series
+ *
+ * For small arguments I_n(x) ~ (x/2)^n / n! and K_n(x) ~ (n-1)! / 2 (x/2)^-n,
+ * so on deep trees (lambda 2^(-l) small) the M2L matrices of the orders up to
+ * 2p overflow and the P2M coefficients underflow (inf times 0 gave NaN).  The
+ * series of a box of level l are therefore kept in the scaled functions
+ *   I'_n(z) = I_n(z) |n|! / sigma^|n|    K'_n(z) = K_n(z) sigma^|n| / |n|!
+ * with sigma = lambda 2^(-l) / 2 (getSigma), the coefficients c'[n] = c[n]
+ * |n|! / sigma^|n| and d'[n] = d[n] sigma^|n| / |n|!, which are of the order
+ * of 1 for the distances of the boxes of the level (as the scaled Laplace
+ * series of FmmTree).  besselIScaled and besselKScaled have the recurrences
+ * above in the scaled functions, so no power of sigma is formed:
+ *   I'_(k-1) = I'_(k+1) sigma^2 / (k (k+1)) + (2 sigma / x) I'_k
+ *   K'_(k+1) = K'_(k-1) sigma^2 / (k (k+1)) + (2 sigma / x) k / (k+1) K'_k
+ * (the Miller values normalized with I_0(x)).  The entries of the matrices
+ * are the scaled functions times the remaining powers of sigma (the
+ * exponents are not negative) and factorials, one exponential of their
+ * logarithms; the child level of M2M and L2L has half the sigma of the
+ * parent, so S|S and R|R are different matrices (ss and rr).
+ */
+YukawaKernel::YukawaKernel(double lambda, int p)
+       :
+       lambda(lambda),
+       p(p),
+       numOfLevels(0),
+       tol2(2.0*std::numeric_limits<double>::epsilon()*std::numeric_limits<double>::epsilon())
+{
+  assert(lambda > 0.0 && "YukawaKernel lambda <= 0");
+  assert(p > 0 && "YukawaKernel p < 1");
+}
+
+// the matrices of the levels 0, ..., numOfLevels-1 (the cells of level l have
+// the length 2^(-l), see TranslationOperators.cc for the child and offset
+// vectors).  The scaled Bessel functions of the level are multiplied with the
+// remaining powers of sigma and factorials (see the explanation of the scaled
+// series), which are computed as one exponential so that no factor overflows.
+void YukawaKernel::build(int numOfLevels)
+{
+  this->numOfLevels = numOfLevels;
+  int n = getNumCoeff();
+  ss.assign(numOfLevels, std::vector<std::vector<std::complex<double> > >(4));
+  rr.assign(numOfLevels, std::vector<std::vector<std::complex<double> > >(4));
+  sr.assign(numOfLevels, std::vector<std::vector<std::complex<double> > >(
+                           TranslationOperators::OFFSETS_PER_SIDE*TranslationOperators::OFFSETS_PER_SIDE));
+  std::vector<double> logFactorial(2*n);
+  for (unsigned int k=0; k<logFactorial.size(); ++k)
+    logFactorial[k] = std::lgamma(k + 1.0);
+  const double log2 = std::log(2.0);
+  std::vector<std::complex<double> > value;
+  for (int l=1; l<numOfLevels; ++l)
+  {
+    double s = TranslationOperators::getScale(l);
+    double logSigma = std::log(getSigma(l));
+    for (int k=0; k<4; ++k)
+    {
+      double xb = (k >> 1) & 1;
+      double yb = k & 1;
+      getI(std::complex<double>((xb-0.5)*s, (yb-0.5)*s), 2*p, getSigma(l), value);   // child - parent
+      ss[l][k].resize(n*n);
+      rr[l][k].resize(n*n);
+      for (int i=0; i<n; ++i)
+        for (int j=0; j<n; ++j)
+        {
+          int a = std::abs(i-p);           // term of the output
+          int b = std::abs(j-p);           // term of the input
+          int c = std::abs(j-i);           // order of the Bessel function
+          ss[l][k][i*n+j] = value[2*p + j - i]                                           // I_(j-i)
+                            * std::exp((c + b - a)*logSigma - a*log2
+                                       + logFactorial[a] - logFactorial[b] - logFactorial[c]);
+          rr[l][k][i*n+j] = value[2*p + j - i]
+                            * std::exp((c + a - b)*logSigma - b*log2
+                                       + logFactorial[b] - logFactorial[a] - logFactorial[c]);
+        }
+    }
+    for (int dx=-TranslationOperators::MAX_OFFSET; dx<=TranslationOperators::MAX_OFFSET; ++dx)
+      for (int dy=-TranslationOperators::MAX_OFFSET; dy<=TranslationOperators::MAX_OFFSET; ++dy)
+      {
+        if (std::abs(dx) <= 1 && std::abs(dy) <= 1)
+          continue;
+        int m = TranslationOperators::getOffsetIndex(dx, dy);
+        getK(std::complex<double>(-dx*s, -dy*s), 2*p, getSigma(l), value);              // target - source
+        sr[l][m].resize(n*n);
+        for (int i=0; i<n; ++i)
+          for (int j=0; j<n; ++j)
+          {
+            int a = std::abs(i-p);
+            int b = std::abs(j-p);
+            int c = std::abs(j-i);
+            std::complex<double> entry = value[2*p + j - i]                              // K_(j-i)
+                                         * std::exp((a + b - c)*logSigma
+                                                    + logFactorial[c] - logFactorial[a] - logFactorial[b]);
+            sr[l][m][i*n+j] = ((i-p) & 1) ? -entry : entry;
+          }
+      }
+  }
+}
+
+void YukawaKernel::p2m(const double *x, const double *y, const double *q, int n,
+                       std::complex<double> center, int level, std::complex<double> *c)
+{
+  std::vector<std::complex<double> > value;
+  for (int j=0; j<n; ++j)
+  {
+    getI(std::complex<double>(x[j], y[j]) - center, p, getSigma(level), value);
+    for (int k=-p; k<=p; ++k)
+      c[p+k] += q[j] * value[p-k];                                           // 1
+  }
+}
+
+void YukawaKernel::m2m(int level, int child, const std::complex<double> *c, std::complex<double> *parentC)
+{
+  apply(ss[level][child], c, parentC);                                       // 2
+}
+
+void YukawaKernel::m2l(int level, int offsetIndex, const std::complex<double> *c, std::complex<double> *d)
+{
+  apply(sr[level][offsetIndex], c, d);                                       // 3
+}
+
+void YukawaKernel::p2l(const double *x, const double *y, const double *q, int n,
+                       std::complex<double> center, int level, std::complex<double> *d)
+{
+  std::vector<std::complex<double> > value;
+  for (int j=0; j<n; ++j)
+  {
+    getK(std::complex<double>(x[j], y[j]) - center, p, getSigma(level), value);
+    for (int k=-p; k<=p; ++k)
+      d[p+k] += q[j] * value[p-k];                                           // 4
+  }
+}
+
+void YukawaKernel::l2l(int level, int child, const std::complex<double> *parentD, std::complex<double> *d)
+{
+  apply(rr[level][child], parentD, d);                                       // 5
+}
+
+void YukawaKernel::l2p(const std::complex<double> *d, std::complex<double> center, int level,
+                       const double *x, const double *y, int n, double *v)
+{
+  std::vector<std::complex<double> > value;
+  for (int j=0; j<n; ++j)
+  {
+    getI(std::complex<double>(x[j], y[j]) - center, p, getSigma(level), value);
+    std::complex<double> sum = 0.0;
+    for (int k=0; k<getNumCoeff(); ++k)
+      sum += d[k] * value[k];                                                // 6
+    v[j] += sum.real();
+  }
+}
+
+void YukawaKernel::m2p(const std::complex<double> *c, std::complex<double> center, int level,
+                       const double *x, const double *y, int n, double *v)
+{
+  std::vector<std::complex<double> > value;
+  for (int j=0; j<n; ++j)
+  {
+    getK(std::complex<double>(x[j], y[j]) - center, p, getSigma(level), value);
+    std::complex<double> sum = 0.0;
+    for (int k=0; k<getNumCoeff(); ++k)
+      sum += c[k] * value[k];
+    v[j] += sum.real();
+  }
+}
+
+// P2P: the direct sum, the pairs with r2 <= tol2 (the target itself) are skipped
+void YukawaKernel::p2p(const double *tx, const double *ty, int nt,
+                       const double *sx, const double *sy, const double *q, int ns, double *v)
+{
+  for (int i=0; i<nt; ++i)
+  {
+    double sum = 0.0;
+    for (int j=0; j<ns; ++j)
+    {
+      double dx = tx[i] - sx[j];
+      double dy = ty[i] - sy[j];
+      double r2 = dx*dx + dy*dy;
+      if (r2 > tol2)
+        sum += q[j] * besselK0(lambda * std::sqrt(r2));
+    }
+    v[i] += sum;
+  }
+}
+
+/**
+ * Explanation of the Bessel functions
+ *
+ * besselI: I_0(x), ..., I_n(x) with the backward recurrence of Miller
+ *   I_(k-1)(x) = I_(k+1)(x) + (2k / x) I_k(x)
+ * started far enough above n with I_(m+1) = 0 and I_m = 1 (the recurrence is
+ * stable downwards) and normalized with e^x = I_0(x) + 2 sum_k I_k(x).  The
+ * values are rescaled when they become large, x is limited to 700 (e^x).
+ * besselK: K_0(x) and K_1(x) (besselK01) and the upward recurrence
+ *   K_(k+1)(x) = K_(k-1)(x) + (2k / x) K_k(x)
+ * which is stable upwards.
+ * besselK01: for x < 2 the power series (Abramowitz and Stegun 9.6.11, 9.6.13)
+ *   K_0(x) = -(log(x/2) + gamma) I_0(x) + sum_k H_k (x^2/4)^k / (k!)^2
+ *   K_1(x) = 1/x + log(x/2) I_1(x) - (x/4) sum_k (psi(k+1) + psi(k+2)) (x^2/4)^k / (k! (k+1)!)
+ * (H_k the harmonic numbers, psi(k+1) = H_k - gamma) and for x >= 2 the
+ * trapezoidal rule for K_nu(x) = int_0^inf e^(-x cosh t) cosh(nu t) dt, which
+ * converges exponentially for this integrand.  The integrand has the width
+ * 1 / sqrt(x) at t = 0, and the step min(1/4, 1/(2 sqrt(x))) gives full double
+ * precision with about 20 points for every x.  besselK0 is the same for K_0
+ * alone (the P2P kernel).
+ */
+void YukawaKernel::besselI(double x, int n, double *i)
+{
+  assert(x >= 0.0 && x < 700.0 && "YukawaKernel::besselI argument out of range");
+  if (x == 0.0)
+  {
+    i[0] = 1.0;
+    for (int k=1; k<=n; ++k)
+      i[k] = 0.0;
+    return;
+  }
+  int m = n + 16 + (int)(x + std::sqrt(40.0*(n + x)));
+  double above = 0.0;                    // I_(k+1)
+  double current = 1.0;                  // I_k
+  double sum = 0.0;
+  for (int k=m; k>=1; --k)
+  {
+    sum += 2.0*current;
+    if (k <= n)
+      i[k] = current;
+    double below = above + (2.0*k/x)*current;
+    above = current;
+    current = below;
+    if (current > 1.0e250)
+    {
+      above *= 1.0e-250;
+      current *= 1.0e-250;
+      sum *= 1.0e-250;
+      for (int j=k; j<=n; ++j)
+        i[j] *= 1.0e-250;
+    }
+  }
+  i[0] = current;
+  sum += current;
+  double scale = std::exp(x) / sum;
+  for (int k=0; k<=n; ++k)
+    i[k] *= scale;
+}
+
+void YukawaKernel::besselK(double x, int n, double *k)
+{
+  double k1;
+  besselK01(x, k[0], k1);
+  if (n > 0)
+    k[1] = k1;
+  for (int j=1; j<n; ++j)
+    k[j+1] = k[j-1] + (2.0*j/x)*k[j];
+}
+
+void YukawaKernel::besselIScaled(double x, double sigma, int n, double *i)
+{
+  assert(x >= 0.0 && x < 700.0 && "YukawaKernel::besselIScaled argument out of range");
+  if (x == 0.0)
+  {
+    i[0] = 1.0;
+    for (int k=1; k<=n; ++k)
+      i[k] = 0.0;
+    return;
+  }
+  int m = n + 16 + (int)(x + std::sqrt(40.0*(n + x)));
+  double above = 0.0;                    // scaled I_(k+1)
+  double current = 1.0;                  // scaled I_k
+  double ratio = 2.0*sigma/x;
+  double sigma2 = sigma*sigma;
+  for (int k=m; k>=1; --k)
+  {
+    if (k <= n)
+      i[k] = current;
+    double below = above*sigma2/((double)k*(k+1)) + ratio*current;
+    above = current;
+    current = below;
+    if (current > 1.0e250)
+    {
+      above *= 1.0e-250;
+      current *= 1.0e-250;
+      for (int j=k; j<=n; ++j)
+        i[j] *= 1.0e-250;
+    }
+  }
+  double i0;
+  besselI(x, 0, &i0);
+  double scale = i0 / current;
+  i[0] = i0;
+  for (int k=1; k<=n; ++k)
+    i[k] *= scale;
+}
+
+void YukawaKernel::besselKScaled(double x, double sigma, int n, double *k)
+{
+  double k1;
+  besselK01(x, k[0], k1);
+  if (n > 0)
+    k[1] = sigma*k1;
+  double ratio = 2.0*sigma/x;
+  double sigma2 = sigma*sigma;
+  for (int j=1; j<n; ++j)
+    k[j+1] = k[j-1]*sigma2/((double)j*(j+1)) + ratio*j/(j+1)*k[j];
+}
+
+void YukawaKernel::besselK01(double x, double &k0, double &k1)
+{
+  assert(x > 0.0 && "YukawaKernel::besselK01 argument <= 0");
+  const double gamma = 0.57721566490153286061;
+  if (x < 2.0)
+  {
+    double y = 0.25*x*x;
+    double logHalf = std::log(0.5*x);
+    double term = 1.0;                   // y^k / (k!)^2
+    double i0 = 0.0, s0 = 0.0;
+    double term1 = 1.0;                  // y^k / (k! (k+1)!)
+    double i1 = 0.0, s1 = 0.0;
+    double h = 0.0;                      // H_k
+    for (int k=0; k<30; ++k)
+    {
+      if (k > 0)
+      {
+        h += 1.0/k;
+        term *= y/((double)k*k);
+        term1 *= y/((double)k*(k+1));
+      }
+      i0 += term;
+      s0 += h*term;
+      i1 += term1;
+      s1 += (2.0*h + 1.0/(k+1) - 2.0*gamma)*term1;
+      if (term1 < 1.0e-18*i1)
+        break;
+    }
+    k0 = -(logHalf + gamma)*i0 + s0;
+    k1 = 1.0/x + logHalf*0.5*x*i1 - 0.25*x*s1;
+    return;
+  }
+  double h = std::min(0.25, 0.5/std::sqrt(x));
+  double sum0 = 0.5, sum1 = 0.5;
+  for (int j=1; ; ++j)
+  {
+    double t = j*h;
+    double sh = std::sinh(0.5*t);
+    double e = std::exp(-2.0*x*sh*sh);   // e^(-x (cosh t - 1))
+    sum0 += e;
+    sum1 += e*std::cosh(t);
+    if (e < 1.0e-18)
+      break;
+  }
+  double scale = h*std::exp(-x);
+  k0 = scale*sum0;
+  k1 = scale*sum1;
+}
+
+double YukawaKernel::besselK0(double x)
+{
+  if (x < 2.0)
+  {
+    const double gamma = 0.57721566490153286061;
+    double y = 0.25*x*x;
+    double term = 1.0;
+    double i0 = 1.0, s0 = 0.0;
+    double h = 0.0;
+    for (int k=1; k<30; ++k)
+    {
+      h += 1.0/k;
+      term *= y/((double)k*k);
+      i0 += term;
+      s0 += h*term;
+      if (term < 1.0e-18*i0)
+        break;
+    }
+    return -(std::log(0.5*x) + gamma)*i0 + s0;
+  }
+  double h = std::min(0.25, 0.5/std::sqrt(x));
+  double sum = 0.5;
+  for (int j=1; ; ++j)
+  {
+    double sh = std::sinh(0.5*j*h);
+    double e = std::exp(-2.0*x*sh*sh);
+    sum += e;
+    if (e < 1.0e-18)
+      break;
+  }
+  return h*std::exp(-x)*sum;
+}
+
+void YukawaKernel::getI(std::complex<double> t, int m, double sigma,
+                        std::vector<std::complex<double> > &value)
+{
+  std::vector<double> i(m+1);
+  besselIScaled(lambda*std::abs(t), sigma, m, &i[0]);
+  value.resize(2*m+1);
+  std::complex<double> w = (std::abs(t) > 0.0) ? t / std::abs(t) : std::complex<double>(1.0);
+  std::complex<double> power = 1.0;      // e^(i n arg t)
+  for (int n=0; n<=m; ++n)
+  {
+    value[m+n] = i[n]*power;
+    value[m-n] = i[n]*std::conj(power);
+    power *= w;
+  }
+}
+
+void YukawaKernel::getK(std::complex<double> t, int m, double sigma,
+                        std::vector<std::complex<double> > &value)
+{
+  std::vector<double> k(m+1);
+  besselKScaled(lambda*std::abs(t), sigma, m, &k[0]);
+  value.resize(2*m+1);
+  std::complex<double> w = t / std::abs(t);
+  std::complex<double> power = 1.0;
+  for (int n=0; n<=m; ++n)
+  {
+    value[m+n] = k[n]*power;
+    value[m-n] = k[n]*std::conj(power);
+    power *= w;
+  }
+}
+
+// out += matrix in for the (2p+1) x (2p+1) matrix stored row by row
+void YukawaKernel::apply(const std::vector<std::complex<double> > &matrix, const std::complex<double> *in,
+                         std::complex<double> *out)
+{
+  int n = getNumCoeff();
+  for (int i=0; i<n; ++i)
+  {
+    std::complex<double> sum = 0.0;
+    const std::complex<double> *row = &matrix[i*n];
+    for (int j=0; j<n; ++j)
+      sum += row[j] * in[j];
+    out[i] += sum;
+  }
+}
@@ -0,0 +1,240 @@
+/*
+ * fmm2d.cc
+ *
+ *  Created on: Oct 14, 2026
+ */
+
+#include <vector>
+#include <complex>
+#include <new>
+
+#include "fmm2d.h"
+#include "FmmTree.h"
+#include "FmmTuning.h"
+#include "Potential.h"
+
+/*
+ * Header Interface of the C API
+ *
+#define FMM2D_API_VERSION 1
+
+// orders p of the series accepted by fmm2d_plan_create (FmmTuning gives 4, ..., 32)
+#define FMM2D_MIN_P 4
+#define FMM2D_MAX_P 64
+
+#define FMM2D_SUCCESS          0
+#define FMM2D_ERROR_ARGUMENT   1           // NULL pointer, no points, a point outside the unit square or p out of range
+#define FMM2D_ERROR_MEMORY     2           // out of memory
+#define FMM2D_ERROR_INTERNAL   3           // any other error of the library
+
+typedef struct fmm2d_plan fmm2d_plan;
+
+int  fmm2d_api_version(void);
+
+// order of the series for a target error relative to the largest potential (FmmTuning::getP)
+int  fmm2d_get_p(double relative_error);
+
+// a plan for the sources (source_x[i], source_y[i]) and the targets (target_x[j], target_y[j]),
+// p terms of the series (FMM2D_MIN_P <= p <= FMM2D_MAX_P) and at most max_points_per_box
+// points in a leaf box (0: chosen for p by FmmTuning)
+int  fmm2d_plan_create(const double *source_x, const double *source_y, int num_sources,
+                       const double *target_x, const double *target_y, int num_targets,
+                       int p, int max_points_per_box, fmm2d_plan **plan);
+
+// potentials[j] = sum_i charges[i] log |y[j] - x[i]| (the pairs with x[i] = y[j] are skipped)
+int  fmm2d_plan_apply(fmm2d_plan *plan, const double *charges, double *potentials);
+
+// the same and the gradient of the potential (gradient[2j], gradient[2j+1]),
+// either potentials or gradient can be NULL
+int  fmm2d_plan_apply_field(fmm2d_plan *plan, const double *charges, double *potentials,
+                            double *gradient);
+
+// new coordinates of the same points (time stepping, see FmmTree::update)
+int  fmm2d_plan_update(fmm2d_plan *plan, const double *source_x, const double *source_y,
+                       const double *target_x, const double *target_y);
+
+// threads of apply (OpenMP, 1 by default, 0 for the number of threads of OpenMP)
+int  fmm2d_plan_set_num_threads(fmm2d_plan *plan, int num_threads);
+
+void fmm2d_plan_destroy(fmm2d_plan *plan);
+*/
+
+// the plan of the C API: the tree (with its own copy of the Potential) and a
+// buffer for the complex potentials of apply_field
+struct fmm2d_plan
+{
+  Potential potential;
+  FmmTree   tree;
+  std::vector<std::complex<double> > phi;
+  std::vector<std::complex<double> > dphi;
+
+  fmm2d_plan(const double *sourceX, const double *sourceY, int numSources,
+             const double *targetX, const double *targetY, int numTargets,
+             int p, int maxPointsPerBox)
+     : potential(p),
+       tree(sourceX, sourceY, numSources, targetX, targetY, numTargets, potential, maxPointsPerBox),
+       phi(),
+       dphi()
+  {};
+};
+
+// true if all n points are in the unit square (the domain of FmmTree)
+static bool inUnitSquare(const double *x, const double *y, int n)
+{
+  for (int i=0; i<n; ++i)
+    if (!(x[i] >= 0.0 && x[i] < 1.0 && y[i] >= 0.0 && y[i] < 1.0))
+      return false;
+  return true;
+}
+
+int fmm2d_api_version(void)
+{
+  return FMM2D_API_VERSION;
+}
+
+int fmm2d_get_p(double relative_error)
+{
+  return FmmTuning::getP(relative_error);
+}
+
+// Explanation of fmm2d_plan_create:
+//
+// 1 checks the arguments (the FmmTree asserts are for programming errors of
+//   the library, the C API reports bad input with an error code instead)
+// 2 chooses the leaf size of the adaptive tree: a given max_points_per_box, or
+//   the balance of the near field and the translations of FmmTuning measured
+//   on this machine for p
+// 3 builds the tree (sorted points, interaction lists and translation
+//   matrices); *plan is set only if all steps succeed
+int fmm2d_plan_create(const double *source_x, const double *source_y, int num_sources,
+                      const double *target_x, const double *target_y, int num_targets,
+                      int p, int max_points_per_box, fmm2d_plan **plan)
+{
+  // 1
+  if (plan == 0)
+    return FMM2D_ERROR_ARGUMENT;
+  *plan = 0;
+  if (source_x == 0 || source_y == 0 || target_x == 0 || target_y == 0
+      || num_sources < 1 || num_targets < 1 || p < FMM2D_MIN_P || p > FMM2D_MAX_P
+      || max_points_per_box < 0)
+    return FMM2D_ERROR_ARGUMENT;
+  if (!inUnitSquare(source_x, source_y, num_sources) || !inUnitSquare(target_x, target_y, num_targets))
+    return FMM2D_ERROR_ARGUMENT;
+
+  try
+  {
+    // 2
+    if (max_points_per_box == 0)
+    {
+      FmmTuning tuning;
+      tuning.calibrate(p);
+      max_points_per_box = tuning.getMaxParticlesPerBox(p);
+    }
+    // 3
+    *plan = new fmm2d_plan(source_x, source_y, num_sources, target_x, target_y, num_targets,
+                           p, max_points_per_box);
+  }
+  catch (std::bad_alloc &e)
+  {
+    return FMM2D_ERROR_MEMORY;
+  }
+  catch (...)
+  {
+    return FMM2D_ERROR_INTERNAL;
+  }
+  return FMM2D_SUCCESS;
+}
+
+int fmm2d_plan_apply(fmm2d_plan *plan, const double *charges, double *potentials)
+{
+  if (plan == 0 || charges == 0 || potentials == 0)
+    return FMM2D_ERROR_ARGUMENT;
+  try
+  {
+    plan->tree.apply(charges, potentials);
+  }
+  catch (std::bad_alloc &e)
+  {
+    return FMM2D_ERROR_MEMORY;
+  }
+  catch (...)
+  {
+    return FMM2D_ERROR_INTERNAL;
+  }
+  return FMM2D_SUCCESS;
+}
+
+// Explanation of fmm2d_plan_apply_field:
+//
+// FmmTree::applyField gives the complex potential phi and its derivative
+// dphi = sum u / (y - x); the potential is Re phi and the gradient of the
+// potential is (Re dphi, -Im dphi).  The complex values go through the buffers
+// of the plan (kept for the next call) and are written into the arrays of the
+// caller in the input order of the targets.
+int fmm2d_plan_apply_field(fmm2d_plan *plan, const double *charges, double *potentials,
+                           double *gradient)
+{
+  if (plan == 0 || charges == 0)
+    return FMM2D_ERROR_ARGUMENT;
+  try
+  {
+    int n = plan->tree.getNumOfTargets();
+    plan->phi.resize(n);
+    plan->dphi.resize(n);
+    plan->tree.applyField(charges, &plan->phi[0], &plan->dphi[0]);
+    if (potentials)
+      for (int j=0; j<n; ++j)
+        potentials[j] = plan->phi[j].real();
+    if (gradient)
+      for (int j=0; j<n; ++j)
+      {
+        gradient[2*j] = plan->dphi[j].real();
+        gradient[2*j+1] = -plan->dphi[j].imag();
+      }
+  }
+  catch (std::bad_alloc &e)
+  {
+    return FMM2D_ERROR_MEMORY;
+  }
+  catch (...)
+  {
+    return FMM2D_ERROR_INTERNAL;
+  }
+  return FMM2D_SUCCESS;
+}
+
+int fmm2d_plan_update(fmm2d_plan *plan, const double *source_x, const double *source_y,
+                      const double *target_x, const double *target_y)
+{
+  if (plan == 0 || source_x == 0 || source_y == 0 || target_x == 0 || target_y == 0)
+    return FMM2D_ERROR_ARGUMENT;
+  if (!inUnitSquare(source_x, source_y, plan->tree.getNumOfSources())
+      || !inUnitSquare(target_x, target_y, plan->tree.getNumOfTargets()))
+    return FMM2D_ERROR_ARGUMENT;
+  try
+  {
+    plan->tree.update(source_x, source_y, target_x, target_y);
+  }
+  catch (std::bad_alloc &e)
+  {
+    return FMM2D_ERROR_MEMORY;
+  }
+  catch (...)
+  {
+    return FMM2D_ERROR_INTERNAL;
+  }
+  return FMM2D_SUCCESS;
+}
+
+int fmm2d_plan_set_num_threads(fmm2d_plan *plan, int num_threads)
+{
+  if (plan == 0 || num_threads < 0)
+    return FMM2D_ERROR_ARGUMENT;
+  plan->tree.setNumThreads(num_threads);
+  return FMM2D_SUCCESS;
+}
+
+void fmm2d_plan_destroy(fmm2d_plan *plan)
+{
+  delete plan;
+}